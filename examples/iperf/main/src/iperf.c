@@ -22,6 +22,7 @@
 
 #include <endian.h>
 #include <string.h>
+#include "mmhal.h"
 #include "mmosal.h"
 #include "mmwlan.h"
 #include "mmipal.h"
@@ -62,6 +63,49 @@ enum iperf_type
 /** Specifies the port to listen on in server mode. */
 #define IPERF_SERVER_PORT               5001
 #endif
+#ifndef IPERF_NUM_STREAMS
+/** Number of parallel streams to run in client mode (equivalent to iperf -P). */
+#define IPERF_NUM_STREAMS               1
+#endif
+#ifndef IPERF_VERSION
+/**
+ * Iperf protocol version. Set to @c IPERF_VERSION_3 to interoperate with iperf3. An iperf3 server
+ * handles both TCP and UDP tests so should be started with @c IPERF_TCP_SERVER, and iperf3
+ * normally uses port 5201 (see @c IPERF_SERVER_PORT).
+ */
+#define IPERF_VERSION                   IPERF_VERSION_2_0_13
+#endif
+#ifndef IPERF_TRIP_TIMES
+/**
+ * Set to @c true to report one-way latency percentiles in UDP server mode. This requires the
+ * clocks of the client and server to be synchronised (see @c mmiperf_set_clock_offset_us()).
+ */
+#define IPERF_TRIP_TIMES                false
+#endif
+#ifndef IPERF_VERIFY_PAYLOAD
+/**
+ * Set to @c true to verify the payload of received data in server mode and report corrupted
+ * bytes. The client must be an mmiperf client since other iperf implementations send different
+ * payload data.
+ */
+#define IPERF_VERIFY_PAYLOAD            false
+#endif
+#ifndef IPERF_MULTICAST_REPORTS
+/**
+ * Set to @c true in UDP client mode with a multicast @c IPERF_SERVER_IP to have each receiver
+ * report its loss and jitter back, and print the delivery ratio of each receiver. The receivers
+ * must be mmiperf UDP servers listening on the multicast address.
+ */
+#define IPERF_MULTICAST_REPORTS         false
+#endif
+#ifndef IPERF_RX_WINDOW_UPDATE_BYTES
+/**
+ * Number of bytes the TCP server may receive before it sends a window update, or 0 to update the
+ * window for every segment. Coalescing updates reduces the number of ACKs competing for airtime
+ * on slow links with small segments.
+ */
+#define IPERF_RX_WINDOW_UPDATE_BYTES    0
+#endif
 
 /* ------------------------ End of configuration options ------------------------ */
 
@@ -93,6 +137,24 @@ static uint32_t format_bytes(uint64_t bytes, uint8_t *unit_index)
 
     return bytes;
 }
+
+/**
+ * Number of receive packets that had been allocated when the SPI statistics were last reset, used
+ * to report SPI interrupts per received frame.
+ */
+static uint32_t spi_stats_rx_total_base;
+
+/** Reset the SPI statistics reported at the end of each iperf transfer. */
+static void reset_spi_stats(void)
+{
+    struct mmhal_wlan_spi_stats spi_stats;
+    struct mmhal_wlan_pktmem_stats pktmem_stats;
+
+    mmhal_wlan_spi_get_stats(&spi_stats, true);
+    mmhal_wlan_pktmem_get_stats(&pktmem_stats, false);
+    spi_stats_rx_total_base = pktmem_stats.rx_total;
+}
+
 /**
  * Handle a report at the end of an iperf transfer.
  *
@@ -106,21 +168,119 @@ static void iperf_report_handler(const struct mmiperf_report *report, void *arg,
     (void)arg;
     (void)handle;
 
+    struct mmhal_wlan_spi_stats spi_stats;
     uint8_t bytes_transferred_unit_index = 0;
     uint32_t bytes_transferred_formatted = format_bytes(report->bytes_transferred,
                                                         &bytes_transferred_unit_index);
 
-    printf("\nIperf Report\n");
+    if (report->stream_id == MMIPERF_STREAM_ID_SUM)
+    {
+        printf("\nIperf Report [SUM]\n");
+    }
+    else
+    {
+        printf("\nIperf Report\n");
+    }
     printf("  Remote Address: %s:%d\n", report->remote_addr, report->remote_port);
     printf("  Local Address:  %s:%d\n", report->local_addr, report->local_port);
     printf("  Transferred: %lu %cBytes, duration: %lu ms, bandwidth: %lu kbps\n",
            bytes_transferred_formatted, units[bytes_transferred_unit_index],
            report->duration_ms, report->bandwidth_kbitpsec);
+    if (report->tx_frames != 0 && report->duration_ms != 0)
+    {
+        printf("  Frames transmitted: %lu, rate: %lu pps\n", report->tx_frames,
+               (uint32_t)(((uint64_t)report->tx_frames * 1000) / report->duration_ms));
+    }
+    if (report->latency_count != 0)
+    {
+        printf("  One-way latency (us): p50 %lu, p90 %lu, p99 %lu, max %lu\n",
+               report->latency_p50_us, report->latency_p90_us, report->latency_p99_us,
+               report->latency_max_us);
+    }
+    if (report->verify_segments != 0)
+    {
+        printf("  Payload verification: %lu/%lu segments corrupted (%lu bytes), "
+               "took %lu ms\n",
+               report->verify_corrupted_segments, report->verify_segments,
+               (uint32_t)report->verify_corrupted_bytes,
+               (uint32_t)(report->verify_time_us / 1000));
+    }
+    if (report->cpu_num_cores != 0)
+    {
+        unsigned ii;
+        printf("  CPU load (%%):");
+        for (ii = 0; ii < report->cpu_num_cores; ii++)
+        {
+            printf(" core%u %u.%u", ii, report->cpu_load_permille[ii] / 10,
+                   report->cpu_load_permille[ii] % 10);
+        }
+        printf(", %lu.%lu%% of a core per Mbps\n", report->cpu_permille_per_mbps / 10,
+               report->cpu_permille_per_mbps % 10);
+    }
+    if (report->jitter_us != 0)
+    {
+        printf("  Jitter: %lu us\n", report->jitter_us);
+    }
+    if (report->mcast_num_receivers != 0)
+    {
+        unsigned ii;
+        printf("  Multicast receivers: %u (%u not listed), delivery min %u.%u%% (%s), "
+               "mean %u.%u%%, max jitter %lu us\n",
+               report->mcast_num_receivers, report->mcast_receivers_dropped,
+               report->mcast_delivery_min_permille / 10,
+               report->mcast_delivery_min_permille % 10, report->mcast_worst_receiver_addr,
+               report->mcast_delivery_mean_permille / 10,
+               report->mcast_delivery_mean_permille % 10, report->mcast_jitter_max_us);
+        for (ii = 0; report->mcast_receivers != NULL && ii < report->mcast_num_receivers; ii++)
+        {
+            const struct mmiperf_mcast_receiver *rx = &report->mcast_receivers[ii];
+            printf("    %s: %lu frames, %lu lost, delivery %u.%u%%, jitter %lu us\n",
+                   rx->addr, rx->rx_frames, rx->error_count, rx->delivery_permille / 10,
+                   rx->delivery_permille % 10, rx->jitter_us);
+        }
+    }
+    printf("  Peak heap used: %lu/%lu bytes, peak pktmem: tx %u/%u, rx %u/%u\n",
+           report->heap_peak_used, report->heap_total_size,
+           report->pktmem_tx_peak, report->pktmem_tx_capacity,
+           report->pktmem_rx_peak, report->pktmem_rx_capacity);
+    mmhal_wlan_spi_get_stats(&spi_stats, false);
+    if (spi_stats.transactions != 0)
+    {
+        printf("  SPI: %lu transactions, bus utilisation %u.%u%% at %lu kHz\n",
+               spi_stats.transactions,
+               spi_stats.utilisation_permille / 10, spi_stats.utilisation_permille % 10,
+               spi_stats.clock_khz);
+        printf("  SPI overhead: poll %lu ns, interrupt %lu ns, interrupt threshold %lu bytes\n",
+               spi_stats.poll_overhead_ns, spi_stats.interrupt_overhead_ns,
+               spi_stats.interrupt_min_length);
+        printf("  SPI bounce copies: tx %lu, rx %lu\n",
+               spi_stats.tx_bounce_transactions, spi_stats.rx_bounce_transactions);
+    }
+    if (spi_stats.irq_isr_entries != 0)
+    {
+        struct mmhal_wlan_pktmem_stats pktmem_stats;
+        uint32_t rx_frames;
+
+        mmhal_wlan_pktmem_get_stats(&pktmem_stats, false);
+        rx_frames = pktmem_stats.rx_total - spi_stats_rx_total_base;
+        printf("  SPI IRQ: %lu ISR entries, %lu re-arms, %lu rx frames",
+               spi_stats.irq_isr_entries, spi_stats.irq_rearms, rx_frames);
+        if (rx_frames != 0)
+        {
+            uint32_t per_frame_x100 =
+                (uint32_t)(((uint64_t)spi_stats.irq_isr_entries * 100) / rx_frames);
+            printf(", %lu.%02lu ISR entries per rx frame", per_frame_x100 / 100,
+                   per_frame_x100 % 100);
+        }
+        printf("\n");
+    }
     printf("\n");
 
     if ((report->report_type == MMIPERF_UDP_DONE_SERVER) ||
         (report->report_type == MMIPERF_TCP_DONE_SERVER))
     {
+        /* Restart the SPI statistics for the next test. */
+        reset_spi_stats();
         printf("Waiting for client to connect...\n");
     }
 }
@@ -145,6 +305,8 @@ static void start_tcp_client(void)
         args.amount *= 100;
     }
     args.report_fn = iperf_report_handler;
+    args.num_streams = IPERF_NUM_STREAMS;
+    args.version = IPERF_VERSION;
 
     mmiperf_start_tcp_client(&args);
     printf("\nIperf TCP client started, waiting for completion...\n");
@@ -168,6 +330,9 @@ static void start_udp_client(void)
         args.amount *= 100;
     }
     args.report_fn = iperf_report_handler;
+    args.num_streams = IPERF_NUM_STREAMS;
+    args.version = IPERF_VERSION;
+    args.multicast_reports = IPERF_MULTICAST_REPORTS;
 
     mmiperf_start_udp_client(&args);
     printf("\nIperf UDP client started, waiting for completion...\n");
@@ -182,6 +347,9 @@ static void start_tcp_server(void)
     args.local_port = (uint16_t) local_port;
 
     args.report_fn = iperf_report_handler;
+    args.version = IPERF_VERSION;
+    args.verify_payload = IPERF_VERIFY_PAYLOAD;
+    args.rx_window_update_bytes = IPERF_RX_WINDOW_UPDATE_BYTES;
 
     mmiperf_handle_t iperf_handle = mmiperf_start_tcp_server(&args);
     if (iperf_handle == NULL)
@@ -217,6 +385,9 @@ static void start_udp_server(void)
     args.local_port = (uint16_t) local_port;
 
     args.report_fn = iperf_report_handler;
+    args.version = IPERF_VERSION;
+    args.trip_times = IPERF_TRIP_TIMES;
+    args.verify_payload = IPERF_VERIFY_PAYLOAD;
 
     mmiperf_handle_t iperf_handle = mmiperf_start_udp_server(&args);
     if (iperf_handle == NULL)
@@ -258,6 +429,10 @@ void app_main(void)
 
     enum iperf_type iperf_mode = IPERF_TYPE;
 
+    /* Discard the SPI statistics accumulated while connecting so that the first report only
+     * covers the test. */
+    reset_spi_stats();
+
     switch (iperf_mode)
     {
     case IPERF_TCP_SERVER:
@@ -46,9 +46,11 @@ extern const struct test_step test_step_set_spi_mode;                   /**< Tes
 extern const struct test_step test_step_read_chip_id;                   /**< Test definition */
 extern const struct test_step test_step_bulk_write_read;                /**< Test definition */
 extern const struct test_step test_step_raw_tput;                       /**< Test definition */
+extern const struct test_step test_step_crc;                            /**< Test definition */
 
 extern const struct test_step test_step_mmhal_wlan_validate_fw;         /**< Test definition */
 extern const struct test_step test_step_mmhal_wlan_validate_bcf;        /**< Test definition */
+extern const struct test_step test_step_fw_download;                    /**< Test definition */
 
 extern const struct test_step test_step_enable_leds;                    /**< Test definition */
 
@@ -67,8 +69,10 @@ static const struct test_step * const test_steps[] = {
     &test_step_read_chip_id,
     &test_step_bulk_write_read,
     &test_step_raw_tput,
+    &test_step_crc,
     &test_step_mmhal_wlan_validate_fw,
     &test_step_mmhal_wlan_validate_bcf,
+    &test_step_fw_download,
     &test_step_enable_leds,
 };
 
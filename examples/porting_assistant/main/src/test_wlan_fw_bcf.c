@@ -6,47 +6,60 @@
 
 #include "porting_assistant.h"
 #include "mmhal.h"
+#include "mmbin.h"
 
-#ifndef PACKED
-#define PACKED __attribute__((packed))
-#endif
-
-/** Enumeration of TLV field types */
-enum fw_tlv_types
-{
-    FIELD_TYPE_MAGIC = 0x8000,
-    FIELD_TYPE_EOF   = 0x8f00,
-};
-
-/** Expected value of the magic field for a firmware image. */
-#define MBIN_FW_MAGIC_NUMBER (0x57464d4d)
-/** Expected value of the magic field for a BCF. */
-#define MBIN_BCF_MAGIC_NUMBER (0x43424d4d)
-
-/** TLV (type-length-value) header */
-struct PACKED tlv_header
-{
-    /** Type code. */
-    uint16_t type;
-    /** Value length. */
-    uint16_t len;
-};
-
-/** Max number of TLVs to iterate through in this test. We would not expect to find more than this
- *  number in a firmware or BCF file. */
-#define MAX_TLVS    (50)
-
-/** Clean up an robuf when it is no longer needed. */
-static void robuf_cleanup(struct mmhal_robuf *robuf)
+/** Log a description of an error returned by the mmbin API. */
+static void log_mmbin_error(enum mmbin_status status, const char *file_read_fn_name,
+                            const char *type, uint32_t expected_magic_number,
+                            uint32_t magic, char *log_buf, size_t log_buf_len)
 {
-    if (robuf != NULL)
+    switch (status)
     {
-        /* Free the robuf buffer */
-        if (robuf->free_cb != NULL)
-        {
-            robuf->free_cb(robuf->free_arg);
-        }
-        memset(robuf, 0, sizeof(*robuf));
+    case MMBIN_ERR_READ_FAILED:
+        TEST_LOG_APPEND("%s() returned no data or a NULL buffer\n", file_read_fn_name);
+        TEST_LOG_APPEND("Review your implementation of %s().\n", file_read_fn_name);
+        break;
+
+    case MMBIN_ERR_READ_TOO_SHORT:
+        TEST_LOG_APPEND(
+            "The length of data returned by %s() was too short\n"
+            "%s() is required to return a minimum of "
+            "MMWLAN_FW_BCF_MIN_READ_LENGTH (%u) bytes.\n",
+            file_read_fn_name, file_read_fn_name, MMHAL_WLAN_FW_BCF_MIN_READ_LENGTH);
+        break;
+
+    case MMBIN_ERR_READ_TOO_LONG:
+        TEST_LOG_APPEND(
+            "The length of data returned by %s() was too great\n"
+            "%s() should not return more than `requested_len` bytes.\n",
+            file_read_fn_name, file_read_fn_name);
+        break;
+
+    case MMBIN_ERR_NO_MAGIC:
+        TEST_LOG_APPEND(
+            "The %s was corrupt (did not start with a magic number). \n"
+            "Possible causes include using invalid (e.g., outdated) firmware, or a bug in\n"
+            "%s()\n", type, file_read_fn_name);
+        break;
+
+    case MMBIN_ERR_BAD_MAGIC:
+        TEST_LOG_APPEND(
+            "The %s was corrupt (did not contain the correct magic number -- "
+            "expect 0x%08lx, got 0x%08lx).\n"
+            "This is likey caused by using an invalid (e.g., outdated) version.\n",
+            type, expected_magic_number, magic);
+        break;
+
+    case MMBIN_ERR_NO_MEM:
+        TEST_LOG_APPEND("Failed to allocate memory to index the %s\n", type);
+        break;
+
+    default:
+        TEST_LOG_APPEND(
+            "%s invalid or ended too soon (EOF marker not found)\n"
+            "Check that you have provided a valid %s file and review your implementation\n"
+            "of %s().\n", type, type, file_read_fn_name);
+        break;
     }
 }
 
@@ -57,122 +70,51 @@ static enum test_result execute_fw_bcf_test(file_read_fn_t file_read_fn,
                                             uint32_t expected_magic_number,
                                             char *log_buf, size_t log_buf_len)
 {
-    uint32_t offset = 0;
-
-    unsigned num_tlvs;
-    for (num_tlvs = 0; num_tlvs < MAX_TLVS; num_tlvs++)
+    struct mmbin_index index;
+    struct mmbin_iter iter;
+    const struct mmbin_entry *entry;
+    enum mmbin_status status;
+
+    /* Indexing checks the TLV structure, magic number and EOF marker, reading only the headers. */
+    status = mmbin_index_build(&index, file_read_fn, expected_magic_number);
+    if (status != MMBIN_OK)
     {
-        struct mmhal_robuf robuf = {0};
-        struct tlv_header hdr;
-        file_read_fn(offset, sizeof(hdr), &robuf);
-
-        if (robuf.len == 0)
-        {
-            TEST_LOG_APPEND(
-                    "%s invalid or ended too soon (EOF marker not found)\n"
-                    "Check that you have provided a valid %s file and review your implementation\n"
-                    "of %s().\n", type, type, file_read_fn_name);
-            return TEST_FAILED_NON_CRITICAL;
-        }
-
-        if (robuf.buf == NULL)
-        {
-            TEST_LOG_APPEND("%s returned NULL buffer but non-zero length\n", file_read_fn_name);
-            TEST_LOG_APPEND("Review your implementation of %s().\n", file_read_fn_name);
-            return TEST_FAILED_NON_CRITICAL;
-        }
-
-        if (robuf.len < sizeof(hdr))
-        {
-            TEST_LOG_APPEND(
-                "The length of data returned by %s() was too short\n"
-                "%s() is required to return a minimum of "
-                "MMWLAN_FW_BCF_MIN_READ_LENGTH (%u) bytes.\n",
-                file_read_fn_name, file_read_fn_name, MMHAL_WLAN_FW_BCF_MIN_READ_LENGTH);
-            return TEST_FAILED_NON_CRITICAL;
-        }
-
-        memcpy(&hdr, (struct tlv_header *)robuf.buf, sizeof(hdr));
-
-        robuf_cleanup(&robuf);
-
-        if (num_tlvs == 0 && hdr.type != FIELD_TYPE_MAGIC)
-        {
-            TEST_LOG_APPEND(
-                "The firware was corrupt (did not start with a magic number). \n"
-                "Possible causes include using invalid (e.g., outdated) firmware, or a bug in\n"
-                "%s()\n", file_read_fn_name);
-            return TEST_FAILED_NON_CRITICAL;
-        }
-
-        if (hdr.type == FIELD_TYPE_EOF)
-        {
-            return TEST_PASSED;
-        }
+        log_mmbin_error(status, file_read_fn_name, type, expected_magic_number, index.magic,
+                        log_buf, log_buf_len);
+        return TEST_FAILED_NON_CRITICAL;
+    }
 
-        offset += sizeof(hdr);
+    /* Then read back the data of every field, seeking directly to each one, so that the read
+     * function is exercised over the whole image. */
+    mmbin_iter_init(&iter, &index, MMBIN_ITER_ALL);
+    while (status == MMBIN_OK && (entry = mmbin_iter_next(&iter)) != NULL)
+    {
+        uint32_t data_len = mmbin_entry_data_len(entry);
+        uint32_t offset = 0;
 
-        /* Read TLV data */
-        uint32_t remaining_len = hdr.len;
-        while (remaining_len > 0)
+        while (offset < data_len)
         {
-            file_read_fn(offset, remaining_len, &robuf);
-            if (robuf.len == 0)
+            struct mmhal_robuf robuf = {0};
+            status = mmbin_entry_get(&index, entry, offset, data_len - offset, &robuf);
+            if (status != MMBIN_OK)
             {
-                TEST_LOG_APPEND(
-                    "%s ended too soon.\n"
-                    "Check that you have provided a valid firmware file and review "
-                    "your implementation of\n%s().\n", type, file_read_fn_name);
-                return TEST_FAILED_NON_CRITICAL;
+                break;
             }
-
-            if (robuf.len > remaining_len)
-            {
-                TEST_LOG_APPEND(
-                    "The length of data returned by %s() was too great\n"
-                    "%s() should not return more than `requested_len` bytes.\n",
-                    file_read_fn_name, file_read_fn_name);
-                return TEST_FAILED_NON_CRITICAL;
-            }
-
-            if (num_tlvs == 0)
-            {
-                if (robuf.len < sizeof(uint32_t))
-                {
-                    TEST_LOG_APPEND(
-                        "The length of data returned by %s() was too short\n"
-                        "%s() is required to return a minimum of "
-                        "MMWLAN_FW_BCF_MIN_READ_LENGTH %u) bytes\n",
-                        file_read_fn_name, file_read_fn_name, MMHAL_WLAN_FW_BCF_MIN_READ_LENGTH);
-                    return TEST_FAILED_NON_CRITICAL;
-                }
-
-                uint32_t magic = (robuf.buf[0]) |
-                                 (robuf.buf[1] << 8) |
-                                 (robuf.buf[2] << 16) |
-                                 (robuf.buf[3] << 24);
-                if (magic != expected_magic_number)
-                {
-                    TEST_LOG_APPEND(
-                        "The %s was corrupt (did not contain the correct magic number -- "
-                        "expect 0x%08lx, got 0x%08lx).\n"
-                        "This is likey caused by using an invalid (e.g., outdated) version.\n",
-                        type, expected_magic_number, magic);
-                    return TEST_FAILED_NON_CRITICAL;
-                }
-            }
-
             offset += robuf.len;
-            remaining_len -= robuf.len;
-            robuf_cleanup(&robuf);
+            mmbin_robuf_release(&robuf);
         }
     }
 
-    TEST_LOG_APPEND(
-        "%s invalid or ended too soon (EOF marker not found)\n"
-        "Check that you have provided a valid %s file and review your implementation\n"
-        "of %s().\n", type, type, file_read_fn_name);
-    return TEST_FAILED_NON_CRITICAL;
+    mmbin_index_free(&index);
+
+    if (status != MMBIN_OK)
+    {
+        log_mmbin_error(status, file_read_fn_name, type, expected_magic_number, index.magic,
+                        log_buf, log_buf_len);
+        return TEST_FAILED_NON_CRITICAL;
+    }
+
+    return TEST_PASSED;
 }
 
 TEST_STEP(test_step_mmhal_wlan_validate_fw, "Validate MM firmware")
@@ -0,0 +1,476 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "porting_assistant.h"
+#include "sdio_spi.h"
+#include "mmhal.h"
+#include "mmbin.h"
+#include "mmutils.h"
+#include "miniz.h"
+
+/** Address that firmware blocks are written to. The chip is not booted, so the real segment
+ * load addresses are not used. */
+#define FW_DOWNLOAD_ADDR            (0x80100000)
+
+/** Maximum length of each block written for an uncompressed segment. */
+#define FW_DOWNLOAD_BLOCK_LEN       (4096)
+
+/** Stack size of the task that prepares blocks during the pipelined download, in 32-bit words.
+ * Inflation itself uses little stack as the decompressor state is allocated on the heap. */
+#define FW_DOWNLOAD_TASK_STACK_SIZE (768)
+
+/** Maximum time to wait for the producer task to prepare a block. */
+#define FW_DOWNLOAD_TIMEOUT_MS      (5000)
+
+/* Defined in test_wlan_io.c */
+bool process_sdio_spi_multi_byte_return(int ret, char *log_buf, size_t log_buf_len);
+
+/** Position in the firmware image of the next block to prepare. */
+struct fw_download_cursor
+{
+    /** Iterator over the segments of the image. */
+    struct mmbin_iter iter;
+    /** Segment currently being prepared, or @c NULL to advance to the next one. */
+    const struct mmbin_entry *entry;
+    /** Offset of the next block within the data of @c entry. */
+    uint32_t offset;
+};
+
+/** State shared by the steps of the firmware download benchmark. */
+struct fw_download
+{
+    /** Index of the firmware image. */
+    struct mmbin_index index;
+    /** Decompressor state, used for deflated segments. */
+    tinfl_decompressor *inflator;
+    /** Ping-pong block buffers, each @c buf_size octets long. */
+    uint8_t *bufs[2];
+    /** Length of the block in each buffer. Zero marks the end of the image. */
+    uint32_t lens[2];
+    /** Size of each block buffer. */
+    uint32_t buf_size;
+    /** Counts blocks that are ready to be written. */
+    struct mmosal_sem *full;
+    /** Counts buffers that are free to be filled. */
+    struct mmosal_sem *empty;
+    /** Given by the producer task when it will no longer access this structure. */
+    struct mmosal_semb *done;
+    /** Status of the producer task. */
+    volatile enum mmbin_status producer_status;
+    /** Set by the consumer to ask the producer to stop early. */
+    volatile bool abort;
+};
+
+/**
+ * Inflate a deflated segment into @p buf.
+ *
+ * The zlib stream is fed to the decompressor directly from the read-only buffers returned by
+ * the read function, so the compressed data is never copied.
+ */
+static enum mmbin_status fw_download_inflate(struct fw_download *dl,
+                                             const struct mmbin_entry *entry, uint8_t *buf)
+{
+    uint32_t data_len = mmbin_entry_data_len(entry);
+    uint32_t in_offset = 0;
+    size_t out_offset = 0;
+    tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+
+    tinfl_init(dl->inflator);
+
+    while (status == TINFL_STATUS_NEEDS_MORE_INPUT && in_offset < data_len)
+    {
+        struct mmhal_robuf robuf = { 0 };
+        enum mmbin_status ret;
+        mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF;
+        size_t in_len;
+        size_t out_len;
+
+        ret = mmbin_entry_get(&dl->index, entry, in_offset, data_len - in_offset, &robuf);
+        if (ret != MMBIN_OK)
+        {
+            return ret;
+        }
+
+        if (in_offset + robuf.len < data_len)
+        {
+            flags |= TINFL_FLAG_HAS_MORE_INPUT;
+        }
+
+        in_len = robuf.len;
+        out_len = entry->chunk_size - out_offset;
+        status = tinfl_decompress(dl->inflator, robuf.buf, &in_len, buf, buf + out_offset,
+                                  &out_len, flags);
+        in_offset += in_len;
+        out_offset += out_len;
+        mmbin_robuf_release(&robuf);
+    }
+
+    if (status != TINFL_STATUS_DONE || out_offset != entry->chunk_size)
+    {
+        return MMBIN_ERR_MALFORMED;
+    }
+
+    return MMBIN_OK;
+}
+
+/**
+ * Prepare the next block of the image in @p buf.
+ *
+ * Deflated segments are inflated a chunk at a time; uncompressed segments are copied in blocks of
+ * up to @ref FW_DOWNLOAD_BLOCK_LEN octets. Blocks are padded to a multiple of 4 octets as required
+ * by @ref sdio_spi_write_multi_byte().
+ *
+ * @param dl        Download state.
+ * @param cursor    Position of the next block, updated on return.
+ * @param buf       Buffer of @c dl->buf_size octets to fill.
+ * @param len       Set to the length of the block, or zero at the end of the image.
+ *
+ * @returns @ref MMBIN_OK on success, otherwise an error code.
+ */
+static enum mmbin_status fw_download_next_block(struct fw_download *dl,
+                                                struct fw_download_cursor *cursor,
+                                                uint8_t *buf, uint32_t *len)
+{
+    enum mmbin_status status;
+    uint32_t block_len;
+
+    while (cursor->entry == NULL)
+    {
+        cursor->entry = mmbin_iter_next(&cursor->iter);
+        cursor->offset = 0;
+        if (cursor->entry == NULL)
+        {
+            *len = 0;
+            return MMBIN_OK;
+        }
+        if (!mmbin_entry_is_deflated(cursor->entry) && mmbin_entry_data_len(cursor->entry) == 0)
+        {
+            cursor->entry = NULL;
+        }
+    }
+
+    if (mmbin_entry_is_deflated(cursor->entry))
+    {
+        block_len = cursor->entry->chunk_size;
+        status = fw_download_inflate(dl, cursor->entry, buf);
+        cursor->entry = NULL;
+    }
+    else
+    {
+        block_len = MM_MIN(mmbin_entry_data_len(cursor->entry) - cursor->offset,
+                           FW_DOWNLOAD_BLOCK_LEN);
+        status = mmbin_entry_read(&dl->index, cursor->entry, cursor->offset, buf, block_len);
+        cursor->offset += block_len;
+        if (cursor->offset == mmbin_entry_data_len(cursor->entry))
+        {
+            cursor->entry = NULL;
+        }
+    }
+
+    while (block_len & 3)
+    {
+        buf[block_len++] = 0;
+    }
+
+    *len = block_len;
+    return status;
+}
+
+/** Initialize a cursor at the first segment of the image. */
+static void fw_download_cursor_init(struct fw_download *dl, struct fw_download_cursor *cursor)
+{
+    mmbin_iter_init(&cursor->iter, &dl->index, MMBIN_ITER_SEGMENTS);
+    cursor->entry = NULL;
+    cursor->offset = 0;
+}
+
+/**
+ * Prepare and optionally write every block of the image, one after the other.
+ *
+ * @returns @c true on success, else @c false.
+ */
+static bool fw_download_serial(struct fw_download *dl, bool write, char *log_buf,
+                               size_t log_buf_len)
+{
+    struct fw_download_cursor cursor;
+    enum mmbin_status status;
+    uint32_t len;
+
+    fw_download_cursor_init(dl, &cursor);
+    while (true)
+    {
+        status = fw_download_next_block(dl, &cursor, dl->bufs[0], &len);
+        if (status != MMBIN_OK)
+        {
+            TEST_LOG_APPEND("Failed to prepare firmware block (mmbin status %d)\n", status);
+            return false;
+        }
+
+        if (len == 0)
+        {
+            return true;
+        }
+
+        if (write)
+        {
+            int ret = sdio_spi_write_multi_byte(FW_DOWNLOAD_ADDR, dl->bufs[0], len);
+            if (!process_sdio_spi_multi_byte_return(ret, log_buf, log_buf_len))
+            {
+                TEST_LOG_APPEND("Failure during sdio_spi_write_multi_byte\n");
+                return false;
+            }
+        }
+    }
+}
+
+/** Task that prepares blocks into the ping-pong buffers for @ref fw_download_pipelined(). */
+static void fw_download_producer(void *arg)
+{
+    struct fw_download *dl = (struct fw_download *)arg;
+    struct fw_download_cursor cursor;
+    unsigned idx = 0;
+
+    fw_download_cursor_init(dl, &cursor);
+    while (true)
+    {
+        if (!mmosal_sem_wait(dl->empty, FW_DOWNLOAD_TIMEOUT_MS) || dl->abort)
+        {
+            break;
+        }
+
+        dl->producer_status = fw_download_next_block(dl, &cursor, dl->bufs[idx], &dl->lens[idx]);
+        if (dl->producer_status != MMBIN_OK)
+        {
+            dl->lens[idx] = 0;
+        }
+        mmosal_sem_give(dl->full);
+
+        if (dl->lens[idx] == 0)
+        {
+            break;
+        }
+        idx ^= 1;
+    }
+
+    mmosal_semb_give(dl->done);
+}
+
+/**
+ * Write every block of the image while the next is prepared by another task.
+ *
+ * The producer task is not pinned to a core, so on a dual core target it may run on the other
+ * core. On a single core target inflation still overlaps with the time the writer spends blocked
+ * waiting for SPI DMA to complete.
+ *
+ * @returns @c true on success, else @c false.
+ */
+static bool fw_download_pipelined(struct fw_download *dl, char *log_buf, size_t log_buf_len)
+{
+    struct mmosal_task *task;
+    unsigned idx = 0;
+    bool ok = true;
+
+    dl->producer_status = MMBIN_OK;
+    dl->abort = false;
+
+    task = mmosal_task_create(fw_download_producer, dl, MMOSAL_TASK_PRI_NORM,
+                              FW_DOWNLOAD_TASK_STACK_SIZE, "fwdl");
+    if (task == NULL)
+    {
+        TEST_LOG_APPEND("Failed to create the firmware block producer task\n");
+        return false;
+    }
+
+    while (true)
+    {
+        int ret;
+
+        if (!mmosal_sem_wait(dl->full, FW_DOWNLOAD_TIMEOUT_MS))
+        {
+            TEST_LOG_APPEND("Timed out waiting for a firmware block\n");
+            ok = false;
+            break;
+        }
+
+        if (dl->lens[idx] == 0)
+        {
+            if (dl->producer_status != MMBIN_OK)
+            {
+                TEST_LOG_APPEND("Failed to prepare firmware block (mmbin status %d)\n",
+                                dl->producer_status);
+                ok = false;
+            }
+            break;
+        }
+
+        ret = sdio_spi_write_multi_byte(FW_DOWNLOAD_ADDR, dl->bufs[idx], dl->lens[idx]);
+        if (!process_sdio_spi_multi_byte_return(ret, log_buf, log_buf_len))
+        {
+            TEST_LOG_APPEND("Failure during sdio_spi_write_multi_byte\n");
+            ok = false;
+            break;
+        }
+
+        mmosal_sem_give(dl->empty);
+        idx ^= 1;
+    }
+
+    if (!ok)
+    {
+        dl->abort = true;
+        mmosal_sem_give(dl->empty);
+    }
+
+    /* Wait for the producer to finish with the shared state before it is freed. */
+    if (!mmosal_semb_wait(dl->done, FW_DOWNLOAD_TIMEOUT_MS * 2))
+    {
+        TEST_LOG_APPEND("Firmware block producer task did not exit\n");
+        ok = false;
+    }
+
+    return ok;
+}
+
+TEST_STEP(test_step_fw_download, "Firmware download pipeline")
+{
+    /* This test measures the host side of downloading the firmware to the MM chip: reading each
+     * segment from mmhal_wlan_read_fw_file(), inflating it if it is deflated, and writing it over
+     * SPI. The image is written three ways:
+     *
+     *  - prepare only (no SPI), to measure the cost of reading/inflating the image;
+     *  - serially, preparing then writing each block in turn, as a simple loader would;
+     *  - pipelined, with the next block prepared into a second buffer by another task while the
+     *    current block is written.
+     *
+     * The difference between the serial and pipelined times is the saving available to a loader
+     * that overlaps the two stages. The saving is largest for deflated images, where inflation is
+     * comparable in cost to the SPI transfer. All blocks are written to the same scratch address,
+     * so the chip is not booted. */
+    enum test_result result = TEST_PASSED;
+    struct fw_download dl;
+    struct mmbin_iter iter;
+    const struct mmbin_entry *entry;
+    enum mmbin_status status;
+    uint32_t num_deflated = 0;
+    uint32_t start_time;
+    uint32_t prepare_ms;
+    uint32_t serial_ms;
+    uint32_t pipelined_ms;
+
+    memset(&dl, 0, sizeof(dl));
+
+    status = mmbin_index_build(&dl.index, mmhal_wlan_read_fw_file, MBIN_FW_MAGIC_NUMBER);
+    if (status != MMBIN_OK)
+    {
+        TEST_LOG_APPEND("Failed to index the firmware (mmbin status %d). "
+                        "See the firmware validation step.\n", status);
+        return TEST_FAILED_NON_CRITICAL;
+    }
+
+    dl.buf_size = FW_DOWNLOAD_BLOCK_LEN;
+    mmbin_iter_init(&iter, &dl.index, MMBIN_ITER_SEGMENTS);
+    while ((entry = mmbin_iter_next(&iter)) != NULL)
+    {
+        if (mmbin_entry_is_deflated(entry))
+        {
+            num_deflated++;
+            dl.buf_size = MM_MAX(dl.buf_size, entry->chunk_size);
+        }
+    }
+    /* Allow for padding to a multiple of 4 octets. */
+    dl.buf_size = (dl.buf_size + 3) & ~3ul;
+
+    dl.bufs[0] = (uint8_t *)mmosal_malloc(dl.buf_size);
+    dl.bufs[1] = (uint8_t *)mmosal_malloc(dl.buf_size);
+    dl.full = mmosal_sem_create(2, 0, "fwdl_full");
+    dl.empty = mmosal_sem_create(2, 2, "fwdl_empty");
+    dl.done = mmosal_semb_create("fwdl_done");
+    if (num_deflated > 0)
+    {
+        dl.inflator = (tinfl_decompressor *)mmosal_malloc(sizeof(*dl.inflator));
+    }
+    if (dl.bufs[0] == NULL || dl.bufs[1] == NULL || dl.full == NULL || dl.empty == NULL ||
+        dl.done == NULL || (num_deflated > 0 && dl.inflator == NULL))
+    {
+        TEST_LOG_APPEND("Failed to allocate firmware download buffers. "
+                        "Is there enough heap allocated?\n");
+        result = TEST_FAILED;
+        goto exit;
+    }
+
+    start_time = mmosal_get_time_ms();
+    if (!fw_download_serial(&dl, false, log_buf, log_buf_len))
+    {
+        result = TEST_FAILED;
+        goto exit;
+    }
+    prepare_ms = mmosal_get_time_ms() - start_time;
+
+    start_time = mmosal_get_time_ms();
+    if (!fw_download_serial(&dl, true, log_buf, log_buf_len))
+    {
+        result = TEST_FAILED;
+        goto exit;
+    }
+    serial_ms = mmosal_get_time_ms() - start_time;
+
+    start_time = mmosal_get_time_ms();
+    if (!fw_download_pipelined(&dl, log_buf, log_buf_len))
+    {
+        result = TEST_FAILED;
+        goto exit;
+    }
+    pipelined_ms = mmosal_get_time_ms() - start_time;
+
+    TEST_LOG_APPEND("\tSegments: %u (%lu deflated)\n", dl.index.num_segments, num_deflated);
+    TEST_LOG_APPEND("\tImage size: %lu bytes, loaded size: %lu bytes\n",
+                    dl.index.image_len, dl.index.loaded_len);
+    TEST_LOG_APPEND("\tPrepare only (ms): %lu\n", prepare_ms);
+    TEST_LOG_APPEND("\tSerial download (ms): %lu\n", serial_ms);
+    TEST_LOG_APPEND("\tPipelined download (ms): %lu\n", pipelined_ms);
+    if (serial_ms > pipelined_ms)
+    {
+        TEST_LOG_APPEND("\tSaving (ms): %lu (%lu%%)\n", serial_ms - pipelined_ms,
+                        ((serial_ms - pipelined_ms) * 100) / serial_ms);
+    }
+    if (num_deflated == 0)
+    {
+        TEST_LOG_APPEND("Note: firmware is not compressed. See framework/tools/mbin_deflate.py "
+                        "to compare against a deflated image.\n");
+    }
+    TEST_LOG_APPEND("\n");
+
+exit:
+    if (dl.done != NULL)
+    {
+        mmosal_semb_delete(dl.done);
+    }
+    if (dl.empty != NULL)
+    {
+        mmosal_sem_delete(dl.empty);
+    }
+    if (dl.full != NULL)
+    {
+        mmosal_sem_delete(dl.full);
+    }
+    if (dl.inflator != NULL)
+    {
+        mmosal_free(dl.inflator);
+    }
+    if (dl.bufs[0] != NULL)
+    {
+        mmosal_free(dl.bufs[0]);
+    }
+    if (dl.bufs[1] != NULL)
+    {
+        mmosal_free(dl.bufs[1]);
+    }
+    mmbin_index_free(&dl.index);
+
+    return result;
+}
@@ -8,6 +8,7 @@
 #include "sdio_spi.h"
 #include "mmhal.h"
 #include "mmutils.h"
+#include "mmcrc.h"
 
 /** Address where the chip ID is stored on the MM6108 */
 #define MM6108_REG_CHIP_ID      0x10054d20
@@ -22,6 +23,12 @@
 /** Duration to perform the benchmark over. This was arbitrarily chosen. */
 #define BENCHMARK_WAIT_MS (2500)
 
+/** Size of an SDIO block on the data path, over which the CRC benchmark is run. */
+#define CRC_BENCHMARK_BLOCK_LEN (512)
+
+/** Duration to perform the CRC benchmark over. */
+#define CRC_BENCHMARK_WAIT_MS (500)
+
 /** Array of valid chip ids for the MM6108 */
 const uint32_t valid_chip_ids[] = {
     0x206,
@@ -529,3 +536,78 @@ exit:
 
     return result;
 }
+
+TEST_STEP(test_step_crc, "CRC performance")
+{
+    /* Every data block exchanged with the MM chip is protected by a CRC-16 that is computed in
+     * software on both the read and write paths. This test checks the CRC implementation against
+     * known values and measures how long it takes per block, which can be compared against the
+     * time taken to clock the block over the SPI bus. */
+    static const uint8_t check_data[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    static const uint8_t cmd0[] = { 0x40, 0x00, 0x00, 0x00, 0x00 };
+    enum test_result result = TEST_PASSED;
+    uint32_t start_time;
+    uint32_t time_taken_ms;
+    uint32_t block_count = 0;
+    volatile uint16_t crc16 = 0;
+    uint16_t copy_crc16;
+
+    if (mmcrc_16_xmodem(0, check_data, sizeof(check_data)) != 0x31c3)
+    {
+        TEST_LOG_APPEND("CRC-16 check value mismatch\n\n");
+        return TEST_FAILED;
+    }
+
+    if (mmcrc_7(0, cmd0, sizeof(cmd0)) != 0x4a)
+    {
+        TEST_LOG_APPEND("CRC-7 check value mismatch\n\n");
+        return TEST_FAILED;
+    }
+
+    uint8_t *block = (uint8_t *)mmosal_malloc(CRC_BENCHMARK_BLOCK_LEN);
+    uint8_t *copy = (uint8_t *)mmosal_malloc(CRC_BENCHMARK_BLOCK_LEN);
+    if ((block == NULL) || (copy == NULL))
+    {
+        TEST_LOG_APPEND("Failed to allocate CRC buffers. Is there enough heap allocated?");
+        result = TEST_FAILED;
+        goto exit;
+    }
+
+    populate_buffer(block, CRC_BENCHMARK_BLOCK_LEN);
+
+    copy_crc16 = mmcrc_16_xmodem_copy(0, copy, block, CRC_BENCHMARK_BLOCK_LEN);
+    if ((copy_crc16 != mmcrc_16_xmodem(0, block, CRC_BENCHMARK_BLOCK_LEN)) ||
+        (memcmp(copy, block, CRC_BENCHMARK_BLOCK_LEN) != 0))
+    {
+        TEST_LOG_APPEND("CRC-16 with copy does not match CRC-16\n\n");
+        result = TEST_FAILED;
+        goto exit;
+    }
+
+    start_time = mmosal_get_time_ms();
+    while (mmosal_time_le(mmosal_get_time_ms(), start_time + CRC_BENCHMARK_WAIT_MS))
+    {
+        crc16 = mmcrc_16_xmodem(crc16, block, CRC_BENCHMARK_BLOCK_LEN);
+        block_count++;
+    }
+    time_taken_ms = mmosal_get_time_ms() - start_time;
+
+    TEST_LOG_APPEND("\tCRC-16 per %u byte block (ns): %lu\n", CRC_BENCHMARK_BLOCK_LEN,
+                    (uint32_t)(((uint64_t)time_taken_ms * 1000000) / block_count));
+    TEST_LOG_APPEND("\tCRC-16 throughput (kbit/s): %lu\n\n",
+                    (uint32_t)(((uint64_t)block_count * CRC_BENCHMARK_BLOCK_LEN * 8) /
+                               time_taken_ms));
+
+exit:
+    if (block != NULL)
+    {
+        mmosal_free(block);
+    }
+
+    if (copy != NULL)
+    {
+        mmosal_free(copy);
+    }
+
+    return result;
+}
@@ -10,13 +10,16 @@ endif
 
 MMIPERF_DIR = src/mmiperf
 
+MMIPERF_SRCS_C += common/mmiperf3.c
 MMIPERF_SRCS_C += common/mmiperf_common.c
 MMIPERF_SRCS_C += common/mmiperf_data.c
 MMIPERF_SRCS_C += common/mmiperf_list.c
 MMIPERF_SRCS_H += common/mmiperf_private.h
+MMIPERF_SRCS_H += common/mmiperf3_private.h
 
 
 ifeq ($(IP_STACK),lwip)
+MMIPERF_SRCS_C += lwip/mmiperf3_lwip.c
 MMIPERF_SRCS_C += lwip/mmiperf_tcp.c
 MMIPERF_SRCS_C += lwip/mmiperf_udp.c
 MMIPERF_SRCS_H += lwip/mmiperf_lwip.h
@@ -24,6 +27,7 @@ else
 MMIPERF_SRCS_C += freertosplustcp/mmiperf_tcp.c
 MMIPERF_SRCS_C += freertosplustcp/mmiperf_udp.c
 MMIPERF_SRCS_C += freertosplustcp/mmiperf_freertosplustcp_common.c
+MMIPERF_SRCS_C += freertosplustcp/mmiperf3_freertosplustcp.c
 BUILD_DEFINES += MMIPERF_STACK_SIZE=640
 endif
 
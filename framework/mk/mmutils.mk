@@ -9,10 +9,12 @@ MMUTILS_DIR = src/mmutils
 MMUTILS_SRCS_C += mmutils_wlan.c
 MMUTILS_SRCS_C += mmbuf.c
 MMUTILS_SRCS_C += mmcrc.c
+MMUTILS_SRCS_C += mmbin.c
 
 MMUTILS_SRCS_H += mmutils.h
 MMUTILS_SRCS_H +=mmbuf.h
 MMUTILS_SRCS_H +=mmcrc.h
+MMUTILS_SRCS_H +=mmbin.h
 
 MMIOT_SRCS_C += $(addprefix $(MMUTILS_DIR)/,$(MMUTILS_SRCS_C))
 MMIOT_SRCS_H += $(addprefix $(MMUTILS_DIR)/,$(MMUTILS_SRCS_H))
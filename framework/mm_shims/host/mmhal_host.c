@@ -0,0 +1,43 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host (Linux) implementation of the parts of the mmhal API used by the framework code that is
+ * built on a host by framework/tools/host. It is not part of the ESP-IDF build.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "mmhal.h"
+#include "mmhal_wlan.h"
+
+uint32_t mmhal_random_u32(uint32_t min, uint32_t max)
+{
+    /* Note: the below implementation does not guarantee a uniform distribution. */
+
+    uint32_t random_value;
+
+    if (getrandom(&random_value, sizeof(random_value), 0) != sizeof(random_value))
+    {
+        random_value = (uint32_t)random();
+    }
+
+    if (min == 0 && max == UINT32_MAX)
+    {
+        return random_value;
+    }
+
+    return min + (random_value % (max - min + 1));
+}
+
+void mmhal_wlan_pktmem_get_stats(struct mmhal_wlan_pktmem_stats *stats, bool reset_peak)
+{
+    /* There is no WLAN packet memory on the host. */
+    (void)reset_peak;
+    memset(stats, 0, sizeof(*stats));
+}
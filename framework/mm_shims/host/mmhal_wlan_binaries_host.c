@@ -0,0 +1,141 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host (Linux) implementation of mmhal_wlan_read_fw_file() and mmhal_wlan_read_bcf_file().
+ *
+ * This mirrors the flash partition backend in mmhal_wlan_binaries.c: each file is memory mapped
+ * in full on first use and stays mapped, and reads return a robuf pointing directly into the
+ * mapping. It is not part of the ESP-IDF build; it is compiled together with the mmbin code by
+ * framework/tools/host so that image handling can be benchmarked and debugged on a host. For
+ * example:
+ *
+ *     MMHAL_FW_FILE=mm6108.mbin MMHAL_BCF_FILE=bcf_mf16858_us.mbin ./loader_benchmark
+ *
+ * The files are given by the MMHAL_FW_FILE and MMHAL_BCF_FILE environment variables.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mmhal_wlan.h"
+
+/** A file from which the firmware or BCF is read. */
+struct mmhal_wlan_binary_file
+{
+    /** Environment variable giving the path of the file. */
+    const char *env_var;
+    /** Start of the mapped file, or @c NULL if it has not been mapped yet. */
+    const uint8_t *data;
+    /** Length of the file. */
+    uint32_t len;
+};
+
+/**
+ * Map a file if it has not been mapped already.
+ *
+ * @param file      The file to map.
+ *
+ * @returns @c true if the file is mapped, else @c false.
+ */
+static bool mmhal_wlan_map_file(struct mmhal_wlan_binary_file *file)
+{
+    const char *path;
+    struct stat st;
+    void *addr;
+    int fd;
+
+    if (file->data != NULL)
+    {
+        return true;
+    }
+
+    path = getenv(file->env_var);
+    if (path == NULL)
+    {
+        printf("%s not set. It must give the path of the file to read.\n", file->env_var);
+        return false;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Failed to open %s (%s).\n", path, strerror(errno));
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > UINT32_MAX)
+    {
+        printf("Failed to get the size of %s.\n", path);
+        close(fd);
+        return false;
+    }
+
+    /* The mapping is never released, in the same way as the partition backend. */
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        printf("Failed to map %s (%s).\n", path, strerror(errno));
+        return false;
+    }
+
+    file->data = (const uint8_t *)addr;
+    file->len = st.st_size;
+    return true;
+}
+
+/**
+ * Read part of a file.
+ *
+ * @param file          The file to read.
+ * @param offset        Offset within the file to start reading from.
+ * @param requested_len Maximum length to return.
+ * @param robuf         Read-only buffer to fill out. Its length is zero at the end of the file.
+ */
+static void mmhal_wlan_read_mapped_file(struct mmhal_wlan_binary_file *file, uint32_t offset,
+                                        uint32_t requested_len, struct mmhal_robuf *robuf)
+{
+    uint32_t len;
+
+    memset(robuf, 0, sizeof(*robuf));
+
+    if (!mmhal_wlan_map_file(file))
+    {
+        return;
+    }
+
+    if (offset > file->len)
+    {
+        printf("Detected an attempt to read off the end of %s.\n", getenv(file->env_var));
+        return;
+    }
+
+    len = file->len - offset;
+    robuf->buf = file->data + offset;
+    robuf->len = (len < requested_len) ? len : requested_len;
+}
+
+void mmhal_wlan_read_bcf_file(uint32_t offset, uint32_t requested_len, struct mmhal_robuf *robuf)
+{
+    static struct mmhal_wlan_binary_file bcf_file = { .env_var = "MMHAL_BCF_FILE" };
+
+    mmhal_wlan_read_mapped_file(&bcf_file, offset, requested_len, robuf);
+}
+
+void mmhal_wlan_read_fw_file(uint32_t offset, uint32_t requested_len, struct mmhal_robuf *robuf)
+{
+    static struct mmhal_wlan_binary_file fw_file = { .env_var = "MMHAL_FW_FILE" };
+
+    mmhal_wlan_read_mapped_file(&fw_file, offset, requested_len, robuf);
+}
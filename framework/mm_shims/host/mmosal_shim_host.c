@@ -0,0 +1,390 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host (Linux) implementation of the parts of the mmosal API used by the framework code that is
+ * built on a host by framework/tools/host. It is not part of the ESP-IDF build.
+ *
+ * Tasks and timers are POSIX threads. Task priorities and stack sizes are ignored, and critical
+ * sections are a single process-wide lock rather than disabling preemption.
+ */
+
+/* For PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mmosal.h"
+
+/* --------------------------------------------------------------------------------------------- */
+
+/**
+ * Convert a timeout from now into an absolute time for the pthread timed wait functions.
+ *
+ * @param clock_id      Clock that the time is measured against.
+ * @param timeout_ms    Timeout in milliseconds.
+ * @param abstime       Receives the absolute time.
+ */
+static void mmosal_host_abstime(clockid_t clock_id, uint32_t timeout_ms, struct timespec *abstime)
+{
+    clock_gettime(clock_id, abstime);
+    abstime->tv_sec += timeout_ms / 1000;
+    abstime->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (abstime->tv_nsec >= 1000000000)
+    {
+        abstime->tv_sec++;
+        abstime->tv_nsec -= 1000000000;
+    }
+}
+
+void mmosal_log_failure_info(const struct mmosal_failure_info *info)
+{
+    printf("Failure at fileid %lu line %lu (platform info %08lx %08lx %08lx %08lx)\n",
+           (unsigned long)info->fileid, (unsigned long)info->line,
+           (unsigned long)info->platform_info[0], (unsigned long)info->platform_info[1],
+           (unsigned long)info->platform_info[2], (unsigned long)info->platform_info[3]);
+}
+
+void mmosal_impl_assert(void)
+{
+    fflush(stdout);
+    abort();
+}
+
+void *mmosal_malloc_(size_t size)
+{
+    return malloc(size);
+}
+
+void *mmosal_malloc_dbg(size_t size, const char *name, unsigned line_number)
+{
+    (void)name;
+    (void)line_number;
+    return malloc(size);
+}
+
+void mmosal_free(void *p)
+{
+    free(p);
+}
+
+void *mmosal_realloc(void *ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void *mmosal_calloc(size_t nitems, size_t size)
+{
+    return calloc(nitems, size);
+}
+
+void mmosal_get_heap_stats(struct mmosal_heap_stats *stats)
+{
+    /* The host heap has no fixed size. */
+    memset(stats, 0, sizeof(*stats));
+}
+
+/* --------------------------------------------------------------------------------------------- */
+
+struct mmosal_task
+{
+    /** Thread running the task. */
+    pthread_t thread;
+    /** Task main function. */
+    mmosal_task_fn_t task_fn;
+    /** Argument to pass to @c task_fn. */
+    void *argument;
+};
+
+/** Thread entry point that runs a task. The task handle is released when the task returns. */
+static void *mmosal_host_task_main(void *arg)
+{
+    struct mmosal_task *task = (struct mmosal_task *)arg;
+
+    task->task_fn(task->argument);
+    free(task);
+    return NULL;
+}
+
+struct mmosal_task *mmosal_task_create(mmosal_task_fn_t task_fn, void *argument,
+                                       enum mmosal_task_priority priority,
+                                       unsigned stack_size_u32, const char *name)
+{
+    struct mmosal_task *task = (struct mmosal_task *)malloc(sizeof(*task));
+
+    (void)priority;
+    (void)stack_size_u32;
+    (void)name;
+
+    if (task == NULL)
+    {
+        return NULL;
+    }
+
+    task->task_fn = task_fn;
+    task->argument = argument;
+    if (pthread_create(&task->thread, NULL, mmosal_host_task_main, task) != 0)
+    {
+        free(task);
+        return NULL;
+    }
+    pthread_detach(task->thread);
+    return task;
+}
+
+void mmosal_task_sleep(uint32_t duration_ms)
+{
+    struct timespec ts = {
+        .tv_sec = duration_ms / 1000,
+        .tv_nsec = (long)(duration_ms % 1000) * 1000000,
+    };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+/** Lock used for critical sections. */
+static pthread_mutex_t mmosal_host_critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void mmosal_task_enter_critical(void)
+{
+    pthread_mutex_lock(&mmosal_host_critical_lock);
+}
+
+void mmosal_task_exit_critical(void)
+{
+    pthread_mutex_unlock(&mmosal_host_critical_lock);
+}
+
+void mmosal_get_cpu_stats(struct mmosal_cpu_stats *stats)
+{
+    /* CPU usage is not measured on the host. */
+    memset(stats, 0, sizeof(*stats));
+}
+
+/* --------------------------------------------------------------------------------------------- */
+
+struct mmosal_mutex
+{
+    /** The underlying mutex. */
+    pthread_mutex_t mutex;
+};
+
+struct mmosal_mutex *mmosal_mutex_create(const char *name)
+{
+    struct mmosal_mutex *mutex = (struct mmosal_mutex *)malloc(sizeof(*mutex));
+
+    (void)name;
+
+    if (mutex != NULL)
+    {
+        pthread_mutex_init(&mutex->mutex, NULL);
+    }
+    return mutex;
+}
+
+void mmosal_mutex_delete(struct mmosal_mutex *mutex)
+{
+    if (mutex != NULL)
+    {
+        pthread_mutex_destroy(&mutex->mutex);
+        free(mutex);
+    }
+}
+
+bool mmosal_mutex_get(struct mmosal_mutex *mutex, uint32_t timeout_ms)
+{
+    struct timespec abstime;
+
+    if (timeout_ms == UINT32_MAX)
+    {
+        return pthread_mutex_lock(&mutex->mutex) == 0;
+    }
+
+    mmosal_host_abstime(CLOCK_REALTIME, timeout_ms, &abstime);
+    return pthread_mutex_timedlock(&mutex->mutex, &abstime) == 0;
+}
+
+bool mmosal_mutex_release(struct mmosal_mutex *mutex)
+{
+    return pthread_mutex_unlock(&mutex->mutex) == 0;
+}
+
+uint32_t mmosal_get_time_ms(void)
+{
+    return mmosal_get_time_us() / 1000;
+}
+
+uint64_t mmosal_get_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* --------------------------------------------------------------------------------------------- */
+
+struct mmosal_timer
+{
+    /** Protects the fields below. */
+    pthread_mutex_t lock;
+    /** Signalled when the timer is started, stopped or deleted. */
+    pthread_cond_t cond;
+    /** Period of the timer. */
+    uint32_t period_ms;
+    /** @c true if the timer is reloaded when it expires. */
+    bool auto_reload;
+    /** @c true while the timer is running. */
+    bool active;
+    /** @c true once the timer has been deleted, which ends its thread. */
+    bool deleted;
+    /** Time at which the timer next expires, if active. */
+    uint64_t expiry_us;
+    /** Argument given when the timer was created. */
+    void *arg;
+    /** Callback invoked when the timer expires. */
+    timer_callback_t callback;
+};
+
+/** Thread that waits for a timer to expire and invokes its callback. */
+static void *mmosal_host_timer_main(void *arg)
+{
+    struct mmosal_timer *timer = (struct mmosal_timer *)arg;
+
+    pthread_mutex_lock(&timer->lock);
+    while (!timer->deleted)
+    {
+        uint64_t now_us = mmosal_get_time_us();
+
+        if (!timer->active)
+        {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+
+        if (now_us < timer->expiry_us)
+        {
+            struct timespec abstime;
+            mmosal_host_abstime(CLOCK_REALTIME, (timer->expiry_us - now_us + 999) / 1000,
+                                &abstime);
+            pthread_cond_timedwait(&timer->cond, &timer->lock, &abstime);
+            continue;
+        }
+
+        if (timer->auto_reload)
+        {
+            timer->expiry_us += (uint64_t)timer->period_ms * 1000;
+        }
+        else
+        {
+            timer->active = false;
+        }
+
+        /* The callback may start or stop the timer, so it is invoked without the lock held. */
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer);
+        pthread_mutex_lock(&timer->lock);
+    }
+    pthread_mutex_unlock(&timer->lock);
+
+    pthread_mutex_destroy(&timer->lock);
+    pthread_cond_destroy(&timer->cond);
+    free(timer);
+    return NULL;
+}
+
+struct mmosal_timer *mmosal_timer_create(const char *name, uint32_t timer_period_ms,
+                                         bool auto_reload, void *arg, timer_callback_t callback)
+{
+    struct mmosal_timer *timer = (struct mmosal_timer *)calloc(1, sizeof(*timer));
+    pthread_t thread;
+
+    (void)name;
+
+    if (timer == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_cond_init(&timer->cond, NULL);
+    timer->period_ms = timer_period_ms;
+    timer->auto_reload = auto_reload;
+    timer->arg = arg;
+    timer->callback = callback;
+
+    if (pthread_create(&thread, NULL, mmosal_host_timer_main, timer) != 0)
+    {
+        pthread_mutex_destroy(&timer->lock);
+        pthread_cond_destroy(&timer->cond);
+        free(timer);
+        return NULL;
+    }
+    pthread_detach(thread);
+    return timer;
+}
+
+void mmosal_timer_delete(struct mmosal_timer *timer)
+{
+    /* The timer's thread frees it. */
+    pthread_mutex_lock(&timer->lock);
+    timer->deleted = true;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+}
+
+bool mmosal_timer_change_period(struct mmosal_timer *timer, uint32_t new_period)
+{
+    /* As for FreeRTOS, changing the period also starts the timer. */
+    pthread_mutex_lock(&timer->lock);
+    timer->period_ms = new_period;
+    timer->active = true;
+    timer->expiry_us = mmosal_get_time_us() + (uint64_t)new_period * 1000;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return true;
+}
+
+bool mmosal_timer_start(struct mmosal_timer *timer)
+{
+    pthread_mutex_lock(&timer->lock);
+    timer->active = true;
+    timer->expiry_us = mmosal_get_time_us() + (uint64_t)timer->period_ms * 1000;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return true;
+}
+
+bool mmosal_timer_stop(struct mmosal_timer *timer)
+{
+    pthread_mutex_lock(&timer->lock);
+    timer->active = false;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return true;
+}
+
+void *mmosal_timer_get_arg(struct mmosal_timer *timer)
+{
+    return timer->arg;
+}
+
+bool mmosal_is_timer_active(struct mmosal_timer *timer)
+{
+    bool active;
+
+    pthread_mutex_lock(&timer->lock);
+    active = timer->active;
+    pthread_mutex_unlock(&timer->lock);
+    return active;
+}
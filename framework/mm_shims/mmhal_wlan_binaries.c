@@ -6,6 +6,171 @@
 
 #include "mmhal_wlan.h"
 #include "mmosal.h"
+#include "sdkconfig.h"
+
+#if CONFIG_MM_BINARIES_PARTITION
+
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "mbin.h"
+
+/*
+ * ---------------------------------------------------------------------------------------------
+ *                               Firmware and BCF Partitions
+ * ---------------------------------------------------------------------------------------------
+ */
+
+/*
+ * The firmware and BCF are stored in dedicated data partitions rather than being linked into the
+ * application image, so they are not part of every OTA update. Each partition is mapped into the
+ * data address space once, on first use, and stays mapped. Reads return a robuf pointing directly
+ * into the mapping.
+ *
+ * The image is usually shorter than its partition and the rest of the partition reads as erased
+ * flash (0xff). Reads are clamped to the end of the image (the end of its EOF field) so that the
+ * reader sees the end of the image rather than trailing 0xff octets.
+ */
+
+/** A firmware or BCF image stored in a data partition. */
+struct mmhal_wlan_binary_partition
+{
+    /** Label of the partition. */
+    const char *label;
+    /** Start of the mapped partition, or @c NULL if it has not been mapped yet. */
+    const uint8_t *data;
+    /** Length of the image in the partition. */
+    uint32_t image_len;
+};
+
+/**
+ * Find the length of the mbin image at the start of a partition by walking its TLV chain to the
+ * EOF field.
+ *
+ * @param data      Start of the mapped partition.
+ * @param size      Size of the partition.
+ *
+ * @returns the offset of the end of the EOF field, or @p size if no EOF field was found (in which
+ *          case the image is invalid and the reader will report it).
+ */
+static uint32_t mmhal_wlan_image_len(const uint8_t *data, uint32_t size)
+{
+    uint32_t offset = 0;
+
+    while (size - offset >= sizeof(struct mbin_tlv_hdr))
+    {
+        const uint8_t *hdr = data + offset;
+        uint16_t type = hdr[0] | (hdr[1] << 8);
+        uint16_t len = hdr[2] | (hdr[3] << 8);
+
+        if (len > size - offset - sizeof(struct mbin_tlv_hdr))
+        {
+            break;
+        }
+
+        offset += sizeof(struct mbin_tlv_hdr) + len;
+        if (type == FIELD_TYPE_EOF || type == FIELD_TYPE_EOF_WITH_SIGNATURE)
+        {
+            return offset;
+        }
+    }
+
+    return size;
+}
+
+/**
+ * Map a partition if it has not been mapped already.
+ *
+ * @param part      The partition to map.
+ *
+ * @returns @c true if the partition is mapped, else @c false.
+ */
+static bool mmhal_wlan_map_partition(struct mmhal_wlan_binary_partition *part)
+{
+    const esp_partition_t *partition;
+    esp_partition_mmap_handle_t handle;
+    const void *ptr;
+    esp_err_t err;
+
+    if (part->data != NULL)
+    {
+        return true;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         part->label);
+    if (partition == NULL)
+    {
+        printf("Partition %s not found. Check the partition table.\n", part->label);
+        return false;
+    }
+
+    /* The mapping is never released, so the handle is not needed. */
+    err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &ptr,
+                             &handle);
+    if (err != ESP_OK)
+    {
+        printf("Failed to map partition %s (%s).\n", part->label, esp_err_to_name(err));
+        return false;
+    }
+
+    part->image_len = mmhal_wlan_image_len((const uint8_t *)ptr, partition->size);
+    part->data = (const uint8_t *)ptr;
+    return true;
+}
+
+/**
+ * Read part of the image in a partition.
+ *
+ * @param part          The partition to read from.
+ * @param offset        Offset within the image to start reading from.
+ * @param requested_len Maximum length to return.
+ * @param robuf         Read-only buffer to fill out. Its length is zero at the end of the image.
+ */
+static void mmhal_wlan_read_partition(struct mmhal_wlan_binary_partition *part, uint32_t offset,
+                                      uint32_t requested_len, struct mmhal_robuf *robuf)
+{
+    uint32_t len;
+
+    memset(robuf, 0, sizeof(*robuf));
+
+    if (!mmhal_wlan_map_partition(part))
+    {
+        return;
+    }
+
+    if (offset > part->image_len)
+    {
+        printf("Detected an attempt to read off the end of the image in partition %s.\n",
+               part->label);
+        return;
+    }
+
+    len = part->image_len - offset;
+    robuf->buf = part->data + offset;
+    robuf->len = (len < requested_len) ? len : requested_len;
+}
+
+void mmhal_wlan_read_bcf_file(uint32_t offset, uint32_t requested_len, struct mmhal_robuf *robuf)
+{
+    static struct mmhal_wlan_binary_partition bcf_partition = {
+        .label = CONFIG_MM_BCF_PARTITION_LABEL,
+    };
+
+    mmhal_wlan_read_partition(&bcf_partition, offset, requested_len, robuf);
+}
+
+void mmhal_wlan_read_fw_file(uint32_t offset, uint32_t requested_len, struct mmhal_robuf *robuf)
+{
+    static struct mmhal_wlan_binary_partition fw_partition = {
+        .label = CONFIG_MM_FW_PARTITION_LABEL,
+    };
+
+    mmhal_wlan_read_partition(&fw_partition, offset, requested_len, robuf);
+}
+
+#else
 
 /*
  * ---------------------------------------------------------------------------------------------
@@ -70,3 +235,5 @@ void mmhal_wlan_read_fw_file(uint32_t offset, uint32_t requested_len, struct mmh
 
     robuf->len = (firmware_len < requested_len) ? firmware_len : requested_len;
 }
+
+#endif
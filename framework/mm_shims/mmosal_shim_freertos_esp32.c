@@ -11,6 +11,8 @@
 #include "freertos/timers.h"
 #include "rom/ets_sys.h"
 #include "esp_debug_helpers.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_private/startup_internal.h"
 
 #include "mmosal.h"
@@ -176,6 +178,12 @@ void *mmosal_calloc(size_t nitems, size_t size)
     return ptr;
 }
 
+void mmosal_get_heap_stats(struct mmosal_heap_stats *stats)
+{
+    stats->total_size = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+    stats->free_size = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
 
 /* --------------------------------------------------------------------------------------------- */
 
@@ -282,6 +290,24 @@ const char *mmosal_task_name(void)
     return pcTaskGetName(t);
 }
 
+void mmosal_get_cpu_stats(struct mmosal_cpu_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+#if (configGENERATE_RUN_TIME_STATS == 1) && (configUSE_TRACE_FACILITY == 1)
+    /* Requires CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS. */
+    BaseType_t core;
+    stats->num_cores = (portNUM_PROCESSORS < MMOSAL_MAX_CPU_CORES) ?
+                       portNUM_PROCESSORS : MMOSAL_MAX_CPU_CORES;
+    stats->run_time = (uint32_t)portGET_RUN_TIME_COUNTER_VALUE();
+    for (core = 0; core < stats->num_cores; core++)
+    {
+        TaskStatus_t status;
+        vTaskGetInfo(xTaskGetIdleTaskHandleForCore(core), &status, pdFALSE, eReady);
+        stats->idle_time[core] = (uint32_t)status.ulRunTimeCounter;
+    }
+#endif
+}
+
 bool mmosal_task_wait_for_notification(uint32_t timeout_ms)
 {
     TickType_t wait = portMAX_DELAY;
@@ -537,6 +563,11 @@ uint32_t mmosal_get_time_ms(void)
     return xTaskGetTickCount() * portTICK_PERIOD_MS;
 }
 
+uint64_t mmosal_get_time_us(void)
+{
+    return esp_timer_get_time();
+}
+
 uint32_t mmosal_get_time_ticks(void)
 {
     return xTaskGetTickCount();
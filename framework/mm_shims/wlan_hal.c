@@ -11,8 +11,12 @@
 #include "mmhal.h"
 #include "mmosal.h"
 
+#include "esp_attr.h"
+#include "esp_memory_utils.h"
 #include "esp_system.h"
 #include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
 #include "driver/spi_common.h"
@@ -28,6 +32,31 @@ static mmhal_irq_handler_t busy_irq_handler = NULL;
 
 static spi_device_handle_t spi_handle;
 
+/** SPI transfer statistics. See @ref mmhal_wlan_spi_get_stats(). */
+static struct wlan_hal_spi_stats
+{
+    uint32_t transactions;
+    uint64_t octets;
+    uint64_t active_us;
+    uint32_t poll_transactions;
+    uint64_t poll_us;
+    uint32_t interrupt_transactions;
+    uint64_t interrupt_us;
+    uint32_t tx_bounce_transactions;
+    uint32_t rx_bounce_transactions;
+    uint32_t irq_isr_entries;
+    uint32_t irq_rearms;
+} spi_stats;
+
+/**
+ * Protects the interrupt counters in @ref spi_stats, which are updated from the SPI interrupt
+ * service routine, against being read or reset from a task running on the other core.
+ */
+static portMUX_TYPE spi_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** Actual SPI clock frequency in kHz, as reported by the driver. */
+static uint32_t spi_clock_khz;
+
 static void wlan_hal_gpio_init(void)
 {
     gpio_config_t io_conf = {};
@@ -95,6 +124,7 @@ static void wlan_hal_spi_init(void)
     int actual_freq_khz = 0;
     spi_device_get_actual_freq(spi_handle, &actual_freq_khz);
     printf("Actual SPI CLK %dkHz\n", actual_freq_khz);
+    spi_clock_khz = actual_freq_khz;
 }
 
 static void wlan_hal_spi_deinit(void)
@@ -113,43 +143,529 @@ static void wlan_hal_spi_deinit(void)
 }
 
 /**
- * Minium transfer length in bytes before interrupt based transactions are used. This is because
+ * Default minimum transfer length in bytes before interrupt based transactions are used. This is
+ * only used until the threshold has been calibrated (see @ref wlan_hal_spi_calibrate()), or if
+ * calibration fails.
+ */
+#define INTERRUPT_TRANSFER_DEFAULT_MIN_LENGTH 75
+
+/** Upper bound on the calibrated interrupt transfer threshold in bytes. */
+#define INTERRUPT_TRANSFER_MAX_MIN_LENGTH 1024
+
+/** Number of transfers of each type timed when calibrating the interrupt transfer threshold. */
+#define SPI_CALIBRATION_ITERATIONS 32
+
+/**
+ * Weight given to the previous overhead estimate when adapting the interrupt transfer threshold
+ * at run time, as a power of two (i.e., each new sample contributes 1/16).
+ */
+#define SPI_OVERHEAD_EWMA_SHIFT 4
+
+/**
+ * When adapting the interrupt transfer threshold at run time, one in this many transactions uses
+ * the method that the threshold does not select, so that the estimate for that method keeps
+ * following changes in load. Only transactions no longer than
+ * @ref INTERRUPT_TRANSFER_MAX_MIN_LENGTH are used as probes.
+ */
+#define SPI_OVERHEAD_PROBE_INTERVAL 64
+
+/**
+ * Minimum transfer length in bytes before interrupt based transactions are used. This is because
  * there is some setup time associated with using the interrupt based method when compared to the
  * polling method. In the cases where the difference in setup time exceeds the transaction duration
  * it is more efficient to uses the polling method instead of the interrupt based one. The below
- * equation was used to calculate this.
+ * equation is used to calculate this.
+ *
+ * (DMA_TRANSACTION_OVERHEAD - POLL_TRANSACTION_OVERHEAD) / (8/SPI_FREQ)
+ *
+ * The overheads depend on the SPI clock, CPU frequency and core load, so they are measured at
+ * start up and, if @c CONFIG_MM_SPI_ADAPTIVE_THRESHOLD is enabled, tracked at run time.
+ */
+static uint32_t spi_interrupt_min_length = INTERRUPT_TRANSFER_DEFAULT_MIN_LENGTH;
+
+/** Estimated fixed cost of a polling transaction in nanoseconds. */
+static uint32_t spi_poll_overhead_ns;
+
+/** Estimated fixed cost of an interrupt based transaction in nanoseconds. */
+static uint32_t spi_interrupt_overhead_ns;
+
+/** Time in nanoseconds taken to clock @p len octets at the current SPI clock frequency. */
+static uint32_t spi_wire_time_ns(size_t len)
+{
+    if (spi_clock_khz == 0)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)len * 8 * 1000000) / spi_clock_khz);
+}
+
+/** Recalculate @ref spi_interrupt_min_length from the current overhead estimates. */
+static void spi_update_interrupt_min_length(void)
+{
+    uint64_t min_length;
+
+    if (spi_interrupt_overhead_ns <= spi_poll_overhead_ns)
+    {
+        min_length = 0;
+    }
+    else
+    {
+        min_length = ((uint64_t)(spi_interrupt_overhead_ns - spi_poll_overhead_ns) *
+                      spi_clock_khz) / (8 * 1000000);
+    }
+
+    if (min_length > INTERRUPT_TRANSFER_MAX_MIN_LENGTH)
+    {
+        min_length = INTERRUPT_TRANSFER_MAX_MIN_LENGTH;
+    }
+    spi_interrupt_min_length = min_length;
+}
+
+#if CONFIG_MM_SPI_ADAPTIVE_THRESHOLD
+/** Number of transactions since the method not selected by the threshold was last probed. */
+static uint32_t spi_transactions_since_probe;
+
+/**
+ * Decide whether a transaction should use the polling method. This normally follows
+ * @ref spi_interrupt_min_length but periodically selects the other method (see
+ * @ref SPI_OVERHEAD_PROBE_INTERVAL), since only the method used is measured.
+ *
+ * @param len   Length of the transaction in octets.
+ *
+ * @returns @c true to use the polling method, @c false to use the interrupt based method.
+ */
+static bool spi_use_polling(size_t len)
+{
+    bool use_polling = (len < spi_interrupt_min_length);
+
+    if (len <= INTERRUPT_TRANSFER_MAX_MIN_LENGTH &&
+        ++spi_transactions_since_probe >= SPI_OVERHEAD_PROBE_INTERVAL)
+    {
+        spi_transactions_since_probe = 0;
+        use_polling = !use_polling;
+    }
+    return use_polling;
+}
+
+/**
+ * Fold a measured transaction duration into an overhead estimate.
+ *
+ * @param estimate_ns   The overhead estimate to update.
+ * @param elapsed_us    Measured duration of the transaction.
+ * @param len           Length of the transaction in octets.
+ */
+static void spi_update_overhead(uint32_t *estimate_ns, int64_t elapsed_us, size_t len)
+{
+    int64_t overhead_ns = (elapsed_us * 1000) - spi_wire_time_ns(len);
+    if (overhead_ns < 0)
+    {
+        overhead_ns = 0;
+    }
+
+    *estimate_ns = *estimate_ns - (*estimate_ns >> SPI_OVERHEAD_EWMA_SHIFT) +
+                   ((uint32_t)overhead_ns >> SPI_OVERHEAD_EWMA_SHIFT);
+}
+#else
+static inline bool spi_use_polling(size_t len)
+{
+    return len < spi_interrupt_min_length;
+}
+#endif
+
+/**
+ * Tests whether the SPI driver will need to copy the given buffer through a DMA-capable bounce
+ * buffer, which it does silently if the buffer is not in DMA-capable memory or is not word aligned.
+ */
+static inline bool spi_buf_needs_bounce(const void *buf)
+{
+    return buf != NULL && (!esp_ptr_dma_capable(buf) || ((uintptr_t)buf % 4) != 0);
+}
+
+/** Count the buffers of the given transaction that the SPI driver will bounce-copy. */
+static void spi_check_bounce(const spi_transaction_t *trans)
+{
+    if (!(trans->flags & SPI_TRANS_USE_TXDATA) && spi_buf_needs_bounce(trans->tx_buffer))
+    {
+        spi_stats.tx_bounce_transactions++;
+    }
+    if (!(trans->flags & SPI_TRANS_USE_RXDATA) && spi_buf_needs_bounce(trans->rx_buffer))
+    {
+        spi_stats.rx_bounce_transactions++;
+    }
+}
+
+/** Trace direction flag indicating that the caller supplied data to transmit. */
+#define SPI_TRACE_DIR_TX 0x01
+/** Trace direction flag indicating that the caller wants the received data. */
+#define SPI_TRACE_DIR_RX 0x02
+
+/** Trace mode for transactions executed using the polling method. */
+#define SPI_TRACE_MODE_POLL 'P'
+/** Trace mode for transactions executed using the interrupt based method. */
+#define SPI_TRACE_MODE_INTERRUPT 'I'
+/** Trace mode for the time that chip select was asserted. */
+#define SPI_TRACE_MODE_CS 'C'
+
+#if CONFIG_MM_SPI_TRACE
+/** An entry in the SPI trace ring. */
+struct spi_trace_entry
+{
+    /** Start time in microseconds (the low 32 bits of @c esp_timer_get_time()). */
+    uint32_t start_us;
+    /** Duration in microseconds. */
+    uint32_t duration_us;
+    /** Transaction length in octets, or 0 for a chip select window. */
+    uint16_t len;
+    /** Combination of @c SPI_TRACE_DIR_* flags. */
+    uint8_t dir;
+    /** One of the @c SPI_TRACE_MODE_* values. */
+    char mode;
+    /** First octet transmitted, which identifies commands and data tokens. */
+    uint8_t first_tx;
+    /** First octet received, which identifies token polling (0xff while the chip is busy). */
+    uint8_t first_rx;
+};
+
+/**
+ * SPI trace ring. Transactions are serialized by the chip select, so entries are only added from
+ * one task at a time. Each entry is written inside a critical section so that
+ * @ref mmhal_wlan_spi_trace_dump(), which may run from another task, never sees a partially
+ * written entry.
+ */
+static struct
+{
+    struct spi_trace_entry entries[CONFIG_MM_SPI_TRACE_RING_LEN];
+    /** Index of the entry to write next. */
+    uint32_t next;
+    /** @c true if the ring has wrapped, in which case @c next is also the oldest entry. */
+    bool wrapped;
+    /** @c true if recording is enabled. */
+    volatile bool enabled;
+    /** @c true while the ring is being dumped, during which recording is paused. */
+    bool dumping;
+    /** Time at which chip select was asserted, or 0 if it is not asserted. */
+    int64_t cs_assert_us;
+} spi_trace = { .enabled = true };
+
+/**
+ * Record an entry in the SPI trace ring.
+ *
+ * @param start_us  Start time as returned by @c esp_timer_get_time().
+ * @param end_us    End time as returned by @c esp_timer_get_time().
+ * @param trans     The completed transaction, or @c NULL for a chip select window.
+ * @param len       Transaction length in octets.
+ * @param dir       Combination of @c SPI_TRACE_DIR_* flags.
+ * @param mode      One of the @c SPI_TRACE_MODE_* values.
+ */
+static void spi_trace_record(int64_t start_us, int64_t end_us, const spi_transaction_t *trans,
+                             size_t len, uint8_t dir, char mode)
+{
+    struct spi_trace_entry *entry;
+    uint8_t first_tx = 0xff;
+    uint8_t first_rx = 0xff;
+
+    if (!spi_trace.enabled)
+    {
+        return;
+    }
+
+    if (trans != NULL && len != 0)
+    {
+        if (trans->flags & SPI_TRANS_USE_TXDATA)
+        {
+            first_tx = trans->tx_data[0];
+        }
+        else if (trans->tx_buffer != NULL)
+        {
+            first_tx = ((const uint8_t *)trans->tx_buffer)[0];
+        }
+
+        if (trans->flags & SPI_TRANS_USE_RXDATA)
+        {
+            first_rx = trans->rx_data[0];
+        }
+        else if (trans->rx_buffer != NULL)
+        {
+            first_rx = ((const uint8_t *)trans->rx_buffer)[0];
+        }
+    }
+
+    MMOSAL_TASK_ENTER_CRITICAL();
+    if (spi_trace.enabled && !spi_trace.dumping)
+    {
+        entry = &spi_trace.entries[spi_trace.next];
+        if (++spi_trace.next == CONFIG_MM_SPI_TRACE_RING_LEN)
+        {
+            spi_trace.next = 0;
+            spi_trace.wrapped = true;
+        }
+
+        entry->start_us = (uint32_t)start_us;
+        entry->duration_us = (uint32_t)(end_us - start_us);
+        entry->len = (len > UINT16_MAX) ? UINT16_MAX : len;
+        entry->dir = dir;
+        entry->mode = mode;
+        entry->first_tx = first_tx;
+        entry->first_rx = first_rx;
+    }
+    MMOSAL_TASK_EXIT_CRITICAL();
+}
+
+/** Start timing a chip select window. */
+static inline void spi_trace_cs_assert(void)
+{
+    spi_trace.cs_assert_us = esp_timer_get_time();
+}
+
+/** Record the chip select window started by @ref spi_trace_cs_assert(), if any. */
+static inline void spi_trace_cs_deassert(void)
+{
+    if (spi_trace.cs_assert_us != 0)
+    {
+        spi_trace_record(spi_trace.cs_assert_us, esp_timer_get_time(), NULL, 0, 0,
+                         SPI_TRACE_MODE_CS);
+        spi_trace.cs_assert_us = 0;
+    }
+}
+
+void mmhal_wlan_spi_trace_enable(bool enable)
+{
+    spi_trace.enabled = enable;
+}
+
+void mmhal_wlan_spi_trace_dump(void)
+{
+    static const char dir_chars[] = { '-', 'T', 'R', 'X' };
+    uint32_t count;
+    uint32_t index;
+    bool wrapped;
+    uint32_t ii;
+
+    /* Pause recording and take a snapshot of the ring position. Entries are only written inside
+     * the critical section, so none is partially written once recording is paused. */
+    MMOSAL_TASK_ENTER_CRITICAL();
+    spi_trace.dumping = true;
+    wrapped = spi_trace.wrapped;
+    count = wrapped ? CONFIG_MM_SPI_TRACE_RING_LEN : spi_trace.next;
+    index = wrapped ? spi_trace.next : 0;
+    MMOSAL_TASK_EXIT_CRITICAL();
+
+    printf("SPITRACE begin clock_khz=%lu entries=%lu wrapped=%d\n",
+           (unsigned long)spi_clock_khz, (unsigned long)count, wrapped);
+    for (ii = 0; ii < count; ii++)
+    {
+        const struct spi_trace_entry *entry = &spi_trace.entries[index];
+        printf("SPITRACE %lu %lu %c %c %u %02x %02x\n",
+               (unsigned long)entry->start_us, (unsigned long)entry->duration_us, entry->mode,
+               dir_chars[entry->dir & 0x03], entry->len, entry->first_tx, entry->first_rx);
+        index = (index + 1) % CONFIG_MM_SPI_TRACE_RING_LEN;
+    }
+    printf("SPITRACE end\n");
+
+    MMOSAL_TASK_ENTER_CRITICAL();
+    spi_trace.next = 0;
+    spi_trace.wrapped = false;
+    spi_trace.dumping = false;
+    MMOSAL_TASK_EXIT_CRITICAL();
+}
+#else
+static inline void spi_trace_record(int64_t start_us, int64_t end_us,
+                                    const spi_transaction_t *trans, size_t len, uint8_t dir,
+                                    char mode)
+{
+    (void)start_us;
+    (void)end_us;
+    (void)trans;
+    (void)len;
+    (void)dir;
+    (void)mode;
+}
+
+static inline void spi_trace_cs_assert(void)
+{
+}
+
+static inline void spi_trace_cs_deassert(void)
+{
+}
+
+void mmhal_wlan_spi_trace_enable(bool enable)
+{
+    (void)enable;
+}
+
+void mmhal_wlan_spi_trace_dump(void)
+{
+    printf("SPI trace not enabled (CONFIG_MM_SPI_TRACE)\n");
+}
+#endif
+
+/**
+ * Execute a transaction synchronously, using the polling method if it is shorter than
+ * @ref spi_interrupt_min_length and the interrupt based method otherwise (see
+ * @ref spi_use_polling()).
  *
- * (DMA_TRANSACTION_DURATION - POLL_TRANSACTION_DURATION) / (8/SPI_FREQ)
+ * @param trans     The transaction to execute.
+ * @param len       Transaction length in octets.
+ * @param trace_dir Combination of @c SPI_TRACE_DIR_* flags recorded in the SPI trace.
  *
- * The typical duration for the ESP32 can be found in the [transaction
- * duration](https://docs.espressif.com/projects/esp-idf/en/v5.1.1/esp32s3/api-reference/peripherals/spi_master.html#transaction-duration)
- * section of the docs.
+ * @returns the result of the SPI driver transaction.
  */
-#define INTERRUPT_TRANSFER_MIN_LENGTH 75
+static esp_err_t spi_transfer(spi_transaction_t *trans, size_t len, uint8_t trace_dir)
+{
+    esp_err_t err;
+    int64_t start_us = esp_timer_get_time();
+    int64_t elapsed_us;
+
+    spi_check_bounce(trans);
+
+    if (spi_use_polling(len))
+    {
+        err = spi_device_polling_transmit(spi_handle, trans);
+        elapsed_us = esp_timer_get_time() - start_us;
+        spi_stats.poll_transactions++;
+        spi_stats.poll_us += elapsed_us;
+        spi_trace_record(start_us, start_us + elapsed_us, trans, len, trace_dir,
+                         SPI_TRACE_MODE_POLL);
+#if CONFIG_MM_SPI_ADAPTIVE_THRESHOLD
+        spi_update_overhead(&spi_poll_overhead_ns, elapsed_us, len);
+#endif
+    }
+    else
+    {
+        err = spi_device_transmit(spi_handle, trans);
+        elapsed_us = esp_timer_get_time() - start_us;
+        spi_stats.interrupt_transactions++;
+        spi_stats.interrupt_us += elapsed_us;
+        spi_trace_record(start_us, start_us + elapsed_us, trans, len, trace_dir,
+                         SPI_TRACE_MODE_INTERRUPT);
+#if CONFIG_MM_SPI_ADAPTIVE_THRESHOLD
+        spi_update_overhead(&spi_interrupt_overhead_ns, elapsed_us, len);
+#endif
+    }
+
+#if CONFIG_MM_SPI_ADAPTIVE_THRESHOLD
+    spi_update_interrupt_min_length();
+#endif
+
+    return err;
+}
 
 static void spi_master_rw(const uint8_t *w_data, uint8_t *r_data, size_t len)
 {
+    int64_t start_us = esp_timer_get_time();
     spi_transaction_t trans_desc = {
         .rx_buffer = r_data,
         .tx_buffer = w_data,
         .length = (len * 8),
         .flags = 0,
     };
+    bool use_rx_data = false;
 
-    esp_err_t err;
-    if (len < INTERRUPT_TRANSFER_MIN_LENGTH)
+    /* Transfers of up to four octets are carried in the transaction descriptor itself. This is
+     * always suitable for DMA, whereas the caller's buffers (e.g., a single octet on the stack)
+     * would otherwise be bounce-copied by the driver. */
+    if (len <= sizeof(trans_desc.tx_data))
     {
-        err = spi_device_polling_transmit(spi_handle, &trans_desc);
-    }
-    else
-    {
-        err = spi_device_transmit(spi_handle, &trans_desc);
+        trans_desc.flags = SPI_TRANS_USE_TXDATA;
+        if (w_data != NULL)
+        {
+            memcpy(trans_desc.tx_data, w_data, len);
+        }
+        else
+        {
+            memset(trans_desc.tx_data, 0xff, sizeof(trans_desc.tx_data));
+        }
+
+        if (r_data != NULL)
+        {
+            trans_desc.flags |= SPI_TRANS_USE_RXDATA;
+            use_rx_data = true;
+        }
     }
 
+    uint8_t trace_dir = ((w_data != NULL) ? SPI_TRACE_DIR_TX : 0) |
+                        ((r_data != NULL) ? SPI_TRACE_DIR_RX : 0);
+    esp_err_t err = spi_transfer(&trans_desc, len, trace_dir);
     if (err!= ESP_OK)
     {
         printf("SPI rw error = %x\n", err);
     }
+
+    if (use_rx_data)
+    {
+        memcpy(r_data, trans_desc.rx_data, len);
+    }
+
+    spi_stats.transactions++;
+    spi_stats.octets += len;
+    spi_stats.active_us += esp_timer_get_time() - start_us;
+}
+
+/**
+ * Measure the average duration of a single octet transaction using the given method.
+ *
+ * @param use_polling   @c true to time polling transactions, @c false for interrupt based ones.
+ * @param duration_ns   Set to the average duration in nanoseconds on success.
+ *
+ * @returns @c true on success, else @c false.
+ */
+static bool spi_time_transactions(bool use_polling, uint32_t *duration_ns)
+{
+    unsigned ii;
+    int64_t start_us = esp_timer_get_time();
+
+    for (ii = 0; ii < SPI_CALIBRATION_ITERATIONS; ii++)
+    {
+        /* Carry the data in the descriptor, as spi_master_rw() does for short transfers, so
+         * that the driver does not add a bounce buffer allocation to the measurement. */
+        spi_transaction_t trans_desc = {
+            .flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA,
+            .length = 8,
+            .tx_data = { 0xff, 0xff, 0xff, 0xff },
+        };
+        esp_err_t err = use_polling ? spi_device_polling_transmit(spi_handle, &trans_desc) :
+                                      spi_device_transmit(spi_handle, &trans_desc);
+        if (err != ESP_OK)
+        {
+            return false;
+        }
+    }
+
+    *duration_ns = ((esp_timer_get_time() - start_us) * 1000) / SPI_CALIBRATION_ITERATIONS;
+    return true;
+}
+
+/**
+ * Measure the fixed cost of polling and interrupt based transactions at the configured SPI clock
+ * and derive @ref spi_interrupt_min_length from them.
+ *
+ * This must be called before the transceiver is taken out of reset. Only 0xff is clocked out,
+ * with chip select deasserted, in the same way as the training sequence.
+ */
+static void wlan_hal_spi_calibrate(void)
+{
+    uint32_t poll_ns;
+    uint32_t interrupt_ns;
+    uint32_t wire_ns = spi_wire_time_ns(1);
+
+    mmhal_wlan_spi_cs_deassert();
+    if (!spi_time_transactions(true, &poll_ns) || !spi_time_transactions(false, &interrupt_ns))
+    {
+        printf("SPI calibration failed, interrupt threshold %lu bytes\n",
+               (unsigned long)spi_interrupt_min_length);
+        mmhal_wlan_spi_cs_assert();
+        return;
+    }
+    mmhal_wlan_spi_cs_assert();
+
+    spi_poll_overhead_ns = (poll_ns > wire_ns) ? (poll_ns - wire_ns) : 0;
+    spi_interrupt_overhead_ns = (interrupt_ns > wire_ns) ? (interrupt_ns - wire_ns) : 0;
+    spi_update_interrupt_min_length();
+
+    printf("SPI overhead: poll %lu ns, interrupt %lu ns, interrupt threshold %lu bytes\n",
+           (unsigned long)spi_poll_overhead_ns, (unsigned long)spi_interrupt_overhead_ns,
+           (unsigned long)spi_interrupt_min_length);
 }
 
 void mmhal_wlan_hard_reset(void)
@@ -163,11 +679,13 @@ void mmhal_wlan_hard_reset(void)
 void mmhal_wlan_spi_cs_assert(void)
 {
     gpio_set_level(CONFIG_MM_SPI_CS, 0);
+    spi_trace_cs_assert();
 }
 
 void mmhal_wlan_spi_cs_deassert(void)
 {
     gpio_set_level(CONFIG_MM_SPI_CS, 1);
+    spi_trace_cs_deassert();
 }
 
 uint8_t mmhal_wlan_spi_rw(uint8_t data)
@@ -187,6 +705,169 @@ void mmhal_wlan_spi_write_buf(const uint8_t *buf, unsigned len)
     spi_master_rw(buf, NULL, len);
 }
 
+/**
+ * Size of the buffers that the segments of a vectored transfer are gathered into. This is large
+ * enough for a 512 octet data block along with its framing. Segments that do not fit are
+ * transferred in place.
+ */
+#define SPI_XFER_VEC_BUF_LEN 576
+
+/*
+ * Bounce buffers for vectored transfers. Access to the SPI bus is serialized by the caller (the
+ * chip select is held for the duration of the transfer) so these can safely be shared.
+ */
+DMA_ATTR static uint8_t spi_xfer_vec_tx_buf[SPI_XFER_VEC_BUF_LEN];
+DMA_ATTR static uint8_t spi_xfer_vec_rx_buf[SPI_XFER_VEC_BUF_LEN];
+
+/**
+ * Transfer segments @p first to @p last (exclusive) as a single transaction using the bounce
+ * buffers. The combined length must not exceed @ref SPI_XFER_VEC_BUF_LEN.
+ */
+static void spi_xfer_vec_gathered(const struct mmhal_wlan_spi_seg *segs,
+                                  unsigned first, unsigned last)
+{
+    unsigned ii;
+    size_t offset = 0;
+    bool rx_required = false;
+
+    for (ii = first; ii < last; ii++)
+    {
+        if (segs[ii].tx != NULL)
+        {
+            memcpy(spi_xfer_vec_tx_buf + offset, segs[ii].tx, segs[ii].len);
+        }
+        else
+        {
+            memset(spi_xfer_vec_tx_buf + offset, 0xff, segs[ii].len);
+        }
+        rx_required |= (segs[ii].rx != NULL);
+        offset += segs[ii].len;
+    }
+
+    spi_master_rw(spi_xfer_vec_tx_buf, rx_required ? spi_xfer_vec_rx_buf : NULL, offset);
+
+    if (!rx_required)
+    {
+        return;
+    }
+
+    offset = 0;
+    for (ii = first; ii < last; ii++)
+    {
+        if (segs[ii].rx != NULL)
+        {
+            memcpy(segs[ii].rx, spi_xfer_vec_rx_buf + offset, segs[ii].len);
+        }
+        offset += segs[ii].len;
+    }
+}
+
+/**
+ * Transfer a segment that is too large for the bounce buffers directly to/from the caller's
+ * buffers. If no transmit data was given then the transmit bounce buffer is used to send 0xff.
+ */
+static void spi_xfer_vec_in_place(const struct mmhal_wlan_spi_seg *seg)
+{
+    size_t offset;
+
+    if (seg->tx != NULL)
+    {
+        spi_master_rw(seg->tx, seg->rx, seg->len);
+        return;
+    }
+
+    memset(spi_xfer_vec_tx_buf, 0xff, sizeof(spi_xfer_vec_tx_buf));
+    for (offset = 0; offset < seg->len; offset += SPI_XFER_VEC_BUF_LEN)
+    {
+        size_t chunk_len = seg->len - offset;
+        if (chunk_len > SPI_XFER_VEC_BUF_LEN)
+        {
+            chunk_len = SPI_XFER_VEC_BUF_LEN;
+        }
+        spi_master_rw(spi_xfer_vec_tx_buf, seg->rx != NULL ? seg->rx + offset : NULL, chunk_len);
+    }
+}
+
+void mmhal_wlan_spi_xfer_vec(const struct mmhal_wlan_spi_seg *segs, unsigned num_segs)
+{
+    unsigned first = 0;
+
+    /* Hold the bus for the whole vector so that the driver does not need to re-acquire it for
+     * each transaction. */
+    esp_err_t err = spi_device_acquire_bus(spi_handle, portMAX_DELAY);
+    if (err != ESP_OK)
+    {
+        printf("SPI acquire bus error = %x\n", err);
+        return;
+    }
+
+    while (first < num_segs)
+    {
+        unsigned last = first;
+        size_t total_len = 0;
+
+        while (last < num_segs && total_len + segs[last].len <= SPI_XFER_VEC_BUF_LEN)
+        {
+            total_len += segs[last].len;
+            last++;
+        }
+
+        if (last == first)
+        {
+            /* Too large to gather, so transfer this segment directly from the caller's buffers. */
+            spi_xfer_vec_in_place(&segs[first]);
+            first++;
+        }
+        else
+        {
+            spi_xfer_vec_gathered(segs, first, last);
+            first = last;
+        }
+    }
+
+    spi_device_release_bus(spi_handle);
+}
+
+void mmhal_wlan_spi_get_stats(struct mmhal_wlan_spi_stats *stats, bool reset)
+{
+    struct wlan_hal_spi_stats snapshot;
+    uint64_t clocked_us;
+
+    taskENTER_CRITICAL(&spi_stats_lock);
+    snapshot = spi_stats;
+    if (reset)
+    {
+        memset(&spi_stats, 0, sizeof(spi_stats));
+    }
+    taskEXIT_CRITICAL(&spi_stats_lock);
+
+    stats->clock_khz = spi_clock_khz;
+    stats->transactions = snapshot.transactions;
+    stats->octets = snapshot.octets;
+    stats->active_us = snapshot.active_us;
+    stats->poll_transactions = snapshot.poll_transactions;
+    stats->poll_us = snapshot.poll_us;
+    stats->interrupt_transactions = snapshot.interrupt_transactions;
+    stats->interrupt_us = snapshot.interrupt_us;
+    stats->tx_bounce_transactions = snapshot.tx_bounce_transactions;
+    stats->rx_bounce_transactions = snapshot.rx_bounce_transactions;
+    stats->poll_overhead_ns = spi_poll_overhead_ns;
+    stats->interrupt_overhead_ns = spi_interrupt_overhead_ns;
+    stats->interrupt_min_length = spi_interrupt_min_length;
+    stats->utilisation_permille = 0;
+    stats->irq_isr_entries = snapshot.irq_isr_entries;
+    stats->irq_rearms = snapshot.irq_rearms;
+
+    if (spi_clock_khz != 0 && snapshot.active_us != 0)
+    {
+        clocked_us = (snapshot.octets * 8 * 1000) / spi_clock_khz;
+        stats->utilisation_permille = (clocked_us * 1000) / snapshot.active_us;
+        if (stats->utilisation_permille > 1000)
+        {
+            stats->utilisation_permille = 1000;
+        }
+    }
+}
 
 void mmhal_wlan_send_training_seq(void)
 {
@@ -203,21 +884,26 @@ void mmhal_wlan_send_training_seq(void)
     spi_master_rw(buf, NULL, BYTE_TRAIN);
 }
 
-void mmhal_wlan_register_spi_irq_handler(mmhal_irq_handler_t handler)
+/** SPI interrupt service routine. This counts the interrupt and passes it straight on. */
+static void IRAM_ATTR spi_irq_isr(void *arg)
 {
-    spi_irq_handler = handler;
-    gpio_isr_handler_add(CONFIG_MM_SPI_IRQ, (gpio_isr_t)spi_irq_handler, NULL);
-}
+    (void)arg;
 
-bool mmhal_wlan_spi_irq_is_asserted(void)
-{
-    return !gpio_get_level(CONFIG_MM_SPI_IRQ);
+    taskENTER_CRITICAL_ISR(&spi_stats_lock);
+    spi_stats.irq_isr_entries++;
+    taskEXIT_CRITICAL_ISR(&spi_stats_lock);
+
+    spi_irq_handler();
 }
 
 void mmhal_wlan_set_spi_irq_enabled(bool enabled)
 {
     if (enabled)
     {
+        /* This may be called from the interrupt handler as well as from a task. */
+        portENTER_CRITICAL_SAFE(&spi_stats_lock);
+        spi_stats.irq_rearms++;
+        portEXIT_CRITICAL_SAFE(&spi_stats_lock);
         gpio_set_intr_type(CONFIG_MM_SPI_IRQ, GPIO_INTR_LOW_LEVEL);
     }
     else
@@ -226,10 +912,22 @@ void mmhal_wlan_set_spi_irq_enabled(bool enabled)
     }
 }
 
+void mmhal_wlan_register_spi_irq_handler(mmhal_irq_handler_t handler)
+{
+    spi_irq_handler = handler;
+    gpio_isr_handler_add(CONFIG_MM_SPI_IRQ, spi_irq_isr, NULL);
+}
+
+bool mmhal_wlan_spi_irq_is_asserted(void)
+{
+    return !gpio_get_level(CONFIG_MM_SPI_IRQ);
+}
+
 void mmhal_wlan_init(void)
 {
     wlan_hal_gpio_init();
     wlan_hal_spi_init();
+    wlan_hal_spi_calibrate();
     /* Raise the RESET_N line to enable the WLAN transceiver. */
     gpio_set_level(CONFIG_MM_RESET_N, 1);
 }
@@ -270,6 +270,116 @@ void mmhal_wlan_spi_read_buf(uint8_t *buf, unsigned len);
  */
 void mmhal_wlan_spi_write_buf(const uint8_t *buf, unsigned len);
 
+/** A segment of a vectored SPI transfer. See @ref mmhal_wlan_spi_xfer_vec(). */
+struct mmhal_wlan_spi_seg
+{
+    /** Data to transmit, or @c NULL to transmit 0xff for the length of the segment. */
+    const uint8_t *tx;
+    /** Buffer to receive into, or @c NULL if the received data is not required. */
+    uint8_t *rx;
+    /** Length of the segment in octets. */
+    uint16_t len;
+};
+
+/**
+ * Simultaneously read and write a sequence of segments on the SPI bus.
+ *
+ * The segments are clocked out back to back, in order, as if they were a single buffer. This
+ * allows a complete protocol exchange (e.g., start token, data block, CRC16 and data response)
+ * to be executed as one transaction instead of a series of single octet transfers, each of
+ * which carries the fixed setup cost of the SPI peripheral.
+ *
+ * @param segs      Array of segments to transfer.
+ * @param num_segs  Number of entries in @p segs.
+ *
+ * @note Chip select is not modified by this function. The caller must assert it beforehand
+ *       and it remains asserted across all segments.
+ * @note Blocks until transfer complete.
+ */
+void mmhal_wlan_spi_xfer_vec(const struct mmhal_wlan_spi_seg *segs, unsigned num_segs);
+
+/** SPI transfer statistics. See @ref mmhal_wlan_spi_get_stats(). */
+struct mmhal_wlan_spi_stats
+{
+    /** SPI clock frequency in kHz. */
+    uint32_t clock_khz;
+    /** Number of SPI transactions executed. */
+    uint32_t transactions;
+    /** Number of octets transferred. */
+    uint64_t octets;
+    /** Time spent in the SPI transfer functions in microseconds. */
+    uint64_t active_us;
+    /** Number of @c transactions executed synchronously using the polling method. */
+    uint32_t poll_transactions;
+    /** Total duration of the polling transactions in microseconds. */
+    uint64_t poll_us;
+    /** Number of @c transactions executed synchronously using the interrupt based method. */
+    uint32_t interrupt_transactions;
+    /** Total duration of the interrupt based transactions in microseconds. */
+    uint64_t interrupt_us;
+    /**
+     * Number of @c transactions whose transmit buffer the SPI driver had to copy to a bounce
+     * buffer because it was not DMA-capable or not word aligned. This should be zero on the data
+     * path.
+     */
+    uint32_t tx_bounce_transactions;
+    /** Number of @c transactions whose receive buffer the SPI driver had to bounce-copy. */
+    uint32_t rx_bounce_transactions;
+    /** Current estimate of the fixed cost of a polling transaction in nanoseconds. */
+    uint32_t poll_overhead_ns;
+    /** Current estimate of the fixed cost of an interrupt based transaction in nanoseconds. */
+    uint32_t interrupt_overhead_ns;
+    /**
+     * Minimum transaction length in octets for which the interrupt based method is used. This is
+     * derived from the overhead estimates and the SPI clock. It is not reset.
+     */
+    uint32_t interrupt_min_length;
+    /**
+     * Bus utilisation in permille: the time required to clock @c octets at @c clock_khz as a
+     * fraction of @c active_us. The remainder is transaction setup and driver overhead.
+     */
+    uint16_t utilisation_permille;
+    /** Number of times the SPI interrupt service routine was entered. */
+    uint32_t irq_isr_entries;
+    /**
+     * Number of times the driver re-enabled the SPI interrupt. Dividing @c irq_isr_entries by
+     * the number of frames received over the same period (see
+     * @ref mmhal_wlan_pktmem_stats.rx_total) gives the interrupt cost per frame.
+     */
+    uint32_t irq_rearms;
+};
+
+/**
+ * Get SPI transfer statistics.
+ *
+ * Unlike the other functions in this group, this may be called by the application (e.g., to
+ * report bus utilisation during a throughput test).
+ *
+ * @param stats         Statistics structure to fill in.
+ * @param reset         If @c true then the statistics are reset after they have been read.
+ */
+void mmhal_wlan_spi_get_stats(struct mmhal_wlan_spi_stats *stats, bool reset);
+
+/**
+ * Enable or disable recording of SPI transactions and chip select windows to the SPI trace ring.
+ *
+ * Tracing is only available if the HAL was built with tracing support (@c CONFIG_MM_SPI_TRACE on
+ * ESP32), in which case it is enabled from start up. Otherwise this function has no effect. This
+ * may be called by the application.
+ *
+ * @param enable        @c true to enable recording, @c false to disable it.
+ */
+void mmhal_wlan_spi_trace_enable(bool enable);
+
+/**
+ * Print the contents of the SPI trace ring to the console, oldest entry first, and then empty it.
+ *
+ * Recording is suspended while the trace is printed. The output is intended to be captured from
+ * the console and processed by the host-side decoder (@c framework/tools/spi_trace.py), which
+ * produces a bus utilisation breakdown and a timeline. This may be called by the application.
+ */
+void mmhal_wlan_spi_trace_dump(void);
+
 /**
  * Hard reset the chip by asserting and then releasing the reset pin.
  *
@@ -424,6 +534,37 @@ struct mmpkt *mmhal_wlan_alloc_mmpkt_for_tx(uint8_t pkt_class,
  */
 struct mmpkt *mmhal_wlan_alloc_mmpkt_for_rx(uint32_t capacity, uint32_t metadata_length);
 
+/** Packet memory occupancy statistics, see @ref mmhal_wlan_pktmem_get_stats(). */
+struct mmhal_wlan_pktmem_stats
+{
+    /** Number of transmit data packets currently allocated. */
+    uint32_t tx_allocated;
+    /** Maximum number of transmit data packets allocated at once since the last peak reset. */
+    uint32_t tx_peak;
+    /** Maximum number of transmit data packets that can be allocated. */
+    uint32_t tx_capacity;
+    /** Number of receive packets currently allocated. */
+    uint32_t rx_allocated;
+    /** Maximum number of receive packets allocated at once since the last peak reset. */
+    uint32_t rx_peak;
+    /** Maximum number of receive packets that can be allocated. */
+    uint32_t rx_capacity;
+    /** Total number of receive packets allocated since initialization. This is not reset. */
+    uint32_t rx_total;
+};
+
+/**
+ * Get packet memory occupancy statistics.
+ *
+ * Unlike the other functions in this group, this may be called by the application (e.g., to
+ * report resource usage during a throughput test).
+ *
+ * @param stats         Statistics structure to fill in.
+ * @param reset_peak    If @c true then the peak values are reset to the current allocation
+ *                      counts after they have been read.
+ */
+void mmhal_wlan_pktmem_get_stats(struct mmhal_wlan_pktmem_stats *stats, bool reset_peak);
+
 /** @} */
 
 /**
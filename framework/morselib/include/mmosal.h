@@ -124,6 +124,22 @@ void *mmosal_realloc(void *ptr, size_t size);
  */
 void *mmosal_calloc(size_t nitems, size_t size);
 
+/** Heap usage statistics, see @ref mmosal_get_heap_stats(). */
+struct mmosal_heap_stats
+{
+    /** Total size of the heap in bytes. */
+    size_t total_size;
+    /** Number of bytes of the heap that are currently free. */
+    size_t free_size;
+};
+
+/**
+ * Get heap usage statistics.
+ *
+ * @param stats     Statistics structure to fill in.
+ */
+void mmosal_get_heap_stats(struct mmosal_heap_stats *stats);
+
 #ifndef MMOSAL_TRACK_ALLOCATIONS
 /**
  * Allocate memory of the given size and return a pointer to it (malloc).
@@ -309,6 +325,32 @@ void mmosal_enable_interrupts(void);
  */
 const char *mmosal_task_name(void);
 
+/** Maximum number of CPU cores reported in @ref mmosal_cpu_stats. */
+#define MMOSAL_MAX_CPU_CORES (2)
+
+/**
+ * CPU usage statistics, see @ref mmosal_get_cpu_stats().
+ *
+ * The times are free running counters in an implementation defined unit that wrap around, so
+ * utilisation should be calculated from the (unsigned) differences between two samples.
+ */
+struct mmosal_cpu_stats
+{
+    /** Number of CPU cores reported, or zero if CPU usage statistics are not available. */
+    uint8_t num_cores;
+    /** Elapsed run time. */
+    uint32_t run_time;
+    /** Time that each core has spent running its idle task. */
+    uint32_t idle_time[MMOSAL_MAX_CPU_CORES];
+};
+
+/**
+ * Get CPU usage statistics.
+ *
+ * @param stats     Statistics structure to fill in.
+ */
+void mmosal_get_cpu_stats(struct mmosal_cpu_stats *stats);
+
 /**
  * Blocks the current task until a notification is received.
  *
@@ -676,6 +718,16 @@ bool mmosal_queue_push_from_isr(struct mmosal_queue *queue, const void *item);
  */
 uint32_t mmosal_get_time_ms(void);
 
+/**
+ * Get the system time in microseconds.
+ *
+ * This is intended for fine-grained time measurement. It is a monotonic counter but does not
+ * necessarily have the same epoch as @ref mmosal_get_time_ms().
+ *
+ * @returns the system time in microseconds.
+ */
+uint64_t mmosal_get_time_us(void);
+
 /**
  * Get the system time in ticks.
  *
@@ -0,0 +1,1775 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * iperf3 compatibility mode.
+ *
+ * This implements enough of the iperf3 protocol to interoperate with a stock iperf3 client or
+ * server: the TCP control channel with its cookie and state bytes, the JSON parameter exchange,
+ * TCP and UDP data streams (including parallel streams and reverse tests) and the exchange of
+ * results at the end of the test.
+ *
+ * Each test is run from a single task using the socket API in mmiperf3_private.h, which is
+ * implemented for each IP stack.
+ */
+
+#include <endian.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmhal.h"
+#include "mmiperf3_private.h"
+#include "mmutils.h"
+
+/** iperf3 control channel states. These are sent over the control channel as a signed byte. */
+enum iperf3_ctrl_state
+{
+    IPERF3_TEST_START = 1,
+    IPERF3_TEST_RUNNING = 2,
+    IPERF3_TEST_END = 4,
+    IPERF3_PARAM_EXCHANGE = 9,
+    IPERF3_CREATE_STREAMS = 10,
+    IPERF3_SERVER_TERMINATE = 11,
+    IPERF3_CLIENT_TERMINATE = 12,
+    IPERF3_EXCHANGE_RESULTS = 13,
+    IPERF3_DISPLAY_RESULTS = 14,
+    IPERF3_IPERF_START = 15,
+    IPERF3_IPERF_DONE = 16,
+    IPERF3_ACCESS_DENIED = -1,
+    IPERF3_SERVER_ERROR = -2,
+};
+
+/** Message sent by the client to set up a UDP stream. */
+#define IPERF3_UDP_CONNECT_MSG              (0x36373839)
+/** Reply sent by the server to set up a UDP stream. */
+#define IPERF3_UDP_CONNECT_REPLY            (0x39383736)
+/** Reply sent by the server to set up a UDP stream (iperf3 versions before 3.10). */
+#define IPERF3_LEGACY_UDP_CONNECT_REPLY     (987654321)
+
+/** iperf3 error code sent with @c IPERF3_SERVER_ERROR when too many streams are requested. */
+#define IPERF3_IENUMSTREAMS                 (6)
+
+/** Maximum length of JSON message we accept from the remote end. */
+#define IPERF3_JSON_MAX_LEN                 (4096)
+/** Length of the buffer used to build the test parameters message. */
+#define IPERF3_PARAMS_JSON_LEN              (256)
+/** Length of the buffer used to build the results message. */
+#define IPERF3_RESULTS_JSON_LEN             (192 + (160 * MMIPERF_MAX_STREAMS))
+
+/** Characters used in the iperf3 cookie. */
+static const char iperf3_cookie_chars[] = "abcdefghijklmnopqrstuvwxyz234567";
+
+/** Header at the start of each iperf3 UDP datagram (using 32-bit packet counters). */
+struct MM_PACKED iperf3_udp_header
+{
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+    uint32_t pcount;
+};
+
+/** Parameters of an iperf3 test, as exchanged over the control channel. */
+struct iperf3_params
+{
+    /** @c true for a UDP test, @c false for a TCP test. */
+    bool udp;
+    /** @c true if the server sends and the client receives. */
+    bool reverse;
+    /** @c true if both ends send at the same time. */
+    bool bidirectional;
+    /** Duration of the test in seconds (zero if limited by @c num_bytes). */
+    uint32_t time_s;
+    /** Number of bytes to transfer (zero if limited by @c time_s). */
+    uint64_t num_bytes;
+    /** Number of parallel streams. */
+    uint32_t parallel;
+    /** Length of each block (TCP) or datagram (UDP). */
+    uint32_t len;
+    /** Target bandwidth in bits per second (zero for no limit). */
+    uint64_t bandwidth_bps;
+};
+
+/** State of a single iperf3 data stream. */
+struct iperf3_stream
+{
+    /** Statistics for the stream. This is the handle of a single stream test. */
+    struct mmiperf_state base;
+    /** Socket for the stream, or @c NULL if not yet connected. */
+    struct iperf3_sock *sock;
+    /** iperf3 stream ID, which is used to match up results at the end of the test. */
+    uint32_t id;
+    /** Set if the remote end closed the stream. */
+    bool closed;
+    /** UDP packet counter: last packet sent, or highest packet received. */
+    uint32_t packet_count;
+    /** Set once @c prev_transit_us is valid. */
+    bool have_transit;
+    /** UDP transit time of the previous packet received. */
+    int64_t prev_transit_us;
+    /** UDP jitter (smoothed as per RFC 1889). */
+    uint32_t jitter_us;
+    /** End time of current bandwidth limit pacing interval. */
+    uint32_t block_end_time;
+    /** Number of bytes that may still be sent under the bandwidth limit. */
+    uint32_t block_remaining_len;
+    /** Set if results for this stream were received from the remote end. */
+    bool have_remote_results;
+    /** Number of bytes reported by the remote end. */
+    uint64_t remote_bytes;
+    /** Number of packets reported by the remote end (UDP only). */
+    uint32_t remote_packets;
+    /** Number of lost packets reported by the remote end (UDP only). */
+    uint32_t remote_errors;
+    /** Jitter reported by the remote end (UDP only). */
+    uint32_t remote_jitter_us;
+};
+
+/** State of an iperf3 test. */
+struct iperf3_test
+{
+    /** Parameters of the test. */
+    struct iperf3_params params;
+    /** Control channel socket. */
+    struct iperf3_sock *ctrl;
+    /** Cookie identifying the test. */
+    char cookie[IPERF3_COOKIE_SIZE];
+    /** @c true if this end is the server. */
+    bool server;
+    /** @c true if this end sends the data. */
+    bool sender;
+    /** Number of streams in the test. */
+    uint32_t num_streams;
+    /** The streams of the test. */
+    struct iperf3_stream *streams[MMIPERF_MAX_STREAMS];
+    /** Aggregate of the streams for a parallel test, else @c NULL. */
+    struct iperf_stream_group *group;
+    /** Time at which the data transfer started. */
+    uint32_t start_time_ms;
+    /** Duration of the data transfer. */
+    uint32_t duration_ms;
+    /** Buffer used for transmitting (UDP) and receiving data. */
+    uint8_t *buf;
+    /** Length of @c buf. */
+    uint32_t buf_len;
+    /** Source of the payload data sent (client only, the server sends the default data). */
+    struct iperf_payload_source payload;
+    /** If not @c NULL, the test is terminated once this is set (server only). */
+    const volatile bool *stop;
+};
+
+/** State of an iperf3 client. */
+struct iperf3_client
+{
+    struct iperf3_test test;
+    struct mmiperf_client_args args;
+};
+
+/** State of an iperf3 server. */
+struct iperf3_server
+{
+    /** Handle of the server. */
+    struct mmiperf_state base;
+    struct mmiperf_server_args args;
+    /** Socket listening for control and TCP data connections. */
+    struct iperf3_sock *listener;
+    /** Set by @ref mmiperf_stop_server() to stop the server. */
+    volatile bool stop;
+};
+
+/*
+ * ---------------------------------------------------------------------------------------------
+ * JSON helpers.
+ *
+ * These only handle the subset of JSON that is used by iperf3 for parameters and results.
+ * ---------------------------------------------------------------------------------------------
+ */
+
+/** Skip whitespace in a JSON string. */
+static const char *iperf3_json_skip_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    {
+        p++;
+    }
+    return p;
+}
+
+/** Skip over a JSON string, where @p p points to the opening quote. */
+static const char *iperf3_json_skip_string(const char *p, const char *end)
+{
+    for (p++; p < end && *p != '"'; p++)
+    {
+        if (*p == '\\')
+        {
+            p++;
+        }
+    }
+    return (p < end) ? p + 1 : end;
+}
+
+/** Skip over a JSON object or array, where @p p points to the opening bracket. */
+static const char *iperf3_json_skip_container(const char *p, const char *end)
+{
+    unsigned depth = 0;
+
+    while (p < end)
+    {
+        if (*p == '"')
+        {
+            p = iperf3_json_skip_string(p, end);
+            continue;
+        }
+        if (*p == '{' || *p == '[')
+        {
+            depth++;
+        }
+        else if (*p == '}' || *p == ']')
+        {
+            if (--depth == 0)
+            {
+                return p + 1;
+            }
+        }
+        p++;
+    }
+    return end;
+}
+
+/**
+ * Find the value of the given key in a JSON object.
+ *
+ * @param start     Start of the JSON object.
+ * @param end       End of the JSON object.
+ * @param key       The key to look for.
+ *
+ * @returns a pointer to the value on success, else @c NULL.
+ */
+static const char *iperf3_json_find(const char *start, const char *end, const char *key)
+{
+    size_t key_len = strlen(key);
+    const char *p = start;
+
+    while (p < end)
+    {
+        if (*p != '"')
+        {
+            p++;
+            continue;
+        }
+
+        if ((size_t)(end - p) > key_len + 1 &&
+            memcmp(p + 1, key, key_len) == 0 && p[key_len + 1] == '"')
+        {
+            const char *value = iperf3_json_skip_ws(p + key_len + 2, end);
+            if (value < end && *value == ':')
+            {
+                return iperf3_json_skip_ws(value + 1, end);
+            }
+        }
+        p = iperf3_json_skip_string(p, end);
+    }
+    return NULL;
+}
+
+/**
+ * Get the value of a number or boolean in a JSON object. Any fractional part of a number is
+ * discarded.
+ *
+ * @param start     Start of the JSON object.
+ * @param end       End of the JSON object.
+ * @param key       The key to look for.
+ * @param value     Receives the value (booleans are returned as 0 or 1).
+ *
+ * @returns @c true on success, else @c false.
+ */
+static bool iperf3_json_get_int(const char *start, const char *end, const char *key,
+                                int64_t *value)
+{
+    const char *p = iperf3_json_find(start, end, key);
+    bool negative = false;
+    bool have_digits = false;
+    int64_t result = 0;
+
+    if (p == NULL)
+    {
+        return false;
+    }
+
+    if ((end - p) >= 4 && memcmp(p, "true", 4) == 0)
+    {
+        *value = 1;
+        return true;
+    }
+    if ((end - p) >= 5 && memcmp(p, "false", 5) == 0)
+    {
+        *value = 0;
+        return true;
+    }
+
+    if (p < end && *p == '-')
+    {
+        negative = true;
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        result = (result * 10) + (*p - '0');
+        have_digits = true;
+        p++;
+    }
+    if (!have_digits)
+    {
+        return false;
+    }
+
+    *value = negative ? -result : result;
+    return true;
+}
+
+/**
+ * Get the value of a non-negative number of seconds in a JSON object, in microseconds. Digits
+ * beyond microsecond precision are discarded.
+ *
+ * @param start     Start of the JSON object.
+ * @param end       End of the JSON object.
+ * @param key       The key to look for.
+ * @param value_us  Receives the value.
+ *
+ * @returns @c true on success, else @c false.
+ */
+static bool iperf3_json_get_us(const char *start, const char *end, const char *key,
+                               uint32_t *value_us)
+{
+    const char *p = iperf3_json_find(start, end, key);
+    uint64_t result = 0;
+    uint32_t scale = 1000000;
+
+    if (p == NULL || p >= end || *p < '0' || *p > '9')
+    {
+        return false;
+    }
+
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        result = (result * 10) + (*p - '0');
+        p++;
+    }
+    result *= scale;
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9' && scale > 1; p++)
+        {
+            scale /= 10;
+            result += (uint64_t)(*p - '0') * scale;
+        }
+    }
+
+    *value_us = (uint32_t)MM_MIN(result, UINT32_MAX);
+    return true;
+}
+
+/**
+ * Build the JSON test parameters message sent by the client.
+ *
+ * @param params    The test parameters.
+ * @param buf       Buffer to write the message to.
+ * @param buf_len   Length of @p buf.
+ *
+ * @returns the length of the message.
+ */
+static int iperf3_format_params(const struct iperf3_params *params, char *buf, size_t buf_len)
+{
+    return snprintf(buf, buf_len,
+                    "{\"%s\":true,\"omit\":0,\"time\":%" PRIu32 ",\"num\":%" PRIu64
+                    ",\"blockcount\":0,\"parallel\":%" PRIu32 ",\"len\":%" PRIu32
+                    ",\"bandwidth\":%" PRIu64 "%s}",
+                    params->udp ? "udp" : "tcp", params->time_s, params->num_bytes,
+                    params->parallel, params->len, params->bandwidth_bps,
+                    params->reverse ? ",\"reverse\":true" : "");
+}
+
+/**
+ * Parse the JSON test parameters message received by the server.
+ *
+ * @param json      The message.
+ * @param len       Length of the message.
+ * @param params    Receives the test parameters.
+ */
+static void iperf3_parse_params(const char *json, size_t len, struct iperf3_params *params)
+{
+    const char *end = json + len;
+    int64_t value;
+
+    memset(params, 0, sizeof(*params));
+    params->parallel = 1;
+
+    if (iperf3_json_get_int(json, end, "udp", &value))
+    {
+        params->udp = (value != 0);
+    }
+    if (iperf3_json_get_int(json, end, "reverse", &value))
+    {
+        params->reverse = (value != 0);
+    }
+    if (iperf3_json_get_int(json, end, "bidirectional", &value))
+    {
+        params->bidirectional = (value != 0);
+    }
+    if (iperf3_json_get_int(json, end, "time", &value) && value > 0)
+    {
+        params->time_s = (uint32_t)value;
+    }
+    if (iperf3_json_get_int(json, end, "num", &value) && value > 0)
+    {
+        params->num_bytes = (uint64_t)value;
+    }
+    if (iperf3_json_get_int(json, end, "parallel", &value) && value > 0)
+    {
+        params->parallel = (uint32_t)value;
+    }
+    if (iperf3_json_get_int(json, end, "len", &value) && value > 0)
+    {
+        params->len = (uint32_t)value;
+    }
+    if (iperf3_json_get_int(json, end, "bandwidth", &value) && value > 0)
+    {
+        params->bandwidth_bps = (uint64_t)value;
+    }
+}
+
+/**
+ * Build the JSON results message for this end of the test.
+ *
+ * @param test      The test.
+ * @param buf       Buffer to write the message to.
+ * @param buf_len   Length of @p buf.
+ *
+ * @returns the length of the message, or a negative number if it did not fit.
+ */
+static int iperf3_format_results(const struct iperf3_test *test, char *buf, size_t buf_len)
+{
+    uint32_t ii;
+    int len;
+
+    len = snprintf(buf, buf_len,
+                   "{\"cpu_util_total\":0,\"cpu_util_user\":0,\"cpu_util_system\":0,"
+                   "\"sender_has_retransmits\":%d,\"streams\":[",
+                   test->sender ? 0 : -1);
+
+    for (ii = 0; ii < test->num_streams && len > 0 && (size_t)len < buf_len; ii++)
+    {
+        const struct iperf3_stream *stream = test->streams[ii];
+        const struct mmiperf_report *report = &stream->base.report;
+
+        len += snprintf(buf + len, buf_len - len,
+                        "%s{\"id\":%" PRIu32 ",\"bytes\":%" PRIu64 ",\"retransmits\":%d,"
+                        "\"jitter\":%" PRIu32 ".%06" PRIu32 ",\"errors\":%" PRIu32
+                        ",\"packets\":%" PRIu32 ",\"start_time\":0,"
+                        "\"end_time\":%" PRIu32 ".%03" PRIu32 "}",
+                        (ii == 0) ? "" : ",", stream->id, report->bytes_transferred,
+                        test->sender ? 0 : -1,
+                        stream->jitter_us / 1000000, stream->jitter_us % 1000000,
+                        test->sender ? 0 : report->error_count,
+                        test->sender ? report->tx_frames : stream->packet_count,
+                        test->duration_ms / 1000, test->duration_ms % 1000);
+    }
+
+    if (len > 0 && (size_t)len < buf_len)
+    {
+        len += snprintf(buf + len, buf_len - len, "]}");
+    }
+    if (len < 0 || (size_t)len >= buf_len)
+    {
+        return -1;
+    }
+    return len;
+}
+
+/**
+ * Parse the JSON results message received from the remote end of the test.
+ *
+ * @param test      The test.
+ * @param json      The message.
+ * @param len       Length of the message.
+ *
+ * @returns @c true on success, else @c false.
+ */
+static bool iperf3_parse_results(struct iperf3_test *test, const char *json, size_t len)
+{
+    const char *end = json + len;
+    const char *p = iperf3_json_find(json, end, "streams");
+
+    if (p == NULL || *p != '[')
+    {
+        return false;
+    }
+
+    for (p++; p < end; )
+    {
+        const char *obj_end;
+        int64_t id;
+        int64_t value;
+        uint32_t ii;
+
+        p = iperf3_json_skip_ws(p, end);
+        if (p < end && *p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (p >= end || *p != '{')
+        {
+            break;
+        }
+
+        obj_end = iperf3_json_skip_container(p, end);
+        if (iperf3_json_get_int(p, obj_end, "id", &id))
+        {
+            for (ii = 0; ii < test->num_streams; ii++)
+            {
+                struct iperf3_stream *stream = test->streams[ii];
+                if (stream->id != id)
+                {
+                    continue;
+                }
+
+                stream->have_remote_results = true;
+                if (iperf3_json_get_int(p, obj_end, "bytes", &value) && value > 0)
+                {
+                    stream->remote_bytes = (uint64_t)value;
+                }
+                if (iperf3_json_get_int(p, obj_end, "packets", &value) && value > 0)
+                {
+                    stream->remote_packets = (uint32_t)value;
+                }
+                if (iperf3_json_get_int(p, obj_end, "errors", &value) && value > 0)
+                {
+                    stream->remote_errors = (uint32_t)value;
+                }
+                (void)iperf3_json_get_us(p, obj_end, "jitter", &stream->remote_jitter_us);
+            }
+        }
+        p = obj_end;
+    }
+
+    return true;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------
+ * Control channel helpers.
+ * ---------------------------------------------------------------------------------------------
+ */
+
+/** Send all of the given data on a socket. Returns 0 on success, else -1. */
+static int iperf3_send_all(struct iperf3_sock *sock, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+
+    while (len > 0)
+    {
+        int ret = iperf3_sock_send(sock, p, len, IPERF3_CTRL_TIMEOUT_MS);
+        if (ret <= 0)
+        {
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/** Receive exactly the given amount of data from a socket. Returns 0 on success, else -1. */
+static int iperf3_recv_all(struct iperf3_sock *sock, void *buf, size_t len, uint32_t timeout_ms)
+{
+    uint8_t *p = (uint8_t *)buf;
+    uint32_t deadline = mmosal_get_time_ms() + timeout_ms;
+
+    while (len > 0)
+    {
+        int32_t remaining_ms = (int32_t)(deadline - mmosal_get_time_ms());
+        int ret;
+
+        if (remaining_ms <= 0)
+        {
+            return -1;
+        }
+        ret = iperf3_sock_recv(sock, p, len, remaining_ms);
+        if (ret < 0)
+        {
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/** Send a state byte on the control channel. Returns 0 on success, else -1. */
+static int iperf3_send_state(struct iperf3_test *test, int8_t state)
+{
+    return iperf3_send_all(test->ctrl, &state, sizeof(state));
+}
+
+/** Receive a state byte from the control channel. Returns 0 on success, else -1. */
+static int iperf3_recv_state(struct iperf3_test *test, int8_t *state)
+{
+    return iperf3_recv_all(test->ctrl, state, sizeof(*state), IPERF3_CTRL_TIMEOUT_MS);
+}
+
+/** Send a JSON message on the control channel. Returns 0 on success, else -1. */
+static int iperf3_send_json(struct iperf3_test *test, const char *json, size_t len)
+{
+    uint32_t len_be = htobe32(len);
+
+    if (iperf3_send_all(test->ctrl, &len_be, sizeof(len_be)) != 0)
+    {
+        return -1;
+    }
+    return iperf3_send_all(test->ctrl, json, len);
+}
+
+/**
+ * Receive a JSON message from the control channel.
+ *
+ * @param test      The test.
+ * @param len       Receives the length of the message.
+ *
+ * @returns the null-terminated message on success (which must be freed with @c mmosal_free()),
+ *          else @c NULL.
+ */
+static char *iperf3_recv_json(struct iperf3_test *test, size_t *len)
+{
+    uint32_t len_be;
+    char *json;
+
+    if (iperf3_recv_all(test->ctrl, &len_be, sizeof(len_be), IPERF3_CTRL_TIMEOUT_MS) != 0)
+    {
+        return NULL;
+    }
+
+    *len = be32toh(len_be);
+    if (*len == 0 || *len > IPERF3_JSON_MAX_LEN)
+    {
+        iperf3_log("iperf3: invalid JSON length %u\n", (unsigned)*len);
+        return NULL;
+    }
+
+    json = (char *)mmosal_malloc(*len + 1);
+    if (json == NULL)
+    {
+        return NULL;
+    }
+
+    if (iperf3_recv_all(test->ctrl, json, *len, IPERF3_CTRL_TIMEOUT_MS) != 0)
+    {
+        mmosal_free(json);
+        return NULL;
+    }
+    json[*len] = '\0';
+    return json;
+}
+
+/** Send our results and receive the results of the remote end. Returns 0 on success. */
+static int iperf3_exchange_results(struct iperf3_test *test)
+{
+    char *json;
+    size_t len;
+    int ret = -1;
+
+    json = (char *)mmosal_malloc(IPERF3_RESULTS_JSON_LEN);
+    if (json == NULL)
+    {
+        return -1;
+    }
+
+    int results_len = iperf3_format_results(test, json, IPERF3_RESULTS_JSON_LEN);
+    if (results_len < 0)
+    {
+        mmosal_free(json);
+        return -1;
+    }
+
+    /* The client sends its results first. */
+    if (!test->server)
+    {
+        ret = iperf3_send_json(test, json, results_len);
+        if (ret != 0)
+        {
+            mmosal_free(json);
+            return ret;
+        }
+    }
+
+    char *remote_json = iperf3_recv_json(test, &len);
+    if (remote_json == NULL)
+    {
+        mmosal_free(json);
+        return -1;
+    }
+    if (!iperf3_parse_results(test, remote_json, len))
+    {
+        iperf3_log("iperf3: failed to parse results\n");
+    }
+    mmosal_free(remote_json);
+
+    ret = 0;
+    if (test->server)
+    {
+        ret = iperf3_send_json(test, json, results_len);
+    }
+    mmosal_free(json);
+    return ret;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------
+ * Data transfer.
+ * ---------------------------------------------------------------------------------------------
+ */
+
+/** Allocate the streams of a test. Returns 0 on success, else -1. */
+static int iperf3_alloc_streams(struct iperf3_test *test, uint32_t num_streams,
+                                const struct mmiperf_client_args *report_args)
+{
+    uint32_t ii;
+
+    if (num_streams > 1)
+    {
+        test->group = iperf_stream_group_alloc(!test->params.udp, report_args);
+        if (test->group == NULL)
+        {
+            return -1;
+        }
+        test->group->base.server = test->server;
+    }
+
+    for (ii = 0; ii < num_streams; ii++)
+    {
+        struct iperf3_stream *stream =
+            (struct iperf3_stream *)IPERF_ALLOC(struct iperf3_stream);
+        if (stream == NULL)
+        {
+            return -1;
+        }
+
+        memset(stream, 0, sizeof(*stream));
+        stream->base.tcp = !test->params.udp;
+        stream->base.server = test->server;
+        stream->base.report_fn = report_args->report_fn;
+        stream->base.report_arg = report_args->report_arg;
+        stream->base.time_started_ms = mmosal_get_time_ms();
+        iperf_resource_start(&stream->base);
+        stream->base.report.report_type = MMIPERF_INTERRIM_REPORT;
+        /* iperf3 numbers its streams 1, 3, 4, 5, ... */
+        stream->id = (ii == 0) ? 1 : ii + 2;
+        test->streams[ii] = stream;
+        test->num_streams++;
+
+        if (test->group != NULL)
+        {
+            iperf_stream_group_add(test->group, &stream->base);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Register the streams of a test so that interim reports can be retrieved.
+ *
+ * @returns @c true on success, or @c false (with no streams registered) if there are too many
+ *          iperf sessions.
+ */
+static bool iperf3_list_add_streams(struct iperf3_test *test)
+{
+    uint32_t ii;
+    bool ok = true;
+
+    for (ii = 0; ii < test->num_streams && ok; ii++)
+    {
+        ok = iperf_list_add(&test->streams[ii]->base);
+    }
+    if (ok && test->group != NULL)
+    {
+        ok = iperf_list_add(&test->group->base);
+    }
+    if (ok)
+    {
+        return true;
+    }
+
+    iperf3_log("iperf3: too many iperf sessions\n");
+    for (ii = 0; ii < test->num_streams; ii++)
+    {
+        iperf_list_remove(&test->streams[ii]->base);
+    }
+    return false;
+}
+
+/**
+ * Release the resources of a test, invoking the report callback for each stream (and the
+ * aggregate of a parallel test) if the streams have been registered.
+ */
+static void iperf3_finish_test(struct iperf3_test *test, bool report,
+                               enum mmiperf_report_type report_type)
+{
+    uint32_t ii;
+
+    if (test->duration_ms == 0 && test->start_time_ms != 0)
+    {
+        test->duration_ms = mmosal_get_time_ms() - test->start_time_ms;
+    }
+
+    for (ii = 0; ii < test->num_streams; ii++)
+    {
+        struct iperf3_stream *stream = test->streams[ii];
+        struct mmiperf_report *stream_report = &stream->base.report;
+
+        iperf3_sock_close(stream->sock);
+        stream->sock = NULL;
+
+        if (report)
+        {
+            if (test->params.udp && test->sender && stream->have_remote_results)
+            {
+                /* Report what actually arrived at the receiver. */
+                stream_report->bytes_transferred = stream->remote_bytes;
+                stream_report->error_count = stream->remote_errors;
+                stream_report->rx_frames = (stream->remote_packets > stream->remote_errors) ?
+                    stream->remote_packets - stream->remote_errors : 0;
+                stream_report->jitter_us = stream->remote_jitter_us;
+            }
+            else if (test->params.udp && !test->sender)
+            {
+                stream_report->jitter_us = stream->jitter_us;
+            }
+            iperf_list_remove(&stream->base);
+            iperf_finalize_report_and_invoke_callback(&stream->base, test->duration_ms,
+                                                      report_type);
+        }
+        IPERF_FREE(struct iperf3_stream, stream);
+        test->streams[ii] = NULL;
+    }
+
+    if (!report && test->group != NULL)
+    {
+        /* The group is otherwise freed when its last stream is finalized. */
+        IPERF_FREE(struct iperf_stream_group, test->group);
+    }
+    test->group = NULL;
+    test->num_streams = 0;
+
+    iperf3_sock_close(test->ctrl);
+    test->ctrl = NULL;
+
+    if (test->buf != NULL)
+    {
+        mmosal_free(test->buf);
+        test->buf = NULL;
+    }
+}
+
+/** Allocate the data buffer for a test. Returns 0 on success, else -1. */
+static int iperf3_alloc_buf(struct iperf3_test *test)
+{
+    uint32_t ii;
+
+    test->buf_len = test->params.udp ? test->params.len : IPERF3_TCP_BLOCK_LEN;
+    test->buf = (uint8_t *)mmosal_malloc(test->buf_len);
+    if (test->buf == NULL)
+    {
+        return -1;
+    }
+
+    /* The payload of UDP datagrams is filled in once and reused for every datagram. */
+    for (ii = 0; ii < test->buf_len; ii += 10)
+    {
+        memcpy(test->buf + ii, iperf_get_data(0), MM_MIN(10, test->buf_len - ii));
+    }
+    return 0;
+}
+
+/**
+ * Check whether a bandwidth limited stream may send the given amount of data.
+ *
+ * The allowance is topped up every @c IPERF3_PACING_INTERVAL_MS rather than once per
+ * @c BLOCK_DURATION_MS, since sending a whole block back to back overflows the receive buffers
+ * of the remote end. Unused allowance carries over (up to one interval plus one datagram) so
+ * that rates below one datagram per interval are still met.
+ */
+static bool iperf3_stream_may_send(struct iperf3_test *test, struct iperf3_stream *stream,
+                                   uint32_t len)
+{
+    uint32_t interval_len;
+
+    if (test->params.bandwidth_bps == 0)
+    {
+        return true;
+    }
+
+    interval_len = (uint32_t)(test->params.bandwidth_bps * IPERF3_PACING_INTERVAL_MS / 8000);
+    interval_len = MM_MAX(interval_len, 1);
+    if (mmosal_time_has_passed(stream->block_end_time))
+    {
+        stream->block_end_time += IPERF3_PACING_INTERVAL_MS;
+        stream->block_remaining_len = MM_MIN(stream->block_remaining_len + interval_len,
+                                             interval_len + len);
+    }
+    return stream->block_remaining_len >= len;
+}
+
+/**
+ * Send the next block or datagram on a stream.
+ *
+ * @returns the number of bytes sent, zero if nothing could be sent, or a negative number on error.
+ */
+static int iperf3_stream_send(struct iperf3_test *test, struct iperf3_stream *stream,
+                              uint32_t timeout_ms)
+{
+    struct mmiperf_report *report = &stream->base.report;
+    uint32_t len = test->params.udp ? test->params.len : IPERF3_TCP_BLOCK_LEN;
+    int ret;
+
+    if (!iperf3_stream_may_send(test, stream, len))
+    {
+        return 0;
+    }
+
+    if (test->params.udp)
+    {
+        struct iperf3_udp_header *hdr = (struct iperf3_udp_header *)test->buf;
+        uint64_t now_us = iperf_get_time_us();
+
+        hdr->tv_sec = htobe32(now_us / 1000000);
+        hdr->tv_usec = htobe32(now_us % 1000000);
+        hdr->pcount = htobe32(stream->packet_count + 1);
+        if (!iperf_payload_is_default(&test->payload))
+        {
+            /* Application payload continues from one datagram to the next. */
+            iperf_payload_copy(&test->payload, stream->packet_count * (len - sizeof(*hdr)),
+                               test->buf + sizeof(*hdr), len - sizeof(*hdr));
+        }
+
+        ret = iperf3_sock_send(stream->sock, test->buf, len, timeout_ms);
+        if (ret > 0)
+        {
+            stream->packet_count++;
+            report->tx_frames++;
+        }
+    }
+    else
+    {
+        uint32_t avail;
+        const uint8_t *data = iperf_payload_get(&test->payload, report->bytes_transferred, len,
+                                                &avail);
+        if (data == NULL)
+        {
+            iperf_payload_copy(&test->payload, report->bytes_transferred, test->buf, len);
+            data = test->buf;
+            avail = len;
+        }
+        ret = iperf3_sock_send(stream->sock, data, avail, timeout_ms);
+    }
+
+    if (ret > 0)
+    {
+        report->bytes_transferred += ret;
+        stream->block_remaining_len -= MM_MIN((uint32_t)ret, stream->block_remaining_len);
+    }
+    return ret;
+}
+
+/** Update the UDP statistics of a stream for a received datagram. */
+static void iperf3_stream_rx_udp(struct iperf3_stream *stream, const uint8_t *buf, int len)
+{
+    const struct iperf3_udp_header *hdr = (const struct iperf3_udp_header *)buf;
+    struct mmiperf_report *report = &stream->base.report;
+    uint32_t pcount;
+    int64_t sent_us;
+    int64_t transit_us;
+
+    if (len < (int)sizeof(*hdr))
+    {
+        return;
+    }
+
+    report->rx_frames++;
+
+    pcount = be32toh(hdr->pcount);
+    if (pcount >= stream->packet_count + 1)
+    {
+        /* Any gap in the packet counter is counted as lost packets. */
+        report->error_count += pcount - (stream->packet_count + 1);
+        stream->packet_count = pcount;
+    }
+    else
+    {
+        /* A late packet that we previously counted as lost. */
+        report->out_of_sequence_frames++;
+        if (report->error_count > 0)
+        {
+            report->error_count--;
+        }
+    }
+
+    sent_us = (int64_t)be32toh(hdr->tv_sec) * 1000000 + be32toh(hdr->tv_usec);
+    transit_us = (int64_t)iperf_get_time_us() - sent_us;
+    if (stream->have_transit)
+    {
+        int64_t delta_us = transit_us - stream->prev_transit_us;
+        if (delta_us < 0)
+        {
+            delta_us = -delta_us;
+        }
+        stream->jitter_us += (int32_t)(delta_us - stream->jitter_us) / 16;
+    }
+    stream->prev_transit_us = transit_us;
+    stream->have_transit = true;
+}
+
+/**
+ * Receive the next block or datagram on a stream.
+ *
+ * @returns the number of bytes received, zero if nothing was received, or a negative number if
+ *          the stream was closed.
+ */
+static int iperf3_stream_recv(struct iperf3_test *test, struct iperf3_stream *stream,
+                              uint32_t timeout_ms)
+{
+    int ret = iperf3_sock_recv(stream->sock, test->buf, test->buf_len, timeout_ms);
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    stream->base.report.bytes_transferred += ret;
+    stream->base.last_rx_time_ms = mmosal_get_time_ms();
+    if (test->params.udp)
+    {
+        iperf3_stream_rx_udp(stream, test->buf, ret);
+    }
+    return ret;
+}
+
+/** Check whether the test duration has elapsed or the requested amount has been transferred. */
+static bool iperf3_test_done(struct iperf3_test *test)
+{
+    uint64_t total_bytes = 0;
+    uint32_t last_rx_time_ms = test->start_time_ms;
+    uint32_t ii;
+
+    if (test->params.num_bytes == 0)
+    {
+        return mmosal_time_has_passed(test->start_time_ms + test->params.time_s * 1000);
+    }
+
+    for (ii = 0; ii < test->num_streams; ii++)
+    {
+        const struct iperf3_stream *stream = test->streams[ii];
+
+        total_bytes += stream->base.report.bytes_transferred;
+        if ((int32_t)(stream->base.last_rx_time_ms - last_rx_time_ms) > 0)
+        {
+            last_rx_time_ms = stream->base.last_rx_time_ms;
+        }
+    }
+    if (total_bytes >= test->params.num_bytes)
+    {
+        return true;
+    }
+
+    /* A receiving client never gets the full amount if UDP datagrams are lost, so it ends the
+     * test once the server has stopped sending. */
+    return !test->server && !test->sender &&
+           mmosal_time_has_passed(last_rx_time_ms + IPERF3_CLIENT_RX_IDLE_MS);
+}
+
+/**
+ * Run the data transfer phase of a test. For the client this finishes once the test duration
+ * (or amount) is reached; for the server this finishes when the client says the test is over.
+ *
+ * @returns 0 on success, else -1.
+ */
+static int iperf3_run_test(struct iperf3_test *test)
+{
+    uint32_t ii;
+    uint32_t next_ctrl_poll_time;
+    uint32_t timeout_time = 0;
+    /* If there is only one stream we can afford to block on it. */
+    uint32_t wait_ms = (test->num_streams == 1) ? IPERF3_DATA_WAIT_MS : 0;
+
+    test->start_time_ms = mmosal_get_time_ms();
+    next_ctrl_poll_time = test->start_time_ms + IPERF3_CTRL_POLL_INTERVAL_MS;
+    if (test->server && test->params.time_s != 0)
+    {
+        /* Give up if the client does not end the test in a reasonable time. */
+        timeout_time = test->start_time_ms + test->params.time_s * 1000 + IPERF3_CTRL_TIMEOUT_MS;
+    }
+
+    for (ii = 0; ii < test->num_streams; ii++)
+    {
+        struct iperf3_stream *stream = test->streams[ii];
+        stream->base.time_started_ms = test->start_time_ms;
+        iperf_resource_start(&stream->base);
+        stream->block_end_time = test->start_time_ms;
+    }
+
+    while (true)
+    {
+        bool progress = false;
+        bool done = iperf3_test_done(test);
+
+        if (!test->server && done)
+        {
+            test->duration_ms = mmosal_get_time_ms() - test->start_time_ms;
+            return iperf3_send_state(test, IPERF3_TEST_END);
+        }
+
+        /* A sending server stops once it is done but waits for the client to end the test. */
+        for (ii = 0; ii < test->num_streams && !(test->sender && done); ii++)
+        {
+            struct iperf3_stream *stream = test->streams[ii];
+            int ret;
+
+            if (stream->closed)
+            {
+                continue;
+            }
+
+            if (test->sender)
+            {
+                ret = iperf3_stream_send(test, stream, wait_ms);
+            }
+            else
+            {
+                ret = iperf3_stream_recv(test, stream, wait_ms);
+            }
+
+            if (ret > 0)
+            {
+                progress = true;
+            }
+            else if (ret < 0)
+            {
+                stream->closed = true;
+                if (test->sender)
+                {
+                    iperf3_log("iperf3: failed to send on stream %" PRIu32 "\n", stream->id);
+                    return -1;
+                }
+            }
+        }
+
+        if (mmosal_time_has_passed(next_ctrl_poll_time))
+        {
+            int8_t state;
+            int ret = iperf3_sock_recv(test->ctrl, &state, sizeof(state), 0);
+
+            next_ctrl_poll_time = mmosal_get_time_ms() + IPERF3_CTRL_POLL_INTERVAL_MS;
+            if (ret < 0)
+            {
+                iperf3_log("iperf3: control connection closed\n");
+                return -1;
+            }
+            if (ret > 0)
+            {
+                if (test->server && state == IPERF3_TEST_END)
+                {
+                    test->duration_ms = mmosal_get_time_ms() - test->start_time_ms;
+                    return 0;
+                }
+                iperf3_log("iperf3: test terminated by remote (state %d)\n", state);
+                return -1;
+            }
+            if (timeout_time != 0 && mmosal_time_has_passed(timeout_time))
+            {
+                iperf3_log("iperf3: timed out waiting for end of test\n");
+                return -1;
+            }
+        }
+
+        if (test->stop != NULL && *test->stop)
+        {
+            iperf3_log("iperf3: server stopped, terminating test\n");
+            (void)iperf3_send_state(test, IPERF3_SERVER_TERMINATE);
+            return -1;
+        }
+
+        if (!progress)
+        {
+            mmosal_task_sleep(1);
+        }
+    }
+}
+
+/** Get the report type to use for a test that completed successfully. */
+static enum mmiperf_report_type iperf3_done_report_type(const struct iperf3_test *test)
+{
+    if (test->params.udp)
+    {
+        return test->sender ? MMIPERF_UDP_DONE_CLIENT : MMIPERF_UDP_DONE_SERVER;
+    }
+    return test->sender ? MMIPERF_TCP_DONE_CLIENT : MMIPERF_TCP_DONE_SERVER;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------
+ * Client.
+ * ---------------------------------------------------------------------------------------------
+ */
+
+/** Connect the data streams of a client test. Returns 0 on success, else -1. */
+static int iperf3_client_create_streams(struct iperf3_client *client)
+{
+    struct iperf3_test *test = &client->test;
+    uint32_t ii;
+
+    for (ii = 0; ii < test->num_streams; ii++)
+    {
+        struct iperf3_stream *stream = test->streams[ii];
+
+        if (test->params.udp)
+        {
+            uint32_t msg = IPERF3_UDP_CONNECT_MSG;
+            uint32_t reply = 0;
+
+            stream->sock = iperf3_sock_udp_connect(client->args.server_addr,
+                                                   client->args.server_port);
+            if (stream->sock == NULL)
+            {
+                return -1;
+            }
+
+            /* iperf3 sends these in host byte order, so we accept either byte order. */
+            if (iperf3_sock_send(stream->sock, &msg, sizeof(msg), IPERF3_CTRL_TIMEOUT_MS) <= 0 ||
+                iperf3_recv_all(stream->sock, &reply, sizeof(reply), IPERF3_CTRL_TIMEOUT_MS) != 0)
+            {
+                iperf3_log("iperf3: failed to connect UDP stream\n");
+                return -1;
+            }
+            if (reply != IPERF3_UDP_CONNECT_REPLY && reply != IPERF3_LEGACY_UDP_CONNECT_REPLY &&
+                reply != __builtin_bswap32(IPERF3_UDP_CONNECT_REPLY) &&
+                reply != __builtin_bswap32(IPERF3_LEGACY_UDP_CONNECT_REPLY))
+            {
+                iperf3_log("iperf3: unexpected UDP connect reply\n");
+                return -1;
+            }
+        }
+        else
+        {
+            stream->sock = iperf3_sock_tcp_connect(client->args.server_addr,
+                                                   client->args.server_port);
+            if (stream->sock == NULL ||
+                iperf3_send_all(stream->sock, test->cookie, IPERF3_COOKIE_SIZE) != 0)
+            {
+                iperf3_log("iperf3: failed to connect TCP stream\n");
+                return -1;
+            }
+        }
+
+        iperf3_sock_get_addrs(stream->sock, &stream->base.report);
+    }
+
+    return 0;
+}
+
+/**
+ * Run an iperf3 client test.
+ *
+ * @returns the report type to finish the test with.
+ */
+static enum mmiperf_report_type iperf3_client_run(struct iperf3_client *client)
+{
+    struct iperf3_test *test = &client->test;
+    char params_json[IPERF3_PARAMS_JSON_LEN];
+    int8_t state;
+    int len;
+
+    test->ctrl = iperf3_sock_tcp_connect(client->args.server_addr, client->args.server_port);
+    if (test->ctrl == NULL)
+    {
+        iperf3_log("iperf3: failed to connect to %s:%u\n",
+                   client->args.server_addr, client->args.server_port);
+        return MMIPERF_TCP_ABORTED_LOCAL;
+    }
+
+    if (iperf3_send_all(test->ctrl, test->cookie, IPERF3_COOKIE_SIZE) != 0)
+    {
+        return MMIPERF_TCP_ABORTED_LOCAL;
+    }
+
+    while (true)
+    {
+        if (iperf3_recv_state(test, &state) != 0)
+        {
+            iperf3_log("iperf3: control connection lost\n");
+            return MMIPERF_TCP_ABORTED_REMOTE;
+        }
+
+        switch (state)
+        {
+        case IPERF3_PARAM_EXCHANGE:
+            len = iperf3_format_params(&test->params, params_json, sizeof(params_json));
+            if (iperf3_send_json(test, params_json, len) != 0)
+            {
+                return MMIPERF_TCP_ABORTED_LOCAL;
+            }
+            break;
+
+        case IPERF3_CREATE_STREAMS:
+            if (iperf3_client_create_streams(client) != 0)
+            {
+                return MMIPERF_TCP_ABORTED_LOCAL;
+            }
+            break;
+
+        case IPERF3_TEST_START:
+            break;
+
+        case IPERF3_TEST_RUNNING:
+            if (iperf3_run_test(test) != 0)
+            {
+                return MMIPERF_TCP_ABORTED_LOCAL_TXERROR;
+            }
+            break;
+
+        case IPERF3_EXCHANGE_RESULTS:
+            if (iperf3_exchange_results(test) != 0)
+            {
+                return MMIPERF_TCP_ABORTED_REMOTE;
+            }
+            break;
+
+        case IPERF3_DISPLAY_RESULTS:
+            (void)iperf3_send_state(test, IPERF3_IPERF_DONE);
+            return iperf3_done_report_type(test);
+
+        case IPERF3_SERVER_ERROR:
+        {
+            uint32_t errors[2] = { 0 };
+            (void)iperf3_recv_all(test->ctrl, errors, sizeof(errors), IPERF3_CTRL_TIMEOUT_MS);
+            iperf3_log("iperf3: server error %" PRIu32 " (errno %" PRIu32 ")\n",
+                       be32toh(errors[0]), be32toh(errors[1]));
+            return MMIPERF_TCP_ABORTED_REMOTE;
+        }
+
+        case IPERF3_ACCESS_DENIED:
+            iperf3_log("iperf3: server is busy\n");
+            return MMIPERF_TCP_ABORTED_REMOTE;
+
+        default:
+            iperf3_log("iperf3: unexpected state %d from server\n", state);
+            return MMIPERF_TCP_ABORTED_REMOTE;
+        }
+    }
+}
+
+/** Task that runs an iperf3 client test. */
+static void iperf3_client_task(void *arg)
+{
+    struct iperf3_client *client = (struct iperf3_client *)arg;
+    enum mmiperf_report_type report_type;
+
+    report_type = iperf3_client_run(client);
+    iperf3_finish_test(&client->test, true, report_type);
+    IPERF_FREE(struct iperf3_client, client);
+}
+
+/** Generate a random iperf3 cookie. */
+static void iperf3_make_cookie(char *cookie)
+{
+    unsigned ii;
+
+    for (ii = 0; ii < IPERF3_COOKIE_SIZE - 1; ii++)
+    {
+        cookie[ii] = iperf3_cookie_chars[mmhal_random_u32(0, sizeof(iperf3_cookie_chars) - 2)];
+    }
+    cookie[IPERF3_COOKIE_SIZE - 1] = '\0';
+}
+
+mmiperf_handle_t iperf3_start_client(const struct mmiperf_client_args *args, bool udp)
+{
+    struct iperf3_client *client;
+    struct iperf3_test *test;
+    uint32_t num_streams = args->num_streams > 1 ? args->num_streams : 1;
+    mmiperf_handle_t handle;
+
+    if (num_streams > MMIPERF_MAX_STREAMS ||
+        (args->mode != MMIPERF_CLIENT_MODE_NORMAL && args->mode != MMIPERF_CLIENT_MODE_REVERSE) ||
+        iperf_frame_mode(args))
+    {
+        iperf3_log("iperf3: unsupported client configuration\n");
+        return NULL;
+    }
+
+    client = (struct iperf3_client *)IPERF_ALLOC(struct iperf3_client);
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    memset(client, 0, sizeof(*client));
+    memcpy(&client->args, args, sizeof(client->args));
+    if (client->args.server_port == 0)
+    {
+        client->args.server_port = MMIPERF3_DEFAULT_PORT;
+    }
+
+    test = &client->test;
+    test->sender = (args->mode != MMIPERF_CLIENT_MODE_REVERSE);
+    iperf_payload_source_init(&test->payload, args);
+    test->params.udp = udp;
+    test->params.reverse = !test->sender;
+    test->params.parallel = num_streams;
+    test->params.bandwidth_bps = (uint64_t)args->target_bw * 1000;
+    if (udp)
+    {
+        test->params.len = args->packet_size ? args->packet_size :
+                                               MMIPERF_DEFAULT_UDP_PACKET_SIZE_V4;
+        if (test->params.len > IPERF3_UDP_MAX_LEN ||
+            test->params.len < sizeof(struct iperf3_udp_header))
+        {
+            iperf3_log("iperf3: unsupported packet size\n");
+            IPERF_FREE(struct iperf3_client, client);
+            return NULL;
+        }
+    }
+    else
+    {
+        test->params.len = IPERF3_TCP_BLOCK_LEN;
+    }
+    if (args->amount < 0)
+    {
+        /* iperf3 only supports whole seconds. */
+        test->params.time_s = (-args->amount + 99) / 100;
+    }
+    else if (args->amount > 0)
+    {
+        test->params.num_bytes = args->amount;
+    }
+    else
+    {
+        test->params.time_s = -MMIPERF_DEFAULT_AMOUNT / 100;
+    }
+    iperf3_make_cookie(test->cookie);
+
+    if (iperf3_alloc_streams(test, num_streams, &client->args) != 0 ||
+        iperf3_alloc_buf(test) != 0)
+    {
+        iperf3_finish_test(test, false, MMIPERF_TCP_ABORTED_LOCAL);
+        IPERF_FREE(struct iperf3_client, client);
+        return NULL;
+    }
+
+    for (uint32_t ii = 0; ii < test->num_streams; ii++)
+    {
+        struct mmiperf_report *report = &test->streams[ii]->base.report;
+        mmosal_safer_strcpy(report->remote_addr, client->args.server_addr,
+                            sizeof(report->remote_addr));
+        report->remote_port = client->args.server_port;
+    }
+
+    if (!iperf3_list_add_streams(test))
+    {
+        iperf3_finish_test(test, false, MMIPERF_TCP_ABORTED_LOCAL);
+        IPERF_FREE(struct iperf3_client, client);
+        return NULL;
+    }
+    handle = (test->group != NULL) ? test->group->base.handle : test->streams[0]->base.handle;
+
+    struct mmosal_task *task = mmosal_task_create(iperf3_client_task, client,
+                                                  MMOSAL_TASK_PRI_LOW, IPERF3_STACK_SIZE,
+                                                  "iperf3_client");
+    MMOSAL_ASSERT(task != NULL);
+    return handle;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------
+ * Server.
+ * ---------------------------------------------------------------------------------------------
+ */
+
+/** Send an error code to the client and fail the test. */
+static void iperf3_server_send_error(struct iperf3_test *test, int32_t error_code)
+{
+    int32_t errors[2] = { (int32_t)htobe32(error_code), 0 };
+
+    if (iperf3_send_state(test, IPERF3_SERVER_ERROR) == 0)
+    {
+        (void)iperf3_send_all(test->ctrl, errors, sizeof(errors));
+    }
+}
+
+/** Accept the data streams of a server test. Returns 0 on success, else -1. */
+static int iperf3_server_accept_streams(struct iperf3_server *server, struct iperf3_test *test,
+                                        struct iperf3_sock *udp_sock)
+{
+    uint32_t ii;
+
+    if (test->params.udp)
+    {
+        uint32_t msg;
+        uint32_t reply = IPERF3_UDP_CONNECT_REPLY;
+
+        /* UDP tests only have a single stream; its source is learnt from the connect message. */
+        if (iperf3_recv_all(udp_sock, &msg, sizeof(msg), IPERF3_CTRL_TIMEOUT_MS) != 0 ||
+            iperf3_sock_send(udp_sock, &reply, sizeof(reply), IPERF3_CTRL_TIMEOUT_MS) <= 0)
+        {
+            iperf3_sock_close(udp_sock);
+            return -1;
+        }
+        test->streams[0]->sock = udp_sock;
+        iperf3_sock_get_addrs(udp_sock, &test->streams[0]->base.report);
+        return 0;
+    }
+
+    for (ii = 0; ii < test->num_streams; )
+    {
+        char cookie[IPERF3_COOKIE_SIZE];
+        struct iperf3_sock *sock = iperf3_sock_tcp_accept(server->listener,
+                                                          IPERF3_CTRL_TIMEOUT_MS);
+        if (sock == NULL)
+        {
+            return -1;
+        }
+
+        if (iperf3_recv_all(sock, cookie, sizeof(cookie), IPERF3_CTRL_TIMEOUT_MS) != 0 ||
+            memcmp(cookie, test->cookie, sizeof(cookie)) != 0)
+        {
+            /* Not a stream of this test (e.g., another client trying to start a test). */
+            int8_t state = IPERF3_ACCESS_DENIED;
+            (void)iperf3_sock_send(sock, &state, sizeof(state), 0);
+            iperf3_sock_close(sock);
+            continue;
+        }
+
+        test->streams[ii]->sock = sock;
+        iperf3_sock_get_addrs(sock, &test->streams[ii]->base.report);
+        ii++;
+    }
+
+    return 0;
+}
+
+/**
+ * Run an iperf3 server test on a newly accepted control connection.
+ *
+ * @param server    The server.
+ * @param test      The test, with @c ctrl set to the control connection.
+ * @param reported  Set to @c true if the streams were registered and so must be reported.
+ *
+ * @returns the report type to finish the test with.
+ */
+static enum mmiperf_report_type iperf3_server_run(struct iperf3_server *server,
+                                                  struct iperf3_test *test, bool *reported)
+{
+    struct mmiperf_client_args report_args = MMIPERF_CLIENT_ARGS_DEFAULT;
+    struct mmiperf_report ctrl_addrs;
+    struct iperf3_sock *udp_sock = NULL;
+    char *json;
+    size_t len;
+    int8_t state;
+
+    if (iperf3_recv_all(test->ctrl, test->cookie, sizeof(test->cookie),
+                        IPERF3_CTRL_TIMEOUT_MS) != 0 ||
+        iperf3_send_state(test, IPERF3_PARAM_EXCHANGE) != 0)
+    {
+        return MMIPERF_TCP_ABORTED_REMOTE;
+    }
+
+    json = iperf3_recv_json(test, &len);
+    if (json == NULL)
+    {
+        return MMIPERF_TCP_ABORTED_REMOTE;
+    }
+    iperf3_parse_params(json, len, &test->params);
+    mmosal_free(json);
+
+    if (test->params.bidirectional)
+    {
+        iperf3_log("iperf3: bidirectional tests are not supported\n");
+        (void)iperf3_send_state(test, IPERF3_ACCESS_DENIED);
+        return MMIPERF_TCP_ABORTED_LOCAL;
+    }
+    if (test->params.parallel > MMIPERF_MAX_STREAMS ||
+        (test->params.udp && test->params.parallel > 1))
+    {
+        iperf3_log("iperf3: too many streams requested\n");
+        iperf3_server_send_error(test, IPERF3_IENUMSTREAMS);
+        return MMIPERF_TCP_ABORTED_LOCAL;
+    }
+    if (test->params.udp)
+    {
+        if (test->params.len == 0)
+        {
+            test->params.len = MMIPERF_DEFAULT_UDP_PACKET_SIZE_V4;
+        }
+        test->params.len = MM_MIN(test->params.len, IPERF3_UDP_MAX_LEN);
+        test->params.len = MM_MAX(test->params.len, sizeof(struct iperf3_udp_header));
+    }
+    test->sender = test->params.reverse;
+
+    /* Create the streams, using the address of the control connection for the aggregate. */
+    memset(&ctrl_addrs, 0, sizeof(ctrl_addrs));
+    iperf3_sock_get_addrs(test->ctrl, &ctrl_addrs);
+    report_args.report_fn = server->args.report_fn;
+    report_args.report_arg = server->args.report_arg;
+    report_args.server_port = ctrl_addrs.remote_port;
+    mmosal_safer_strcpy(report_args.server_addr, ctrl_addrs.remote_addr,
+                        sizeof(report_args.server_addr));
+    if (iperf3_alloc_streams(test, test->params.parallel, &report_args) != 0 ||
+        iperf3_alloc_buf(test) != 0)
+    {
+        iperf3_server_send_error(test, 0);
+        return MMIPERF_TCP_ABORTED_LOCAL;
+    }
+
+    if (test->params.udp)
+    {
+        /* The UDP stream uses the same port number as the control connection. */
+        udp_sock = iperf3_sock_udp_bind(server->args.local_addr, server->args.local_port);
+        if (udp_sock == NULL)
+        {
+            iperf3_server_send_error(test, 0);
+            return MMIPERF_TCP_ABORTED_LOCAL;
+        }
+    }
+
+    if (iperf3_send_state(test, IPERF3_CREATE_STREAMS) != 0 ||
+        iperf3_server_accept_streams(server, test, udp_sock) != 0)
+    {
+        return MMIPERF_TCP_ABORTED_REMOTE;
+    }
+
+    if (!iperf3_list_add_streams(test))
+    {
+        return MMIPERF_TCP_ABORTED_LOCAL;
+    }
+    *reported = true;
+
+    if (iperf3_send_state(test, IPERF3_TEST_START) != 0 ||
+        iperf3_send_state(test, IPERF3_TEST_RUNNING) != 0 ||
+        iperf3_run_test(test) != 0)
+    {
+        return server->stop ? MMIPERF_TCP_ABORTED_LOCAL : MMIPERF_TCP_ABORTED_REMOTE;
+    }
+
+    if (iperf3_send_state(test, IPERF3_EXCHANGE_RESULTS) != 0 ||
+        iperf3_exchange_results(test) != 0 ||
+        iperf3_send_state(test, IPERF3_DISPLAY_RESULTS) != 0)
+    {
+        return MMIPERF_TCP_ABORTED_REMOTE;
+    }
+
+    /* Wait for the client to acknowledge the results (or close the connection). */
+    if (iperf3_recv_state(test, &state) == 0 && state != IPERF3_IPERF_DONE)
+    {
+        iperf3_log("iperf3: unexpected state %d from client\n", state);
+    }
+
+    return iperf3_done_report_type(test);
+}
+
+/**
+ * Task that runs an iperf3 server. It runs until the server is stopped with
+ * @ref mmiperf_stop_server(), then closes the listener and frees the server.
+ */
+static void iperf3_server_task(void *arg)
+{
+    struct iperf3_server *server = (struct iperf3_server *)arg;
+
+    while (!server->stop)
+    {
+        struct iperf3_test test;
+        enum mmiperf_report_type report_type;
+        bool reported = false;
+
+        memset(&test, 0, sizeof(test));
+        test.server = true;
+        test.stop = &server->stop;
+        test.ctrl = iperf3_sock_tcp_accept(server->listener, IPERF3_SERVER_ACCEPT_TIMEOUT_MS);
+        if (test.ctrl == NULL)
+        {
+            continue;
+        }
+
+        report_type = iperf3_server_run(server, &test, &reported);
+        iperf3_finish_test(&test, reported, report_type);
+    }
+
+    iperf_list_remove(&server->base);
+    iperf3_sock_close(server->listener);
+    IPERF_FREE(struct iperf3_server, server);
+}
+
+mmiperf_handle_t iperf3_start_server(const struct mmiperf_server_args *args)
+{
+    struct iperf3_server *server;
+
+    server = (struct iperf3_server *)IPERF_ALLOC(struct iperf3_server);
+    if (server == NULL)
+    {
+        return NULL;
+    }
+    memset(server, 0, sizeof(*server));
+    memcpy(&server->args, args, sizeof(server->args));
+    if (server->args.local_port == 0)
+    {
+        server->args.local_port = MMIPERF3_DEFAULT_PORT;
+    }
+    server->base.tcp = 1;
+    server->base.server = 1;
+    server->base.iperf3_server = 1;
+    server->base.report_fn = args->report_fn;
+    server->base.report_arg = args->report_arg;
+    server->base.time_started_ms = mmosal_get_time_ms();
+    iperf_resource_start(&server->base);
+
+    server->listener = iperf3_sock_tcp_listen(server->args.local_addr, server->args.local_port);
+    if (server->listener == NULL)
+    {
+        iperf3_log("iperf3: failed to listen on port %u\n", server->args.local_port);
+        IPERF_FREE(struct iperf3_server, server);
+        return NULL;
+    }
+
+    if (!iperf_list_add(&server->base))
+    {
+        iperf3_log("iperf3: too many iperf sessions\n");
+        iperf3_sock_close(server->listener);
+        IPERF_FREE(struct iperf3_server, server);
+        return NULL;
+    }
+
+    struct mmosal_task *task = mmosal_task_create(iperf3_server_task, server,
+                                                  MMOSAL_TASK_PRI_LOW, IPERF3_STACK_SIZE,
+                                                  "iperf3_server");
+    MMOSAL_ASSERT(task != NULL);
+    return server->base.handle;
+}
+
+bool mmiperf_stop_server(mmiperf_handle_t handle)
+{
+    struct mmiperf_state *state = iperf_list_acquire(handle);
+    bool stopped = false;
+
+    if (state == NULL)
+    {
+        return false;
+    }
+
+    /* The server task removes the server from the list before freeing it, so it remains valid
+     * while the list is acquired. */
+    if (state->iperf3_server)
+    {
+        ((struct iperf3_server *)state)->stop = true;
+        stopped = true;
+    }
+    iperf_list_release();
+    return stopped;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef MMIPERF3_PRIVATE_H__
+#define MMIPERF3_PRIVATE_H__
+
+#include "mmiperf_private.h"
+
+/*
+ * iperf3 compatibility mode.
+ *
+ * The iperf3 protocol engine (mmiperf3.c) is common to all IP stacks. It runs from a task and
+ * uses the small blocking socket API declared below, which is implemented for each IP stack.
+ */
+
+/** Length of the iperf3 session cookie, including null-terminator. */
+#define IPERF3_COOKIE_SIZE                  (37)
+
+/** Timeout for iperf3 control channel exchanges. */
+#ifndef IPERF3_CTRL_TIMEOUT_MS
+#define IPERF3_CTRL_TIMEOUT_MS              (10000)
+#endif
+
+/**
+ * Maximum time the iperf3 server blocks waiting for a connection. This bounds the time taken for
+ * the server to stop after @ref mmiperf_stop_server() is called.
+ */
+#ifndef IPERF3_SERVER_ACCEPT_TIMEOUT_MS
+#define IPERF3_SERVER_ACCEPT_TIMEOUT_MS     (1000)
+#endif
+
+/** Interval at which the control channel is checked for messages while a test is running. */
+#ifndef IPERF3_CTRL_POLL_INTERVAL_MS
+#define IPERF3_CTRL_POLL_INTERVAL_MS        (50)
+#endif
+
+/** Maximum time to block on a data stream when it is the only stream in the test. */
+#ifndef IPERF3_DATA_WAIT_MS
+#define IPERF3_DATA_WAIT_MS                 (10)
+#endif
+
+/**
+ * Time after the last data was received at which a receiving (reverse) client ends a test that
+ * is limited by amount rather than duration.
+ */
+#ifndef IPERF3_CLIENT_RX_IDLE_MS
+#define IPERF3_CLIENT_RX_IDLE_MS            (1000)
+#endif
+
+/** Interval at which the bandwidth limit allowance of a stream is topped up. */
+#ifndef IPERF3_PACING_INTERVAL_MS
+#define IPERF3_PACING_INTERVAL_MS           (10)
+#endif
+
+/** Length of the blocks we ask the remote end to use for a TCP test. */
+#ifndef IPERF3_TCP_BLOCK_LEN
+#define IPERF3_TCP_BLOCK_LEN                (1460)
+#endif
+
+/** Maximum length of UDP datagram supported by the iperf3 implementation. */
+#ifndef IPERF3_UDP_MAX_LEN
+#define IPERF3_UDP_MAX_LEN                  (1500)
+#endif
+
+/** Maximum length of an iperf3 log message, including null-terminator. */
+#ifndef IPERF3_LOG_MAX_LEN
+#define IPERF3_LOG_MAX_LEN                  (96)
+#endif
+
+/** Stack size (in 32-bit words) of the iperf3 client and server tasks. */
+#ifndef IPERF3_STACK_SIZE
+#define IPERF3_STACK_SIZE                   (MMIPERF_STACK_SIZE + 256)
+#endif
+
+/** Opaque socket handle, defined by the IP stack specific implementation. */
+struct iperf3_sock;
+
+/**
+ * Open a TCP connection.
+ *
+ * @param addr          Remote IP address (as a string).
+ * @param port          Remote port.
+ *
+ * @returns the connected socket on success, else @c NULL.
+ */
+struct iperf3_sock *iperf3_sock_tcp_connect(const char *addr, uint16_t port);
+
+/**
+ * Open a TCP socket listening for connections.
+ *
+ * @param local_addr    Local IP address to listen on (as a string). May be empty to listen on
+ *                      all addresses.
+ * @param port          Local port.
+ *
+ * @returns the listening socket on success, else @c NULL.
+ */
+struct iperf3_sock *iperf3_sock_tcp_listen(const char *local_addr, uint16_t port);
+
+/**
+ * Accept a connection on a listening TCP socket.
+ *
+ * @param listener      The listening socket.
+ * @param timeout_ms    Maximum time to wait for a connection.
+ *
+ * @returns the accepted socket on success, else @c NULL.
+ */
+struct iperf3_sock *iperf3_sock_tcp_accept(struct iperf3_sock *listener, uint32_t timeout_ms);
+
+/**
+ * Open a UDP socket to send datagrams to the given remote address.
+ *
+ * @param addr          Remote IP address (as a string).
+ * @param port          Remote port.
+ *
+ * @returns the socket on success, else @c NULL.
+ */
+struct iperf3_sock *iperf3_sock_udp_connect(const char *addr, uint16_t port);
+
+/**
+ * Open a UDP socket bound to the given local port. Datagrams sent on the socket go to the source
+ * of the last datagram received.
+ *
+ * @param local_addr    Local IP address to bind to (as a string). May be empty to bind to all
+ *                      addresses.
+ * @param port          Local port.
+ *
+ * @returns the socket on success, else @c NULL.
+ */
+struct iperf3_sock *iperf3_sock_udp_bind(const char *local_addr, uint16_t port);
+
+/**
+ * Send data on a socket. For UDP sockets the data is sent as a single datagram.
+ *
+ * @param sock          The socket.
+ * @param buf           The data to send.
+ * @param len           Length of the data.
+ * @param timeout_ms    Maximum time to block waiting for buffer space (zero to not block).
+ *
+ * @returns the number of bytes sent, zero if no buffer space was available, or a negative
+ *          number on error.
+ */
+int iperf3_sock_send(struct iperf3_sock *sock, const void *buf, size_t len, uint32_t timeout_ms);
+
+/**
+ * Receive data from a socket. For UDP sockets this receives a single datagram.
+ *
+ * @param sock          The socket.
+ * @param buf           Buffer to receive into.
+ * @param len           Length of @p buf.
+ * @param timeout_ms    Maximum time to block waiting for data (zero to not block).
+ *
+ * @returns the number of bytes received, zero if no data was available, or a negative number
+ *          if the connection was closed or on error.
+ */
+int iperf3_sock_recv(struct iperf3_sock *sock, void *buf, size_t len, uint32_t timeout_ms);
+
+/**
+ * Fill in the local and remote address and port of a socket in the given report.
+ *
+ * @param sock          The socket.
+ * @param report        The report to fill in.
+ */
+void iperf3_sock_get_addrs(struct iperf3_sock *sock, struct mmiperf_report *report);
+
+/**
+ * Close a socket and release its resources.
+ *
+ * @param sock          The socket. May be @c NULL.
+ */
+void iperf3_sock_close(struct iperf3_sock *sock);
+
+/**
+ * Log an iperf3 warning using the debug output of the IP stack.
+ *
+ * @param format        printf-style format string.
+ */
+void iperf3_log(const char *format, ...);
+
+/**
+ * Start an iperf3 client.
+ *
+ * @param args  Iperf client arguments.
+ * @param udp   @c true for a UDP test, @c false for a TCP test.
+ *
+ * @returns a handle to the client on success, or @c NULL on failure.
+ */
+mmiperf_handle_t iperf3_start_client(const struct mmiperf_client_args *args, bool udp);
+
+/**
+ * Start an iperf3 server. The server accepts both TCP and UDP tests.
+ *
+ * @param args  Iperf server arguments.
+ *
+ * @returns a handle to the server on success, or @c NULL on failure.
+ */
+mmiperf_handle_t iperf3_start_server(const struct mmiperf_server_args *args);
+
+#endif
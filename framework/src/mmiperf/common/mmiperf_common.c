@@ -5,14 +5,614 @@
  */
 #include <endian.h>
 
+#include "mmhal.h"
 #include "mmiperf_private.h"
+#include "mmutils.h"
 
 
+/** Offset added to the system clock to get the time used for UDP packet timestamps. */
+static int64_t iperf_clock_offset_us;
+
+void mmiperf_set_clock_offset_us(int64_t offset_us)
+{
+    iperf_clock_offset_us = offset_us;
+}
+
+uint64_t iperf_get_time_us(void)
+{
+    return mmosal_get_time_us() + iperf_clock_offset_us;
+}
+
+/** Get the index of the latency histogram bucket for the given latency. */
+static unsigned iperf_latency_bucket(uint32_t latency_us)
+{
+    unsigned exp;
+
+    if (latency_us < IPERF_LATENCY_SUB_BUCKETS)
+    {
+        return latency_us;
+    }
+
+    exp = 31 - __builtin_clz(latency_us);
+    if (exp > IPERF_LATENCY_MAX_EXP)
+    {
+        return IPERF_LATENCY_NUM_BUCKETS - 1;
+    }
+
+    return ((exp - IPERF_LATENCY_SUB_BUCKET_BITS + 1) * IPERF_LATENCY_SUB_BUCKETS) +
+           ((latency_us >> (exp - IPERF_LATENCY_SUB_BUCKET_BITS)) &
+            (IPERF_LATENCY_SUB_BUCKETS - 1));
+}
+
+/** Get the largest latency that falls into the given latency histogram bucket. */
+static uint32_t iperf_latency_bucket_max(unsigned bucket)
+{
+    unsigned shift;
+    uint32_t sub_bucket;
+
+    if (bucket < IPERF_LATENCY_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    shift = (bucket / IPERF_LATENCY_SUB_BUCKETS) - 1;
+    sub_bucket = bucket % IPERF_LATENCY_SUB_BUCKETS;
+    return ((IPERF_LATENCY_SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
+
+void iperf_latency_stats_add(struct iperf_latency_stats *stats, int64_t latency_us)
+{
+    uint32_t sample_us;
+
+    if (latency_us < 0)
+    {
+        sample_us = 0;
+    }
+    else if (latency_us > UINT32_MAX)
+    {
+        sample_us = UINT32_MAX;
+    }
+    else
+    {
+        sample_us = latency_us;
+    }
+
+    stats->count++;
+    stats->buckets[iperf_latency_bucket(sample_us)]++;
+    if (sample_us > stats->max_us)
+    {
+        stats->max_us = sample_us;
+    }
+}
+
+/** Get the given percentile of the one-way latency statistics. */
+static uint32_t iperf_latency_stats_percentile(const struct iperf_latency_stats *stats,
+                                               unsigned percentile)
+{
+    uint32_t target = ((uint64_t)stats->count * percentile + 99) / 100;
+    uint32_t cumulative = 0;
+    unsigned ii;
+
+    for (ii = 0; ii < IPERF_LATENCY_NUM_BUCKETS; ii++)
+    {
+        cumulative += stats->buckets[ii];
+        if (cumulative >= target)
+        {
+            return MM_MIN(iperf_latency_bucket_max(ii), stats->max_us);
+        }
+    }
+    return stats->max_us;
+}
+
+/** Fill in the one-way latency fields of a report. */
+static void iperf_latency_stats_fill_report(const struct iperf_latency_stats *stats,
+                                            struct mmiperf_report *report)
+{
+    report->latency_count = stats->count;
+    if (stats->count == 0)
+    {
+        return;
+    }
+
+    report->latency_p50_us = iperf_latency_stats_percentile(stats, 50);
+    report->latency_p90_us = iperf_latency_stats_percentile(stats, 90);
+    report->latency_p99_us = iperf_latency_stats_percentile(stats, 99);
+    report->latency_max_us = stats->max_us;
+}
+
+void iperf_udp_server_update_timing(struct mmiperf_state *base_state, uint64_t tx_time_us,
+                                    uint64_t *prev_tx_time_us)
+{
+    struct mmiperf_report *report = &base_state->report;
+    /* The clocks need not be synchronised since only differences in transit time are used. */
+    int64_t transit_us = (int64_t)(iperf_get_time_us() - tx_time_us);
+
+    if (*prev_tx_time_us != 0)
+    {
+        /* Note that this will be negative for packets that arrived out of order. */
+        report->ipg_count++;
+        report->ipg_sum_us += (int64_t)(tx_time_us - *prev_tx_time_us);
+        report->ipg_sum_ms = report->ipg_sum_us / 1000;
+
+        /* RFC 3550 interarrival jitter: J += (|D| - J) / 16, kept scaled by 16. */
+        int64_t d = transit_us - base_state->prev_transit_us;
+        uint32_t abs_d = (uint32_t)MM_MIN((uint64_t)(d < 0 ? -d : d), UINT32_MAX >> 4);
+        base_state->jitter_x16_us += abs_d - ((base_state->jitter_x16_us + 8) >> 4);
+        report->jitter_us = base_state->jitter_x16_us >> 4;
+    }
+    else
+    {
+        base_state->jitter_x16_us = 0;
+    }
+    *prev_tx_time_us = tx_time_us;
+    base_state->prev_transit_us = transit_us;
+
+    if (base_state->latency != NULL)
+    {
+        iperf_latency_stats_add(base_state->latency, transit_us);
+    }
+}
+
+uint32_t iperf_udp_hdrs_len(enum iperf_version version)
+{
+    uint32_t hdrs_len = sizeof(struct iperf_udp_header) + sizeof(struct iperf_settings);
+
+    if (version == IPERF_VERSION_2_0_9)
+    {
+        /* Iperf 2.0.9 does not have the id_hi field */
+        hdrs_len -= sizeof(uint32_t);
+    }
+    return hdrs_len;
+}
+
+void iperf_udp_client_settings_init(struct iperf_settings *settings,
+                                    const struct mmiperf_client_args *args)
+{
+    memset(settings, 0, sizeof(*settings));
+
+    switch (args->mode)
+    {
+    case MMIPERF_CLIENT_MODE_DUAL:
+        settings->flags = htobe32(IPERF_FLAGS_ANSWER_TEST | IPERF_FLAGS_ANSWER_NOW);
+        break;
+
+    case MMIPERF_CLIENT_MODE_TRADEOFF:
+    case MMIPERF_CLIENT_MODE_REVERSE:
+        settings->flags = htobe32(IPERF_FLAGS_ANSWER_TEST);
+        break;
+
+    default:
+        /* Unidirectional test: the settings are not used, apart from our own flags. */
+        if (args->multicast_reports)
+        {
+            settings->flags = htobe32(IPERF_FLAGS_MCAST_REPORT);
+        }
+        return;
+    }
+
+    settings->num_threads = htobe32(1);
+    settings->remote_port = htobe32(MMIPERF_DEFAULT_PORT);
+    settings->buffer_len = htobe32(args->packet_size);
+    /* The remote side expects the rate in bits per second. */
+    settings->win_band = htobe32(args->target_bw * 1000);
+    settings->amount = htobe32(args->amount);
+}
+
+void iperf_udp_server_answer_args(const struct iperf_settings *settings,
+                                  struct mmiperf_client_args *args)
+{
+    args->server_port = (uint16_t)be32toh(settings->remote_port);
+    args->amount = (int32_t)be32toh(settings->amount);
+    args->packet_size = be32toh(settings->buffer_len);
+    args->target_bw = be32toh(settings->win_band) / 1000;
+    if (args->packet_size > MMIPERF_DEFAULT_UDP_PACKET_SIZE_V4)
+    {
+        /* Our payload data is only so long; use the default for the address family instead. */
+        args->packet_size = 0;
+    }
+}
+
+void iperf_verify_record(struct mmiperf_state *base_state, uint32_t corrupted_bytes,
+                         uint64_t start_time_us)
+{
+    struct mmiperf_report *report = &base_state->report;
+
+    report->verify_segments++;
+    if (corrupted_bytes != 0)
+    {
+        report->verify_corrupted_segments++;
+        report->verify_corrupted_bytes += corrupted_bytes;
+    }
+    report->verify_time_us += mmosal_get_time_us() - start_time_us;
+}
+
+/** Record the delivery of a frame in the report of a session. */
+static void iperf_frame_record(struct mmiperf_state *base_state, int64_t latency_us,
+                               uint32_t deadline_us)
+{
+    struct mmiperf_report *report = &base_state->report;
+    uint32_t sample_us = 0;
+    unsigned bucket = 0;
+
+    if (latency_us > UINT32_MAX)
+    {
+        sample_us = UINT32_MAX;
+    }
+    else if (latency_us > 0)
+    {
+        /* Negative latencies can occur if the clocks are not perfectly synchronised. */
+        sample_us = (uint32_t)latency_us;
+    }
+
+    if (sample_us >= 1000)
+    {
+        bucket = 32 - __builtin_clz(sample_us / 1000);
+        bucket = MM_MIN(bucket, MMIPERF_FRAME_LATENCY_BUCKETS - 1);
+    }
+    report->frame_latency_hist[bucket]++;
+
+    report->frame_count++;
+    report->frame_latency_mean_us +=
+        ((int64_t)sample_us - report->frame_latency_mean_us) / (int64_t)report->frame_count;
+    report->frame_latency_max_us = MM_MAX(report->frame_latency_max_us, sample_us);
+    if (sample_us > deadline_us)
+    {
+        report->frame_deadline_misses++;
+    }
+}
+
+void iperf_frame_tx_init(struct iperf_frame_tx *tx, const struct mmiperf_client_args *args,
+                         uint64_t stream_offset)
+{
+    memset(tx, 0, sizeof(*tx));
+    if (args->frame_len == 0 || args->frame_period_ms == 0)
+    {
+        return;
+    }
+
+    tx->len = args->frame_len;
+    tx->period_ms = args->frame_period_ms;
+    tx->deadline_us = (args->frame_deadline_ms ? args->frame_deadline_ms : args->frame_period_ms) *
+                      1000;
+    tx->next_start_ms = mmosal_get_time_ms();
+    tx->queued_end = stream_offset;
+}
+
+bool iperf_frame_tx_start(struct iperf_frame_tx *tx, bool track_acks)
+{
+    uint32_t now_ms = mmosal_get_time_ms();
+    uint32_t late_ms;
+
+    if (tx->remaining > 0 || !mmosal_time_has_passed(tx->next_start_ms) ||
+        (track_acks && tx->in_flight_count >= IPERF_FRAME_MAX_IN_FLIGHT))
+    {
+        return false;
+    }
+
+    late_ms = now_ms - tx->next_start_ms;
+    tx->start_us = iperf_get_time_us() - (uint64_t)late_ms * 1000;
+    tx->next_start_ms += tx->period_ms;
+    tx->remaining = tx->len;
+    tx->id++;
+
+    if (track_acks)
+    {
+        unsigned idx = (tx->in_flight_head + tx->in_flight_count) % IPERF_FRAME_MAX_IN_FLIGHT;
+        tx->queued_end += tx->len;
+        tx->in_flight[idx].end = tx->queued_end;
+        tx->in_flight[idx].start_us = tx->start_us;
+        tx->in_flight_count++;
+    }
+    return true;
+}
+
+uint32_t iperf_frame_tx_wait_ms(const struct iperf_frame_tx *tx)
+{
+    if (mmosal_time_has_passed(tx->next_start_ms))
+    {
+        return 0;
+    }
+    return tx->next_start_ms - mmosal_get_time_ms();
+}
+
+void iperf_frame_tx_acked(struct mmiperf_state *base_state, struct iperf_frame_tx *tx,
+                          uint64_t acked)
+{
+    while (tx->in_flight_count > 0 && acked >= tx->in_flight[tx->in_flight_head].end)
+    {
+        iperf_frame_record(base_state,
+                           (int64_t)(iperf_get_time_us() -
+                                     tx->in_flight[tx->in_flight_head].start_us),
+                           tx->deadline_us);
+        tx->in_flight_head = (tx->in_flight_head + 1) % IPERF_FRAME_MAX_IN_FLIGHT;
+        tx->in_flight_count--;
+    }
+}
+
+void iperf_frame_tx_fill_header(void *hdr, const struct iperf_frame_tx *tx, uint32_t payload_len)
+{
+    struct iperf_frame_header frame_hdr;
+
+    frame_hdr.magic = htobe32(IPERF_FRAME_MAGIC);
+    frame_hdr.frame_id = htobe32(tx->id);
+    frame_hdr.start_sec = htobe32(tx->start_us / 1000000);
+    frame_hdr.start_usec = htobe32(tx->start_us % 1000000);
+    frame_hdr.deadline_us = htobe32(tx->deadline_us);
+    frame_hdr.datagrams = htobe32((tx->len + payload_len - 1) / payload_len);
+    memcpy(hdr, &frame_hdr, sizeof(frame_hdr));
+}
+
+void iperf_frame_rx_update(struct mmiperf_state *base_state, struct iperf_frame_rx *rx,
+                           const void *payload, uint32_t len)
+{
+    struct iperf_frame_header frame_hdr;
+    uint32_t frame_id;
+
+    if (len < sizeof(frame_hdr))
+    {
+        return;
+    }
+    memcpy(&frame_hdr, payload, sizeof(frame_hdr));
+    if (be32toh(frame_hdr.magic) != IPERF_FRAME_MAGIC)
+    {
+        return;
+    }
+
+    frame_id = be32toh(frame_hdr.frame_id);
+    if (frame_id != rx->id)
+    {
+        if (rx->id != 0 && (int32_t)(frame_id - rx->id) < 0)
+        {
+            /* A late datagram of a frame we have already given up on. */
+            return;
+        }
+        iperf_frame_rx_finish(base_state, rx);
+        rx->id = frame_id;
+        rx->datagrams = be32toh(frame_hdr.datagrams);
+        rx->deadline_us = be32toh(frame_hdr.deadline_us);
+        rx->start_us = (uint64_t)be32toh(frame_hdr.start_sec) * 1000000 +
+                       be32toh(frame_hdr.start_usec);
+    }
+
+    if (rx->received < rx->datagrams && ++rx->received == rx->datagrams)
+    {
+        iperf_frame_record(base_state, (int64_t)(iperf_get_time_us() - rx->start_us),
+                           rx->deadline_us);
+    }
+}
+
+void iperf_frame_rx_finish(struct mmiperf_state *base_state, struct iperf_frame_rx *rx)
+{
+    if (rx->id != 0 && rx->received < rx->datagrams)
+    {
+        /* The frame was never delivered. */
+        base_state->report.frame_deadline_misses++;
+    }
+    rx->received = rx->datagrams;
+}
+
+/** Heap and packet memory usage peaks, shared by all iperf sessions. */
+static struct
+{
+    /** Timer used to periodically sample usage, or @c NULL if it has not been created yet. */
+    struct mmosal_timer *timer;
+    /** Total size of the heap in bytes. */
+    size_t heap_total_size;
+    /** Lowest free heap size sampled since the last reset. */
+    size_t heap_min_free;
+    /** Peak number of transmit mmpkts allocated since the last reset. */
+    uint32_t pktmem_tx_peak;
+    /** Peak number of receive mmpkts allocated since the last reset. */
+    uint32_t pktmem_rx_peak;
+    /** Number of transmit mmpkts available. */
+    uint32_t pktmem_tx_capacity;
+    /** Number of receive mmpkts available. */
+    uint32_t pktmem_rx_capacity;
+} iperf_resource;
+
+/**
+ * Sample heap and packet memory usage.
+ *
+ * @param reset If @c true then restart the peaks from the current usage.
+ */
+static void iperf_resource_sample(bool reset)
+{
+    struct mmosal_heap_stats heap;
+    struct mmhal_wlan_pktmem_stats pktmem;
+
+    mmosal_get_heap_stats(&heap);
+    mmhal_wlan_pktmem_get_stats(&pktmem, true);
+    if (reset)
+    {
+        pktmem.tx_peak = pktmem.tx_allocated;
+        pktmem.rx_peak = pktmem.rx_allocated;
+    }
+
+    MMOSAL_TASK_ENTER_CRITICAL();
+    iperf_resource.heap_total_size = heap.total_size;
+    iperf_resource.pktmem_tx_capacity = pktmem.tx_capacity;
+    iperf_resource.pktmem_rx_capacity = pktmem.rx_capacity;
+    if (reset || heap.free_size < iperf_resource.heap_min_free)
+    {
+        iperf_resource.heap_min_free = heap.free_size;
+    }
+    if (reset || pktmem.tx_peak > iperf_resource.pktmem_tx_peak)
+    {
+        iperf_resource.pktmem_tx_peak = pktmem.tx_peak;
+    }
+    if (reset || pktmem.rx_peak > iperf_resource.pktmem_rx_peak)
+    {
+        iperf_resource.pktmem_rx_peak = pktmem.rx_peak;
+    }
+    MMOSAL_TASK_EXIT_CRITICAL();
+}
+
+/** Timer callback to sample resource usage. Sampling stops once there are no iperf sessions. */
+static void iperf_resource_timer_cb(struct mmosal_timer *timer)
+{
+    if (iperf_list_is_empty())
+    {
+        mmosal_timer_stop(timer);
+        return;
+    }
+    iperf_resource_sample(false);
+}
+
+void iperf_resource_start(struct mmiperf_state *base_state)
+{
+    mmosal_get_cpu_stats(&base_state->cpu_start);
+    iperf_resource_sample(true);
+
+    if (iperf_resource.timer == NULL)
+    {
+        iperf_resource.timer = mmosal_timer_create("iperf_res", IPERF_RESOURCE_SAMPLE_INTERVAL_MS,
+                                                   true, NULL, iperf_resource_timer_cb);
+    }
+    if (iperf_resource.timer != NULL && !mmosal_is_timer_active(iperf_resource.timer))
+    {
+        mmosal_timer_start(iperf_resource.timer);
+    }
+}
+
+/**
+ * Fill in the resource usage fields of a report. This must be done after the bandwidth has
+ * been calculated.
+ */
+static void iperf_resource_fill_report(const struct mmiperf_state *base_state,
+                                       struct mmiperf_report *report)
+{
+    struct mmosal_cpu_stats cpu;
+    uint32_t run_time;
+    uint32_t load_sum = 0;
+    unsigned ii;
+
+    iperf_resource_sample(false);
+    MMOSAL_TASK_ENTER_CRITICAL();
+    report->heap_total_size = iperf_resource.heap_total_size;
+    report->heap_peak_used = iperf_resource.heap_total_size - iperf_resource.heap_min_free;
+    report->pktmem_tx_peak = iperf_resource.pktmem_tx_peak;
+    report->pktmem_tx_capacity = iperf_resource.pktmem_tx_capacity;
+    report->pktmem_rx_peak = iperf_resource.pktmem_rx_peak;
+    report->pktmem_rx_capacity = iperf_resource.pktmem_rx_capacity;
+    MMOSAL_TASK_EXIT_CRITICAL();
+
+    mmosal_get_cpu_stats(&cpu);
+    run_time = cpu.run_time - base_state->cpu_start.run_time;
+    report->cpu_num_cores = MM_MIN(base_state->cpu_start.num_cores, MMIPERF_MAX_CPU_CORES);
+    if (run_time == 0)
+    {
+        report->cpu_num_cores = 0;
+    }
+    for (ii = 0; ii < report->cpu_num_cores; ii++)
+    {
+        uint32_t idle_time = cpu.idle_time[ii] - base_state->cpu_start.idle_time[ii];
+        idle_time = MM_MIN(idle_time, run_time);
+        report->cpu_load_permille[ii] =
+            1000 - (uint16_t)(((uint64_t)idle_time * 1000) / run_time);
+        load_sum += report->cpu_load_permille[ii];
+    }
+
+    report->cpu_permille_per_mbps = 0;
+    if (report->bandwidth_kbitpsec > 0)
+    {
+        report->cpu_permille_per_mbps = (load_sum * 1000) / report->bandwidth_kbitpsec;
+    }
+}
+
+/** Add the counters of the given report to the given aggregate report. */
+static void iperf_report_accumulate(struct mmiperf_report *sum,
+                                    const struct mmiperf_report *report)
+{
+    sum->bytes_transferred += report->bytes_transferred;
+    sum->tx_frames += report->tx_frames;
+    sum->rx_frames += report->rx_frames;
+    sum->out_of_sequence_frames += report->out_of_sequence_frames;
+    sum->error_count += report->error_count;
+    sum->ipg_count += report->ipg_count;
+    sum->ipg_sum_ms += report->ipg_sum_ms;
+    sum->ipg_sum_us += report->ipg_sum_us;
+    sum->verify_segments += report->verify_segments;
+    sum->verify_corrupted_segments += report->verify_corrupted_segments;
+    sum->verify_corrupted_bytes += report->verify_corrupted_bytes;
+    sum->verify_time_us += report->verify_time_us;
+}
+
+struct iperf_stream_group *iperf_stream_group_alloc(uint8_t tcp,
+                                                    const struct mmiperf_client_args *args)
+{
+    struct iperf_stream_group *group =
+        (struct iperf_stream_group *)IPERF_ALLOC(struct iperf_stream_group);
+    if (group == NULL)
+    {
+        return NULL;
+    }
+
+    memset(group, 0, sizeof(*group));
+    group->base.tcp = tcp;
+    group->base.is_group = 1;
+    group->base.stream_id = MMIPERF_STREAM_ID_SUM;
+    group->base.report_fn = args->report_fn;
+    group->base.report_arg = args->report_arg;
+    group->base.time_started_ms = mmosal_get_time_ms();
+    iperf_resource_start(&group->base);
+    group->base.report.report_type = MMIPERF_INTERRIM_REPORT;
+    group->base.report.stream_id = MMIPERF_STREAM_ID_SUM;
+    mmosal_safer_strcpy(group->base.report.remote_addr, args->server_addr,
+                        sizeof(group->base.report.remote_addr));
+    group->base.report.remote_port = args->server_port;
+    return group;
+}
+
+void iperf_stream_group_add(struct iperf_stream_group *group, struct mmiperf_state *stream)
+{
+    MMOSAL_ASSERT(group->num_streams < MMIPERF_MAX_STREAMS);
+
+    stream->group = group;
+    stream->stream_id = group->num_streams;
+    stream->report.stream_id = stream->stream_id;
+    group->streams[group->num_streams++] = stream;
+}
+
+/** Fold a finished stream into the aggregate report, finishing the test if it was the last. */
+static void iperf_stream_group_stream_done(struct iperf_stream_group *group,
+                                           struct mmiperf_state *stream)
+{
+    struct mmiperf_report *sum = &group->base.report;
+
+    MMOSAL_ASSERT(stream->stream_id < group->num_streams);
+    MMOSAL_ASSERT(group->streams[stream->stream_id] == stream);
+    group->streams[stream->stream_id] = NULL;
+    stream->group = NULL;
+
+    iperf_report_accumulate(sum, &stream->report);
+    if (group->num_done == 0)
+    {
+        mmosal_safer_strcpy(sum->local_addr, stream->report.local_addr,
+                            sizeof(sum->local_addr));
+    }
+    /* The aggregate lasts until the longest running stream is done. */
+    if (stream->report.duration_ms > sum->duration_ms)
+    {
+        sum->duration_ms = stream->report.duration_ms;
+    }
+
+    if (++group->num_done < group->num_streams)
+    {
+        return;
+    }
+
+    iperf_list_remove(&group->base);
+    iperf_finalize_report_and_invoke_callback(&group->base, sum->duration_ms,
+                                              stream->report.report_type);
+    IPERF_FREE(struct iperf_stream_group, group);
+}
+
 void iperf_finalize_report_and_invoke_callback(struct mmiperf_state *base_state,
                                                uint32_t duration_ms,
                                                enum mmiperf_report_type report_type)
 {
     base_state->report.report_type = report_type;
+    base_state->report.stream_id = base_state->stream_id;
     base_state->report.duration_ms = duration_ms;
     /* This shouldn't be possible in practice but, just in case, we clamp the duration
      * to be greater than or equal to zero. */
@@ -27,15 +627,29 @@ void iperf_finalize_report_and_invoke_callback(struct mmiperf_state *base_state,
             base_state->report.bytes_transferred * 8 / duration_ms;
     }
 
+    if (base_state->latency != NULL)
+    {
+        iperf_latency_stats_fill_report(base_state->latency, &base_state->report);
+    }
+
+    iperf_resource_fill_report(base_state, &base_state->report);
+
     if (base_state->report_fn != NULL)
     {
-        base_state->report_fn(&base_state->report, base_state->report_arg, base_state);
+        base_state->report_fn(&base_state->report, base_state->report_arg,
+                              base_state->handle);
+    }
+
+    if (base_state->group != NULL)
+    {
+        iperf_stream_group_stream_done(base_state->group, base_state);
     }
 }
 
 bool mmiperf_get_interim_report(mmiperf_handle_t handle, struct mmiperf_report *report)
 {
-    struct mmiperf_state *base_state = iperf_list_get(handle);
+    /* The session cannot be removed (and freed) until it is released below. */
+    struct mmiperf_state *base_state = iperf_list_acquire(handle);
     if (base_state == NULL)
     {
         return false;
@@ -45,6 +659,26 @@ bool mmiperf_get_interim_report(mmiperf_handle_t handle, struct mmiperf_report *
      * time we read it, but it is relatively unlikely and should be minor in its impact. */
     memcpy(report, &base_state->report, sizeof(*report));
 
+    if (base_state->is_group)
+    {
+        /* Add in the streams that are still running to the totals of those that are done. */
+        struct iperf_stream_group *group = (struct iperf_stream_group *)base_state;
+        unsigned ii;
+        for (ii = 0; ii < group->num_streams; ii++)
+        {
+            struct mmiperf_state *stream = group->streams[ii];
+            if (stream != NULL)
+            {
+                iperf_report_accumulate(report, &stream->report);
+            }
+        }
+        report->report_type = MMIPERF_INTERRIM_REPORT;
+    }
+    else if (base_state->latency != NULL)
+    {
+        iperf_latency_stats_fill_report(base_state->latency, report);
+    }
+
     /* Adjust duration and bandwidth values if the iperf session is still running, in case
      * it has been a while since the last time the report as updated. */
     if (report->report_type == MMIPERF_INTERRIM_REPORT)
@@ -61,8 +695,10 @@ bool mmiperf_get_interim_report(mmiperf_handle_t handle, struct mmiperf_report *
         {
             report->bandwidth_kbitpsec = report->bytes_transferred * 8 / report->duration_ms;
         }
+        iperf_resource_fill_report(base_state, report);
     }
 
+    iperf_list_release();
     return true;
 }
 
@@ -81,13 +717,14 @@ void iperf_populate_udp_server_report(struct mmiperf_state *base_state,
     report->datagrams = htobe32(base_state->report.rx_frames);
     report->IPGcnt = htobe32(base_state->report.ipg_count);
     report->IPGsum = htobe32(base_state->report.ipg_sum_ms);
+    report->jitter1 = htobe32(base_state->report.jitter_us / 1000000);
+    report->jitter2 = htobe32(base_state->report.jitter_us % 1000000);
 }
 
 
-bool iperf_parse_udp_server_report(struct mmiperf_state *base_state,
-                                   const struct iperf_udp_header *hdr,
-                                   const struct iperf_udp_server_report *report,
-                                   enum iperf_version version)
+/** Check the packet ID in the header of a received UDP server report is valid. */
+static bool iperf_udp_server_report_valid(const struct iperf_udp_header *hdr,
+                                          enum iperf_version version)
 {
     int64_t packet_id = 0;
     if (version == IPERF_VERSION_2_0_9)
@@ -100,9 +737,17 @@ bool iperf_parse_udp_server_report(struct mmiperf_state *base_state,
                                (uint64_t)be32toh(hdr->id_lo));
     }
 
-    if (packet_id > 0)
+    /* If not less than or equal to zero then this is not a report and something went wrong. */
+    return packet_id <= 0;
+}
+
+bool iperf_parse_udp_server_report(struct mmiperf_state *base_state,
+                                   const struct iperf_udp_header *hdr,
+                                   const struct iperf_udp_server_report *report,
+                                   enum iperf_version version)
+{
+    if (!iperf_udp_server_report_valid(hdr, version))
     {
-        /* If not less than or equal to zero then this is not a report and something went wrong. */
         return false;
     }
 
@@ -113,7 +758,89 @@ bool iperf_parse_udp_server_report(struct mmiperf_state *base_state,
     base_state->report.rx_frames = be32toh(report->datagrams);
     base_state->report.duration_ms =
         be32toh(report->stop_sec) * 1000 + be32toh(report->stop_usec) / 1000;
+    base_state->report.jitter_us =
+        be32toh(report->jitter1) * 1000000 + be32toh(report->jitter2);
     /* This will be calculated later. */
     base_state->report.bandwidth_kbitpsec = 0;
     return true;
 }
+
+bool iperf_mcast_receivers_add(struct iperf_mcast_receivers *receivers, const char *addr,
+                               const struct iperf_udp_header *hdr,
+                               const struct iperf_udp_server_report *report,
+                               enum iperf_version version, uint32_t tx_frames)
+{
+    struct mmiperf_mcast_receiver *entry;
+    unsigned ii;
+
+    if (!iperf_udp_server_report_valid(hdr, version))
+    {
+        return false;
+    }
+
+    for (ii = 0; ii < receivers->num; ii++)
+    {
+        if (strcmp(receivers->entries[ii].addr, addr) == 0)
+        {
+            /* Duplicate report, e.g., in response to a repeat of the final packet. */
+            return true;
+        }
+    }
+
+    if (receivers->num >= MMIPERF_MAX_MCAST_RECEIVERS)
+    {
+        receivers->dropped++;
+        return true;
+    }
+
+    entry = &receivers->entries[receivers->num++];
+    mmosal_safer_strcpy(entry->addr, addr, sizeof(entry->addr));
+    entry->rx_frames = be32toh(report->datagrams);
+    entry->error_count = be32toh(report->error_cnt);
+    entry->out_of_sequence_frames = be32toh(report->outorder_cnt);
+    entry->jitter_us = be32toh(report->jitter1) * 1000000 + be32toh(report->jitter2);
+    entry->delivery_permille = 1000;
+    if (tx_frames != 0 && entry->rx_frames < tx_frames)
+    {
+        entry->delivery_permille = (uint16_t)((uint64_t)entry->rx_frames * 1000 / tx_frames);
+    }
+    return true;
+}
+
+void iperf_mcast_receivers_summarise(const struct iperf_mcast_receivers *receivers,
+                                     struct mmiperf_report *report)
+{
+    const struct mmiperf_mcast_receiver *worst = NULL;
+    uint32_t delivery_sum = 0;
+    unsigned ii;
+
+    report->mcast_num_receivers = receivers->num;
+    report->mcast_receivers_dropped = receivers->dropped;
+    report->mcast_receivers = (receivers->num != 0) ? receivers->entries : NULL;
+    report->mcast_jitter_max_us = 0;
+
+    for (ii = 0; ii < receivers->num; ii++)
+    {
+        const struct mmiperf_mcast_receiver *entry = &receivers->entries[ii];
+
+        delivery_sum += entry->delivery_permille;
+        report->mcast_jitter_max_us = MM_MAX(report->mcast_jitter_max_us, entry->jitter_us);
+        if (worst == NULL || entry->delivery_permille < worst->delivery_permille)
+        {
+            worst = entry;
+        }
+    }
+
+    if (worst != NULL)
+    {
+        report->mcast_delivery_min_permille = worst->delivery_permille;
+        report->mcast_delivery_mean_permille = (uint16_t)(delivery_sum / receivers->num);
+        mmosal_safer_strcpy(report->mcast_worst_receiver_addr, worst->addr,
+                            sizeof(report->mcast_worst_receiver_addr));
+    }
+}
+
+uint32_t iperf_udp_mcast_report_delay_ms(void)
+{
+    return mmhal_random_u32(0, IPERF_UDP_MCAST_REPORT_SPREAD_MS);
+}
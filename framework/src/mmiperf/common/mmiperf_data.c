@@ -4,7 +4,16 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "mmiperf_private.h"
+#include "mmutils.h"
+
+/** The iperf payload data repeats with this period. */
+#define IPERF_DATA_PERIOD   (10)
+
+/** Number of words compared per iteration when verifying data (two periods of the data). */
+#define IPERF_VERIFY_BLOCK_WORDS    ((2 * IPERF_DATA_PERIOD) / sizeof(uint32_t))
 
 /** iperf packet contents to save generating every time. */
 static const uint8_t iperf_data[] = {
@@ -170,8 +179,130 @@ static const uint8_t iperf_data[] = {
     '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
 };
 
-const uint8_t *iperf_get_data(uint32_t offset)
+const uint8_t *iperf_get_data(uint64_t offset)
 {
     /* Data repeats every 10 characters, so we can take modulo 10 of the offset. */
-    return &iperf_data[offset % 10];
+    return &iperf_data[offset % IPERF_DATA_PERIOD];
+}
+
+void iperf_payload_source_init(struct iperf_payload_source *src,
+                               const struct mmiperf_client_args *args)
+{
+    memset(src, 0, sizeof(*src));
+    if (args->payload_buf != NULL && args->payload_len > 0)
+    {
+        src->buf = args->payload_buf;
+        src->len = args->payload_len;
+    }
+    else if (args->payload_fn != NULL)
+    {
+        src->fn = args->payload_fn;
+        src->arg = args->payload_arg;
+    }
+}
+
+const uint8_t *iperf_payload_get(const struct iperf_payload_source *src, uint64_t offset,
+                                 uint32_t len, uint32_t *avail)
+{
+    uint32_t pos;
+
+    if (src->fn != NULL)
+    {
+        *avail = 0;
+        return NULL;
+    }
+
+    if (src->buf == NULL)
+    {
+        /* The default data is long enough for any packet from any phase of the pattern. */
+        pos = (uint32_t)(offset % IPERF_DATA_PERIOD);
+        *avail = MM_MIN(len, sizeof(iperf_data) - pos);
+        return &iperf_data[pos];
+    }
+
+    pos = (uint32_t)(offset % src->len);
+    *avail = MM_MIN(len, src->len - pos);
+    return &src->buf[pos];
+}
+
+void iperf_payload_copy(const struct iperf_payload_source *src, uint64_t offset, uint8_t *buf,
+                        uint32_t len)
+{
+    if (src->fn != NULL)
+    {
+        src->fn(offset, buf, len, src->arg);
+        return;
+    }
+
+    while (len > 0)
+    {
+        uint32_t avail;
+        const uint8_t *data = iperf_payload_get(src, offset, len, &avail);
+
+        memcpy(buf, data, avail);
+        buf += avail;
+        offset += avail;
+        len -= avail;
+    }
+}
+
+/** Count the number of non-zero bytes in a word. */
+static inline uint32_t iperf_count_nonzero_bytes(uint32_t word)
+{
+    /* Fold each byte down into its least significant bit then sum the bytes. */
+    word |= word >> 4;
+    word |= word >> 2;
+    word |= word >> 1;
+    word &= 0x01010101;
+    return (word * 0x01010101) >> 24;
+}
+
+uint32_t iperf_verify_data(const uint8_t *data, size_t len, uint64_t offset)
+{
+    uint32_t corrupted = 0;
+    uint32_t phase = (uint32_t)(offset % IPERF_DATA_PERIOD);
+    uint32_t expected[IPERF_VERIFY_BLOCK_WORDS];
+    uint32_t actual[IPERF_VERIFY_BLOCK_WORDS];
+    unsigned ii;
+
+    /* Compare a byte at a time until the data is word aligned. */
+    while (len > 0 && ((uintptr_t)data & (sizeof(uint32_t) - 1)) != 0)
+    {
+        corrupted += (*data++ != iperf_data[phase]);
+        len--;
+        phase = (phase + 1 == IPERF_DATA_PERIOD) ? 0 : phase + 1;
+    }
+
+    /* Then compare a block of words at a time. Each block spans a whole number of periods of the
+     * data so the expected words are the same for every block. */
+    memcpy(expected, &iperf_data[phase], sizeof(expected));
+    while (len >= sizeof(actual))
+    {
+        uint32_t diff = 0;
+
+        memcpy(actual, __builtin_assume_aligned(data, sizeof(uint32_t)), sizeof(actual));
+        for (ii = 0; ii < IPERF_VERIFY_BLOCK_WORDS; ii++)
+        {
+            diff |= actual[ii] ^ expected[ii];
+        }
+        if (diff != 0)
+        {
+            for (ii = 0; ii < IPERF_VERIFY_BLOCK_WORDS; ii++)
+            {
+                corrupted += iperf_count_nonzero_bytes(actual[ii] ^ expected[ii]);
+            }
+        }
+        data += sizeof(actual);
+        len -= sizeof(actual);
+    }
+
+    /* Finally compare any remaining bytes individually. */
+    while (len > 0)
+    {
+        corrupted += (*data++ != iperf_data[phase]);
+        len--;
+        phase = (phase + 1 == IPERF_DATA_PERIOD) ? 0 : phase + 1;
+    }
+
+    return corrupted;
 }
@@ -35,63 +35,167 @@
 
 #include "mmiperf_private.h"
 
-/** List of active iperf sessions */
-static struct mmiperf_state *iperf_all_connections;
+#if IPERF_MAX_SESSIONS > 255
+#error IPERF_MAX_SESSIONS must fit into an uint8_t
+#endif
 
-void iperf_list_add(struct mmiperf_state *item)
+/*
+ * Active iperf sessions are kept in a table of slots. A handle encodes the index of the slot
+ * (plus one, so that a handle is never NULL) in its low byte and the generation of the slot in
+ * the next 16 bits. The generation is incremented each time a slot is freed so that a stale
+ * handle no longer matches once its session has been removed, even if the slot is reused.
+ *
+ * The table is protected by a mutex, which also prevents a session that has been looked up with
+ * @ref iperf_list_acquire() from being removed (and so freed) until it is released.
+ */
+
+/** Number of bits of a handle used for the slot index. */
+#define IPERF_HANDLE_INDEX_BITS (8)
+
+/** A slot in the session table. */
+struct iperf_slot
 {
-    item->next = iperf_all_connections;
-    iperf_all_connections = item;
-}
+    /** The session in this slot, or @c NULL if the slot is free. */
+    struct mmiperf_state *state;
+    /** Generation of this slot, incremented each time the slot is freed. */
+    uint16_t generation;
+    /** Index plus one of the next slot in the free list, or zero for the end of the list. */
+    uint8_t next_free;
+};
 
-void iperf_list_remove(struct mmiperf_state *item)
+/** Table of active iperf sessions. */
+static struct
+{
+    /** Mutex protecting the table (created on first use). */
+    struct mmosal_mutex *mutex;
+    /** The slots. */
+    struct iperf_slot slots[IPERF_MAX_SESSIONS];
+    /** Index plus one of the first slot in the free list, or zero if the list is empty. */
+    uint8_t free_head;
+    /** Number of slots that have ever been used. Slots beyond this are free but not listed. */
+    uint8_t num_initialised;
+    /** Number of slots in use. */
+    volatile uint8_t num_used;
+} iperf_sessions;
+
+/** Get the mutex protecting the session table, creating it if necessary. */
+static struct mmosal_mutex *iperf_list_mutex(void)
 {
-    struct mmiperf_state *prev = NULL;
-    struct mmiperf_state *iter;
-    for (iter = iperf_all_connections; iter != NULL; prev = iter, iter = iter->next)
+    struct mmosal_mutex *mutex = iperf_sessions.mutex;
+    if (mutex == NULL)
     {
-        if (iter == item)
+        mutex = mmosal_mutex_create("iperf_list");
+        MMOSAL_ASSERT(mutex != NULL);
+
+        MMOSAL_TASK_ENTER_CRITICAL();
+        if (iperf_sessions.mutex == NULL)
         {
-            if (prev == NULL)
-            {
-                iperf_all_connections = iter->next;
-            }
-            else
-            {
-                prev->next = iter->next;
-            }
-            /* ensure this item is listed only once */
-            for (iter = iter->next; iter != NULL; iter = iter->next)
-            {
-                MMOSAL_ASSERT(iter != item);
-            }
-            break;
+            iperf_sessions.mutex = mutex;
+            mutex = NULL;
+        }
+        MMOSAL_TASK_EXIT_CRITICAL();
+
+        /* Another task got there first. */
+        if (mutex != NULL)
+        {
+            mmosal_mutex_delete(mutex);
         }
     }
+    return iperf_sessions.mutex;
 }
 
-struct mmiperf_state *iperf_list_find(struct mmiperf_state *item)
+/** Get the slot that the given handle refers to, or @c NULL if the handle is stale or invalid. */
+static struct iperf_slot *iperf_list_lookup(mmiperf_handle_t handle)
 {
-    struct mmiperf_state *iter;
-    for (iter = iperf_all_connections; iter != NULL; iter = iter->next)
+    uint32_t value = (uint32_t)(uintptr_t)handle;
+    uint32_t index = value & ((1u << IPERF_HANDLE_INDEX_BITS) - 1);
+    struct iperf_slot *slot;
+
+    if (index == 0 || index > iperf_sessions.num_initialised)
     {
-        if (iter == item)
-        {
-            return item;
-        }
+        return NULL;
     }
-    return NULL;
+
+    slot = &iperf_sessions.slots[index - 1];
+    if (slot->state == NULL || slot->generation != (uint16_t)(value >> IPERF_HANDLE_INDEX_BITS))
+    {
+        return NULL;
+    }
+    return slot;
 }
 
-struct mmiperf_state *iperf_list_get(mmiperf_handle_t handle)
+bool iperf_list_add(struct mmiperf_state *item)
 {
-    struct mmiperf_state *iter;
-    for (iter = iperf_all_connections; iter != NULL; iter = iter->next)
+    struct mmosal_mutex *mutex = iperf_list_mutex();
+    struct iperf_slot *slot;
+    uint32_t index;
+
+    mmosal_mutex_get(mutex, UINT32_MAX);
+    if (iperf_sessions.free_head != 0)
     {
-        if (iter == handle)
-        {
-            return iter;
-        }
+        index = iperf_sessions.free_head;
+        iperf_sessions.free_head = iperf_sessions.slots[index - 1].next_free;
+    }
+    else if (iperf_sessions.num_initialised < IPERF_MAX_SESSIONS)
+    {
+        index = ++iperf_sessions.num_initialised;
+    }
+    else
+    {
+        mmosal_mutex_release(mutex);
+        return false;
+    }
+
+    slot = &iperf_sessions.slots[index - 1];
+    slot->state = item;
+    item->handle = (mmiperf_handle_t)(uintptr_t)(((uint32_t)slot->generation <<
+                                                  IPERF_HANDLE_INDEX_BITS) | index);
+    iperf_sessions.num_used++;
+    mmosal_mutex_release(mutex);
+    return true;
+}
+
+void iperf_list_remove(struct mmiperf_state *item)
+{
+    struct mmosal_mutex *mutex = iperf_list_mutex();
+    struct iperf_slot *slot;
+
+    mmosal_mutex_get(mutex, UINT32_MAX);
+    slot = iperf_list_lookup(item->handle);
+    /* The item may never have been added, or may have been removed already. Its handle is
+     * left as is so that it can still be passed to the report callback. */
+    if (slot != NULL && slot->state == item)
+    {
+        slot->state = NULL;
+        slot->generation++;
+        slot->next_free = iperf_sessions.free_head;
+        iperf_sessions.free_head = (uint8_t)(slot - iperf_sessions.slots) + 1;
+        iperf_sessions.num_used--;
     }
-    return NULL;
+    mmosal_mutex_release(mutex);
+}
+
+bool iperf_list_is_empty(void)
+{
+    return iperf_sessions.num_used == 0;
+}
+
+struct mmiperf_state *iperf_list_acquire(mmiperf_handle_t handle)
+{
+    struct mmosal_mutex *mutex = iperf_list_mutex();
+    struct iperf_slot *slot;
+
+    mmosal_mutex_get(mutex, UINT32_MAX);
+    slot = iperf_list_lookup(handle);
+    if (slot == NULL)
+    {
+        mmosal_mutex_release(mutex);
+        return NULL;
+    }
+    return slot->state;
+}
+
+void iperf_list_release(void)
+{
+    mmosal_mutex_release(iperf_sessions.mutex);
 }
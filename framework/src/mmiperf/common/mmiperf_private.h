@@ -67,6 +67,29 @@
 #define IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS        (1000)
 #endif
 
+/**
+ * Maximum delay before a multicast receiver sends its report to the client. Each receiver picks
+ * a random delay up to this so that the client is not flooded by reports all at once.
+ */
+#ifndef IPERF_UDP_MCAST_REPORT_SPREAD_MS
+#define IPERF_UDP_MCAST_REPORT_SPREAD_MS          (500)
+#endif
+
+/** Number of times a multicast UDP client sends its final packet, since it is not acknowledged. */
+#ifndef IPERF_UDP_MCAST_FINAL_REPEATS
+#define IPERF_UDP_MCAST_FINAL_REPEATS             (3)
+#endif
+
+/** Interval between the repeats of a multicast UDP client's final packet. */
+#ifndef IPERF_UDP_MCAST_FINAL_INTERVAL_MS
+#define IPERF_UDP_MCAST_FINAL_INTERVAL_MS         (50)
+#endif
+
+/** Time a multicast UDP client waits for receiver reports after sending its final packet. */
+#ifndef IPERF_UDP_MCAST_REPORT_WINDOW_MS
+#define IPERF_UDP_MCAST_REPORT_WINDOW_MS          (IPERF_UDP_MCAST_REPORT_SPREAD_MS + 1000)
+#endif
+
 /** The maximum number of conecutive transmit failurse we tolerate before giving up. */
 #ifndef IPERF_UDP_CLIENT_MAX_CONSEC_FAILURES
 #define IPERF_UDP_CLIENT_MAX_CONSEC_FAILURES      (60)
@@ -77,6 +100,45 @@
 #define IPERF_UDP_CLIENT_RETRY_WAIT_TIME_MS       (1000)
 #endif
 
+/**
+ * The maximum number of datagrams the lwIP UDP client transmits per stream each time it takes the
+ * TCPIP core lock.
+ */
+#ifndef IPERF_UDP_CLIENT_TX_BURST
+#define IPERF_UDP_CLIENT_TX_BURST                 (8)
+#endif
+
+/**
+ * Time the UDP client waits for the remote side to start (or continue) transmitting the receive
+ * direction of a bidirectional test before giving up on it.
+ */
+#ifndef IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS
+#define IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS       (5000)
+#endif
+
+/** Interval at which the UDP client checks the receive direction of a bidirectional test. */
+#ifndef IPERF_UDP_CLIENT_REVERSE_POLL_MS
+#define IPERF_UDP_CLIENT_REVERSE_POLL_MS          (100)
+#endif
+
+/**
+ * Maximum number of frames a TCP client in isochronous frame mode may have written but not yet
+ * had acknowledged. Starting further frames is deferred until earlier frames are acknowledged.
+ */
+#ifndef IPERF_FRAME_MAX_IN_FLIGHT
+#define IPERF_FRAME_MAX_IN_FLIGHT                 (8)
+#endif
+
+/** Maximum number of iperf sessions that can be registered at once (at most 255). */
+#ifndef IPERF_MAX_SESSIONS
+#define IPERF_MAX_SESSIONS                        (32)
+#endif
+
+/** Interval at which heap and packet memory usage are sampled while iperf sessions exist. */
+#ifndef IPERF_RESOURCE_SAMPLE_INTERVAL_MS
+#define IPERF_RESOURCE_SAMPLE_INTERVAL_MS         (20)
+#endif
+
 /** Beginning of the local port range for the UDP client to use. */
 #ifndef IPERF_UDP_CLIENT_LOCAL_PORT_RANGE_BASE
 #define IPERF_UDP_CLIENT_LOCAL_PORT_RANGE_BASE    (5010)
@@ -92,6 +154,8 @@ struct iperf_settings
 {
 #define IPERF_FLAGS_ANSWER_TEST 0x80000000
 #define IPERF_FLAGS_ANSWER_NOW 0x00000001
+/* mmiperf extension: multicast receivers unicast their server report back to the client */
+#define IPERF_FLAGS_MCAST_REPORT 0x00001000
     uint32_t flags;
     uint32_t num_threads; /* unused for now */
     uint32_t remote_port;
@@ -112,6 +176,29 @@ struct iperf_udp_header
 };
 
 
+/** Value of @c magic in @ref iperf_frame_header ("ISOF"). */
+#define IPERF_FRAME_MAGIC 0x49534f46
+
+/**
+ * Header at the start of the payload of each datagram of a frame sent by a UDP client in
+ * isochronous frame mode. All fields are in network byte order.
+ */
+struct iperf_frame_header
+{
+    /** Always @ref IPERF_FRAME_MAGIC. */
+    uint32_t magic;
+    /** Sequence number of the frame, starting at one. */
+    uint32_t frame_id;
+    /** Scheduled start time of the frame (seconds part). */
+    uint32_t start_sec;
+    /** Scheduled start time of the frame (microseconds part). */
+    uint32_t start_usec;
+    /** Deadline for delivery of the frame, relative to its start time. */
+    uint32_t deadline_us;
+    /** Number of datagrams in the frame. */
+    uint32_t datagrams;
+};
+
 struct iperf_udp_server_report
 {
     int32_t flags;
@@ -141,14 +228,49 @@ struct iperf_udp_server_report
     int32_t IPGsum;
 };
 
+/** log2 of the number of sub-buckets per power of two in the latency histogram. */
+#define IPERF_LATENCY_SUB_BUCKET_BITS       (3)
+/** Number of sub-buckets per power of two in the latency histogram. */
+#define IPERF_LATENCY_SUB_BUCKETS           (1u << IPERF_LATENCY_SUB_BUCKET_BITS)
+/** Latencies of 2^(n+1) microseconds or more (about 33 seconds) share the last bucket. */
+#define IPERF_LATENCY_MAX_EXP               (24)
+/** Number of buckets in the latency histogram. */
+#define IPERF_LATENCY_NUM_BUCKETS \
+    ((IPERF_LATENCY_MAX_EXP - IPERF_LATENCY_SUB_BUCKET_BITS + 2) * IPERF_LATENCY_SUB_BUCKETS)
+
+/**
+ * One-way latency statistics. Latencies are collected in a log-linear histogram so that
+ * percentiles can be reported without storing every sample; each bucket spans at most 1/8 of
+ * its lower bound.
+ */
+struct iperf_latency_stats
+{
+    /** Number of samples. */
+    uint32_t count;
+    /** Largest sample (in microseconds). */
+    uint32_t max_us;
+    /** Histogram of samples. */
+    uint32_t buckets[IPERF_LATENCY_NUM_BUCKETS];
+};
+
+struct iperf_stream_group;
+
 struct mmiperf_state
 {
-    /* Allow these state structures to be collected as a linked list. */
-    struct mmiperf_state *next;
+    /** Handle assigned to this session when it was added to the 'active' list, else @c NULL. */
+    mmiperf_handle_t handle;
     /* Iperf protocol: 1=tcp, 0=udp. */
     uint8_t tcp;
     /* Iperf type: 1=server, 0=client. */
     uint8_t server;
+    /* 1=this is the aggregate of a parallel test (struct iperf_stream_group). */
+    uint8_t is_group;
+    /* Index of this stream within its parallel test. */
+    uint8_t stream_id;
+    /* 1=this is an iperf3 server (struct iperf3_server). */
+    uint8_t iperf3_server;
+    /** Parallel test that this session is a stream of, or @c NULL. */
+    struct iperf_stream_group *group;
     /** The time at which this iperf session was startd. */
     uint32_t time_started_ms;
     /** The last time at which we received a packet. (UDP only) */
@@ -160,14 +282,192 @@ struct mmiperf_state
     mmiperf_report_fn report_fn;
     /** Argument to pass to callback function. */
     void *report_arg;
+    /** One-way latency statistics, or @c NULL if latency is not being measured. */
+    struct iperf_latency_stats *latency;
+    /** 1=verify the payload of received data against the iperf data pattern. */
+    uint8_t verify_payload;
+    /** CPU usage statistics at the time the session started. */
+    struct mmosal_cpu_stats cpu_start;
+    /** Transit time of the previous datagram received, for the jitter calculation. (UDP only) */
+    int64_t prev_transit_us;
+    /** Interarrival jitter in microseconds, scaled by 16. (UDP only) */
+    uint32_t jitter_x16_us;
+};
+
+/** Aggregate state for the streams of a parallel (-P) client test. */
+struct iperf_stream_group
+{
+    /** The aggregate (SUM) report is collected in here. This is the handle of the test. */
+    struct mmiperf_state base;
+    /** Number of streams in the test. */
+    uint8_t num_streams;
+    /** Number of streams that have finished. */
+    uint8_t num_done;
+    /** Streams that are still running (entries are cleared as streams finish). */
+    struct mmiperf_state *streams[MMIPERF_MAX_STREAMS];
 };
 
-/** Add an iperf session to the 'active' list */
-void iperf_list_add(struct mmiperf_state *item);
+/**
+ * Allocate the aggregate state for a parallel client test.
+ *
+ * @param tcp   1 for a TCP test, 0 for a UDP test.
+ * @param args  The client arguments for the test.
+ *
+ * @returns the allocated group on success or @c NULL on failure.
+ */
+struct iperf_stream_group *iperf_stream_group_alloc(uint8_t tcp,
+                                                    const struct mmiperf_client_args *args);
+
+/**
+ * Add a stream to a parallel client test. This must be done before the stream starts running.
+ *
+ * @param group     The parallel test.
+ * @param stream    The stream to add.
+ */
+void iperf_stream_group_add(struct iperf_stream_group *group, struct mmiperf_state *stream);
+
+/**
+ * Get the start time of the test that the given session belongs to. For streams of a parallel
+ * test this is the start time shared by all streams.
+ */
+static inline uint32_t iperf_test_start_time_ms(const struct mmiperf_state *base_state)
+{
+    if (base_state->group != NULL)
+    {
+        return base_state->group->base.time_started_ms;
+    }
+    return base_state->time_started_ms;
+}
 
-/** Remove an iperf session from the 'active' list */
+/**
+ * Get the time to use for UDP packet timestamps (see @ref mmiperf_set_clock_offset_us()).
+ *
+ * @returns the time in microseconds.
+ */
+uint64_t iperf_get_time_us(void);
+
+/**
+ * Add a sample to the one-way latency statistics.
+ *
+ * @param stats         The statistics to update.
+ * @param latency_us    The latency in microseconds. Negative values (which can occur if the
+ *                      clocks are not perfectly synchronised) are counted as zero.
+ */
+void iperf_latency_stats_add(struct iperf_latency_stats *stats, int64_t latency_us);
+
+/**
+ * Update the timing statistics of a UDP server session for a received datagram.
+ *
+ * @param base_state        Iperf session state data structure.
+ * @param tx_time_us        The transmit timestamp from the datagram.
+ * @param prev_tx_time_us   The transmit timestamp of the previous datagram of the session, or
+ *                          zero if this is the first. This is updated to @p tx_time_us.
+ */
+void iperf_udp_server_update_timing(struct mmiperf_state *base_state, uint64_t tx_time_us,
+                                    uint64_t *prev_tx_time_us);
+
+/**
+ * Get the length of the headers at the start of each iperf2 UDP datagram. The payload data
+ * follows these headers.
+ *
+ * @param version   The iperf version.
+ *
+ * @returns the length of the headers.
+ */
+uint32_t iperf_udp_hdrs_len(enum iperf_version version);
+
+/**
+ * Initialise the settings that a UDP client sends in each datagram. For the bidirectional and
+ * reverse modes these ask the server to send a test back to us.
+ *
+ * @param settings  The settings to initialise (in network byte order).
+ * @param args      The client arguments.
+ */
+void iperf_udp_client_settings_init(struct iperf_settings *settings,
+                                    const struct mmiperf_client_args *args);
+
+/**
+ * Get the arguments for the UDP client that a server starts to answer a bidirectional test, from
+ * the settings sent by the remote client.
+ *
+ * @param settings  The settings received from the remote client (in network byte order).
+ * @param args      The client arguments to update. The caller must fill in the address.
+ */
+void iperf_udp_server_answer_args(const struct iperf_settings *settings,
+                                  struct mmiperf_client_args *args);
+
+/**
+ * Record the result of verifying a received segment of payload data.
+ *
+ * @param base_state        Iperf session state data structure.
+ * @param corrupted_bytes   Number of corrupted bytes found in the segment (as returned by
+ *                          @ref iperf_verify_data()).
+ * @param start_time_us     The time (from @ref mmosal_get_time_us()) at which verification of
+ *                          the segment started.
+ */
+void iperf_verify_record(struct mmiperf_state *base_state, uint32_t corrupted_bytes,
+                         uint64_t start_time_us);
+
+/*
+ * Locking of the 'active' list.
+ *
+ * The list is protected by a mutex that is taken by iperf_list_add(), iperf_list_remove() and
+ * held between iperf_list_acquire() and iperf_list_release(). The lwIP implementation adds and
+ * removes sessions from TCPIP thread callbacks, so the lock order is:
+ *
+ *   1. the lwIP TCPIP core lock (or the TCPIP thread itself), then
+ *   2. the list mutex.
+ *
+ * Code holding the list mutex must therefore never take the TCPIP core lock or call into the IP
+ * stack, and must only hold it briefly since the TCPIP thread may block on it. It must also not
+ * add or remove sessions, since the mutex is not recursive.
+ */
+
+/**
+ * Add an iperf session to the 'active' list and assign it a handle (see
+ * @ref mmiperf_state::handle).
+ *
+ * @param item  The session to add.
+ *
+ * @returns @c true on success, or @c false if @ref IPERF_MAX_SESSIONS sessions are active.
+ */
+bool iperf_list_add(struct mmiperf_state *item);
+
+/**
+ * Remove an iperf session from the 'active' list. Its handle becomes stale but is left in
+ * @ref mmiperf_state::handle for reporting. This does nothing if the session is not in the list.
+ *
+ * This blocks while another task has the list acquired (see @ref iperf_list_acquire()), so the
+ * session may be freed once this returns.
+ */
 void iperf_list_remove(struct mmiperf_state *item);
 
+/** Check whether there are no iperf sessions in the 'active' list. */
+bool iperf_list_is_empty(void);
+
+/**
+ * Look up an active iperf session by handle and lock the list so that the session cannot be
+ * removed until @ref iperf_list_release() is called. Sessions must not be added or removed by
+ * the caller while the list is locked (see the lock order above).
+ *
+ * @param handle    Handle of the session.
+ *
+ * @returns the session, or @c NULL (with the list not locked) if the handle is invalid or stale.
+ */
+struct mmiperf_state *iperf_list_acquire(mmiperf_handle_t handle);
+
+/** Unlock the list after a successful call to @ref iperf_list_acquire(). */
+void iperf_list_release(void);
+
+/**
+ * Start collecting resource usage (CPU, heap and packet memory) statistics for an iperf session.
+ * This should be called when the session starts. The heap and packet memory peaks are shared
+ * by all sessions and are reset whenever a session starts.
+ *
+ * @param base_state    Iperf session state data structure.
+ */
+void iperf_resource_start(struct mmiperf_state *base_state);
+
 /** Update the report data for the given iperf session based on the given time. */
 void iperf_finalize_report_and_invoke_callback(struct mmiperf_state *state, uint32_t duration_ms,
                                                enum mmiperf_report_type report_type);
@@ -195,11 +495,52 @@ bool iperf_parse_udp_server_report(struct mmiperf_state *base_state,
                                    const struct iperf_udp_server_report *report,
                                    enum iperf_version version);
 
-/** Find a given item in the list and return a pointer to it if found, else return NULL. */
-struct mmiperf_state *iperf_list_find(struct mmiperf_state *item);
+/** Reports collected from the receivers of a multicast UDP client test. */
+struct iperf_mcast_receivers
+{
+    /** Number of entries in use. */
+    uint16_t num;
+    /** Number of receivers that reported after the table was full. */
+    uint16_t dropped;
+    /** The receivers, in the order their reports arrived. */
+    struct mmiperf_mcast_receiver entries[MMIPERF_MAX_MCAST_RECEIVERS];
+};
+
+/**
+ * Record the server report sent back by a receiver of a multicast UDP client test. Duplicate
+ * reports from the same receiver are ignored.
+ *
+ * @param receivers     The receiver reports collected so far.
+ * @param addr          IP address of the receiver (as a string).
+ * @param hdr           The iperf UDP header in the report datagram.
+ * @param report        The iperf UDP server report in the report datagram.
+ * @param version       The iperf version.
+ * @param tx_frames     Number of datagrams sent by the client.
+ *
+ * @returns @c true if the report was valid, else @c false.
+ */
+bool iperf_mcast_receivers_add(struct iperf_mcast_receivers *receivers, const char *addr,
+                               const struct iperf_udp_header *hdr,
+                               const struct iperf_udp_server_report *report,
+                               enum iperf_version version, uint32_t tx_frames);
 
-/** Look up an iperf session in the list based on a given handle. */
-struct mmiperf_state *iperf_list_get(mmiperf_handle_t handle);
+/**
+ * Fill in the multicast summary fields of a client report from the receiver reports collected.
+ * @ref mmiperf_report::mcast_receivers points into @p receivers, which must therefore remain
+ * valid until the report callback has been invoked.
+ *
+ * @param receivers     The receiver reports.
+ * @param report        The client report to update.
+ */
+void iperf_mcast_receivers_summarise(const struct iperf_mcast_receivers *receivers,
+                                     struct mmiperf_report *report);
+
+/**
+ * Get the random delay a multicast receiver should wait before sending its report.
+ *
+ * @returns the delay in milliseconds.
+ */
+uint32_t iperf_udp_mcast_report_delay_ms(void);
 
 /**
  * Get a pointer to iperf payload data at the given offset.
@@ -208,4 +549,210 @@ struct mmiperf_state *iperf_list_get(mmiperf_handle_t handle);
  *
  * @returns a pointer into the data.
  */
-const uint8_t *iperf_get_data(uint32_t offset);
+const uint8_t *iperf_get_data(uint64_t offset);
+
+/** Source of the payload data sent by an iperf client (see @ref mmiperf_client_args). */
+struct iperf_payload_source
+{
+    /** Stable buffer of payload data, or @c NULL. */
+    const uint8_t *buf;
+    /** Length of @c buf. */
+    uint32_t len;
+    /** Payload generator callback, or @c NULL. */
+    mmiperf_payload_fn fn;
+    /** Opaque argument to pass to @c fn. */
+    void *arg;
+};
+
+/**
+ * Initialise a payload source from the client arguments. If the arguments do not supply any
+ * payload then the default iperf payload data is used.
+ *
+ * @param src   The payload source to initialise.
+ * @param args  Iperf client arguments.
+ */
+void iperf_payload_source_init(struct iperf_payload_source *src,
+                               const struct mmiperf_client_args *args);
+
+/**
+ * Check whether a payload source supplies the default iperf payload data. The default data is
+ * periodic, so datagrams may all start at offset zero, whereas application data continues from
+ * one datagram to the next.
+ */
+static inline bool iperf_payload_is_default(const struct iperf_payload_source *src)
+{
+    return src->buf == NULL && src->fn == NULL;
+}
+
+/**
+ * Get a pointer to payload data that can be sent without copying.
+ *
+ * @param src       The payload source.
+ * @param offset    Offset into the payload data.
+ * @param len       Length of data wanted.
+ * @param avail     Receives the length of data available at the returned pointer, which may be
+ *                  less than @p len if the payload buffer wraps.
+ *
+ * @returns a pointer into the payload data, or @c NULL if the data is generated and must be
+ *          copied using @ref iperf_payload_copy().
+ */
+const uint8_t *iperf_payload_get(const struct iperf_payload_source *src, uint64_t offset,
+                                 uint32_t len, uint32_t *avail);
+
+/**
+ * Copy payload data into a buffer.
+ *
+ * @param src       The payload source.
+ * @param offset    Offset into the payload data.
+ * @param buf       Buffer to receive the data.
+ * @param len       Length of data to copy.
+ */
+void iperf_payload_copy(const struct iperf_payload_source *src, uint64_t offset, uint8_t *buf,
+                        uint32_t len);
+
+/**
+ * Stream offset at which iperf2 TCP payload data starts. Our clients send the settings header
+ * twice before sending data, so only data after this offset is verified.
+ */
+#define IPERF_TCP_VERIFY_START_OFFSET       (2 * sizeof(struct iperf_settings))
+
+/**
+ * Verify received data against the iperf payload data (see @ref iperf_get_data()).
+ *
+ * @param data      The received data.
+ * @param len       Length of @p data.
+ * @param offset    Offset into the payload data at which @p data starts.
+ *
+ * @returns the number of bytes of @p data that do not match the payload data.
+ */
+uint32_t iperf_verify_data(const uint8_t *data, size_t len, uint64_t offset);
+
+/** Check whether the client arguments select isochronous frame mode. */
+static inline bool iperf_frame_mode(const struct mmiperf_client_args *args)
+{
+    return args->frame_len != 0 && args->frame_period_ms != 0;
+}
+
+/** Transmit state of a client in isochronous frame mode. */
+struct iperf_frame_tx
+{
+    /** Length of each frame in bytes (zero if not in frame mode). */
+    uint32_t len;
+    /** Frame period. */
+    uint32_t period_ms;
+    /** Deadline for delivery of each frame, relative to its start time. */
+    uint32_t deadline_us;
+    /** Time at which the next frame is due to start. */
+    uint32_t next_start_ms;
+    /** Sequence number of the current frame. */
+    uint32_t id;
+    /** Scheduled start time of the current frame (see @ref iperf_get_time_us()). */
+    uint64_t start_us;
+    /** Number of bytes of the current frame still to be sent. */
+    uint32_t remaining;
+    /** Stream offset of the end of the last frame started (TCP only). */
+    uint64_t queued_end;
+    /** Frames that have been started but not yet acknowledged (TCP only). */
+    struct
+    {
+        /** Stream offset of the end of the frame. */
+        uint64_t end;
+        /** Scheduled start time of the frame. */
+        uint64_t start_us;
+    } in_flight[IPERF_FRAME_MAX_IN_FLIGHT];
+    /** Index of the oldest entry in @c in_flight. */
+    uint8_t in_flight_head;
+    /** Number of entries in @c in_flight. */
+    uint8_t in_flight_count;
+};
+
+/**
+ * Initialise the isochronous frame transmit state of a client from its arguments. The first
+ * frame is due immediately.
+ *
+ * @param tx            The state to initialise.
+ * @param args          Iperf client arguments. Frame mode is disabled unless both
+ *                      @c frame_len and @c frame_period_ms are set.
+ * @param stream_offset Stream offset at which the first frame will start (TCP only).
+ */
+void iperf_frame_tx_init(struct iperf_frame_tx *tx, const struct mmiperf_client_args *args,
+                         uint64_t stream_offset);
+
+/**
+ * Start the next frame if the current frame has been sent and the next one is due. A frame that
+ * starts late (because the previous frame took longer than the period to send) keeps its
+ * scheduled start time, so the delay counts towards its latency.
+ *
+ * @param tx            The frame transmit state.
+ * @param track_acks    @c true to add the frame to @c in_flight for @ref iperf_frame_tx_acked().
+ *                      The frame is not started if @c in_flight is full.
+ *
+ * @returns @c true if a frame was started, else @c false.
+ */
+bool iperf_frame_tx_start(struct iperf_frame_tx *tx, bool track_acks);
+
+/**
+ * Get the time until the next frame is due to start.
+ *
+ * @param tx    The frame transmit state.
+ *
+ * @returns the time in milliseconds, or zero if the next frame is already due.
+ */
+uint32_t iperf_frame_tx_wait_ms(const struct iperf_frame_tx *tx);
+
+/**
+ * Record the delivery of frames that have been acknowledged (TCP only).
+ *
+ * @param base_state    Iperf session state data structure.
+ * @param tx            The frame transmit state.
+ * @param acked         Stream offset up to which data has been acknowledged.
+ */
+void iperf_frame_tx_acked(struct mmiperf_state *base_state, struct iperf_frame_tx *tx,
+                          uint64_t acked);
+
+/**
+ * Fill in the frame header of a datagram of the current frame (UDP only).
+ *
+ * @param hdr           The header to fill in (need not be aligned).
+ * @param tx            The frame transmit state.
+ * @param payload_len   Length of frame data carried by each datagram of the frame.
+ */
+void iperf_frame_tx_fill_header(void *hdr, const struct iperf_frame_tx *tx, uint32_t payload_len);
+
+/** Receive state of a UDP server session for frames in isochronous frame mode. */
+struct iperf_frame_rx
+{
+    /** Sequence number of the current frame, or zero if none. */
+    uint32_t id;
+    /** Number of datagrams in the current frame. */
+    uint32_t datagrams;
+    /** Number of datagrams of the current frame received. */
+    uint32_t received;
+    /** Deadline for delivery of the current frame, relative to its start time. */
+    uint32_t deadline_us;
+    /** Scheduled start time of the current frame. */
+    uint64_t start_us;
+};
+
+/**
+ * Update the frame statistics of a UDP server session for a received datagram. Datagrams that
+ * do not start with a frame header are ignored. A frame that is superseded before all of its
+ * datagrams have been received is counted as a missed deadline.
+ *
+ * @param base_state    Iperf session state data structure.
+ * @param rx            The frame receive state of the session.
+ * @param payload       The payload of the datagram following the iperf headers (need not be
+ *                      aligned).
+ * @param len           Length of @p payload.
+ */
+void iperf_frame_rx_update(struct mmiperf_state *base_state, struct iperf_frame_rx *rx,
+                           const void *payload, uint32_t len);
+
+/**
+ * Finish the frame statistics of a UDP server session when it ends, counting an incomplete
+ * frame as a missed deadline.
+ *
+ * @param base_state    Iperf session state data structure.
+ * @param rx            The frame receive state of the session.
+ */
+void iperf_frame_rx_finish(struct mmiperf_state *base_state, struct iperf_frame_rx *rx);
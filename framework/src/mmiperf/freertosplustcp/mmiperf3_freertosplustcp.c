@@ -0,0 +1,399 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Socket API for the iperf3 compatibility mode, implemented using FreeRTOS+TCP sockets.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mmiperf_freertosplustcp.h"
+#include "../common/mmiperf3_private.h"
+
+/** Timeout value indicating that the socket timeout has not been set. */
+#define IPERF3_FREERTOS_TIMEOUT_UNSET   (UINT32_MAX)
+
+struct iperf3_sock
+{
+    /** The FreeRTOS+TCP socket. */
+    Socket_t socket;
+    /** @c true if this is a UDP socket. */
+    bool udp;
+    /** @c true if sends go to the source of the last datagram received. */
+    bool track_peer;
+    /** Receive timeout currently configured on the socket. */
+    uint32_t rcv_timeout_ms;
+    /** Send timeout currently configured on the socket. */
+    uint32_t snd_timeout_ms;
+    /** For UDP sockets, the address datagrams are sent to. */
+    struct freertos_sockaddr peer;
+    /** @c true if @c peer is valid. */
+    bool have_peer;
+};
+
+/**
+ * Convert an address string and port into a socket address.
+ *
+ * @param addr      The address (as a string). If empty then the unspecified IPv4 address is used.
+ * @param port      The port.
+ * @param sa        Receives the socket address.
+ *
+ * @returns 0 on success, else -1.
+ */
+static int iperf3_freertos_make_sockaddr(const char *addr, uint16_t port,
+                                         struct freertos_sockaddr *sa)
+{
+    BaseType_t parsed = pdFAIL;
+
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_len = sizeof(*sa);
+    sa->sin_port = FreeRTOS_htons(port);
+    sa->sin_family = FREERTOS_AF_INET;
+    if (addr == NULL || addr[0] == '\0')
+    {
+        return 0;
+    }
+
+#if ipconfigUSE_IPv4
+    parsed = FreeRTOS_inet_pton4(addr, &sa->sin_address.ulIP_IPv4);
+#endif
+#if ipconfigUSE_IPv6
+    if (parsed != pdPASS)
+    {
+        sa->sin_family = FREERTOS_AF_INET6;
+        parsed = FreeRTOS_inet_pton6(addr, &sa->sin_address.xIP_IPv6.ucBytes);
+    }
+#endif
+    if (parsed != pdPASS)
+    {
+        FreeRTOS_debug_printf(("iperf3: invalid address %s\n", addr));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Convert a socket address into an address string and port.
+ *
+ * @param sa        The socket address.
+ * @param addr      Buffer to receive the address string.
+ * @param addr_len  Length of @p addr.
+ * @param port      Receives the port.
+ */
+static void iperf3_freertos_parse_sockaddr(const struct freertos_sockaddr *sa, char *addr,
+                                           size_t addr_len, uint16_t *port)
+{
+    addr[0] = '\0';
+#if ipconfigUSE_IPv4
+    if (sa->sin_family == FREERTOS_AF_INET)
+    {
+        (void)FreeRTOS_inet_ntop4(&sa->sin_address.ulIP_IPv4, addr, addr_len);
+    }
+#endif
+#if ipconfigUSE_IPv6
+    if (sa->sin_family == FREERTOS_AF_INET6)
+    {
+        (void)FreeRTOS_inet_ntop6(&sa->sin_address.xIP_IPv6.ucBytes, addr, addr_len);
+    }
+#endif
+    *port = FreeRTOS_ntohs(sa->sin_port);
+}
+
+/** Allocate a socket handle for the given FreeRTOS+TCP socket. */
+static struct iperf3_sock *iperf3_freertos_sock_alloc(Socket_t socket, bool udp)
+{
+    struct iperf3_sock *sock;
+
+    if (socket == NULL || socket == FREERTOS_INVALID_SOCKET)
+    {
+        return NULL;
+    }
+
+    sock = (struct iperf3_sock *)mmosal_malloc(sizeof(*sock));
+    if (sock == NULL)
+    {
+        (void)FreeRTOS_closesocket(socket);
+        return NULL;
+    }
+
+    memset(sock, 0, sizeof(*sock));
+    sock->socket = socket;
+    sock->udp = udp;
+    sock->rcv_timeout_ms = IPERF3_FREERTOS_TIMEOUT_UNSET;
+    sock->snd_timeout_ms = IPERF3_FREERTOS_TIMEOUT_UNSET;
+    return sock;
+}
+
+/** Open a socket of the given address family. */
+static struct iperf3_sock *iperf3_freertos_open(const struct freertos_sockaddr *sa, bool udp)
+{
+    Socket_t socket = FreeRTOS_socket(sa->sin_family,
+                                      udp ? FREERTOS_SOCK_DGRAM : FREERTOS_SOCK_STREAM,
+                                      udp ? FREERTOS_IPPROTO_UDP : FREERTOS_IPPROTO_TCP);
+    return iperf3_freertos_sock_alloc(socket, udp);
+}
+
+/** Set a socket timeout, if not already set to the given value. */
+static void iperf3_freertos_set_timeout(struct iperf3_sock *sock, int32_t optname,
+                                        uint32_t *current_ms, uint32_t timeout_ms)
+{
+    TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+
+    if (*current_ms == timeout_ms)
+    {
+        return;
+    }
+
+    if (FreeRTOS_setsockopt(sock->socket, 0, optname, &ticks, sizeof(ticks)) == 0)
+    {
+        *current_ms = timeout_ms;
+    }
+}
+
+struct iperf3_sock *iperf3_sock_tcp_connect(const char *addr, uint16_t port)
+{
+    struct freertos_sockaddr sa;
+    struct iperf3_sock *sock;
+
+    if (iperf3_freertos_make_sockaddr(addr, port, &sa) != 0)
+    {
+        return NULL;
+    }
+
+    sock = iperf3_freertos_open(&sa, false);
+    if (sock == NULL)
+    {
+        return NULL;
+    }
+
+    /* The connect timeout is the send timeout. */
+    iperf3_freertos_set_timeout(sock, FREERTOS_SO_SNDTIMEO, &sock->snd_timeout_ms,
+                                IPERF3_CTRL_TIMEOUT_MS);
+    if (FreeRTOS_connect(sock->socket, &sa, sizeof(sa)) != 0)
+    {
+        FreeRTOS_debug_printf(("iperf3: connect failed\n"));
+        iperf3_sock_close(sock);
+        return NULL;
+    }
+    return sock;
+}
+
+struct iperf3_sock *iperf3_sock_tcp_listen(const char *local_addr, uint16_t port)
+{
+    struct freertos_sockaddr sa;
+    struct iperf3_sock *sock;
+
+    if (iperf3_freertos_make_sockaddr(local_addr, port, &sa) != 0)
+    {
+        return NULL;
+    }
+
+    sock = iperf3_freertos_open(&sa, false);
+    if (sock == NULL)
+    {
+        return NULL;
+    }
+
+    if (FreeRTOS_bind(sock->socket, &sa, sizeof(sa)) != 0 ||
+        FreeRTOS_listen(sock->socket, MMIPERF_MAX_STREAMS) != 0)
+    {
+        FreeRTOS_debug_printf(("iperf3: failed to listen on port %u\n", port));
+        iperf3_sock_close(sock);
+        return NULL;
+    }
+    return sock;
+}
+
+struct iperf3_sock *iperf3_sock_tcp_accept(struct iperf3_sock *listener, uint32_t timeout_ms)
+{
+    struct freertos_sockaddr sa;
+    uint32_t sa_len = sizeof(sa);
+
+    /* FreeRTOS+TCP applies the receive timeout to accept(). */
+    iperf3_freertos_set_timeout(listener, FREERTOS_SO_RCVTIMEO, &listener->rcv_timeout_ms,
+                                timeout_ms);
+    return iperf3_freertos_sock_alloc(FreeRTOS_accept(listener->socket, &sa, &sa_len), false);
+}
+
+struct iperf3_sock *iperf3_sock_udp_connect(const char *addr, uint16_t port)
+{
+    struct freertos_sockaddr sa;
+    struct iperf3_sock *sock;
+
+    if (iperf3_freertos_make_sockaddr(addr, port, &sa) != 0)
+    {
+        return NULL;
+    }
+
+    sock = iperf3_freertos_open(&sa, true);
+    if (sock == NULL)
+    {
+        return NULL;
+    }
+
+    /* FreeRTOS+TCP has no connected UDP sockets, so we just remember the destination. */
+    memcpy(&sock->peer, &sa, sizeof(sock->peer));
+    sock->have_peer = true;
+    return sock;
+}
+
+struct iperf3_sock *iperf3_sock_udp_bind(const char *local_addr, uint16_t port)
+{
+    struct freertos_sockaddr sa;
+    struct iperf3_sock *sock;
+
+    if (iperf3_freertos_make_sockaddr(local_addr, port, &sa) != 0)
+    {
+        return NULL;
+    }
+
+    sock = iperf3_freertos_open(&sa, true);
+    if (sock == NULL)
+    {
+        return NULL;
+    }
+
+    if (FreeRTOS_bind(sock->socket, &sa, sizeof(sa)) != 0)
+    {
+        FreeRTOS_debug_printf(("iperf3: failed to bind UDP port %u\n", port));
+        iperf3_sock_close(sock);
+        return NULL;
+    }
+    sock->track_peer = true;
+    return sock;
+}
+
+int iperf3_sock_send(struct iperf3_sock *sock, const void *buf, size_t len, uint32_t timeout_ms)
+{
+    BaseType_t flags = 0;
+    int32_t ret;
+
+    if (timeout_ms == 0)
+    {
+        flags = FREERTOS_MSG_DONTWAIT;
+    }
+    else
+    {
+        iperf3_freertos_set_timeout(sock, FREERTOS_SO_SNDTIMEO, &sock->snd_timeout_ms,
+                                    timeout_ms);
+    }
+
+    if (sock->udp)
+    {
+        if (!sock->have_peer)
+        {
+            return -1;
+        }
+
+        /* FreeRTOS_sendto() returns zero if no network buffer was available. */
+        ret = FreeRTOS_sendto(sock->socket, buf, len, flags, &sock->peer, sizeof(sock->peer));
+        return ret;
+    }
+
+    ret = FreeRTOS_send(sock->socket, buf, len, flags);
+    if (ret == -pdFREERTOS_ERRNO_ENOSPC || ret == -pdFREERTOS_ERRNO_EWOULDBLOCK)
+    {
+        return 0;
+    }
+    return ret;
+}
+
+int iperf3_sock_recv(struct iperf3_sock *sock, void *buf, size_t len, uint32_t timeout_ms)
+{
+    BaseType_t flags = 0;
+    int32_t ret;
+
+    if (timeout_ms == 0)
+    {
+        flags = FREERTOS_MSG_DONTWAIT;
+    }
+    else
+    {
+        iperf3_freertos_set_timeout(sock, FREERTOS_SO_RCVTIMEO, &sock->rcv_timeout_ms,
+                                    timeout_ms);
+    }
+
+    if (sock->udp)
+    {
+        struct freertos_sockaddr peer;
+        uint32_t peer_len = sizeof(peer);
+
+        ret = FreeRTOS_recvfrom(sock->socket, buf, len, flags, &peer, &peer_len);
+        if (ret == -pdFREERTOS_ERRNO_EWOULDBLOCK || ret == 0)
+        {
+            return 0;
+        }
+        if (ret > 0 && sock->track_peer)
+        {
+            memcpy(&sock->peer, &peer, sizeof(sock->peer));
+            sock->have_peer = true;
+        }
+        return ret;
+    }
+
+    /* FreeRTOS_recv() returns zero on timeout and a negative error once the connection closes. */
+    ret = FreeRTOS_recv(sock->socket, buf, len, flags);
+    if (ret == -pdFREERTOS_ERRNO_EWOULDBLOCK)
+    {
+        return 0;
+    }
+    return ret;
+}
+
+void iperf3_sock_get_addrs(struct iperf3_sock *sock, struct mmiperf_report *report)
+{
+    struct freertos_sockaddr sa;
+
+    FreeRTOS_GetLocalAddress(sock->socket, &sa);
+    iperf3_freertos_parse_sockaddr(&sa, report->local_addr, sizeof(report->local_addr),
+                                   &report->local_port);
+
+    if (sock->udp)
+    {
+        if (sock->have_peer)
+        {
+            iperf3_freertos_parse_sockaddr(&sock->peer, report->remote_addr,
+                                           sizeof(report->remote_addr), &report->remote_port);
+        }
+        return;
+    }
+
+    FreeRTOS_GetRemoteAddress(sock->socket, &sa);
+    iperf3_freertos_parse_sockaddr(&sa, report->remote_addr, sizeof(report->remote_addr),
+                                   &report->remote_port);
+}
+
+void iperf3_sock_close(struct iperf3_sock *sock)
+{
+    if (sock == NULL)
+    {
+        return;
+    }
+
+    if (!sock->udp)
+    {
+        (void)FreeRTOS_shutdown(sock->socket, FREERTOS_SHUT_RDWR);
+    }
+    (void)FreeRTOS_closesocket(sock->socket);
+    mmosal_free(sock);
+}
+
+void iperf3_log(const char *format, ...)
+{
+#if ipconfigHAS_DEBUG_PRINTF
+    char msg[IPERF3_LOG_MAX_LEN];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+    FreeRTOS_debug_printf(("%s", msg));
+#else
+    (void)format;
+#endif
+}
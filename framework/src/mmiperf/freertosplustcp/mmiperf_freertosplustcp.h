@@ -14,6 +14,15 @@
 #include "FreeRTOS_IPv4_Sockets.h"
 #include "FreeRTOS_IPv6_Sockets.h"
 
+/**
+ * Whether the data paths use the FreeRTOS+TCP zero-copy socket API, reading and writing network
+ * buffers borrowed from the stack instead of copying through buffers of their own. Set this to 0
+ * to build the copying implementation, for example to benchmark one against the other.
+ */
+#ifndef MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+#define MMIPERF_FREERTOSPLUSTCP_ZERO_COPY   (1)
+#endif
+
 /**
  * Initialise the given iperf state structure at the start of an iperf session.
  *
@@ -25,4 +34,25 @@ void iperf_freertosplustcp_session_start_common(struct mmiperf_state *base,
                                                 const struct freertos_sockaddr *local_addr,
                                                 const struct freertos_sockaddr *remote_addr);
 
+/**
+ * Check whether two socket addresses have the same IP address (ignoring the port).
+ *
+ * @param a     The first address.
+ * @param b     The second address.
+ *
+ * @returns @c true if the IP addresses match, else @c false.
+ */
+bool iperf_freertosplustcp_sockaddr_addr_match(const struct freertos_sockaddr *a,
+                                               const struct freertos_sockaddr *b);
+
+/**
+ * Convert the IP address of a socket address to a string.
+ *
+ * @param sa    The socket address.
+ * @param buf   Buffer to receive the string.
+ * @param len   Length of @p buf.
+ */
+void iperf_freertosplustcp_sockaddr_ntop(const struct freertos_sockaddr *sa, char *buf,
+                                         size_t len);
+
 #endif
@@ -46,4 +46,41 @@ void iperf_freertosplustcp_session_start_common(struct mmiperf_state *base,
     report->duration_ms = 0;
 
     base->time_started_ms = mmosal_get_time_ms();
+    iperf_resource_start(base);
+}
+
+bool iperf_freertosplustcp_sockaddr_addr_match(const struct freertos_sockaddr *a,
+                                               const struct freertos_sockaddr *b)
+{
+    if (a->sin_family != b->sin_family)
+    {
+        return false;
+    }
+    if (a->sin_family == FREERTOS_AF_INET)
+    {
+        return a->sin_address.ulIP_IPv4 == b->sin_address.ulIP_IPv4;
+    }
+    else
+    {
+        return !memcmp(&a->sin_address.xIP_IPv6, &b->sin_address.xIP_IPv6,
+                       sizeof(a->sin_address.xIP_IPv6));
+    }
+}
+
+void iperf_freertosplustcp_sockaddr_ntop(const struct freertos_sockaddr *sa, char *buf,
+                                         size_t len)
+{
+    buf[0] = '\0';
+#if ipconfigUSE_IPv4
+    if (sa->sin_family == FREERTOS_AF_INET)
+    {
+        (void)FreeRTOS_inet_ntop4(&sa->sin_address.ulIP_IPv4, buf, len);
+    }
+#endif
+#if ipconfigUSE_IPv6
+    if (sa->sin_family == FREERTOS_AF_INET6)
+    {
+        (void)FreeRTOS_inet_ntop6(&sa->sin_address.xIP_IPv6.ucBytes, buf, len);
+    }
+#endif
 }
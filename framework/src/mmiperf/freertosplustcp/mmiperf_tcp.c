@@ -7,6 +7,7 @@
 #include <stddef.h>
 
 #include "mmiperf_freertosplustcp.h"
+#include "../common/mmiperf3_private.h"
 #include "mmipal.h"
 #include "mmutils.h"
 
@@ -31,7 +32,9 @@ struct iperf_state_tcp
     uint8_t client_tradeoff_mode;
     struct iperf_settings settings;
     uint8_t have_settings_buf;
+    /* 1=only accept a single connection from remote_sa (reverse direction of a bidir test) */
     uint8_t specific_remote;
+    struct freertos_sockaddr remote_sa;
     /* block parameter */
     bool bw_limit;
     uint32_t block_end_time;
@@ -39,8 +42,19 @@ struct iperf_state_tcp
     uint32_t block_remaining_txlen;
     struct mmosal_task *tcp_client_task;
     struct mmosal_task *tcp_server_task;
+    /* source of the payload data (client only) */
+    struct iperf_payload_source payload;
+    /* scratch buffer for generated payload data, or NULL */
+    uint8_t *tx_buf;
+    /* isochronous frame mode (client only) */
+    struct iperf_frame_tx frame;
 };
 
+static int iperf_tx_start_impl(const struct freertos_sockaddr *remote_sa,
+                               const struct mmiperf_client_args *args,
+                               struct iperf_settings *settings,
+                               struct iperf_stream_group *group,
+                               struct iperf_state_tcp **new_conn);
 
 static int tcp_listen_on_new_socket(struct iperf_state_tcp *s)
 {
@@ -86,6 +100,82 @@ static int tcp_listen_on_new_socket(struct iperf_state_tcp *s)
     return err;
 }
 
+/**
+ * Start a TCP connection back to the remote client, as requested in the settings it sent for a
+ * bidirectional test.
+ */
+static int iperf_tx_start_passive(struct iperf_state_tcp *s)
+{
+    int ret;
+    struct iperf_state_tcp *new_conn = NULL;
+    struct iperf_settings settings;
+    struct mmiperf_client_args args = MMIPERF_CLIENT_ARGS_DEFAULT;
+    struct freertos_sockaddr remote_sa = s->tcp_client_sa;
+
+    remote_sa.sin_port = FreeRTOS_htons((uint16_t)FreeRTOS_ntohl(s->settings.remote_port));
+    args.report_fn = s->base.report_fn;
+    args.report_arg = s->base.report_arg;
+
+    memcpy(&settings, &s->settings, sizeof(settings));
+    /* prevent the remote side starting back as client again */
+    settings.flags = 0;
+
+    ret = iperf_tx_start_impl(&remote_sa, &args, &settings, NULL, &new_conn);
+    if (ret != 0)
+    {
+        FreeRTOS_debug_printf(("Failed to start reverse direction of iperf test\n"));
+    }
+    return ret;
+}
+
+/** Collect the settings header from the start of the data received from an iperf client. */
+static void iperf_tcp_server_rx_settings(struct iperf_state_tcp *s, const uint8_t *data,
+                                         uint32_t len)
+{
+    uint32_t offset = (uint32_t)s->base.report.bytes_transferred;
+
+    if (s->have_settings_buf || offset >= sizeof(s->settings))
+    {
+        return;
+    }
+
+    if (len > sizeof(s->settings) - offset)
+    {
+        len = sizeof(s->settings) - offset;
+    }
+    memcpy(((uint8_t *)&s->settings) + offset, data, len);
+    if (offset + len < sizeof(s->settings))
+    {
+        return;
+    }
+    s->have_settings_buf = 1;
+
+    if ((s->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_TEST)) &&
+        (s->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_NOW)))
+    {
+        /* client requested parallel transmission test */
+        iperf_tx_start_passive(s);
+    }
+}
+
+/** Verify data received from an iperf client against the iperf payload data. */
+static void iperf_tcp_server_verify(struct iperf_state_tcp *s, const uint8_t *data, uint32_t len)
+{
+    uint64_t start_time_us = mmosal_get_time_us();
+    uint64_t offset = s->base.report.bytes_transferred;
+    uint32_t corrupted_bytes = 0;
+
+    if (offset < IPERF_TCP_VERIFY_START_OFFSET)
+    {
+        uint32_t skip = MM_MIN(IPERF_TCP_VERIFY_START_OFFSET - offset, len);
+        data += skip;
+        len -= skip;
+        offset += skip;
+    }
+    corrupted_bytes = iperf_verify_data(data, len, offset);
+    iperf_verify_record(&s->base, corrupted_bytes, start_time_us);
+}
+
 static void iperf_tcp_server_task(void *arg)
 {
     struct iperf_state_tcp *s;
@@ -94,39 +184,83 @@ static void iperf_tcp_server_task(void *arg)
     int16_t len = 0;
     uint32_t tcp_recv_len = ipconfigNETWORK_MTU;
     int ret = 0;
+    bool done = false;
+    uint32_t listen_timeout_ms = mmosal_get_time_ms() + IPERF_TCP_MAX_IDLE_S * 1000;
 
     MMOSAL_ASSERT(arg != NULL);
     s = (struct iperf_state_tcp *)arg;
     memset(&s->tcp_client_sa, 0, client_sa_len);
 
+#if !MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
     recv_buff = (uint8_t *)mmosal_malloc(tcp_recv_len);
     if (recv_buff == NULL)
     {
         FreeRTOS_debug_printf(("iperf tcp server task failed to alloc recv_buff\n"));
         goto exit;
     }
+#endif
 
-    while (1)
+    while (!done)
     {
         s->conn_socket = FreeRTOS_accept(s->server_socket, &s->tcp_client_sa, &client_sa_len);
+        if (s->specific_remote)
+        {
+            if ((s->conn_socket != NULL) &&
+                !iperf_freertosplustcp_sockaddr_addr_match(&s->tcp_client_sa, &s->remote_sa))
+            {
+                /* this listener belongs to a client session, and this is not the correct
+                 * remote */
+                (void)FreeRTOS_closesocket(s->conn_socket);
+                s->conn_socket = NULL;
+            }
+            if ((s->conn_socket == NULL) && mmosal_time_has_passed(listen_timeout_ms))
+            {
+                FreeRTOS_debug_printf(("Timed out waiting for reverse iperf connection\n"));
+                break;
+            }
+        }
         if ((s->conn_socket != NULL) && FreeRTOS_issocketconnected(s->conn_socket))
         {
             iperf_freertosplustcp_session_start_common(&s->base,
                                                        &s->tcp_server_sa, &s->tcp_client_sa);
+            memset(&s->settings, 0, sizeof(s->settings));
+            s->have_settings_buf = 0;
         }
 
         while (s->conn_socket != NULL)
         {
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+            /* Borrow the received data in place from the socket's receive stream buffer. */
+            len = FreeRTOS_recv(s->conn_socket, &recv_buff, tcp_recv_len, FREERTOS_ZERO_COPY);
+#else
             len = FreeRTOS_recv(s->conn_socket, recv_buff, tcp_recv_len, 0);
+#endif
             if (len > 0)
             {
                 s->poll_count = 0;
+                iperf_tcp_server_rx_settings(s, recv_buff, len);
+                if (s->base.verify_payload)
+                {
+                    iperf_tcp_server_verify(s, recv_buff, len);
+                }
                 s->base.report.bytes_transferred += len;
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+                (void)FreeRTOS_ReleaseTCPPayloadBuffer(s->conn_socket, recv_buff, len);
+                recv_buff = NULL;
+#endif
             }
 
             if (!FreeRTOS_issocketconnected(s->conn_socket))
             {
                 uint32_t duration_ms = mmosal_get_time_ms() - s->base.time_started_ms;
+
+                if ((s->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_TEST)) &&
+                    !(s->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_NOW)))
+                {
+                    /* client requested transmission after end of test */
+                    iperf_tx_start_passive(s);
+                }
+
                 iperf_finalize_report_and_invoke_callback(&s->base, duration_ms,
                                                           MMIPERF_TCP_DONE_SERVER);
 
@@ -144,6 +278,13 @@ static void iperf_tcp_server_task(void *arg)
                 }
                 s->server_socket = NULL;
 
+                if (s->specific_remote)
+                {
+                    /* this listener only accepts a single connection */
+                    done = true;
+                    break;
+                }
+
                 ret = tcp_listen_on_new_socket(s);
                 if (ret != 0)
                 {
@@ -156,20 +297,29 @@ static void iperf_tcp_server_task(void *arg)
         }
     }
 
+#if !MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
 exit:
     if (recv_buff != NULL)
     {
         mmosal_free(recv_buff);
         recv_buff = NULL;
     }
+#endif
     if (s != NULL)
     {
+        iperf_list_remove(&s->base);
+        if (s->server_socket != NULL)
+        {
+            (void)FreeRTOS_closesocket(s->server_socket);
+            s->server_socket = NULL;
+        }
         mmosal_free(s);
         s = NULL;
     }
 }
 
 static int iperf_start_tcp_server_impl(const struct mmiperf_server_args *args,
+                                       const struct freertos_sockaddr *specific_remote_sa,
                                        struct iperf_state_tcp **state)
 {
     int err = -1;
@@ -217,6 +367,13 @@ static int iperf_start_tcp_server_impl(const struct mmiperf_server_args *args,
     s->base.server = 1;
     s->base.report_fn = args->report_fn;
     s->base.report_arg = args->report_arg;
+    s->base.verify_payload = args->verify_payload;
+    if (specific_remote_sa != NULL)
+    {
+        /* make this server accept one connection only */
+        s->specific_remote = 1;
+        s->remote_sa = *specific_remote_sa;
+    }
 
     local_port = args->local_port ? args->local_port : MMIPERF_DEFAULT_PORT;
 
@@ -233,6 +390,13 @@ static int iperf_start_tcp_server_impl(const struct mmiperf_server_args *args,
         s->tcp_server_sa.sin_address.ulIP_IPv4 = local_addr.xIPAddress.ulIP_IPv4;
     }
 
+    if (!iperf_list_add(&s->base))
+    {
+        FreeRTOS_debug_printf(("Too many iperf sessions\n"));
+        err = -1;
+        goto exit;
+    }
+
     err = tcp_listen_on_new_socket(s);
     if (err != 0)
     {
@@ -244,13 +408,18 @@ static int iperf_start_tcp_server_impl(const struct mmiperf_server_args *args,
                                             MMIPERF_STACK_SIZE, "iperf_tcp_server");
     MMOSAL_ASSERT(s->tcp_server_task != NULL);
 
-    iperf_list_add(&s->base);
     *state = s;
     return 0;
 
 exit:
     if (s != NULL)
     {
+        iperf_list_remove(&s->base);
+        if (s->server_socket != NULL)
+        {
+            (void)FreeRTOS_closesocket(s->server_socket);
+            s->server_socket = NULL;
+        }
         mmosal_free(s);
         s = NULL;
     }
@@ -262,10 +431,15 @@ mmiperf_handle_t mmiperf_start_tcp_server(const struct mmiperf_server_args *args
     int err;
     struct iperf_state_tcp *state = NULL;
 
-    err = iperf_start_tcp_server_impl(args, &state);
+    if (args->version == IPERF_VERSION_3)
+    {
+        return iperf3_start_server(args);
+    }
+
+    err = iperf_start_tcp_server_impl(args, NULL, &state);
     if (err == 0)
     {
-        return &(state->base);
+        return state->base.handle;
     }
     return NULL;
 }
@@ -298,152 +472,338 @@ static void iperf_tcp_close(struct iperf_state_tcp *conn, enum mmiperf_report_ty
         }
         conn->server_socket = NULL;
     }
+    if (conn->tx_buf != NULL)
+    {
+        mmosal_free(conn->tx_buf);
+    }
     mmosal_free(conn);
 }
 
-/** Try to send more data on an iperf tcp session */
-static int iperf_tcp_client_send_more(struct iperf_state_tcp *conn)
+/**
+ * Start listening for the remote server to connect back to us for the receive direction of a
+ * bidirectional test.
+ */
+static int iperf_tcp_client_start_reverse_server(struct iperf_state_tcp *conn)
+{
+    int err;
+    struct iperf_state_tcp *srv = NULL;
+    struct mmiperf_server_args server_args = MMIPERF_SERVER_ARGS_DEFAULT;
+
+    server_args.local_port = (uint16_t)FreeRTOS_ntohl(conn->settings.remote_port);
+    server_args.report_fn = conn->base.report_fn;
+    server_args.report_arg = conn->base.report_arg;
+#if ipconfigUSE_IPv6
+    if (conn->tcp_client_sa.sin_family == FREERTOS_AF_INET6)
+    {
+        (void)FreeRTOS_inet_ntop6(&conn->tcp_client_sa.sin_address.xIP_IPv6.ucBytes,
+                                  server_args.local_addr, sizeof(server_args.local_addr));
+    }
+#endif
+
+    err = iperf_start_tcp_server_impl(&server_args, &conn->tcp_server_sa, &srv);
+    if (err == -pdFREERTOS_ERRNO_EADDRINUSE)
+    {
+        /* An iperf server is already listening on this port; it will receive the test. */
+        FreeRTOS_debug_printf(("Using existing TCP server for reverse test\n"));
+        return 0;
+    }
+    return err;
+}
+
+/**
+ * Record the delivery of acknowledged frames of a client in isochronous frame mode and start the
+ * next frame if it is due.
+ *
+ * @param conn  The client session.
+ *
+ * @returns @c true once the test is over and every frame has been acknowledged.
+ */
+static bool iperf_tcp_client_frame_update(struct iperf_state_tcp *conn)
+{
+    bool test_over;
+
+    /* Data stays in the socket's transmit buffer until it has been acknowledged. */
+    iperf_frame_tx_acked(&conn->base, &conn->frame,
+                         conn->base.report.bytes_transferred -
+                         (uint32_t)FreeRTOS_tx_size(conn->conn_socket));
+
+    if (conn->settings.amount & FreeRTOS_htonl(0x80000000))
+    {
+        uint32_t time_ms = (uint32_t) - (int32_t)FreeRTOS_htonl(conn->settings.amount) * 10;
+        test_over = (mmosal_get_time_ms() - iperf_test_start_time_ms(&conn->base) >= time_ms);
+    }
+    else
+    {
+        uint32_t amount_bytes = FreeRTOS_htonl(conn->settings.amount);
+        test_over = (conn->frame.queued_end - IPERF_TCP_VERIFY_START_OFFSET >= amount_bytes);
+    }
+
+    if (!test_over)
+    {
+        iperf_frame_tx_start(&conn->frame, true);
+    }
+    return test_over && conn->frame.remaining == 0 && conn->frame.in_flight_count == 0;
+}
+
+/**
+ * Try to send the next chunk of data on an iperf tcp client session.
+ *
+ * @param conn  The client session.
+ *
+ * @returns 1 if there is more to send, or 0 once the session should be closed.
+ */
+static int iperf_tcp_client_send_next(struct iperf_state_tcp *conn)
 {
-    int send_more = 1;
     int ret;
     uint16_t txlen;
     uint16_t txlen_max;
     void *txptr;
+    bool frame_data = false;
 
     MMOSAL_ASSERT((conn != NULL) && conn->base.tcp && (conn->base.server == 0));
 
-    do
+    if (conn->frame.len > 0)
     {
-        if (conn->settings.amount & FreeRTOS_htonl(0x80000000))
+        /* in frame mode the test ends once the last frame has been delivered */
+        if (iperf_tcp_client_frame_update(conn))
         {
-            /* this session is time-limited */
-            uint32_t now = mmosal_get_time_ms();
-            uint32_t diff_ms = now - conn->base.time_started_ms;
-            uint32_t time = (uint32_t) - (int32_t)FreeRTOS_htonl(conn->settings.amount);
-            uint32_t time_ms = time * 10;
-
-            if (diff_ms >= time_ms)
-            {
-                /* time specified by the client is over -> close the connection */
-                goto exit;
-            }
+            return 0;
         }
-        else
+        if (conn->base.report.bytes_transferred >= IPERF_TCP_VERIFY_START_OFFSET &&
+            conn->frame.remaining == 0)
         {
-            /* this session is byte-limited */
-            uint32_t amount_bytes = FreeRTOS_htonl(conn->settings.amount);
-            /* @todo: this can send up to 1*MSS more than requested... */
-            if (amount_bytes <= conn->base.report.bytes_transferred)
-            {
-                /* all requested bytes transferred -> close the connection */
-                goto exit;
-            }
+            /* wait for the next frame */
+            mmosal_task_sleep(1);
+            return 1;
         }
-        /* update block parameter after each block duration */
-        if ((conn->bw_limit) && (conn->block_end_time < mmosal_get_time_ms()))
+    }
+    else if (conn->settings.amount & FreeRTOS_htonl(0x80000000))
+    {
+        /* this session is time-limited */
+        uint32_t now = mmosal_get_time_ms();
+        uint32_t diff_ms = now - iperf_test_start_time_ms(&conn->base);
+        uint32_t time = (uint32_t) - (int32_t)FreeRTOS_htonl(conn->settings.amount);
+        uint32_t time_ms = time * 10;
+
+        if (diff_ms >= time_ms)
         {
-            conn->block_end_time += BLOCK_DURATION_MS;
-            conn->block_remaining_txlen += conn->block_txlen;
+            /* time specified by the client is over -> close the connection */
+            return 0;
         }
-
-        if (conn->base.report.bytes_transferred < 24)
+    }
+    else
+    {
+        /* this session is byte-limited */
+        uint32_t amount_bytes = FreeRTOS_htonl(conn->settings.amount);
+        /* @todo: this can send up to 1*MSS more than requested... */
+        if (amount_bytes <= conn->base.report.bytes_transferred)
         {
-            /* transmit the settings a first time */
-            txptr = &((uint8_t *)&conn->settings)[conn->base.report.bytes_transferred];
-            txlen_max = (uint16_t)(24 - conn->base.report.bytes_transferred);
+            /* all requested bytes transferred -> close the connection */
+            return 0;
         }
-        else if (conn->base.report.bytes_transferred < 48)
+    }
+    /* update block parameter after each block duration */
+    if ((conn->bw_limit) && (conn->block_end_time < mmosal_get_time_ms()))
+    {
+        conn->block_end_time += BLOCK_DURATION_MS;
+        conn->block_remaining_txlen += conn->block_txlen;
+    }
+
+    if (conn->base.report.bytes_transferred < 24)
+    {
+        /* transmit the settings a first time */
+        txptr = &((uint8_t *)&conn->settings)[conn->base.report.bytes_transferred];
+        txlen_max = (uint16_t)(24 - conn->base.report.bytes_transferred);
+    }
+    else if (conn->base.report.bytes_transferred < 48)
+    {
+        /* transmit the settings a second time */
+        txptr = &((uint8_t *)&conn->settings)[conn->base.report.bytes_transferred - 24];
+        txlen_max = (uint16_t)(48 - conn->base.report.bytes_transferred);
+    }
+    else
+    {
+        /* transmit data */
+        /* @todo: every x bytes, transmit the settings again */
+        uint64_t offset = conn->base.report.bytes_transferred;
+        uint32_t avail;
+
+        txlen_max = conn->mss;
+        if (conn->base.report.bytes_transferred == 48)
+        { /* @todo: fix this for intermediate settings, too */
+            txlen_max = conn->mss - 24;
+        }
+        if (conn->frame.len > 0)
         {
-            /* transmit the settings a second time */
-            txptr = &((uint8_t *)&conn->settings)[conn->base.report.bytes_transferred - 24];
-            txlen_max = (uint16_t)(48 - conn->base.report.bytes_transferred);
+            txlen_max = (uint16_t)MM_MIN(txlen_max, conn->frame.remaining);
+            frame_data = true;
         }
-        else
+        if (!iperf_payload_is_default(&conn->payload))
         {
-            /* transmit data */
-            /* @todo: every x bytes, transmit the settings again */
-            txptr = (void *)iperf_get_data(conn->base.report.bytes_transferred);
-            txlen_max = conn->mss;
-            if (conn->base.report.bytes_transferred == 48)
-            { /* @todo: fix this for intermediate settings, too */
-                txlen_max = conn->mss - 24;
-            }
+            /* application payload data starts at offset zero after the settings */
+            offset -= IPERF_TCP_VERIFY_START_OFFSET;
         }
-        txlen = txlen_max;
-
-        ret = FreeRTOS_send(conn->conn_socket, txptr, txlen, FREERTOS_MSG_DONTWAIT);
-        if (ret >= 0)
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+        /* Write the payload straight into the socket's transmit stream buffer. This is only
+         * possible once the stream buffer exists, which it will after the settings are sent. */
+        BaseType_t head_len = 0;
+        uint8_t *head = FreeRTOS_get_tx_head(conn->conn_socket, &head_len);
+        if (head != NULL)
         {
-            conn->base.report.bytes_transferred += ret;
-            conn->block_remaining_txlen -= ret;
+            if (head_len <= 0)
+            {
+                /* transmit stream buffer is full */
+                mmosal_task_sleep(1);
+                return 1;
+            }
+            txlen_max = (uint16_t)MM_MIN(txlen_max, (uint32_t)head_len);
+            iperf_payload_copy(&conn->payload, offset, head, txlen_max);
+            /* A NULL buffer tells FreeRTOS_send() the data is already at the stream head. */
+            txptr = NULL;
         }
         else
+#endif
         {
-            mmosal_task_sleep(1);
+            txptr = (void *)iperf_payload_get(&conn->payload, offset, txlen_max, &avail);
+            if (txptr != NULL)
+            {
+                txlen_max = (uint16_t)avail;
+            }
+            else
+            {
+                iperf_payload_copy(&conn->payload, offset, conn->tx_buf, txlen_max);
+                txptr = conn->tx_buf;
+            }
         }
+    }
+    txlen = txlen_max;
 
-        if ((conn->bw_limit) && (conn->block_remaining_txlen <= 0))
+    ret = FreeRTOS_send(conn->conn_socket, txptr, txlen, FREERTOS_MSG_DONTWAIT);
+    if (ret >= 0)
+    {
+        conn->base.report.bytes_transferred += ret;
+        conn->block_remaining_txlen -= ret;
+        if (frame_data)
         {
-            send_more = 0;
+            conn->frame.remaining -= ret;
         }
-    } while (send_more);
+    }
+    else
+    {
+        mmosal_task_sleep(1);
+    }
+
+    if ((conn->bw_limit) && (conn->block_remaining_txlen <= 0))
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/** Flush and close an iperf tcp client session once it has finished sending. */
+static void iperf_tcp_client_send_done(struct iperf_state_tcp *conn)
+{
+    int ret;
 
-exit:
     /* Wait until all the data in the tx queue is transmited. */
     while (FreeRTOS_tx_size(conn->conn_socket) > 0)
     {
         mmosal_task_sleep(1);
     }
+    if (conn->client_tradeoff_mode)
+    {
+        /* tradeoff means that the remote host connects only after the client is done,
+         * so start the server before closing the connection */
+        if (iperf_tcp_client_start_reverse_server(conn) != 0)
+        {
+            FreeRTOS_debug_printf(("Failed to start TCP server for reverse test\n"));
+        }
+    }
     ret = FreeRTOS_shutdown(conn->conn_socket, 2);
     if (ret != 0)
     {
         FreeRTOS_debug_printf(("TCP socket shutdown failed\n"));
     }
     iperf_tcp_close(conn, MMIPERF_TCP_DONE_CLIENT);
-    return 0;
 }
 
-static void iperf_tcp_client_task(void *arg)
+/** Prepare an iperf tcp client session to start sending. */
+static void iperf_tcp_client_send_init(struct iperf_state_tcp *conn)
 {
-    struct iperf_state_tcp *conn = (struct iperf_state_tcp *)arg;
     MMOSAL_ASSERT(conn->conn_socket != NULL);
 
     conn->poll_count = 0;
     conn->base.time_started_ms = mmosal_get_time_ms();
+    iperf_resource_start(&conn->base);
     conn->block_end_time = mmosal_get_time_ms() + BLOCK_DURATION_MS;
+    /* the first frame is due now */
+    conn->frame.next_start_ms = conn->base.time_started_ms;
+}
+
+static void iperf_tcp_client_task(void *arg)
+{
+    struct iperf_state_tcp *conn = (struct iperf_state_tcp *)arg;
 
-    iperf_tcp_client_send_more(conn);
+    iperf_tcp_client_send_init(conn);
+    while (iperf_tcp_client_send_next(conn))
+    {
+    }
+    iperf_tcp_client_send_done(conn);
+}
+
+/**
+ * Task that runs all the streams of a parallel tcp client test, sending a chunk on each stream
+ * in turn. Running the streams from one task keeps the aggregate report single threaded.
+ */
+static void iperf_tcp_client_group_task(void *arg)
+{
+    struct iperf_stream_group *group = (struct iperf_stream_group *)arg;
+    struct iperf_state_tcp *streams[MMIPERF_MAX_STREAMS];
+    uint32_t num_streams = group->num_streams;
+    uint32_t num_active = num_streams;
+    uint32_t ii;
+
+    /* The group is freed when its last stream closes, so take our own copy of the streams. */
+    for (ii = 0; ii < num_streams; ii++)
+    {
+        streams[ii] = (struct iperf_state_tcp *)group->streams[ii];
+        iperf_tcp_client_send_init(streams[ii]);
+    }
+
+    while (num_active > 0)
+    {
+        for (ii = 0; ii < num_streams; ii++)
+        {
+            if (streams[ii] != NULL && !iperf_tcp_client_send_next(streams[ii]))
+            {
+                iperf_tcp_client_send_done(streams[ii]);
+                streams[ii] = NULL;
+                num_active--;
+            }
+        }
+    }
 }
 
 /**
  * Start TCP connection back to the client (either parallel or after the
  * receive test has finished.
  */
-static int iperf_tx_start_impl(const struct mmiperf_client_args *args,
+static int iperf_tx_start_impl(const struct freertos_sockaddr *remote_sa,
+                               const struct mmiperf_client_args *args,
                                struct iperf_settings *settings,
+                               struct iperf_stream_group *group,
                                struct iperf_state_tcp **new_conn)
 {
     int ok;
     struct iperf_state_tcp *client_conn;
-    IPv46_Address_t remote_addr;
-    uint16_t server_port;
-    BaseType_t ret = pdFAIL;
+    bool is_ipv6 = (remote_sa->sin_family == FREERTOS_AF_INET6);
 
     MMOSAL_ASSERT(settings != NULL);
     MMOSAL_ASSERT(new_conn != NULL);
     *new_conn = NULL;
 
-    if (args->server_port == 0)
-    {
-        server_port = MMIPERF_DEFAULT_PORT;
-    }
-    else
-    {
-        server_port = args->server_port;
-    }
-
-    FreeRTOS_debug_printf(("Starting TCP iperf client to %s:%u, amount %ld\n",
-                          args->server_addr, server_port,
+    FreeRTOS_debug_printf(("Starting TCP iperf client to port %u, amount %ld\n",
+                          FreeRTOS_ntohs(remote_sa->sin_port),
                           (int32_t)FreeRTOS_ntohl(settings->amount)));
 
     client_conn = (struct iperf_state_tcp *)mmosal_malloc(sizeof(*client_conn));
@@ -452,31 +812,10 @@ static int iperf_tx_start_impl(const struct mmiperf_client_args *args,
         return -1;
     }
 
-#if ipconfigUSE_IPv4
-    remote_addr.xIs_IPv6 = pdFALSE;
-    ret = FreeRTOS_inet_pton4(args->server_addr, &remote_addr.xIPAddress.ulIP_IPv4);
-#endif
-#if ipconfigUSE_IPv6
-    if (ret != pdPASS)
-    {
-        ret = FreeRTOS_inet_pton6(args->server_addr, &remote_addr.xIPAddress.xIP_IPv6.ucBytes);
-        if (ret == pdPASS)
-        {
-            remote_addr.xIs_IPv6 = pdTRUE;
-        }
-    }
-#else
-    MM_UNUSED(ret);
-#endif
-    if (remote_addr.xIPAddress.ulIP_IPv4 == 0)
-    {
-        mmosal_free(client_conn);
-        return -1;
-    }
-
     memset(client_conn, 0, sizeof(*client_conn));
     client_conn->base.tcp = 1;
     client_conn->base.time_started_ms = mmosal_get_time_ms();
+    iperf_resource_start(&client_conn->base);
     client_conn->base.report_fn = args->report_fn;
     client_conn->base.report_arg = args->report_arg;
     client_conn->next_num = 4; /* initial nr is '4' since the header has 24 byte */
@@ -484,11 +823,19 @@ static int iperf_tx_start_impl(const struct mmiperf_client_args *args,
     client_conn->have_settings_buf = 1;
     client_conn->mss = ipconfigTCP_MSS;
 
+    if (!iperf_list_add(&client_conn->base))
+    {
+        FreeRTOS_debug_printf(("Too many iperf sessions\n"));
+        mmosal_free(client_conn);
+        return -1;
+    }
+
     client_conn->conn_socket =
-        FreeRTOS_socket((remote_addr.xIs_IPv6 ? FREERTOS_AF_INET6 : FREERTOS_AF_INET),
+        FreeRTOS_socket((is_ipv6 ? FREERTOS_AF_INET6 : FREERTOS_AF_INET),
                         FREERTOS_SOCK_STREAM, FREERTOS_IPPROTO_TCP);
     if (client_conn->conn_socket == NULL)
     {
+        iperf_list_remove(&client_conn->base);
         mmosal_free(client_conn);
         return -1;
     }
@@ -509,14 +856,15 @@ static int iperf_tx_start_impl(const struct mmiperf_client_args *args,
     }
 
 #if ipconfigUSE_IPv6
-    if (remote_addr.xIs_IPv6)
+    if (is_ipv6)
     {
         client_conn->mss -= IPV6_HEADER_SIZE_DIFF;
     }
 #endif
 
-    /* set block parameter if bandwidth limit is set */
-    if (args->target_bw == 0)
+    /* set block parameter if bandwidth limit is set (frame mode paces itself instead) */
+    iperf_frame_tx_init(&client_conn->frame, args, IPERF_TCP_VERIFY_START_OFFSET);
+    if (args->target_bw == 0 || client_conn->frame.len > 0)
     {
         client_conn->bw_limit = false;
     }
@@ -534,19 +882,22 @@ static int iperf_tx_start_impl(const struct mmiperf_client_args *args,
         }
     }
 
-    memset(&client_conn->tcp_server_sa, 0, sizeof(client_conn->tcp_server_sa));
-    client_conn->tcp_server_sa.sin_family =
-        (remote_addr.xIs_IPv6 ? FREERTOS_AF_INET6 : FREERTOS_AF_INET);
-    client_conn->tcp_server_sa.sin_port = FreeRTOS_htons(server_port);
-    if (remote_addr.xIs_IPv6)
+    iperf_payload_source_init(&client_conn->payload, args);
+    if (client_conn->payload.fn != NULL)
     {
-        memcpy(client_conn->tcp_server_sa.sin_address.xIP_IPv6.ucBytes,
-               remote_addr.xIPAddress.xIP_IPv6.ucBytes,
-               sizeof(client_conn->tcp_server_sa.sin_address.xIP_IPv6.ucBytes));
+        client_conn->tx_buf = (uint8_t *)mmosal_malloc(client_conn->mss);
+        if (client_conn->tx_buf == NULL)
+        {
+            FreeRTOS_debug_printf(("iperf failed to alloc payload buffer\n"));
+            iperf_tcp_close(client_conn, MMIPERF_TCP_ABORTED_LOCAL);
+            return -1;
+        }
     }
-    else
+
+    client_conn->tcp_server_sa = *remote_sa;
+    if (client_conn->tcp_server_sa.sin_port == 0)
     {
-        client_conn->tcp_server_sa.sin_address.ulIP_IPv4 = remote_addr.xIPAddress.ulIP_IPv4;
+        client_conn->tcp_server_sa.sin_port = FreeRTOS_htons(MMIPERF_DEFAULT_PORT);
     }
 
     ok = FreeRTOS_connect(client_conn->conn_socket, &client_conn->tcp_server_sa,
@@ -563,36 +914,180 @@ static int iperf_tx_start_impl(const struct mmiperf_client_args *args,
                                                &client_conn->tcp_client_sa,
                                                &client_conn->tcp_server_sa);
 
+    if (args->mode == MMIPERF_CLIENT_MODE_DUAL)
+    {
+        /* start corresponding server now, before the remote side receives our settings */
+        ok = iperf_tcp_client_start_reverse_server(client_conn);
+        if (ok != 0)
+        {
+            FreeRTOS_debug_printf(("Failed to start TCP server for reverse test\n"));
+            iperf_tcp_close(client_conn, MMIPERF_TCP_ABORTED_LOCAL);
+            return -1;
+        }
+    }
+    else if (args->mode == MMIPERF_CLIENT_MODE_TRADEOFF)
+    {
+        /* tradeoff means that the remote host connects only after the client is done,
+         * so start the server when the client is closed */
+        client_conn->client_tradeoff_mode = 1;
+    }
+
+    if (group != NULL)
+    {
+        /* The streams of a parallel test are all run from the group task */
+        iperf_stream_group_add(group, &client_conn->base);
+        *new_conn = client_conn;
+        return 0;
+    }
+
     client_conn->tcp_client_task =
         mmosal_task_create(iperf_tcp_client_task, client_conn, MMOSAL_TASK_PRI_LOW,
                            MMIPERF_STACK_SIZE, "iperf_tcp_client");
     MMOSAL_ASSERT(client_conn->tcp_client_task != NULL);
 
-    iperf_list_add(&client_conn->base);
     *new_conn = client_conn;
     return 0;
 }
 
+/**
+ * Start the streams of a parallel TCP test, all run from a single task.
+ *
+ * @param remote_sa     Address of the remote server.
+ * @param args          Iperf client arguments.
+ * @param settings      Settings to send to the remote server on each stream.
+ *
+ * @returns the handle of the aggregate session, or @c NULL if no stream could be started.
+ */
+static mmiperf_handle_t iperf_tx_start_parallel(const struct freertos_sockaddr *remote_sa,
+                                                const struct mmiperf_client_args *args,
+                                                struct iperf_settings *settings)
+{
+    uint32_t ii;
+    struct iperf_state_tcp *state;
+    struct iperf_stream_group *group;
+    struct mmosal_task *task;
+
+    group = iperf_stream_group_alloc(1, args);
+    if (group == NULL)
+    {
+        return NULL;
+    }
+    if (!iperf_list_add(&group->base))
+    {
+        FreeRTOS_debug_printf(("Too many iperf sessions\n"));
+        IPERF_FREE(struct iperf_stream_group, group);
+        return NULL;
+    }
+
+    for (ii = 0; ii < args->num_streams; ii++)
+    {
+        state = NULL;
+        if (iperf_tx_start_impl(remote_sa, args, settings, group, &state) != 0)
+        {
+            FreeRTOS_debug_printf(("Failed to start iperf stream %lu\n", ii));
+            break;
+        }
+    }
+
+    if (group->num_streams == 0)
+    {
+        iperf_list_remove(&group->base);
+        IPERF_FREE(struct iperf_stream_group, group);
+        return NULL;
+    }
+
+    task = mmosal_task_create(iperf_tcp_client_group_task, group, MMOSAL_TASK_PRI_LOW,
+                              MMIPERF_STACK_SIZE, "iperf_tcp_client");
+    MMOSAL_ASSERT(task != NULL);
+    for (ii = 0; ii < group->num_streams; ii++)
+    {
+        ((struct iperf_state_tcp *)group->streams[ii])->tcp_client_task = task;
+    }
+    return group->base.handle;
+}
+
 mmiperf_handle_t mmiperf_start_tcp_client(const struct mmiperf_client_args *args)
 {
     int ret = 0;
     struct iperf_settings settings;
     struct iperf_state_tcp *state = NULL;
     mmiperf_handle_t result = NULL;
+    struct freertos_sockaddr remote_sa;
+    BaseType_t parsed = pdFAIL;
+
+    if (args->version == IPERF_VERSION_3)
+    {
+        return iperf3_start_client(args, false);
+    }
 
-    /* Bidirectional/trade-off disabled until better tested and also until supported in UDP. */
+    memset(&remote_sa, 0, sizeof(remote_sa));
+    remote_sa.sin_len = sizeof(remote_sa);
+    remote_sa.sin_port = FreeRTOS_htons(args->server_port ? args->server_port :
+                                                            MMIPERF_DEFAULT_PORT);
+#if ipconfigUSE_IPv4
+    remote_sa.sin_family = FREERTOS_AF_INET;
+    parsed = FreeRTOS_inet_pton4(args->server_addr, &remote_sa.sin_address.ulIP_IPv4);
+#endif
+#if ipconfigUSE_IPv6
+    if (parsed != pdPASS)
+    {
+        remote_sa.sin_family = FREERTOS_AF_INET6;
+        parsed = FreeRTOS_inet_pton6(args->server_addr, &remote_sa.sin_address.xIP_IPv6.ucBytes);
+    }
+#endif
+    if (parsed != pdPASS)
+    {
+        FreeRTOS_debug_printf(("Unable to parse server_addr as IP address (%s)\n",
+                               args->server_addr));
+        return NULL;
+    }
+
+    if (args->num_streams > MMIPERF_MAX_STREAMS ||
+        (args->num_streams > 1 && args->mode != MMIPERF_CLIENT_MODE_NORMAL) ||
+        (iperf_frame_mode(args) &&
+         (args->num_streams > 1 || args->mode != MMIPERF_CLIENT_MODE_NORMAL)))
+    {
+        FreeRTOS_debug_printf(("Unsupported number of streams\n"));
+        return NULL;
+    }
 
     memset(&settings, 0, sizeof(settings));
 
+    switch (args->mode)
+    {
+    case MMIPERF_CLIENT_MODE_NORMAL:
+        /* Unidirectional tx only test */
+        settings.flags = 0;
+        break;
+
+    case MMIPERF_CLIENT_MODE_DUAL:
+        /* Do a bidirectional test simultaneously */
+        settings.flags = FreeRTOS_htonl(IPERF_FLAGS_ANSWER_TEST | IPERF_FLAGS_ANSWER_NOW);
+        break;
+
+    case MMIPERF_CLIENT_MODE_TRADEOFF:
+        /* Do a bidirectional test individually */
+        settings.flags = FreeRTOS_htonl(IPERF_FLAGS_ANSWER_TEST);
+        break;
+
+    default:
+        return NULL;
+    }
+
     settings.amount = FreeRTOS_htonl(args->amount);
-    settings.num_threads = FreeRTOS_htonl(1);
+    settings.num_threads = FreeRTOS_htonl(args->num_streams > 1 ? args->num_streams : 1);
     settings.remote_port = FreeRTOS_htonl(MMIPERF_DEFAULT_PORT);
 
-    ret = iperf_tx_start_impl(args, &settings, &state);
+    if (args->num_streams > 1)
+    {
+        return iperf_tx_start_parallel(&remote_sa, args, &settings);
+    }
+
+    ret = iperf_tx_start_impl(&remote_sa, args, &settings, NULL, &state);
     if (ret == 0)
     {
         MMOSAL_ASSERT(state != NULL);
-        result = &(state->base);
+        result = state->base.handle;
     }
     return result;
 }
@@ -12,6 +12,7 @@
 #include "mmosal.h"
 #include "mmutils.h"
 #include "mmiperf_freertosplustcp.h"
+#include "../common/mmiperf3_private.h"
 
 #include "FreeRTOS_IP.h"
 #include "FreeRTOS_Sockets.h"
@@ -30,8 +31,13 @@ struct iperf_server_session_udp
     int32_t next_packet_id;
 
     int32_t error_cnt;
-    struct timeval ipg_start;
+    /* Transmit timestamp of the previous packet (in microseconds), or zero if none. */
+    uint64_t prev_tx_time_us;
     struct freertos_sockaddr client_sa;
+    /* Settings sent by the client at the start of the session (in network byte order). */
+    struct iperf_settings settings;
+    /* Frame statistics state for a client in isochronous frame mode. */
+    struct iperf_frame_rx frame_rx;
 };
 
 /** Connection handle for a UDP iperf server */
@@ -48,6 +54,11 @@ struct iperf_server_state_udp
     struct freertos_sockaddr udp_server_sa;
     struct iperf_server_session_udp session;
     struct mmosal_task *task;
+    /* 1=only accept a session from remote_sa (receive direction of a bidirectional test) */
+    uint8_t specific_remote;
+    struct freertos_sockaddr remote_sa;
+    /* Time by which the remote side must start the session (specific_remote only) */
+    uint32_t listen_timeout_ms;
 };
 
 struct iperf_client_state_udp
@@ -72,8 +83,44 @@ struct iperf_client_state_udp
 
     /* block parameter for bandwdith limit */
     uint32_t block_tx_amount;
+
+    /** Datagram buffer reused from one datagram to the next. */
+    uint8_t *tx_buf;
+    /** Length of the datagram @c tx_buf was filled for. */
+    uint32_t tx_buf_len;
+
+    /* Transmit state, owned by the client task */
+    uint32_t end_time;
+    uint64_t remaining_amount;
+    uint32_t tx_amount;
+    bool final;
+    unsigned failure_cnt;
+    uint32_t retry_time;
+    uint32_t block_end_time;
+    uint32_t block_remaining_tx_amount;
+
+    /** Next stream of a parallel test run from the same task, or @c NULL. */
+    struct iperf_client_state_udp *next_stream;
+
+    /** Settings sent in each datagram (in network byte order). */
+    struct iperf_settings settings;
+    /** Whether the listener for the receive direction of a bidirectional test was started. */
+    bool reverse_started;
+
+    /** Source of the payload data. */
+    struct iperf_payload_source payload;
+    /** Offset into the payload data of the next datagram (application payload only). */
+    uint64_t tx_payload_offset;
+    /** Transmit state for isochronous frame mode. */
+    struct iperf_frame_tx frame;
+    /** Reports from the receivers of a multicast test, or @c NULL if not requested. */
+    struct iperf_mcast_receivers *mcast_receivers;
 };
 
+static int iperf_start_udp_server_impl(const struct mmiperf_server_args *args,
+                                       const struct freertos_sockaddr *specific_remote_sa,
+                                       struct iperf_server_state_udp **state);
+
 static bool is_multicast_ip_addr(IPv46_Address_t ip_addr)
 {
     if (!ip_addr.xIs_IPv6 && ((ip_addr.xIPAddress.ulIP_IPv4 >> 28) == 14))
@@ -109,7 +156,8 @@ static struct iperf_server_session_udp *get_free_session_slot(
 }
 
 static struct iperf_server_session_udp *start_session(
-    struct iperf_server_state_udp *server_state, const struct freertos_sockaddr *client_sa)
+    struct iperf_server_state_udp *server_state, const struct freertos_sockaddr *client_sa,
+    const struct iperf_settings *settings)
 {
     /* For now we only support a single session. */
     struct iperf_server_session_udp *session = get_free_session_slot(server_state);
@@ -120,9 +168,14 @@ static struct iperf_server_session_udp *start_session(
 
     memset(session, 0, sizeof(*session));
     memcpy(&session->client_sa, client_sa, sizeof(session->client_sa));
+    session->settings = *settings;
     iperf_freertosplustcp_session_start_common(&server_state->base,
                                                &server_state->udp_server_sa,
                                                client_sa);
+    if (server_state->base.latency != NULL)
+    {
+        memset(server_state->base.latency, 0, sizeof(*server_state->base.latency));
+    }
     return session;
 }
 
@@ -144,7 +197,8 @@ static bool sockaddr_match(const struct freertos_sockaddr *a, const struct freer
 }
 
 static struct iperf_server_session_udp *get_session(struct iperf_server_state_udp *server_state,
-                                                    const struct freertos_sockaddr *rx_client_sa)
+                                                    const struct freertos_sockaddr *rx_client_sa,
+                                                    const struct iperf_settings *settings)
 {
     /* For now we only support a single session. */
     struct iperf_server_session_udp *session = &(server_state->session);
@@ -154,20 +208,203 @@ static struct iperf_server_session_udp *get_session(struct iperf_server_state_ud
     }
     else
     {
-        return start_session(server_state, rx_client_sa);
+        return start_session(server_state, rx_client_sa, settings);
+    }
+}
+
+/**
+ * Start transmitting a test back to the client of a session, as requested in the settings it sent
+ * for a bidirectional test.
+ */
+static void iperf_udp_server_answer_test(struct iperf_server_state_udp *server_state,
+                                         const struct iperf_server_session_udp *session)
+{
+    struct mmiperf_client_args args = MMIPERF_CLIENT_ARGS_DEFAULT;
+
+    iperf_freertosplustcp_sockaddr_ntop(&session->client_sa, args.server_addr,
+                                        sizeof(args.server_addr));
+    iperf_udp_server_answer_args(&session->settings, &args);
+    args.report_fn = server_state->base.report_fn;
+    args.report_arg = server_state->base.report_arg;
+    args.version = server_state->args.version;
+
+    if (mmiperf_start_udp_client(&args) == NULL)
+    {
+        FreeRTOS_debug_printf(("Failed to start reverse direction of iperf test\n"));
+    }
+}
+
+/**
+ * Check whether the listener for the receive direction of a bidirectional test is done. The
+ * remote side must start transmitting within @ref IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS of the
+ * listener starting, and if it stops transmitting for that long without sending its final
+ * datagram then the receive direction is reported as it stands. Once the receive direction is
+ * done the listener lingers in case our report to the remote side was lost and it retransmits its
+ * final datagram.
+ *
+ * @param server_state  The listener.
+ * @param linger_end_ms Time at which the listener stops lingering, or zero if not lingering.
+ *
+ * @returns @c true if the listener should be closed, else @c false.
+ */
+static bool iperf_udp_server_reverse_done(struct iperf_server_state_udp *server_state,
+                                          uint32_t linger_end_ms)
+{
+    if (server_state->session.next_packet_id >= 0)
+    {
+        /* The receive direction is in progress. */
+        if (!mmosal_time_has_passed(server_state->base.last_rx_time_ms +
+                                    IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS))
+        {
+            return false;
+        }
+        FreeRTOS_debug_printf(("iperf UDP reverse test timed out\n"));
+        server_state->session.next_packet_id = -1;
+        iperf_finalize_report_and_invoke_callback(
+            &server_state->base,
+            server_state->base.last_rx_time_ms - server_state->base.time_started_ms,
+            MMIPERF_UDP_DONE_SERVER);
+        return true;
+    }
+
+    if (linger_end_ms != 0)
+    {
+        return mmosal_time_has_passed(linger_end_ms);
+    }
+
+    if (mmosal_time_has_passed(server_state->listen_timeout_ms))
+    {
+        FreeRTOS_debug_printf(("Remote side did not start reverse direction of iperf test\n"));
+        return true;
+    }
+    return false;
+}
+
+/** Verify the payload of a datagram received from an iperf client. */
+static void iperf_udp_server_verify(struct iperf_server_state_udp *server_state,
+                                    const uint8_t *datagram, uint32_t len)
+{
+    uint64_t start_time_us = mmosal_get_time_us();
+    uint32_t hdrs_len = iperf_udp_hdrs_len(server_state->args.version);
+    uint32_t corrupted_bytes = 0;
+
+    if (len > hdrs_len)
+    {
+        corrupted_bytes = iperf_verify_data(datagram + hdrs_len, len - hdrs_len, 0);
     }
+    iperf_verify_record(&server_state->base, corrupted_bytes, start_time_us);
 }
 
+/** Maximum length of a datagram received by the iperf UDP server. */
+#define IPERF_UDP_RECV_LEN (sizeof(struct iperf_udp_header) + 1500)
+
 /**
- * Get the difference in microseconds between to timevals.
+ * Receive a datagram on an iperf UDP socket.
+ *
+ * With @ref MMIPERF_FREERTOSPLUSTCP_ZERO_COPY the datagram is left in the network buffer it
+ * arrived in, otherwise it is copied into @p scratch (which must be @ref IPERF_UDP_RECV_LEN bytes
+ * long). Either way the buffer returned in @p buf must be passed to
+ * @ref iperf_udp_recv_release() once the caller is finished with it.
+ *
+ * @param socket    The socket to receive on.
+ * @param scratch   Buffer to receive into when zero-copy is not in use.
+ * @param buf       Receives a pointer to the datagram, or @c NULL if none was received.
+ * @param from      Receives the address of the sender.
  *
- * \note Delta must not exceed the range of an int32.
+ * @returns the length of the datagram, or zero or a negative value if none was received.
  */
-static int32_t time_delta(const struct timeval *a, const struct timeval *b)
+static int32_t iperf_udp_recv(Socket_t socket, uint8_t *scratch, uint8_t **buf,
+                              struct freertos_sockaddr *from)
 {
-    int32_t delta = (a->tv_sec - b->tv_sec) * 1000000;
-    delta += (a->tv_usec - b->tv_usec);
-    return delta;
+    uint32_t from_len = sizeof(*from);
+    int32_t len;
+
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+    (void)scratch;
+    *buf = NULL;
+    len = FreeRTOS_recvfrom(socket, buf, 0, FREERTOS_ZERO_COPY, from, &from_len);
+    if (len <= 0 && *buf != NULL)
+    {
+        FreeRTOS_ReleaseUDPPayloadBuffer(*buf);
+        *buf = NULL;
+    }
+#else
+    *buf = scratch;
+    len = FreeRTOS_recvfrom(socket, scratch, IPERF_UDP_RECV_LEN, 0, from, &from_len);
+#endif
+    return len;
+}
+
+/**
+ * Release a datagram returned by @ref iperf_udp_recv().
+ *
+ * @param buf   The datagram buffer (may be @c NULL).
+ */
+static void iperf_udp_recv_release(uint8_t *buf)
+{
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+    if (buf != NULL)
+    {
+        FreeRTOS_ReleaseUDPPayloadBuffer(buf);
+    }
+#else
+    (void)buf;
+#endif
+}
+
+/**
+ * Get a buffer to build an outgoing datagram in, to be sent with @ref iperf_udp_send().
+ *
+ * With @ref MMIPERF_FREERTOSPLUSTCP_ZERO_COPY this is a network buffer borrowed from the stack,
+ * which waits up to @ref IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS for one to become free. Otherwise
+ * @p scratch is returned.
+ *
+ * @param len       Length of the datagram.
+ * @param to        The address the datagram will be sent to.
+ * @param scratch   Buffer to build the datagram in when zero-copy is not in use.
+ *
+ * @returns the buffer, or @c NULL if no network buffer was available.
+ */
+static uint8_t *iperf_udp_tx_buffer_get(size_t len, const struct freertos_sockaddr *to,
+                                        uint8_t *scratch)
+{
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+    (void)scratch;
+    return (uint8_t *)FreeRTOS_GetUDPPayloadBuffer_Multi(
+        len, pdMS_TO_TICKS(IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS),
+        (to->sin_family == FREERTOS_AF_INET6) ? ipTYPE_IPv6 : ipTYPE_IPv4);
+#else
+    (void)len;
+    (void)to;
+    return scratch;
+#endif
+}
+
+/**
+ * Send a datagram built in a buffer from @ref iperf_udp_tx_buffer_get(). The buffer is handed
+ * back to the stack whether or not the send succeeds.
+ *
+ * @param socket    The socket to send on.
+ * @param buf       The datagram.
+ * @param len       Length of the datagram.
+ * @param to        The address to send the datagram to.
+ *
+ * @returns the number of bytes sent, or zero or a negative value on failure.
+ */
+static int32_t iperf_udp_send(Socket_t socket, uint8_t *buf, size_t len,
+                              const struct freertos_sockaddr *to)
+{
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+    int32_t ret = FreeRTOS_sendto(socket, buf, len, FREERTOS_ZERO_COPY, to, sizeof(*to));
+    if (ret <= 0)
+    {
+        /* The stack only takes ownership of the buffer if the datagram was queued. */
+        FreeRTOS_ReleaseUDPPayloadBuffer(buf);
+    }
+    return ret;
+#else
+    return FreeRTOS_sendto(socket, buf, len, 0, to, sizeof(*to));
+#endif
 }
 
 static void iperf_udp_recv_task(void *arg)
@@ -175,38 +412,51 @@ static void iperf_udp_recv_task(void *arg)
     struct iperf_server_state_udp *server_state = (struct iperf_server_state_udp *)arg;
 
     struct iperf_udp_header *hdr;
-    struct iperf_settings *settings;
-    struct timeval packet_time;
+    struct iperf_settings settings;
+    uint32_t hdrs_len = iperf_udp_hdrs_len(server_state->args.version);
     int64_t packet_id = 0;
     bool final_packet = false;
+    bool done = false;
+    uint32_t linger_end_ms = 0;
     struct iperf_server_session_udp *session = NULL;
 
-    int udp_recv_len = sizeof(*hdr) + 1500;
     int len = 0;
+    uint8_t *recv_buff = NULL;
+    /* Header of the final datagram of a session, which is echoed back in the server report. */
+    struct iperf_udp_header final_hdr;
 
     struct freertos_sockaddr remote_sa;
-    uint32_t remote_sa_len = sizeof(remote_sa);
 
-    uint8_t *recv_buff = (uint8_t *)mmosal_malloc(udp_recv_len);
-    if (recv_buff == NULL)
+#if !MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+    uint8_t *scratch = (uint8_t *)mmosal_malloc(IPERF_UDP_RECV_LEN);
+    if (scratch == NULL)
     {
         FreeRTOS_debug_printf(("iperf UDP rx task failed to alloc recv_buff\n"));
         return;
     }
+#else
+    uint8_t *scratch = NULL;
+#endif
 
-    while (1)
+    while (!done)
     {
         while (!final_packet)
         {
-            len = FreeRTOS_recvfrom(server_state->udp_socket, recv_buff, udp_recv_len, 0,
-                                    &remote_sa, &remote_sa_len);
+            len = iperf_udp_recv(server_state->udp_socket, scratch, &recv_buff, &remote_sa);
+
+            if (server_state->specific_remote && len > 0 &&
+                !iperf_freertosplustcp_sockaddr_addr_match(&remote_sa, &server_state->remote_sa))
+            {
+                /* this listener belongs to a client session, and this is not the correct
+                 * remote */
+                len = 0;
+            }
 
-            if (len >= (int)(sizeof(*hdr) + sizeof(*settings)))
+            if (len >= (int)hdrs_len)
             {
                 hdr = (struct iperf_udp_header *)recv_buff;
-                settings = (struct iperf_settings *)(hdr + 1);
-                packet_time.tv_sec = FreeRTOS_ntohl(hdr->tv_sec);
-                packet_time.tv_usec = FreeRTOS_ntohl(hdr->tv_usec);
+                /* The settings follow the header, the length of which depends on the version. */
+                memcpy(&settings, recv_buff + hdrs_len - sizeof(settings), sizeof(settings));
 
                 if (server_state->args.version == IPERF_VERSION_2_0_9)
                 {
@@ -225,20 +475,35 @@ static void iperf_udp_recv_task(void *arg)
                     packet_id = -packet_id;
                 }
 
-                session = get_session(server_state, &remote_sa);
+                session = get_session(server_state, &remote_sa, &settings);
                 if (session == NULL)
                 {
                     FreeRTOS_debug_printf(("Another UDP server session already in progress\n"));
+                    final_packet = false;
                 }
                 else if (session->next_packet_id >= 0)
                 {
+                    if (session->next_packet_id == 0 && server_state->base.report.rx_frames == 0 &&
+                        (session->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_TEST)) &&
+                        (session->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_NOW)))
+                    {
+                        /* client requested parallel transmission test */
+                        iperf_udp_server_answer_test(server_state, session);
+                    }
+
                     server_state->base.last_rx_time_ms = mmosal_get_time_ms();
                     server_state->base.report.bytes_transferred += len;
                     server_state->base.report.rx_frames++;
-                    server_state->base.report.ipg_count++;
-                    server_state->base.report.ipg_sum_ms +=
-                        time_delta(&packet_time, &(session->ipg_start));
-                    session->ipg_start = packet_time;
+                    iperf_udp_server_update_timing(&server_state->base,
+                                                   ((uint64_t)FreeRTOS_ntohl(hdr->tv_sec) *
+                                                    1000000) + FreeRTOS_ntohl(hdr->tv_usec),
+                                                   &session->prev_tx_time_us);
+                    if (server_state->base.verify_payload)
+                    {
+                        iperf_udp_server_verify(server_state, recv_buff, len);
+                    }
+                    iperf_frame_rx_update(&server_state->base, &session->frame_rx,
+                                          recv_buff + hdrs_len, len - hdrs_len);
 
                     if (packet_id < session->next_packet_id)
                     {
@@ -255,6 +520,21 @@ static void iperf_udp_recv_task(void *arg)
                         session->next_packet_id = packet_id + 1;
                     }
                 }
+
+                if (final_packet)
+                {
+                    memcpy(&final_hdr, hdr, sizeof(final_hdr));
+                }
+            }
+
+            iperf_udp_recv_release(recv_buff);
+            recv_buff = NULL;
+
+            if (len < (int)hdrs_len && server_state->specific_remote &&
+                iperf_udp_server_reverse_done(server_state, linger_end_ms))
+            {
+                done = true;
+                break;
             }
         }
 
@@ -262,8 +542,10 @@ static void iperf_udp_recv_task(void *arg)
         {
             uint32_t duration_ms =
                 server_state->base.last_rx_time_ms - server_state->base.time_started_ms;
-            if (session->next_packet_id >= 0)
+            bool report_required = (session->next_packet_id >= 0);
+            if (report_required)
             {
+                iperf_frame_rx_finish(&server_state->base, &session->frame_rx);
                 iperf_finalize_report_and_invoke_callback(&server_state->base, duration_ms,
                                                           MMIPERF_UDP_DONE_SERVER);
             }
@@ -271,37 +553,91 @@ static void iperf_udp_recv_task(void *arg)
             session->next_packet_id = -1;
             final_packet = false;
 
-            /* Send server report if not a multicast address */
-            if (!is_multicast_ip_addr(server_state->args.local_addr))
+            /* Send server report if not a multicast address, or if the client of a multicast
+             * test asked each receiver to report back to it. In the latter case only the first
+             * final packet is answered since the client repeats it. */
+            bool send_report = !is_multicast_ip_addr(server_state->args.local_addr);
+            if (!send_report && report_required &&
+                (session->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_MCAST_REPORT)))
             {
-                /* We use the UDP header and flags from the pbuf we received. */
-                struct iperf_udp_header *report_hdr = (struct iperf_udp_header *)recv_buff;
-                struct iperf_udp_server_report *report =
-                    (struct iperf_udp_server_report *)(report_hdr + 1);
-                uint32_t tx_report_len = (sizeof(*report_hdr) + sizeof(*report));
-
-                iperf_populate_udp_server_report(&server_state->base, report);
-
-                len = FreeRTOS_sendto(server_state->udp_socket, recv_buff, tx_report_len, 0,
-                                      &session->client_sa,
-                                      sizeof(session->client_sa));
-                if (len <= 0)
+                /* Spread the reports from all the receivers out over time. */
+                mmosal_task_sleep(iperf_udp_mcast_report_delay_ms());
+                send_report = true;
+            }
+
+            if (send_report)
+            {
+                uint32_t tx_report_len =
+                    sizeof(struct iperf_udp_header) + sizeof(struct iperf_udp_server_report);
+                uint8_t *tx_buf =
+                    iperf_udp_tx_buffer_get(tx_report_len, &session->client_sa, scratch);
+                if (tx_buf != NULL)
+                {
+                    /* We use the UDP header and flags from the final datagram we received. */
+                    struct iperf_udp_header *report_hdr = (struct iperf_udp_header *)tx_buf;
+                    struct iperf_udp_server_report *report =
+                        (struct iperf_udp_server_report *)(report_hdr + 1);
+
+                    memcpy(report_hdr, &final_hdr, sizeof(*report_hdr));
+                    iperf_populate_udp_server_report(&server_state->base, report);
+
+                    len = iperf_udp_send(server_state->udp_socket, tx_buf, tx_report_len,
+                                         &session->client_sa);
+                }
+                if (tx_buf == NULL || len <= 0)
                 {
                     FreeRTOS_debug_printf(("Failed to tx udp server report\n"));
                 }
             }
+
+            if (report_required &&
+                (session->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_TEST)) &&
+                !(session->settings.flags & FreeRTOS_htonl(IPERF_FLAGS_ANSWER_NOW)))
+            {
+                /* client requested transmission after end of test */
+                iperf_udp_server_answer_test(server_state, session);
+            }
+
+            if (report_required && server_state->specific_remote)
+            {
+                linger_end_ms = mmosal_get_time_ms() +
+                                IPERF_UDP_CLIENT_REPORT_RETRIES * IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS;
+            }
         }
     }
 
-    mmosal_free(recv_buff);
-    recv_buff = NULL;
+#if !MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+    mmosal_free(scratch);
+    scratch = NULL;
+#endif
+
+    /* Only listeners for the receive direction of a bidirectional test finish. */
+    iperf_list_remove(&server_state->base);
+    (void)FreeRTOS_closesocket(server_state->udp_socket);
+    if (server_state->base.latency != NULL)
+    {
+        IPERF_FREE(struct iperf_latency_stats, server_state->base.latency);
+    }
+    IPERF_FREE(struct iperf_server_state_udp, server_state);
 }
 
-mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args)
+/**
+ * Start a UDP server.
+ *
+ * @param args                  Iperf server arguments.
+ * @param specific_remote_sa    If not @c NULL, only accept sessions from this address and close
+ *                              the server once its session is done (for the receive direction
+ *                              of a bidirectional test).
+ * @param state                 Receives the new server on success.
+ *
+ * @returns zero on success, else a negative error code.
+ */
+static int iperf_start_udp_server_impl(const struct mmiperf_server_args *args,
+                                       const struct freertos_sockaddr *specific_remote_sa,
+                                       struct iperf_server_state_udp **state)
 {
     int ok = -1;
     struct iperf_server_state_udp *s;
-    mmiperf_handle_t result = NULL;
     struct freertos_sockaddr *sa = NULL;
     BaseType_t ret = pdFAIL;
 
@@ -319,9 +655,25 @@ mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args
     memcpy(&(s->args.local_addr), &args->local_addr, sizeof(s->args.local_addr));
     s->args.local_port = args->local_port;
     s->args.version = args->version;
+    s->base.verify_payload = args->verify_payload;
     /* Set next_packet_id to -1 to show that there is no session active. We will start a new
      * session with the first packet we receive from a client. */
     s->session.next_packet_id = -1;
+    if (specific_remote_sa != NULL)
+    {
+        s->specific_remote = 1;
+        s->remote_sa = *specific_remote_sa;
+        s->listen_timeout_ms = mmosal_get_time_ms() + IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS;
+    }
+    if (args->trip_times)
+    {
+        s->base.latency = (struct iperf_latency_stats *)IPERF_ALLOC(struct iperf_latency_stats);
+        if (s->base.latency == NULL)
+        {
+            goto exit;
+        }
+        memset(s->base.latency, 0, sizeof(*s->base.latency));
+    }
 
     if (args->local_addr[0] != '\0')
     {
@@ -389,19 +741,52 @@ mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args
 
     /* Note: Multicast is not yet supported. */
 
-    iperf_list_add(&s->base);
+    if (!iperf_list_add(&s->base))
+    {
+        FreeRTOS_debug_printf(("Too many iperf sessions\n"));
+        ok = -1;
+        goto exit;
+    }
     s->task = mmosal_task_create(iperf_udp_recv_task, s, MMOSAL_TASK_PRI_LOW,
                                  MMIPERF_STACK_SIZE, "iperf_udp_recv");
     MMOSAL_ASSERT(s->task != NULL);
-    result = &(s->base);
+    *state = s;
     s = NULL;
 
 exit:
     if (s != NULL)
     {
+        if (s->udp_socket != NULL)
+        {
+            (void)FreeRTOS_closesocket(s->udp_socket);
+        }
+        if (s->base.latency != NULL)
+        {
+            IPERF_FREE(struct iperf_latency_stats, s->base.latency);
+        }
         IPERF_FREE(struct iperf_server_state_udp, s);
     }
-    return result;
+    return ok;
+}
+
+mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args)
+{
+    int err;
+    struct iperf_server_state_udp *state = NULL;
+
+    if (args->version == IPERF_VERSION_3)
+    {
+        /* The iperf3 server handles UDP tests too; see mmiperf_start_tcp_server(). */
+        FreeRTOS_debug_printf(("iperf3 server must be started as a TCP server\n"));
+        return NULL;
+    }
+
+    err = iperf_start_udp_server_impl(args, NULL, &state);
+    if (err == 0)
+    {
+        return state->base.handle;
+    }
+    return NULL;
 }
 
 static int iperf_udp_client_send_packet(struct iperf_client_state_udp *client_state,
@@ -409,15 +794,18 @@ static int iperf_udp_client_send_packet(struct iperf_client_state_udp *client_st
 {
     struct iperf_udp_header *udp_hdr;
     struct iperf_settings *settings;
-    uint32_t hdrs_len = sizeof(*udp_hdr) + sizeof(*settings);
+    uint32_t iperf_hdrs_len = iperf_udp_hdrs_len(client_state->args.version);
+    uint32_t hdrs_len = iperf_hdrs_len;
     uint32_t payload_len = 0;
     uint32_t udp_payload_len = 0;
     int ret = 0;
     struct freertos_sockaddr sockaddr_to;
+    /* In isochronous frame mode each datagram apart from the final one carries a frame header */
+    bool frame_hdr = (client_state->frame.len > 0 && !final);
 
-    if (client_state->args.version == IPERF_VERSION_2_0_9)
+    if (frame_hdr)
     {
-        hdrs_len = (hdrs_len - sizeof(uint32_t));
+        hdrs_len += sizeof(struct iperf_frame_header);
     }
 
     if (tx_amount > hdrs_len)
@@ -427,13 +815,66 @@ static int iperf_udp_client_send_packet(struct iperf_client_state_udp *client_st
 
     udp_payload_len = (hdrs_len + payload_len);
 
-    uint8_t *udp_payload = (uint8_t *)mmosal_malloc(udp_payload_len);
+    memset(&sockaddr_to, 0, sizeof(sockaddr_to));
+    struct freertos_sockaddr *sa = (struct freertos_sockaddr *)&sockaddr_to;
+    sa->sin_port = FreeRTOS_htons(client_state->args.server_port);
+    if (client_state->server_addr.xIs_IPv6)
+    {
+        sa->sin_family = FREERTOS_AF_INET6;
+        memcpy(sa->sin_address.xIP_IPv6.ucBytes,
+               client_state->server_addr.xIPAddress.xIP_IPv6.ucBytes,
+               sizeof(sa->sin_address.xIP_IPv6.ucBytes));
+    }
+    else
+    {
+        sa->sin_family = FREERTOS_AF_INET;
+        sa->sin_address.ulIP_IPv4 = client_state->server_addr.xIPAddress.ulIP_IPv4;
+    }
+
+#if MMIPERF_FREERTOSPLUSTCP_ZERO_COPY
+    /* The datagram is built directly in a network buffer, which is handed to the stack when it
+     * is sent, so the payload is written afresh each time. */
+    uint8_t *udp_payload = iperf_udp_tx_buffer_get(udp_payload_len, &sockaddr_to, NULL);
     if (udp_payload == NULL)
     {
-        FreeRTOS_debug_printf(("iperf UDP tx failed to alloc udp_payload\n"));
+        FreeRTOS_debug_printf(("iperf UDP tx failed to get a network buffer\n"));
         return -1;
     }
 
+    iperf_payload_copy(&client_state->payload, client_state->tx_payload_offset,
+                       udp_payload + hdrs_len, payload_len);
+#else
+    /* The buffer (and the payload in it) is reused for each datagram of the same length, so only
+     * the header needs to be filled in each time. */
+    uint8_t *udp_payload = client_state->tx_buf;
+    if (udp_payload == NULL || client_state->tx_buf_len != udp_payload_len)
+    {
+        if (client_state->tx_buf != NULL)
+        {
+            mmosal_free(client_state->tx_buf);
+            client_state->tx_buf = NULL;
+        }
+
+        udp_payload = (uint8_t *)mmosal_malloc(udp_payload_len);
+        if (udp_payload == NULL)
+        {
+            FreeRTOS_debug_printf(("iperf UDP tx failed to alloc udp_payload\n"));
+            return -1;
+        }
+
+        iperf_payload_copy(&client_state->payload, client_state->tx_payload_offset,
+                           udp_payload + hdrs_len, payload_len);
+        client_state->tx_buf = udp_payload;
+        client_state->tx_buf_len = udp_payload_len;
+    }
+    else if (!iperf_payload_is_default(&client_state->payload))
+    {
+        /* Application payload continues from one datagram to the next. */
+        iperf_payload_copy(&client_state->payload, client_state->tx_payload_offset,
+                           udp_payload + hdrs_len, payload_len);
+    }
+#endif
+
     int64_t datagrams_cnt = (int32_t)client_state->base.report.tx_frames;
     if (final)
     {
@@ -450,49 +891,31 @@ static int iperf_udp_client_send_packet(struct iperf_client_state_udp *client_st
         udp_hdr->id_lo = FreeRTOS_htonl((uint32_t)((uint64_t)datagrams_cnt));
         udp_hdr->id_hi = FreeRTOS_htonl((uint32_t)(((uint64_t)datagrams_cnt) >> 32));
     }
-    uint32_t now = mmosal_get_time_ms();
-    udp_hdr->tv_usec = FreeRTOS_htonl((now % 1000) * 1000);
-    udp_hdr->tv_sec = FreeRTOS_htonl(now / 1000);
-
-    settings = (struct iperf_settings *)(udp_hdr + 1);
-    memset(settings, 0, sizeof(*settings));
-
-    const uint8_t *payload = iperf_get_data(0);
-    if (payload == NULL)
+    uint64_t now_us = iperf_get_time_us();
+    udp_hdr->tv_usec = FreeRTOS_htonl(now_us % 1000000);
+    udp_hdr->tv_sec = FreeRTOS_htonl(now_us / 1000000);
+
+    /* The settings follow the header, the length of which depends on the version. */
+    settings = (struct iperf_settings *)(udp_payload + iperf_hdrs_len - sizeof(*settings));
+    memcpy(settings, &client_state->settings, sizeof(*settings));
+    if (frame_hdr)
     {
-        FreeRTOS_debug_printf(("iperf get payload failed\n"));
-        mmosal_free(udp_payload);
-        return -1;
+        iperf_frame_tx_fill_header(udp_payload + iperf_hdrs_len, &client_state->frame,
+                                   client_state->args.packet_size - hdrs_len);
     }
 
-    memcpy((udp_payload + hdrs_len), payload, payload_len);
-
-    memset(&sockaddr_to, 0, sizeof(sockaddr_to));
-    struct freertos_sockaddr *sa = (struct freertos_sockaddr *)&sockaddr_to;
-    sa->sin_port = FreeRTOS_htons(client_state->args.server_port);
-    if (client_state->server_addr.xIs_IPv6)
-    {
-        sa->sin_family = FREERTOS_AF_INET6;
-        memcpy(sa->sin_address.xIP_IPv6.ucBytes,
-               client_state->server_addr.xIPAddress.xIP_IPv6.ucBytes,
-               sizeof(sa->sin_address.xIP_IPv6.ucBytes));
-    }
-    else
-    {
-        sa->sin_family = FREERTOS_AF_INET;
-        sa->sin_address.ulIP_IPv4 = client_state->server_addr.xIPAddress.ulIP_IPv4;
-    }
-
-    ret = FreeRTOS_sendto(client_state->udp_socket, udp_payload, udp_payload_len, 0,
-                          &sockaddr_to, sizeof(sockaddr_to));
-
-    mmosal_free(udp_payload);
+    ret = iperf_udp_send(client_state->udp_socket, udp_payload, udp_payload_len, &sockaddr_to);
     if (ret < 0)
     {
         FreeRTOS_debug_printf(("iperf UDP tx failed to send\n"));
         return -1;
     }
 
+    if (!iperf_payload_is_default(&client_state->payload))
+    {
+        client_state->tx_payload_offset += payload_len;
+    }
+
     return 0;
 }
 
@@ -526,12 +949,56 @@ static void iperf_udp_client_recv(struct iperf_client_state_udp *session)
     recv_buff = NULL;
 }
 
-static void iperf_udp_client_task(void *arg)
+/**
+ * Start listening for the remote server to send the receive direction of a bidirectional test.
+ * The listener closes itself when the receive direction is done.
+ *
+ * @param client_state  The UDP client stream.
+ *
+ * @returns zero on success, else a negative error code.
+ */
+static int iperf_udp_client_start_reverse_server(struct iperf_client_state_udp *client_state)
 {
-    struct iperf_client_state_udp *client_state = (struct iperf_client_state_udp *)arg;
+    int err;
+    struct iperf_server_state_udp *srv = NULL;
+    struct mmiperf_server_args server_args = MMIPERF_SERVER_ARGS_DEFAULT;
+
+    if (client_state->reverse_started)
+    {
+        return 0;
+    }
+    client_state->reverse_started = true;
+
+    server_args.local_port = MMIPERF_DEFAULT_PORT;
+    server_args.report_fn = client_state->args.report_fn;
+    server_args.report_arg = client_state->args.report_arg;
+    server_args.version = client_state->args.version;
+    if (client_state->server_addr.xIs_IPv6)
+    {
+        /* the listener must use the same address family as the remote server */
+        iperf_freertosplustcp_sockaddr_ntop(&client_state->udp_client_sa, server_args.local_addr,
+                                            sizeof(server_args.local_addr));
+    }
+
+    err = iperf_start_udp_server_impl(&server_args, &client_state->udp_server_sa, &srv);
+    if (err == -pdFREERTOS_ERRNO_EADDRINUSE)
+    {
+        /* An iperf server is already listening on this port; it will receive the test. */
+        FreeRTOS_debug_printf(("Using existing UDP server for reverse test\n"));
+        return 0;
+    }
+    if (err != 0)
+    {
+        FreeRTOS_debug_printf(("Failed to start UDP server for reverse test\n"));
+    }
+    return err;
+}
 
-    uint32_t end_time = UINT32_MAX;
-    uint64_t remaining_amount = UINT64_MAX;
+/** Initialise the transmit state of a UDP client stream at the start of the test. */
+static void iperf_udp_client_tx_init(struct iperf_client_state_udp *client_state)
+{
+    client_state->end_time = UINT32_MAX;
+    client_state->remaining_amount = UINT64_MAX;
 
     iperf_freertosplustcp_session_start_common(&client_state->base,
                                                &client_state->udp_client_sa,
@@ -541,74 +1008,229 @@ static void iperf_udp_client_task(void *arg)
      * number of bytes. */
     if (client_state->args.amount < 0)
     {
-        end_time = client_state->base.time_started_ms + (-(client_state->args.amount) * 10);
+        client_state->end_time = iperf_test_start_time_ms(&client_state->base) +
+                                 (-(client_state->args.amount) * 10);
     }
     else
     {
-        remaining_amount = client_state->args.amount;
+        client_state->remaining_amount = client_state->args.amount;
     }
 
-    uint32_t tx_amount = 0;
-    bool final = false;
-    unsigned failure_cnt = 0;
+    if (client_state->args.mode == MMIPERF_CLIENT_MODE_REVERSE)
+    {
+        /* We only send enough to request the test; the amount is for the remote side. */
+        client_state->end_time = UINT32_MAX;
+        client_state->remaining_amount = 0;
+    }
 
-    /* if no input for bandwidth limit, set bw_limit flag to false */
-    bool bw_limit = true;
-    if (client_state->args.target_bw == 0)
+    client_state->block_end_time = mmosal_get_time_ms() + BLOCK_DURATION_MS;
+    client_state->block_remaining_tx_amount = client_state->block_tx_amount;
+    iperf_frame_tx_init(&client_state->frame, &client_state->args, 0);
+}
+
+/** Check whether a UDP client stream has finished transmitting. */
+static bool iperf_udp_client_tx_done(struct iperf_client_state_udp *client_state)
+{
+    return client_state->final ||
+           client_state->failure_cnt >= IPERF_UDP_CLIENT_MAX_CONSEC_FAILURES;
+}
+
+/**
+ * Transmit the next datagram of a UDP client stream in isochronous frame mode, if a frame is in
+ * progress or due. Once the test is over the final datagram is sent without a frame header.
+ *
+ * @param client_state  The UDP client stream.
+ *
+ * @returns @c true if a transmit was attempted, else @c false.
+ */
+static bool iperf_udp_client_tx_next_frame(struct iperf_client_state_udp *client_state)
+{
+    uint32_t hdrs_len = iperf_udp_hdrs_len(client_state->args.version) +
+                        sizeof(struct iperf_frame_header);
+    bool test_over = (mmosal_get_time_ms() > client_state->end_time ||
+                      client_state->remaining_amount == 0);
+
+    if (!test_over)
     {
-        bw_limit = false;
+        iperf_frame_tx_start(&client_state->frame, false);
     }
-    uint32_t block_end_time = mmosal_get_time_ms() + BLOCK_DURATION_MS;
-    uint32_t block_remaining_tx_amount = client_state->block_tx_amount;
 
-    while (!final && failure_cnt < IPERF_UDP_CLIENT_MAX_CONSEC_FAILURES)
+    if (client_state->frame.remaining > 0)
     {
-        /* If this is the last packet then set the counter to negative to inform the other side. */
-        if (mmosal_get_time_ms() > end_time ||
-            remaining_amount <= (uint64_t)client_state->args.packet_size)
+        client_state->tx_amount = hdrs_len + min(client_state->args.packet_size - hdrs_len,
+                                                 client_state->frame.remaining);
+    }
+    else if (test_over)
+    {
+        client_state->final = true;
+        client_state->awaiting_report = true;
+        client_state->tx_amount = iperf_udp_hdrs_len(client_state->args.version);
+    }
+    else
+    {
+        return false;
+    }
+
+    int err = iperf_udp_client_send_packet(client_state, client_state->tx_amount,
+                                           client_state->final);
+    if (err == 0)
+    {
+        client_state->base.report.bytes_transferred += client_state->tx_amount;
+        client_state->base.report.tx_frames++;
+        if (!client_state->final)
         {
-            final = true;
-            client_state->awaiting_report = true;
+            client_state->frame.remaining -= client_state->tx_amount - hdrs_len;
+            client_state->remaining_amount -= min(client_state->remaining_amount,
+                                                  client_state->tx_amount - hdrs_len);
         }
-        tx_amount = min(remaining_amount, client_state->args.packet_size);
+        client_state->failure_cnt = 0;
+    }
+    else
+    {
+        client_state->failure_cnt++;
+        client_state->retry_time = mmosal_get_time_ms() + IPERF_UDP_CLIENT_RETRY_WAIT_TIME_MS;
+    }
+    return true;
+}
+
+/**
+ * Transmit the next datagram of a UDP client stream, if its bandwidth limit allows.
+ *
+ * @param client_state  The UDP client stream.
+ *
+ * @returns @c true if a transmit was attempted, else @c false.
+ */
+static bool iperf_udp_client_tx_next(struct iperf_client_state_udp *client_state)
+{
+    /* if no input for bandwidth limit, set bw_limit flag to false */
+    bool bw_limit = (client_state->args.target_bw != 0);
+
+    if (client_state->failure_cnt > 0 && !mmosal_time_has_passed(client_state->retry_time))
+    {
+        return false;
+    }
 
-        /* when bw_limit is set to false, always send packets without check block parameter */
-        if (bw_limit && block_end_time < mmosal_get_time_ms())
+    if (client_state->frame.len > 0)
+    {
+        return iperf_udp_client_tx_next_frame(client_state);
+    }
+
+    /* If this is the last packet then set the counter to negative to inform the other side. The
+     * first packet cannot be the last since its counter is zero. */
+    if (client_state->base.report.tx_frames > 0 &&
+        (mmosal_get_time_ms() > client_state->end_time ||
+         client_state->remaining_amount <= (uint64_t)client_state->args.packet_size))
+    {
+        client_state->final = true;
+        client_state->awaiting_report = true;
+        if (client_state->args.mode == MMIPERF_CLIENT_MODE_TRADEOFF ||
+            client_state->args.mode == MMIPERF_CLIENT_MODE_REVERSE)
         {
-            block_end_time = mmosal_get_time_ms() + BLOCK_DURATION_MS;
-            block_remaining_tx_amount += client_state->block_tx_amount;
+            /* the remote side starts transmitting once it receives our final packet */
+            iperf_udp_client_start_reverse_server(client_state);
         }
-        if (!bw_limit || block_remaining_tx_amount >= tx_amount || mmosal_get_time_ms() > end_time)
-        {
-            int err = iperf_udp_client_send_packet(client_state, tx_amount, final);
+    }
+    client_state->tx_amount = min(client_state->remaining_amount, client_state->args.packet_size);
 
-            if (err == 0)
-            {
-                client_state->base.report.bytes_transferred += tx_amount;
-                client_state->base.report.tx_frames++;
-                remaining_amount -= tx_amount;
-                block_remaining_tx_amount -= tx_amount;
-                failure_cnt = 0;
-            }
-            else
-            {
-                failure_cnt++;
-                mmosal_task_sleep(IPERF_UDP_CLIENT_RETRY_WAIT_TIME_MS);
-            }
+    /* when bw_limit is set to false, always send packets without check block parameter */
+    if (bw_limit && client_state->block_end_time < mmosal_get_time_ms())
+    {
+        client_state->block_end_time = mmosal_get_time_ms() + BLOCK_DURATION_MS;
+        client_state->block_remaining_tx_amount += client_state->block_tx_amount;
+    }
+    if (bw_limit && client_state->block_remaining_tx_amount < client_state->tx_amount &&
+        mmosal_get_time_ms() <= client_state->end_time)
+    {
+        return false;
+    }
+
+    int err = iperf_udp_client_send_packet(client_state, client_state->tx_amount,
+                                           client_state->final);
+    if (err == 0)
+    {
+        client_state->base.report.bytes_transferred += client_state->tx_amount;
+        client_state->base.report.tx_frames++;
+        client_state->remaining_amount -= client_state->tx_amount;
+        client_state->block_remaining_tx_amount -= client_state->tx_amount;
+        client_state->failure_cnt = 0;
+    }
+    else
+    {
+        client_state->failure_cnt++;
+        client_state->retry_time = mmosal_get_time_ms() + IPERF_UDP_CLIENT_RETRY_WAIT_TIME_MS;
+    }
+    return true;
+}
+
+/**
+ * Collect the reports sent back by the receivers of a multicast test. The final packet is
+ * repeated a few times since it is not acknowledged, then reports are collected for
+ * @ref IPERF_UDP_MCAST_REPORT_WINDOW_MS.
+ */
+static void iperf_udp_client_collect_mcast_reports(struct iperf_client_state_udp *client_state)
+{
+    struct
+    {
+        struct iperf_udp_header hdr;
+        struct iperf_udp_server_report report;
+    } msg;
+    struct freertos_sockaddr from;
+    uint32_t from_len;
+    char addr_str[MMIPERF_IPADDR_MAXLEN];
+    uint32_t window_end_ms;
+    int32_t len;
+    unsigned ii;
+
+    for (ii = 1; ii < IPERF_UDP_MCAST_FINAL_REPEATS; ii++)
+    {
+        mmosal_task_sleep(IPERF_UDP_MCAST_FINAL_INTERVAL_MS);
+        iperf_udp_client_send_packet(client_state, client_state->tx_amount, true);
+    }
+
+    window_end_ms = mmosal_get_time_ms() + IPERF_UDP_MCAST_REPORT_WINDOW_MS;
+    while (!mmosal_time_has_passed(window_end_ms))
+    {
+        from_len = sizeof(from);
+        len = FreeRTOS_recvfrom(client_state->udp_socket, &msg, sizeof(msg), 0, &from,
+                                &from_len);
+        if (len < (int32_t)sizeof(msg) ||
+            from.sin_port != FreeRTOS_htons(client_state->args.server_port))
+        {
+            continue;
         }
-        else
+
+        iperf_freertosplustcp_sockaddr_ntop(&from, addr_str, sizeof(addr_str));
+        if (!iperf_mcast_receivers_add(client_state->mcast_receivers, addr_str, &msg.hdr,
+                                       &msg.report, client_state->args.version,
+                                       client_state->base.report.tx_frames))
         {
-            mmosal_task_sleep(1);
+            FreeRTOS_debug_printf(("iperf UDP rx invalid multicast report\n"));
         }
     }
-    iperf_udp_client_recv(client_state);
+
+    iperf_mcast_receivers_summarise(client_state->mcast_receivers, &client_state->base.report);
+}
+
+/** Collect the server report for a UDP client stream then clean up and report the result. */
+static void iperf_udp_client_finish(struct iperf_client_state_udp *client_state)
+{
+    uint32_t tx_end_ms = mmosal_get_time_ms();
+
+    if (client_state->mcast_receivers != NULL)
+    {
+        iperf_udp_client_collect_mcast_reports(client_state);
+    }
+    else
+    {
+        iperf_udp_client_recv(client_state);
+    }
 
     if (!is_multicast_ip_addr(client_state->server_addr))
     {
         unsigned ii;
         for (ii = 0; ii < IPERF_UDP_CLIENT_REPORT_RETRIES && client_state->report == NULL; ii++)
         {
-            iperf_udp_client_send_packet(client_state, tx_amount, true);
+            iperf_udp_client_send_packet(client_state, client_state->tx_amount, true);
             iperf_udp_client_recv(client_state);
         }
     }
@@ -630,18 +1252,21 @@ static void iperf_udp_client_task(void *arg)
         client_state->report = NULL;
         client_state->report_len = 0;
     }
+    else if (is_multicast_ip_addr(client_state->server_addr))
+    {
+        /* There is no server report for a multicast test, so report what we sent. */
+        final_duration_ms = tx_end_ms - client_state->base.time_started_ms;
+    }
     else
     {
         final_duration_ms = mmosal_get_time_ms() - client_state->base.time_started_ms;
-        if (!is_multicast_ip_addr(client_state->server_addr))
-        {
-            /* If we receive no response from the server in unicast mode then clear the
-             * results in the report so that it is obvious. */
-            client_state->base.report.bytes_transferred = 0;
-            client_state->base.report.bandwidth_kbitpsec = 0;
-        }
+        /* If we receive no response from the server in unicast mode then clear the
+         * results in the report so that it is obvious. */
+        client_state->base.report.bytes_transferred = 0;
+        client_state->base.report.bandwidth_kbitpsec = 0;
     }
 
+    iperf_list_remove(&client_state->base);
     iperf_finalize_report_and_invoke_callback(&client_state->base, final_duration_ms,
                                               MMIPERF_UDP_DONE_CLIENT);
 
@@ -652,12 +1277,73 @@ static void iperf_udp_client_task(void *arg)
         FreeRTOS_debug_printf(("Socket close failed\n"));
     }
     client_state->udp_socket = 0;
+    if (client_state->tx_buf != NULL)
+    {
+        mmosal_free(client_state->tx_buf);
+        client_state->tx_buf = NULL;
+    }
+    if (client_state->mcast_receivers != NULL)
+    {
+        IPERF_FREE(struct iperf_mcast_receivers, client_state->mcast_receivers);
+    }
+    IPERF_FREE(struct iperf_client_state_udp, client_state);
 }
 
-mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args)
+/**
+ * Task that runs a UDP client test. All streams of a parallel test are run from this one task,
+ * transmitting a datagram from each stream in turn.
+ */
+static void iperf_udp_client_task(void *arg)
+{
+    struct iperf_client_state_udp *first_stream = (struct iperf_client_state_udp *)arg;
+    struct iperf_client_state_udp *client_state;
+    struct iperf_client_state_udp *next;
+    bool active;
+
+    for (client_state = first_stream; client_state != NULL;
+         client_state = client_state->next_stream)
+    {
+        iperf_udp_client_tx_init(client_state);
+    }
+
+    do
+    {
+        bool transmitted = false;
+        active = false;
+        for (client_state = first_stream; client_state != NULL;
+             client_state = client_state->next_stream)
+        {
+            if (!iperf_udp_client_tx_done(client_state))
+            {
+                active = true;
+                transmitted |= iperf_udp_client_tx_next(client_state);
+            }
+        }
+        if (active && !transmitted)
+        {
+            mmosal_task_sleep(1);
+        }
+    } while (active);
+
+    for (client_state = first_stream; client_state != NULL; client_state = next)
+    {
+        next = client_state->next_stream;
+        iperf_udp_client_finish(client_state);
+    }
+}
+
+/**
+ * Allocate and initialise a UDP client stream.
+ *
+ * @param args  Iperf client arguments.
+ *
+ * @returns the new stream on success, else @c NULL.
+ */
+static struct iperf_client_state_udp *iperf_udp_client_create(
+    const struct mmiperf_client_args *args)
 {
     struct iperf_client_state_udp *s;
-    mmiperf_handle_t result = NULL;
+    struct iperf_client_state_udp *result = NULL;
     uint32_t pkt_size = 0;
     int ok = 0;
     struct freertos_sockaddr *sa = NULL;
@@ -676,6 +1362,11 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
     s->base.report_fn = args->report_fn;
     s->base.report_arg = args->report_arg;
     s->next_packet_id = 0;
+    if (args->mode == MMIPERF_CLIENT_MODE_REVERSE)
+    {
+        /* Only the receive direction is reported. */
+        s->base.report_fn = NULL;
+    }
 
     memcpy(&(s->args), args, sizeof(s->args));
 #if ipconfigUSE_IPv4
@@ -717,6 +1408,20 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
         s->args.amount = MMIPERF_DEFAULT_AMOUNT;
     }
 
+    iperf_udp_client_settings_init(&s->settings, &s->args);
+    iperf_payload_source_init(&s->payload, &s->args);
+
+    if (s->args.multicast_reports && is_multicast_ip_addr(s->server_addr))
+    {
+        s->mcast_receivers =
+            (struct iperf_mcast_receivers *)IPERF_ALLOC(struct iperf_mcast_receivers);
+        if (s->mcast_receivers == NULL)
+        {
+            goto exit;
+        }
+        memset(s->mcast_receivers, 0, sizeof(*s->mcast_receivers));
+    }
+
     FreeRTOS_debug_printf(("Starting UDP iperf client to %s:%u, amount %ld\n",
                            s->args.server_addr, s->args.server_port, args->amount));
 
@@ -729,6 +1434,13 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
         FreeRTOS_debug_printf(("bandwidth limit too low.\n"));
         goto exit;
     }
+    if (iperf_frame_mode(&s->args) &&
+        s->args.packet_size <= iperf_udp_hdrs_len(s->args.version) +
+                               sizeof(struct iperf_frame_header))
+    {
+        FreeRTOS_debug_printf(("packet size too small for frame mode.\n"));
+        goto exit;
+    }
 
     /* We use a counter across a range of local ports so we don't use the same port for subsequent
      * iterations. */
@@ -784,18 +1496,123 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
         goto exit;
     }
 
-    iperf_list_add(&s->base);
-
-    s->task = mmosal_task_create(iperf_udp_client_task, s, MMOSAL_TASK_PRI_LOW,
-                                 MMIPERF_STACK_SIZE, "iperf_udp");
-    MMOSAL_ASSERT(s->task != NULL);
-    result = &(s->base);
+    result = s;
     s = NULL;
 
 exit:
     if (s != NULL)
     {
+        if (s->udp_socket != NULL)
+        {
+            FreeRTOS_closesocket(s->udp_socket);
+        }
+        if (s->mcast_receivers != NULL)
+        {
+            IPERF_FREE(struct iperf_mcast_receivers, s->mcast_receivers);
+        }
+        IPERF_FREE(struct iperf_session_udp_client, s);
+    }
+    return result;
+}
+
+mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args)
+{
+    struct iperf_client_state_udp *first_stream = NULL;
+    struct iperf_client_state_udp **next_stream = &first_stream;
+    struct iperf_client_state_udp *s;
+    struct iperf_stream_group *group = NULL;
+    struct mmosal_task *task;
+    mmiperf_handle_t result = NULL;
+    uint32_t num_streams = args->num_streams > 1 ? args->num_streams : 1;
+    uint32_t ii;
+
+    if (args->version == IPERF_VERSION_3)
+    {
+        return iperf3_start_client(args, true);
+    }
+
+    if (num_streams > MMIPERF_MAX_STREAMS ||
+        (num_streams > 1 && args->mode != MMIPERF_CLIENT_MODE_NORMAL) ||
+        ((iperf_frame_mode(args) || args->multicast_reports) &&
+         (num_streams > 1 || args->mode != MMIPERF_CLIENT_MODE_NORMAL)))
+    {
+        FreeRTOS_debug_printf(("Unsupported UDP client configuration\n"));
+        return NULL;
+    }
+
+    if (num_streams > 1)
+    {
+        group = iperf_stream_group_alloc(0, args);
+        if (group == NULL)
+        {
+            goto exit;
+        }
+    }
+
+    for (ii = 0; ii < num_streams; ii++)
+    {
+        s = iperf_udp_client_create(args);
+        if (s == NULL)
+        {
+            goto exit;
+        }
+        *next_stream = s;
+        next_stream = &s->next_stream;
+    }
+
+    for (s = first_stream; s != NULL; s = s->next_stream)
+    {
+        if (group != NULL)
+        {
+            iperf_stream_group_add(group, &s->base);
+        }
+        if (!iperf_list_add(&s->base))
+        {
+            FreeRTOS_debug_printf(("Too many iperf sessions\n"));
+            goto exit;
+        }
+    }
+    if (group != NULL && !iperf_list_add(&group->base))
+    {
+        FreeRTOS_debug_printf(("Too many iperf sessions\n"));
+        goto exit;
+    }
+
+    if (args->mode == MMIPERF_CLIENT_MODE_DUAL &&
+        iperf_udp_client_start_reverse_server(first_stream) != 0)
+    {
+        goto exit;
+    }
+
+    result = (group != NULL) ? group->base.handle : first_stream->base.handle;
+
+    task = mmosal_task_create(iperf_udp_client_task, first_stream, MMOSAL_TASK_PRI_LOW,
+                              MMIPERF_STACK_SIZE, "iperf_udp");
+    MMOSAL_ASSERT(task != NULL);
+    for (s = first_stream; s != NULL; s = s->next_stream)
+    {
+        s->task = task;
+    }
+    first_stream = NULL;
+    group = NULL;
+
+exit:
+    while (first_stream != NULL)
+    {
+        s = first_stream;
+        first_stream = s->next_stream;
+        iperf_list_remove(&s->base);
+        FreeRTOS_closesocket(s->udp_socket);
+        if (s->mcast_receivers != NULL)
+        {
+            IPERF_FREE(struct iperf_mcast_receivers, s->mcast_receivers);
+        }
         IPERF_FREE(struct iperf_session_udp_client, s);
     }
+    if (group != NULL)
+    {
+        iperf_list_remove(&group->base);
+        IPERF_FREE(struct iperf_stream_group, group);
+    }
     return result;
 }
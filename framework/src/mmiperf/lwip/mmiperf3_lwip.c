@@ -0,0 +1,409 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Socket API for the iperf3 compatibility mode, implemented using the lwIP sockets API.
+ *
+ * The iperf3 protocol engine runs in its own task and uses blocking calls, so the sockets API is
+ * a better fit here than the raw API used by the rest of the lwIP iperf implementation.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/mmiperf3_private.h"
+#include "lwip/sockets.h"
+
+/** Timeout value indicating that the socket timeout has not been set. */
+#define IPERF3_LWIP_TIMEOUT_UNSET   (UINT32_MAX)
+
+struct iperf3_sock
+{
+    /** The lwIP socket descriptor. */
+    int fd;
+    /** @c true if this is a UDP socket. */
+    bool udp;
+    /** @c true if sends go to the source of the last datagram received. */
+    bool track_peer;
+    /** Receive timeout currently configured on the socket. */
+    uint32_t rcv_timeout_ms;
+    /** Send timeout currently configured on the socket. */
+    uint32_t snd_timeout_ms;
+    /** For bound UDP sockets, the source of the last datagram received. */
+    struct sockaddr_storage peer;
+    /** Length of @c peer, or zero if no datagram has been received. */
+    socklen_t peer_len;
+};
+
+/**
+ * Convert an address string and port into a socket address.
+ *
+ * @param addr      The address (as a string). If empty then the unspecified address is used.
+ * @param port      The port.
+ * @param sa        Receives the socket address.
+ * @param sa_len    Receives the length of the socket address.
+ *
+ * @returns 0 on success, else -1.
+ */
+static int iperf3_lwip_make_sockaddr(const char *addr, uint16_t port,
+                                     struct sockaddr_storage *sa, socklen_t *sa_len)
+{
+    memset(sa, 0, sizeof(*sa));
+
+#if LWIP_IPV6
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)sa;
+    if (addr == NULL || addr[0] == '\0' ||
+        lwip_inet_pton(AF_INET6, addr, &sin6->sin6_addr) == 1)
+    {
+        /* Binding to the unspecified IPv6 address accepts both IPv4 and IPv6. */
+        sin6->sin6_len = sizeof(*sin6);
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = lwip_htons(port);
+        *sa_len = sizeof(*sin6);
+        return 0;
+    }
+#endif
+
+#if LWIP_IPV4
+    struct sockaddr_in *sin = (struct sockaddr_in *)sa;
+    if (addr == NULL || addr[0] == '\0' ||
+        lwip_inet_pton(AF_INET, addr, &sin->sin_addr) == 1)
+    {
+        sin->sin_len = sizeof(*sin);
+        sin->sin_family = AF_INET;
+        sin->sin_port = lwip_htons(port);
+        *sa_len = sizeof(*sin);
+        return 0;
+    }
+#endif
+
+    LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf3: invalid address %s\n", addr));
+    return -1;
+}
+
+/**
+ * Convert a socket address into an address string and port.
+ *
+ * @param sa        The socket address.
+ * @param addr      Buffer to receive the address string.
+ * @param addr_len  Length of @p addr.
+ * @param port      Receives the port.
+ */
+static void iperf3_lwip_parse_sockaddr(const struct sockaddr_storage *sa, char *addr,
+                                       size_t addr_len, uint16_t *port)
+{
+#if LWIP_IPV6
+    if (sa->ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)sa;
+        lwip_inet_ntop(AF_INET6, &sin6->sin6_addr, addr, addr_len);
+        *port = lwip_ntohs(sin6->sin6_port);
+        return;
+    }
+#endif
+
+#if LWIP_IPV4
+    if (sa->ss_family == AF_INET)
+    {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)sa;
+        lwip_inet_ntop(AF_INET, &sin->sin_addr, addr, addr_len);
+        *port = lwip_ntohs(sin->sin_port);
+        return;
+    }
+#endif
+
+    addr[0] = '\0';
+    *port = 0;
+}
+
+/** Allocate a socket handle for the given lwIP socket descriptor. */
+static struct iperf3_sock *iperf3_lwip_sock_alloc(int fd, bool udp)
+{
+    struct iperf3_sock *sock;
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    sock = (struct iperf3_sock *)mmosal_malloc(sizeof(*sock));
+    if (sock == NULL)
+    {
+        lwip_close(fd);
+        return NULL;
+    }
+
+    memset(sock, 0, sizeof(*sock));
+    sock->fd = fd;
+    sock->udp = udp;
+    sock->rcv_timeout_ms = IPERF3_LWIP_TIMEOUT_UNSET;
+    sock->snd_timeout_ms = IPERF3_LWIP_TIMEOUT_UNSET;
+
+    if (!udp)
+    {
+        /* The control channel sends single bytes which we do not want to be delayed. */
+        int nodelay = 1;
+        lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+    return sock;
+}
+
+/** Set a socket timeout, if not already set to the given value. */
+static void iperf3_lwip_set_timeout(struct iperf3_sock *sock, int optname, uint32_t *current_ms,
+                                    uint32_t timeout_ms)
+{
+    struct timeval tv;
+
+    if (*current_ms == timeout_ms)
+    {
+        return;
+    }
+
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    if (lwip_setsockopt(sock->fd, SOL_SOCKET, optname, &tv, sizeof(tv)) == 0)
+    {
+        *current_ms = timeout_ms;
+    }
+}
+
+/** Open a socket and connect it to the given address. */
+static struct iperf3_sock *iperf3_lwip_connect(const char *addr, uint16_t port, bool udp)
+{
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+    struct iperf3_sock *sock;
+
+    if (iperf3_lwip_make_sockaddr(addr, port, &sa, &sa_len) != 0)
+    {
+        return NULL;
+    }
+
+    sock = iperf3_lwip_sock_alloc(lwip_socket(sa.ss_family, udp ? SOCK_DGRAM : SOCK_STREAM, 0),
+                                  udp);
+    if (sock == NULL)
+    {
+        return NULL;
+    }
+
+    if (lwip_connect(sock->fd, (struct sockaddr *)&sa, sa_len) != 0)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf3: connect failed (%d)\n", errno));
+        iperf3_sock_close(sock);
+        return NULL;
+    }
+    return sock;
+}
+
+/** Open a socket and bind it to the given local address. */
+static struct iperf3_sock *iperf3_lwip_bind(const char *local_addr, uint16_t port, bool udp)
+{
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+    struct iperf3_sock *sock;
+    int reuse = 1;
+
+    if (iperf3_lwip_make_sockaddr(local_addr, port, &sa, &sa_len) != 0)
+    {
+        return NULL;
+    }
+
+    sock = iperf3_lwip_sock_alloc(lwip_socket(sa.ss_family, udp ? SOCK_DGRAM : SOCK_STREAM, 0),
+                                  udp);
+    if (sock == NULL)
+    {
+        return NULL;
+    }
+
+    lwip_setsockopt(sock->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (lwip_bind(sock->fd, (struct sockaddr *)&sa, sa_len) != 0)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf3: bind failed (%d)\n", errno));
+        iperf3_sock_close(sock);
+        return NULL;
+    }
+    return sock;
+}
+
+struct iperf3_sock *iperf3_sock_tcp_connect(const char *addr, uint16_t port)
+{
+    return iperf3_lwip_connect(addr, port, false);
+}
+
+struct iperf3_sock *iperf3_sock_tcp_listen(const char *local_addr, uint16_t port)
+{
+    struct iperf3_sock *sock = iperf3_lwip_bind(local_addr, port, false);
+    if (sock == NULL)
+    {
+        return NULL;
+    }
+
+    if (lwip_listen(sock->fd, MMIPERF_MAX_STREAMS) != 0)
+    {
+        iperf3_sock_close(sock);
+        return NULL;
+    }
+    return sock;
+}
+
+struct iperf3_sock *iperf3_sock_tcp_accept(struct iperf3_sock *listener, uint32_t timeout_ms)
+{
+    /* lwIP applies the receive timeout to accept(). */
+    iperf3_lwip_set_timeout(listener, SO_RCVTIMEO, &listener->rcv_timeout_ms, timeout_ms);
+    return iperf3_lwip_sock_alloc(lwip_accept(listener->fd, NULL, NULL), false);
+}
+
+struct iperf3_sock *iperf3_sock_udp_connect(const char *addr, uint16_t port)
+{
+    return iperf3_lwip_connect(addr, port, true);
+}
+
+struct iperf3_sock *iperf3_sock_udp_bind(const char *local_addr, uint16_t port)
+{
+    struct iperf3_sock *sock = iperf3_lwip_bind(local_addr, port, true);
+    if (sock != NULL)
+    {
+        sock->track_peer = true;
+    }
+    return sock;
+}
+
+int iperf3_sock_send(struct iperf3_sock *sock, const void *buf, size_t len, uint32_t timeout_ms)
+{
+    int flags = 0;
+    int ret;
+
+    if (timeout_ms == 0)
+    {
+        flags = MSG_DONTWAIT;
+    }
+    else
+    {
+        iperf3_lwip_set_timeout(sock, SO_SNDTIMEO, &sock->snd_timeout_ms, timeout_ms);
+    }
+
+    if (sock->peer_len != 0)
+    {
+        ret = lwip_sendto(sock->fd, buf, len, flags, (struct sockaddr *)&sock->peer,
+                          sock->peer_len);
+    }
+    else
+    {
+        ret = lwip_send(sock->fd, buf, len, flags);
+    }
+
+    if (ret < 0)
+    {
+        /* Running out of buffers is not fatal; the caller will try again later. */
+        if (errno == EWOULDBLOCK || errno == EAGAIN || errno == ENOMEM)
+        {
+            return 0;
+        }
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf3: send failed (%d)\n", errno));
+    }
+    return ret;
+}
+
+int iperf3_sock_recv(struct iperf3_sock *sock, void *buf, size_t len, uint32_t timeout_ms)
+{
+    int flags = 0;
+    int ret;
+
+    if (timeout_ms == 0)
+    {
+        flags = MSG_DONTWAIT;
+    }
+    else
+    {
+        iperf3_lwip_set_timeout(sock, SO_RCVTIMEO, &sock->rcv_timeout_ms, timeout_ms);
+    }
+
+    if (sock->udp)
+    {
+        struct sockaddr_storage peer;
+        socklen_t peer_len = sizeof(peer);
+
+        ret = lwip_recvfrom(sock->fd, buf, len, flags, (struct sockaddr *)&peer, &peer_len);
+        if (ret >= 0 && sock->track_peer)
+        {
+            memcpy(&sock->peer, &peer, sizeof(peer));
+            sock->peer_len = peer_len;
+        }
+    }
+    else
+    {
+        ret = lwip_recv(sock->fd, buf, len, flags);
+        if (ret == 0)
+        {
+            /* The connection was closed by the remote end. */
+            return -1;
+        }
+    }
+
+    if (ret < 0)
+    {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+        {
+            return 0;
+        }
+        return -1;
+    }
+    return ret;
+}
+
+void iperf3_sock_get_addrs(struct iperf3_sock *sock, struct mmiperf_report *report)
+{
+    struct sockaddr_storage sa;
+    socklen_t sa_len = sizeof(sa);
+
+    if (lwip_getsockname(sock->fd, (struct sockaddr *)&sa, &sa_len) == 0)
+    {
+        iperf3_lwip_parse_sockaddr(&sa, report->local_addr, sizeof(report->local_addr),
+                                   &report->local_port);
+    }
+
+    if (sock->peer_len != 0)
+    {
+        iperf3_lwip_parse_sockaddr(&sock->peer, report->remote_addr,
+                                   sizeof(report->remote_addr), &report->remote_port);
+        return;
+    }
+
+    sa_len = sizeof(sa);
+    if (lwip_getpeername(sock->fd, (struct sockaddr *)&sa, &sa_len) == 0)
+    {
+        iperf3_lwip_parse_sockaddr(&sa, report->remote_addr, sizeof(report->remote_addr),
+                                   &report->remote_port);
+    }
+}
+
+void iperf3_sock_close(struct iperf3_sock *sock)
+{
+    if (sock == NULL)
+    {
+        return;
+    }
+
+    lwip_close(sock->fd);
+    mmosal_free(sock);
+}
+
+void iperf3_log(const char *format, ...)
+{
+#ifdef LWIP_DEBUG
+    char msg[IPERF3_LOG_MAX_LEN];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+    LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("%s", msg));
+#else
+    (void)format;
+#endif
+}
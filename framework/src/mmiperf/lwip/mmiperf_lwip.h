@@ -8,28 +8,111 @@
 #define MMIPERF_LWIP_H__
 
 #include "../common/mmiperf_private.h"
+#include "lwip/opt.h"
 #include "lwip/pbuf.h"
 
-
 /**
- * Get a pbuf containing an iperf payload.
+ * Look up an active iperf session by handle from the TCPIP thread (or with the TCPIP core
+ * locked) and return it without keeping the list locked.
+ *
+ * The sessions of the lwIP raw API implementation are only removed from the TCPIP thread, so a
+ * session returned here remains valid until the caller returns from the TCPIP thread or releases
+ * the core lock. It must not be used for sessions owned by other tasks (e.g., iperf3 sessions);
+ * use @ref iperf_list_acquire() for those.
  *
- * @param offset    The numerical offset that the payload should start at.
- * @param len       Length of data to put into the pbuf.
+ * @param handle    Handle of the session.
  *
- * @returns a pbuf containing the data on success or @c NULL on failure.
+ * @returns the session, or @c NULL if the handle is invalid or stale.
  */
-static inline struct pbuf *iperf_get_data_pbuf(size_t offset, size_t len)
+static inline struct mmiperf_state *iperf_lwip_list_get(mmiperf_handle_t handle)
 {
-    struct pbuf *pbuf = pbuf_alloc(PBUF_RAW, len, PBUF_ROM);
-    if (pbuf == NULL)
+    struct mmiperf_state *state;
+
+    LWIP_ASSERT_CORE_LOCKED();
+    state = iperf_list_acquire(handle);
+    if (state != NULL)
     {
-        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf UDP tx failed to alloc payload\n"));
-        return NULL;
+        iperf_list_release();
     }
+    return state;
+}
+
+/**
+ * Get a pbuf chain referencing iperf payload data without copying it. The payload source must
+ * supply stable data (i.e., it must not use a generator callback).
+ *
+ * @param src       The payload source.
+ * @param offset    The offset into the payload data that the pbuf chain should start at.
+ * @param len       Length of data to put into the pbuf chain.
+ *
+ * @returns a pbuf chain containing the data on success or @c NULL on failure.
+ */
+static inline struct pbuf *iperf_get_data_pbuf(const struct iperf_payload_source *src,
+                                               uint64_t offset, size_t len)
+{
+    struct pbuf *head = NULL;
+
+    do
+    {
+        uint32_t avail;
+        const uint8_t *data = iperf_payload_get(src, offset, len, &avail);
+        struct pbuf *pbuf = pbuf_alloc(PBUF_RAW, avail, PBUF_ROM);
+        if (pbuf == NULL)
+        {
+            LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf UDP tx failed to alloc payload\n"));
+            if (head != NULL)
+            {
+                pbuf_free(head);
+            }
+            return NULL;
+        }
+
+        ((struct pbuf_rom *)pbuf)->payload = data;
+        if (head == NULL)
+        {
+            head = pbuf;
+        }
+        else
+        {
+            /* The payload buffer wrapped, so continue from its start in another pbuf. */
+            pbuf_cat(head, pbuf);
+        }
+        offset += avail;
+        len -= avail;
+    } while (len > 0);
+
+    return head;
+}
 
-    ((struct pbuf_rom *)pbuf)->payload = iperf_get_data(offset);
-    return pbuf;
+/**
+ * Verify the payload of a received pbuf chain against the iperf payload data and record the
+ * result (see @ref iperf_verify_record()).
+ *
+ * @param base_state    Iperf session state data structure.
+ * @param p             The received pbuf chain.
+ * @param skip          Number of bytes at the start of @p p that are not payload.
+ * @param offset        Offset into the payload data of the first byte after @p skip.
+ */
+static inline void iperf_verify_pbuf(struct mmiperf_state *base_state, const struct pbuf *p,
+                                     uint32_t skip, uint64_t offset)
+{
+    uint64_t start_time_us = mmosal_get_time_us();
+    uint32_t corrupted_bytes = 0;
+    const struct pbuf *q;
+
+    for (q = p; q != NULL; q = q->next)
+    {
+        if (skip >= q->len)
+        {
+            skip -= q->len;
+            continue;
+        }
+        corrupted_bytes += iperf_verify_data((const uint8_t *)q->payload + skip, q->len - skip,
+                                             offset);
+        offset += q->len - skip;
+        skip = 0;
+    }
+    iperf_verify_record(base_state, corrupted_bytes, start_time_us);
 }
 
 #endif
@@ -35,12 +35,15 @@
 
 #include "mmosal.h"
 #include "../common/mmiperf_private.h"
+#include "../common/mmiperf3_private.h"
+#include "mmiperf_lwip.h"
 
 #include "lwip/tcpip.h"
 #include "lwip/arch.h"
 #include "lwip/debug.h"
 #include "lwip/ip_addr.h"
 #include "lwip/tcp.h"
+#include "lwip/timeouts.h"
 
 
 
@@ -59,18 +62,54 @@ struct iperf_state_tcp
     uint8_t client_tradeoff_mode;
     struct iperf_settings settings;
     uint8_t have_settings_buf;
+    /* 1=only accept a single connection from remote_addr (reverse direction of a bidir test) */
+    uint8_t specific_remote;
     ip_addr_t remote_addr;
+    /* Handle of the listener for the reverse direction of a bidirectional test (client only) */
+    mmiperf_handle_t reverse_server;
+    /* whether the timer waiting for the remote side to connect back is running (server only) */
+    bool accept_timer_pending;
     /* block parameter */
     bool bw_limit;
     uint32_t block_end_time;
     uint32_t block_txlen;
     int32_t block_remaining_txlen;
+    /* source of the payload data (client only) */
+    struct iperf_payload_source payload;
+    /* scratch buffer for generated payload data, or NULL */
+    uint8_t *tx_buf;
+    /* isochronous frame mode (client only) */
+    struct iperf_frame_tx frame;
+    /* number of bytes sent that have been acknowledged (client only) */
+    uint64_t acked_bytes;
+    /* receive window update coalescing threshold (bytes) and maximum delay (ms) (server only) */
+    uint32_t rx_wnd_update_bytes;
+    uint32_t rx_wnd_update_ms;
+    /* number of bytes received that have not yet been passed to tcp_recved() (server only) */
+    uint32_t rx_unrecved;
+    /* whether the window update timer is running (server only) */
+    bool rx_wnd_timer_pending;
+    /* receive offset at which the next copy of the settings may be expected (server only) */
+    uint64_t next_settings_offset;
 };
 
+/** Interval at which the client repeats the settings in the TCP data stream. */
+#define IPERF_TCP_SETTINGS_INTERVAL (1024 * 128)
+
+/** Time to wait for the remote side to connect back for the reverse direction of a
+ *  bidirectional test before giving up on it. */
+#define IPERF_TCP_REVERSE_ACCEPT_TIMEOUT_MS (10000)
+
 static err_t iperf_start_tcp_server_impl(const struct mmiperf_server_args *args,
                                          struct iperf_state_tcp **state);
 static err_t iperf_tcp_poll(void *arg, struct tcp_pcb *tpcb);
 static void iperf_tcp_err(void *arg, err_t err);
+static void iperf_tcp_client_finish_bidir(struct iperf_state_tcp *conn,
+                                          enum mmiperf_report_type report_type);
+static err_t iperf_tcp_client_send_more(struct iperf_state_tcp *conn);
+static void iperf_tcp_client_frame_timer(void *arg);
+static void iperf_tcp_server_recved_timer(void *arg);
+static void iperf_tcp_reverse_accept_timer(void *arg);
 
 /** Close an iperf tcp session */
 static void
@@ -80,6 +119,26 @@ iperf_tcp_close(struct iperf_state_tcp *conn, enum mmiperf_report_type report_ty
 
     MMOSAL_ASSERT(conn != NULL);
 
+    if (!conn->base.server)
+    {
+        iperf_tcp_client_finish_bidir(conn, report_type);
+        if (conn->frame.len > 0)
+        {
+            sys_untimeout(iperf_tcp_client_frame_timer, conn);
+        }
+    }
+    else if (conn->rx_wnd_timer_pending)
+    {
+        sys_untimeout(iperf_tcp_server_recved_timer, conn);
+        conn->rx_wnd_timer_pending = false;
+    }
+
+    if (conn->accept_timer_pending)
+    {
+        sys_untimeout(iperf_tcp_reverse_accept_timer, conn);
+        conn->accept_timer_pending = false;
+    }
+
     iperf_finalize_report_and_invoke_callback(&conn->base,
                                               mmosal_get_time_ms() - conn->base.time_started_ms,
                                               report_type);
@@ -106,13 +165,68 @@ iperf_tcp_close(struct iperf_state_tcp *conn, enum mmiperf_report_type report_ty
         conn->server_pcb = NULL;
     }
 
+    if (conn->specific_remote && conn->server_pcb != NULL)
+    {
+        /* this listener only accepts a single connection, so close it now that it is done */
+        err = tcp_close(conn->server_pcb);
+        LWIP_ASSERT("error", err == ERR_OK);
+        conn->server_pcb = NULL;
+    }
+
     if (conn->conn_pcb == NULL && conn->server_pcb == NULL)
     {
         iperf_list_remove(&conn->base);
+        if (conn->tx_buf != NULL)
+        {
+            mmosal_free(conn->tx_buf);
+        }
         IPERF_FREE(struct iperf_state_tcp, conn);
     }
 }
 
+/**
+ * Start the next frame of a client in isochronous frame mode if it is due.
+ *
+ * @param conn  The client session.
+ *
+ * @returns @c true once the test is over and every frame has been acknowledged.
+ */
+static bool iperf_tcp_client_frame_update(struct iperf_state_tcp *conn)
+{
+    bool test_over;
+
+    if (conn->settings.amount & PP_HTONL(0x80000000))
+    {
+        uint32_t time_ms = (uint32_t) - (int32_t)lwip_htonl(conn->settings.amount) * 10;
+        test_over = (sys_now() - iperf_test_start_time_ms(&conn->base) >= time_ms);
+    }
+    else
+    {
+        uint32_t amount_bytes = lwip_htonl(conn->settings.amount);
+        test_over = (conn->frame.queued_end - IPERF_TCP_VERIFY_START_OFFSET >= amount_bytes);
+    }
+
+    if (!test_over)
+    {
+        iperf_frame_tx_start(&conn->frame, true);
+    }
+    return test_over && conn->frame.remaining == 0 && conn->frame.in_flight_count == 0;
+}
+
+/**
+ * Timer that starts the frames of a client in isochronous frame mode. Frames are also started
+ * from the sent callback when they were held back waiting for earlier frames.
+ */
+static void iperf_tcp_client_frame_timer(void *arg)
+{
+    struct iperf_state_tcp *conn = (struct iperf_state_tcp *)arg;
+    uint32_t wait_ms = iperf_frame_tx_wait_ms(&conn->frame);
+
+    /* Rearm first, since sending may close the session (which cancels the timer). */
+    sys_timeout(wait_ms ? wait_ms : conn->frame.period_ms, iperf_tcp_client_frame_timer, conn);
+    iperf_tcp_client_send_more(conn);
+}
+
 /** Try to send more data on an iperf tcp session */
 static err_t
 iperf_tcp_client_send_more(struct iperf_state_tcp *conn)
@@ -123,17 +237,34 @@ iperf_tcp_client_send_more(struct iperf_state_tcp *conn)
     u16_t txlen_max;
     void *txptr;
     uint8_t apiflags;
+    bool frame_data;
 
     LWIP_ASSERT("conn invalid", (conn != NULL) && conn->base.tcp && (conn->base.server == 0));
 
     do
     {
         send_more = 0;
-        if (conn->settings.amount & PP_HTONL(0x80000000))
+        frame_data = false;
+        if (conn->frame.len > 0)
+        {
+            /* in frame mode the test ends once the last frame has been delivered */
+            if (iperf_tcp_client_frame_update(conn))
+            {
+                iperf_tcp_close(conn, MMIPERF_TCP_DONE_CLIENT);
+                return ERR_OK;
+            }
+            if (conn->base.report.bytes_transferred >= IPERF_TCP_VERIFY_START_OFFSET &&
+                conn->frame.remaining == 0)
+            {
+                /* wait for the next frame */
+                break;
+            }
+        }
+        else if (conn->settings.amount & PP_HTONL(0x80000000))
         {
             /* this session is time-limited */
             uint32_t now = sys_now();
-            uint32_t diff_ms = now - conn->base.time_started_ms;
+            uint32_t diff_ms = now - iperf_test_start_time_ms(&conn->base);
             uint32_t time = (uint32_t) - (int32_t)lwip_htonl(conn->settings.amount);
             uint32_t time_ms = time * 10;
 
@@ -182,13 +313,38 @@ iperf_tcp_client_send_more(struct iperf_state_tcp *conn)
         {
             /* transmit data */
             /* @todo: every x bytes, transmit the settings again */
-            txptr = LWIP_CONST_CAST(void *, iperf_get_data(conn->base.report.bytes_transferred));
+            uint64_t offset = conn->base.report.bytes_transferred;
+            uint32_t avail;
+
             txlen_max = conn->mss;
             if (conn->base.report.bytes_transferred == 48)
             { /* @todo: fix this for intermediate settings, too */
                 txlen_max = conn->mss - 24;
             }
-            apiflags = 0; /* no copying needed */
+            if (conn->frame.len > 0)
+            {
+                txlen_max = (u16_t)LWIP_MIN(txlen_max, conn->frame.remaining);
+                frame_data = true;
+            }
+            if (!iperf_payload_is_default(&conn->payload))
+            {
+                /* application payload data starts at offset zero after the settings */
+                offset -= IPERF_TCP_VERIFY_START_OFFSET;
+            }
+            txptr = LWIP_CONST_CAST(void *, iperf_payload_get(&conn->payload, offset, txlen_max,
+                                                              &avail));
+            if (txptr != NULL)
+            {
+                txlen_max = (u16_t)avail;
+                apiflags = 0; /* no copying needed */
+            }
+            else
+            {
+                /* generated data has to be copied anyway */
+                iperf_payload_copy(&conn->payload, offset, conn->tx_buf, txlen_max);
+                txptr = conn->tx_buf;
+                apiflags = TCP_WRITE_FLAG_COPY;
+            }
             send_more = 1;
         }
         txlen = txlen_max;
@@ -211,6 +367,10 @@ iperf_tcp_client_send_more(struct iperf_state_tcp *conn)
         {
             conn->base.report.bytes_transferred += txlen;
             conn->block_remaining_txlen -= txlen;
+            if (frame_data)
+            {
+                conn->frame.remaining -= txlen;
+            }
         }
         else
         {
@@ -232,12 +392,15 @@ static err_t
 iperf_tcp_client_sent(void *arg, struct tcp_pcb *tpcb, u16_t len)
 {
     struct iperf_state_tcp *conn = (struct iperf_state_tcp *)arg;
-    /* @todo: check 'len' (e.g. to time ACK of all data)? for now, we just send more... */
     LWIP_ASSERT("invalid conn", conn->conn_pcb == tpcb);
     LWIP_UNUSED_ARG(tpcb);
-    LWIP_UNUSED_ARG(len);
 
     conn->poll_count = 0;
+    conn->acked_bytes += len;
+    if (conn->frame.len > 0)
+    {
+        iperf_frame_tx_acked(&conn->base, &conn->frame, conn->acked_bytes);
+    }
     /* if block txlen is exceeded, sleep until block end time before sending more */
     while (conn->bw_limit && conn->block_remaining_txlen <= 0 && sys_now() < conn->block_end_time)
     {
@@ -287,7 +450,14 @@ iperf_tcp_client_connected(void *arg, struct tcp_pcb *tpcb, err_t err)
     }
     conn->poll_count = 0;
     conn->base.time_started_ms = sys_now();
+    iperf_resource_start(&conn->base);
     conn->block_end_time = sys_now() + BLOCK_DURATION_MS;
+    if (conn->frame.len > 0)
+    {
+        /* the first frame is due now, then the timer starts each subsequent frame */
+        conn->frame.next_start_ms = sys_now();
+        sys_timeout(conn->frame.period_ms, iperf_tcp_client_frame_timer, conn);
+    }
 
     init_report(conn, tpcb);
 
@@ -298,31 +468,26 @@ iperf_tcp_client_connected(void *arg, struct tcp_pcb *tpcb, err_t err)
  * receive test has finished.
  */
 static err_t
-iperf_tx_start_impl(const struct mmiperf_client_args *args, struct iperf_settings *settings,
+iperf_tx_start_impl(const ip_addr_t *remote_addr, uint16_t remote_port,
+                    const struct mmiperf_client_args *args, struct iperf_settings *settings,
                     struct iperf_state_tcp **new_conn)
 {
-    int result;
     err_t err;
     struct iperf_state_tcp *client_conn;
     struct tcp_pcb *newpcb;
-    ip_addr_t remote_addr;
-    uint16_t server_port;
 
-    LWIP_ASSERT("remote_ip != NULL", settings != NULL);
+    LWIP_ASSERT("remote_addr != NULL", remote_addr != NULL);
+    LWIP_ASSERT("settings != NULL", settings != NULL);
     LWIP_ASSERT("new_conn != NULL", new_conn != NULL);
     *new_conn = NULL;
 
-    if (args->server_port == 0)
+    if (remote_port == 0)
     {
-        server_port = MMIPERF_DEFAULT_PORT;
-    }
-    else
-    {
-        server_port = args->server_port;
+        remote_port = MMIPERF_DEFAULT_PORT;
     }
 
     LWIP_DEBUGF(LWIP_DBG_LEVEL_ALL, ("Starting TCP iperf client to %s:%u, amount %ld\n",
-                args->server_addr, server_port, (int32_t)ntohl(settings->amount)));
+                ipaddr_ntoa(remote_addr), remote_port, (int32_t)ntohl(settings->amount)));
 
     client_conn = (struct iperf_state_tcp *)IPERF_ALLOC(struct iperf_state_tcp);
     if (client_conn == NULL)
@@ -330,14 +495,7 @@ iperf_tx_start_impl(const struct mmiperf_client_args *args, struct iperf_setting
         return ERR_MEM;
     }
 
-    result = ipaddr_aton(args->server_addr, &remote_addr);
-    if (!result)
-    {
-        IPERF_FREE(struct iperf_state_tcp, client_conn);
-        return ERR_ARG;
-    }
-
-    newpcb = tcp_new_ip_type(IP_GET_TYPE(&remote_addr));
+    newpcb = tcp_new_ip_type(IP_GET_TYPE(remote_addr));
     if (newpcb == NULL)
     {
         IPERF_FREE(struct iperf_state_tcp, client_conn);
@@ -346,22 +504,33 @@ iperf_tx_start_impl(const struct mmiperf_client_args *args, struct iperf_setting
     memset(client_conn, 0, sizeof(*client_conn));
     client_conn->base.tcp = 1;
     client_conn->conn_pcb = newpcb;
+    client_conn->remote_addr = *remote_addr;
     client_conn->base.time_started_ms = sys_now();
+    iperf_resource_start(&client_conn->base);
     client_conn->base.report_fn = args->report_fn;
     client_conn->base.report_arg = args->report_arg;
     memcpy(&client_conn->settings, settings, sizeof(*settings));
     client_conn->have_settings_buf = 1;
     client_conn->mss = TCP_MSS;
 
+    if (!iperf_list_add(&client_conn->base))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Too many iperf sessions\n"));
+        tcp_close(newpcb);
+        IPERF_FREE(struct iperf_state_tcp, client_conn);
+        return ERR_MEM;
+    }
+
 #if LWIP_IPV6
-    if (IP_IS_V6(&remote_addr))
+    if (IP_IS_V6(remote_addr))
     {
         client_conn->mss -= IPV6_HEADER_SIZE_DIFF;
     }
 #endif
 
-    /* set block parameter if bandwidth limit is set */
-    if (args->target_bw == 0)
+    /* set block parameter if bandwidth limit is set (frame mode paces itself instead) */
+    iperf_frame_tx_init(&client_conn->frame, args, IPERF_TCP_VERIFY_START_OFFSET);
+    if (args->target_bw == 0 || client_conn->frame.len > 0)
     {
         client_conn->bw_limit = false;
     }
@@ -379,12 +548,24 @@ iperf_tx_start_impl(const struct mmiperf_client_args *args, struct iperf_setting
         }
     }
 
+    iperf_payload_source_init(&client_conn->payload, args);
+    if (client_conn->payload.fn != NULL)
+    {
+        client_conn->tx_buf = (uint8_t *)mmosal_malloc(client_conn->mss);
+        if (client_conn->tx_buf == NULL)
+        {
+            LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("iperf failed to alloc payload buffer\n"));
+            iperf_tcp_close(client_conn, MMIPERF_TCP_ABORTED_LOCAL);
+            return ERR_MEM;
+        }
+    }
+
     tcp_arg(newpcb, client_conn);
     tcp_sent(newpcb, iperf_tcp_client_sent);
     tcp_poll(newpcb, iperf_tcp_poll, 2U);
     tcp_err(newpcb, iperf_tcp_err);
 
-    err = tcp_connect(newpcb, &remote_addr, server_port, iperf_tcp_client_connected);
+    err = tcp_connect(newpcb, remote_addr, remote_port, iperf_tcp_client_connected);
     if (err != ERR_OK)
     {
         LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING,
@@ -392,11 +573,197 @@ iperf_tx_start_impl(const struct mmiperf_client_args *args, struct iperf_setting
         iperf_tcp_close(client_conn, MMIPERF_TCP_ABORTED_LOCAL);
         return err;
     }
-    iperf_list_add(&client_conn->base);
     *new_conn = client_conn;
     return ERR_OK;
 }
 
+/**
+ * Start a TCP connection back to the remote client, as requested in the settings it sent for a
+ * bidirectional test.
+ */
+static err_t
+iperf_tx_start_passive(struct iperf_state_tcp *conn)
+{
+    err_t err;
+    struct iperf_state_tcp *new_conn = NULL;
+    struct iperf_settings settings;
+    struct mmiperf_client_args args = MMIPERF_CLIENT_ARGS_DEFAULT;
+    uint16_t remote_port = (uint16_t)lwip_ntohl(conn->settings.remote_port);
+
+    args.report_fn = conn->base.report_fn;
+    args.report_arg = conn->base.report_arg;
+
+    memcpy(&settings, &conn->settings, sizeof(settings));
+    /* prevent the remote side starting back as client again */
+    settings.flags = 0;
+
+    err = iperf_tx_start_impl(&conn->conn_pcb->remote_ip, remote_port, &args, &settings,
+                              &new_conn);
+    if (err != ERR_OK)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING,
+                    ("Failed to start reverse direction of iperf test (%d)\n", err));
+    }
+    return err;
+}
+
+/**
+ * Start listening for the remote server to connect back to us for the receive direction of a
+ * bidirectional test.
+ */
+static err_t
+iperf_tcp_client_start_reverse_server(struct iperf_state_tcp *conn)
+{
+    err_t err;
+    struct iperf_state_tcp *srv = NULL;
+    struct mmiperf_server_args server_args = MMIPERF_SERVER_ARGS_DEFAULT;
+
+    server_args.local_port = (uint16_t)lwip_ntohl(conn->settings.remote_port);
+    server_args.report_fn = conn->base.report_fn;
+    server_args.report_arg = conn->base.report_arg;
+
+    err = iperf_start_tcp_server_impl(&server_args, &srv);
+    if (err == ERR_USE)
+    {
+        /* An iperf server is already listening on this port; it will receive the test. */
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Using existing TCP server for reverse test\n"));
+        return ERR_OK;
+    }
+    if (err != ERR_OK)
+    {
+        return err;
+    }
+
+    /* make this server accept one connection only */
+    srv->specific_remote = 1;
+    srv->remote_addr = conn->remote_addr;
+    conn->reverse_server = srv->base.handle;
+
+    /* In tradeoff mode the client session is closed by the time the remote side connects, so
+     * nothing else would free the listener if it never does. */
+    sys_timeout(IPERF_TCP_REVERSE_ACCEPT_TIMEOUT_MS, iperf_tcp_reverse_accept_timer, srv);
+    srv->accept_timer_pending = true;
+    return ERR_OK;
+}
+
+/** Timer callback to close a reverse listener that the remote side has not connected to. */
+static void
+iperf_tcp_reverse_accept_timer(void *arg)
+{
+    struct iperf_state_tcp *srv = (struct iperf_state_tcp *)arg;
+
+    srv->accept_timer_pending = false;
+    if (srv->conn_pcb == NULL)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING,
+                    ("Remote did not connect back for reverse test, closing listener\n"));
+        iperf_tcp_close(srv, MMIPERF_TCP_ABORTED_REMOTE);
+    }
+}
+
+/**
+ * Handle the receive direction of a bidirectional test when the transmit direction is closed.
+ *
+ * In tradeoff mode the remote side only connects back once we are done, so the listener is
+ * started now. Otherwise a listener that the remote side has not connected to is closed.
+ */
+static void
+iperf_tcp_client_finish_bidir(struct iperf_state_tcp *conn, enum mmiperf_report_type report_type)
+{
+    /* The listener closes itself once its test is done, in which case the handle is stale. */
+    struct iperf_state_tcp *srv =
+        (struct iperf_state_tcp *)iperf_lwip_list_get(conn->reverse_server);
+    conn->reverse_server = NULL;
+
+    if (conn->client_tradeoff_mode)
+    {
+        conn->client_tradeoff_mode = 0;
+        if (report_type == MMIPERF_TCP_DONE_CLIENT &&
+            iperf_tcp_client_start_reverse_server(conn) != ERR_OK)
+        {
+            LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Failed to start TCP server for reverse test\n"));
+        }
+        return;
+    }
+
+    if (srv != NULL && srv->conn_pcb == NULL)
+    {
+        /* prevent report when closing: this is expected */
+        srv->base.report_fn = NULL;
+        iperf_tcp_close(srv, MMIPERF_TCP_ABORTED_LOCAL);
+    }
+}
+
+/** Pass all received data that has been held back to tcp_recved() to open the window. */
+static void
+iperf_tcp_server_recved_flush(struct iperf_state_tcp *conn)
+{
+    if (conn->rx_wnd_timer_pending)
+    {
+        sys_untimeout(iperf_tcp_server_recved_timer, conn);
+        conn->rx_wnd_timer_pending = false;
+    }
+    while (conn->rx_unrecved > 0)
+    {
+        u16_t len = (u16_t)LWIP_MIN(conn->rx_unrecved, 0xffff);
+        tcp_recved(conn->conn_pcb, len);
+        conn->rx_unrecved -= len;
+    }
+}
+
+/** Timer callback to send a window update that has been held back for too long. */
+static void
+iperf_tcp_server_recved_timer(void *arg)
+{
+    struct iperf_state_tcp *conn = (struct iperf_state_tcp *)arg;
+
+    conn->rx_wnd_timer_pending = false;
+    if (conn->conn_pcb != NULL)
+    {
+        iperf_tcp_server_recved_flush(conn);
+    }
+}
+
+/**
+ * Account for data received on an iperf tcp server session. The receive window is updated
+ * straight away unless window update coalescing is enabled, in which case the update is held
+ * back until enough data has been received or the timer expires.
+ *
+ * @param conn  The server session.
+ * @param len   Number of bytes received.
+ */
+static void
+iperf_tcp_server_recved(struct iperf_state_tcp *conn, u16_t len)
+{
+    conn->rx_unrecved += len;
+    if (conn->rx_unrecved >= conn->rx_wnd_update_bytes)
+    {
+        iperf_tcp_server_recved_flush(conn);
+    }
+    else if (!conn->rx_wnd_timer_pending)
+    {
+        sys_timeout(conn->rx_wnd_update_ms, iperf_tcp_server_recved_timer, conn);
+        conn->rx_wnd_timer_pending = true;
+    }
+}
+
+/**
+ * Check whether the client is expected to have repeated the settings at the current receive
+ * offset, which it does every @ref IPERF_TCP_SETTINGS_INTERVAL bytes after the first copy.
+ * The next boundary is tracked so that no 64-bit division is needed for each segment.
+ */
+static bool
+iperf_tcp_server_settings_due(struct iperf_state_tcp *conn)
+{
+    uint64_t offset = conn->base.report.bytes_transferred - sizeof(conn->settings);
+
+    while (conn->next_settings_offset < offset)
+    {
+        conn->next_settings_offset += IPERF_TCP_SETTINGS_INTERVAL;
+    }
+    return offset == conn->next_settings_offset;
+}
+
 /** Receive data on an iperf tcp session */
 static err_t
 iperf_tcp_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
@@ -419,6 +786,12 @@ iperf_tcp_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
     }
     if (p == NULL)
     {
+        if ((conn->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_TEST)) &&
+            !(conn->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_NOW)))
+        {
+            /* client requested transmission after end of test */
+            iperf_tx_start_passive(conn);
+        }
         iperf_tcp_close(conn, MMIPERF_TCP_DONE_SERVER);
         return ERR_OK;
     }
@@ -426,8 +799,7 @@ iperf_tcp_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 
     conn->poll_count = 0;
 
-    if ((!conn->have_settings_buf) ||
-        ((conn->base.report.bytes_transferred - 24) % (1024 * 128) == 0))
+    if ((!conn->have_settings_buf) || iperf_tcp_server_settings_due(conn))
     {
         /* wait for 24-byte header */
         if (p->tot_len < sizeof(conn->settings))
@@ -450,12 +822,25 @@ iperf_tcp_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
                 return ERR_OK;
             }
             conn->have_settings_buf = 1;
+
+            if ((conn->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_TEST)) &&
+                (conn->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_NOW)))
+            {
+                /* client requested parallel transmission test */
+                if (iperf_tx_start_passive(conn) != ERR_OK)
+                {
+                    iperf_tcp_close(conn, MMIPERF_TCP_ABORTED_LOCAL_TXERROR);
+                    pbuf_free(p);
+                    return ERR_OK;
+                }
+            }
         }
         conn->base.report.bytes_transferred += sizeof(conn->settings);
         if (conn->base.report.bytes_transferred <= 24)
         {
             conn->base.time_started_ms = sys_now();
-            tcp_recved(tpcb, p->tot_len);
+            iperf_resource_start(&conn->base);
+            iperf_tcp_server_recved(conn, p->tot_len);
             pbuf_free(p);
             return ERR_OK;
         }
@@ -470,8 +855,20 @@ iperf_tcp_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
         packet_idx += q->len;
     }
     LWIP_ASSERT("count mismatch", packet_idx == p->tot_len);
+    if (conn->base.verify_payload)
+    {
+        uint64_t offset = conn->base.report.bytes_transferred;
+        uint32_t skip = 0;
+
+        if (offset < IPERF_TCP_VERIFY_START_OFFSET)
+        {
+            skip = IPERF_TCP_VERIFY_START_OFFSET - offset;
+            offset = IPERF_TCP_VERIFY_START_OFFSET;
+        }
+        iperf_verify_pbuf(&conn->base, p, skip, offset);
+    }
     conn->base.report.bytes_transferred += packet_idx;
-    tcp_recved(tpcb, tot_len);
+    iperf_tcp_server_recved(conn, tot_len);
     pbuf_free(p);
     return ERR_OK;
 }
@@ -535,9 +932,23 @@ iperf_tcp_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
         return ERR_ALREADY;
     }
 
+    if (conn->specific_remote && !ip_addr_cmp(&conn->remote_addr, &newpcb->remote_ip))
+    {
+        /* this listener belongs to a client session, and this is not the correct remote */
+        return ERR_VAL;
+    }
+
+    if (conn->accept_timer_pending)
+    {
+        sys_untimeout(iperf_tcp_reverse_accept_timer, conn);
+        conn->accept_timer_pending = false;
+    }
+
     memset(&conn->base.report, 0, sizeof(conn->base.report));
     memset(&conn->settings, 0, sizeof(conn->settings));
     conn->have_settings_buf = false;
+    conn->next_settings_offset = 0;
+    conn->rx_unrecved = 0;
 
     /* setup the tcp rx connection */
     conn->conn_pcb = newpcb;
@@ -556,12 +967,17 @@ mmiperf_handle_t mmiperf_start_tcp_server(const struct mmiperf_server_args *args
     err_t err;
     struct iperf_state_tcp *state = NULL;
 
+    if (args->version == IPERF_VERSION_3)
+    {
+        return iperf3_start_server(args);
+    }
+
     LOCK_TCPIP_CORE();
     err = iperf_start_tcp_server_impl(args, &state);
     UNLOCK_TCPIP_CORE();
     if (err == ERR_OK)
     {
-        return &(state->base);
+        return state->base.handle;
     }
     return NULL;
 }
@@ -603,6 +1019,18 @@ static err_t iperf_start_tcp_server_impl(const struct mmiperf_server_args *args,
     s->base.server = 1;
     s->base.report_fn = args->report_fn;
     s->base.report_arg = args->report_arg;
+    s->base.verify_payload = args->verify_payload;
+    /* holding back more than half the window could stall the sender until the timer expires */
+    s->rx_wnd_update_bytes = LWIP_MIN(args->rx_window_update_bytes, TCP_WND / 2);
+    s->rx_wnd_update_ms = args->rx_window_update_ms ? args->rx_window_update_ms :
+                                                      MMIPERF_DEFAULT_RX_WINDOW_UPDATE_MS;
+
+    if (!iperf_list_add(&s->base))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Too many iperf sessions\n"));
+        err = ERR_MEM;
+        goto exit;
+    }
 
     pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
     if (pcb == NULL)
@@ -630,7 +1058,6 @@ static err_t iperf_start_tcp_server_impl(const struct mmiperf_server_args *args,
     tcp_arg(s->server_pcb, s);
     tcp_accept(s->server_pcb, iperf_tcp_accept);
 
-    iperf_list_add(&s->base);
     *state = s;
     s = NULL;
     return ERR_OK;
@@ -643,22 +1070,57 @@ exit:
     }
     if (s != NULL)
     {
+        iperf_list_remove(&s->base);
         IPERF_FREE(struct iperf_state_tcp, s);
         s = NULL;
     }
     return err;
 }
 
-/** Control */
-enum lwiperf_client_type
+/** Start the streams of a parallel TCP client test. */
+static mmiperf_handle_t
+iperf_tx_start_parallel(const ip_addr_t *remote_addr, const struct mmiperf_client_args *args,
+                        struct iperf_settings *settings)
 {
-    /** Unidirectional tx only test */
-    LWIPERF_CLIENT,
-    /** Do a bidirectional test simultaneously */
-    LWIPERF_DUAL,
-    /** Do a bidirectional test individually */
-    LWIPERF_TRADEOFF
-};
+    uint32_t ii;
+    struct iperf_state_tcp *state;
+    struct iperf_stream_group *group;
+
+    LWIP_ASSERT_CORE_LOCKED();
+
+    group = iperf_stream_group_alloc(1, args);
+    if (group == NULL)
+    {
+        return NULL;
+    }
+    if (!iperf_list_add(&group->base))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Too many iperf sessions\n"));
+        IPERF_FREE(struct iperf_stream_group, group);
+        return NULL;
+    }
+
+    for (ii = 0; ii < args->num_streams; ii++)
+    {
+        state = NULL;
+        if (iperf_tx_start_impl(remote_addr, args->server_port, args, settings,
+                                &state) != ERR_OK)
+        {
+            LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Failed to start iperf stream %lu\n", ii));
+            break;
+        }
+        iperf_stream_group_add(group, &state->base);
+    }
+
+    if (group->num_streams == 0)
+    {
+        iperf_list_remove(&group->base);
+        IPERF_FREE(struct iperf_stream_group, group);
+        return NULL;
+    }
+
+    return group->base.handle;
+}
 
 mmiperf_handle_t mmiperf_start_tcp_client(const struct mmiperf_client_args *args)
 {
@@ -666,21 +1128,89 @@ mmiperf_handle_t mmiperf_start_tcp_client(const struct mmiperf_client_args *args
     struct iperf_settings settings;
     struct iperf_state_tcp *state = NULL;
     mmiperf_handle_t result = NULL;
+    ip_addr_t remote_addr;
 
-    /* Bidirectional/trade-off disabled until better tested and also until supported in UDP. */
+    if (args->version == IPERF_VERSION_3)
+    {
+        return iperf3_start_client(args, false);
+    }
+
+    if (!ipaddr_aton(args->server_addr, &remote_addr))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS,
+                    ("Unable to parse server_addr as IP address (%s)\n", args->server_addr));
+        return NULL;
+    }
+
+    if (args->num_streams > MMIPERF_MAX_STREAMS ||
+        (args->num_streams > 1 && args->mode != MMIPERF_CLIENT_MODE_NORMAL) ||
+        (iperf_frame_mode(args) &&
+         (args->num_streams > 1 || args->mode != MMIPERF_CLIENT_MODE_NORMAL)))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Unsupported number of streams\n"));
+        return NULL;
+    }
 
     memset(&settings, 0, sizeof(settings));
 
+    switch (args->mode)
+    {
+    case MMIPERF_CLIENT_MODE_NORMAL:
+        /* Unidirectional tx only test */
+        settings.flags = 0;
+        break;
+
+    case MMIPERF_CLIENT_MODE_DUAL:
+        /* Do a bidirectional test simultaneously */
+        settings.flags = htonl(IPERF_FLAGS_ANSWER_TEST | IPERF_FLAGS_ANSWER_NOW);
+        break;
+
+    case MMIPERF_CLIENT_MODE_TRADEOFF:
+        /* Do a bidirectional test individually */
+        settings.flags = htonl(IPERF_FLAGS_ANSWER_TEST);
+        break;
+
+    default:
+        return NULL;
+    }
+
     settings.amount = htonl(args->amount);
-    settings.num_threads = htonl(1);
+    settings.num_threads = htonl(args->num_streams > 1 ? args->num_streams : 1);
     settings.remote_port = htonl(MMIPERF_DEFAULT_PORT);
 
+    if (args->num_streams > 1)
+    {
+        LOCK_TCPIP_CORE();
+        result = iperf_tx_start_parallel(&remote_addr, args, &settings);
+        UNLOCK_TCPIP_CORE();
+        return result;
+    }
+
     LOCK_TCPIP_CORE();
-    ret = iperf_tx_start_impl(args, &settings, &state);
+    ret = iperf_tx_start_impl(&remote_addr, args->server_port, args, &settings, &state);
     if (ret == ERR_OK)
     {
         LWIP_ASSERT("state != NULL", state != NULL);
-        result = &(state->base);
+        result = state->base.handle;
+
+        if (args->mode == MMIPERF_CLIENT_MODE_DUAL)
+        {
+            /* start corresponding server now */
+            ret = iperf_tcp_client_start_reverse_server(state);
+            if (ret != ERR_OK)
+            {
+                LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS,
+                            ("Failed to start TCP server for reverse test\n"));
+                iperf_tcp_close(state, MMIPERF_TCP_ABORTED_LOCAL);
+                result = NULL;
+            }
+        }
+        else if (args->mode == MMIPERF_CLIENT_MODE_TRADEOFF)
+        {
+            /* tradeoff means that the remote host connects only after the client is done,
+             * so start the server when the client is closed */
+            state->client_tradeoff_mode = 1;
+        }
     }
     UNLOCK_TCPIP_CORE();
     return result;
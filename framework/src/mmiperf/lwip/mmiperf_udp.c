@@ -8,6 +8,7 @@
 
 #include "mmosal.h"
 #include "../common/mmiperf_private.h"
+#include "../common/mmiperf3_private.h"
 #include "mmiperf_lwip.h"
 #include "mmutils.h"
 
@@ -16,6 +17,7 @@
 #include "lwip/ip_addr.h"
 #include "lwip/mld6.h"
 #include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
 #include "lwip/udp.h"
 
 /* Currently, only UDP is implemented */
@@ -40,7 +42,12 @@ struct iperf_server_session_udp
 
     ip_addr_t client_addr;
     uint16_t client_port;
-    struct timeval ipg_start;
+    /* Transmit timestamp of the previous packet (in microseconds), or zero if none. */
+    uint64_t prev_tx_time_us;
+    /* Settings sent by the client at the start of the session (in network byte order). */
+    struct iperf_settings settings;
+    /* Frame statistics state for a client in isochronous frame mode. */
+    struct iperf_frame_rx frame_rx;
 };
 
 /** Connection handle for a UDP iperf server */
@@ -55,6 +62,13 @@ struct iperf_server_state_udp
     } args;
     struct udp_pcb *pcb;
     struct iperf_server_session_udp session;
+    /* 1=only accept sessions from remote_addr (receive direction of a bidirectional test) */
+    uint8_t specific_remote;
+    ip_addr_t remote_addr;
+    /* Report waiting to be sent back to the client of a multicast test, or NULL */
+    struct pbuf *mcast_report;
+    ip_addr_t mcast_report_addr;
+    uint16_t mcast_report_port;
 };
 
 struct iperf_client_state_udp
@@ -77,12 +91,47 @@ struct iperf_client_state_udp
 
     /* block parameter for bandwdith limit */
     uint32_t block_tx_amount;
+
+    /** pbuf chain (header followed by payload) reused from one datagram to the next. */
+    struct pbuf *tx_pbuf;
+    /** Location of the iperf header in @c tx_pbuf. */
+    void *tx_hdr;
+    /** Length of the datagram @c tx_pbuf was allocated for. */
+    uint32_t tx_pbuf_len;
+    /** Source of the payload data. */
+    struct iperf_payload_source payload;
+    /** Offset into the payload data of the next datagram (application payload only). */
+    uint64_t tx_payload_offset;
+
+    /* Transmit state, owned by the client task */
+    uint32_t end_time;
+    uint64_t remaining_amount;
+    uint32_t tx_amount;
+    bool final;
+    unsigned failure_cnt;
+    uint32_t retry_time;
+    uint32_t block_end_time;
+    uint32_t block_remaining_tx_amount;
+
+    /** Next stream of a parallel test run from the same task, or @c NULL. */
+    struct iperf_client_state_udp *next_stream;
+
+    /** Settings sent in each datagram (in network byte order). */
+    struct iperf_settings settings;
+    /** Listener for the receive direction of a bidirectional test, or @c NULL. */
+    struct iperf_server_state_udp *reverse_server;
+    /** Transmit state for isochronous frame mode. */
+    struct iperf_frame_tx frame;
+    /** Reports from the receivers of a multicast test, or @c NULL if not requested. */
+    struct iperf_mcast_receivers *mcast_receivers;
 };
 
 #ifndef min
 #define min(a, b) ((b) < (a) ? (b) : (a))
 #endif
 
+static mmiperf_handle_t iperf_udp_client_start_impl(const struct mmiperf_client_args *args);
+
 
 static bool udp_server_session_has_timed_out(struct iperf_server_state_udp *server_state)
 {
@@ -91,7 +140,8 @@ static bool udp_server_session_has_timed_out(struct iperf_server_state_udp *serv
 }
 
 static struct iperf_server_session_udp *udp_server_start_session(
-    struct iperf_server_state_udp *server_state, const ip_addr_t *addr, uint16_t port)
+    struct iperf_server_state_udp *server_state, const ip_addr_t *addr, uint16_t port,
+    const struct iperf_settings *settings)
 {
     /* For now we only support a single session. */
     struct iperf_server_session_udp *session = &(server_state->session);
@@ -103,9 +153,15 @@ static struct iperf_server_session_udp *udp_server_start_session(
     memset(session, 0, sizeof(*session));
     session->client_addr = *addr;
     session->client_port = port;
+    session->settings = *settings;
     memset(&server_state->base.report, 0, sizeof(server_state->base.report));
     server_state->base.report.report_type = MMIPERF_INTERRIM_REPORT;
     server_state->base.time_started_ms = mmosal_get_time_ms();
+    iperf_resource_start(&server_state->base);
+    if (server_state->base.latency != NULL)
+    {
+        memset(server_state->base.latency, 0, sizeof(*server_state->base.latency));
+    }
     server_state->base.report.local_port = server_state->args.local_port;
     server_state->base.report.remote_port = port;
 
@@ -129,7 +185,8 @@ static struct iperf_server_session_udp *udp_server_start_session(
 #endif
 
 static struct iperf_server_session_udp *get_session(struct iperf_server_state_udp *server_state,
-                                                    const ip_addr_t *addr, uint16_t port)
+                                                    const ip_addr_t *addr, uint16_t port,
+                                                    const struct iperf_settings *settings)
 {
     /* We only support a single session. */
     struct iperf_server_session_udp *session = &(server_state->session);
@@ -140,20 +197,119 @@ static struct iperf_server_session_udp *get_session(struct iperf_server_state_ud
     }
     else
     {
-        return udp_server_start_session(server_state, addr, port);
+        return udp_server_start_session(server_state, addr, port, settings);
+    }
+}
+
+/**
+ * Start transmitting a test back to the client of a session, as requested in the settings it sent
+ * for a bidirectional test.
+ */
+static void iperf_udp_server_answer_test(struct iperf_server_state_udp *server_state,
+                                         const struct iperf_server_session_udp *session)
+{
+    struct mmiperf_client_args args = MMIPERF_CLIENT_ARGS_DEFAULT;
+    const char *result;
+
+    result = ipaddr_ntoa_r(&session->client_addr, args.server_addr, sizeof(args.server_addr));
+    LWIP_ASSERT("IP buf too short", result != NULL);
+    LWIP_UNUSED_ARG(result); /* for LWIP_NOASSERT */
+    iperf_udp_server_answer_args(&session->settings, &args);
+    args.report_fn = server_state->base.report_fn;
+    args.report_arg = server_state->base.report_arg;
+    args.version = server_state->args.version;
+
+    if (iperf_udp_client_start_impl(&args) == NULL)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Failed to start reverse direction of iperf test\n"));
     }
 }
 
+/** Send the report for the client of a multicast test that is waiting to be sent. */
+static void iperf_udp_server_mcast_report_send(struct iperf_server_state_udp *server_state)
+{
+    err_t err = udp_sendto(server_state->pcb, server_state->mcast_report,
+                           &server_state->mcast_report_addr, server_state->mcast_report_port);
+    if (err != ERR_OK)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Failed to send Iperf multicast report.\n"));
+    }
+    pbuf_free(server_state->mcast_report);
+    server_state->mcast_report = NULL;
+}
+
+/** Timer callback to send the report for the client of a multicast test. */
+static void iperf_udp_server_mcast_report_timer(void *arg)
+{
+    iperf_udp_server_mcast_report_send((struct iperf_server_state_udp *)arg);
+}
+
 /**
- * Get the difference in microseconds between two timevals.
+ * Queue a report to be unicast back to the client of a multicast test, after a random delay so
+ * that the reports from all the receivers do not arrive at the client at once.
  *
- * \note Delta must not exceed the range of an int32.
+ * @param server_state  The UDP server.
+ * @param p             The final datagram received from the client.
+ * @param addr          Address of the client.
+ * @param port          Port of the client.
  */
-static int32_t time_delta(const struct timeval *a, const struct timeval *b)
+static void iperf_udp_server_mcast_report_queue(struct iperf_server_state_udp *server_state,
+                                                struct pbuf *p, const ip_addr_t *addr,
+                                                uint16_t port)
 {
-    int32_t delta = (a->tv_sec - b->tv_sec) * 1000000;
-    delta += (a->tv_usec - b->tv_usec);
-    return delta;
+    struct pbuf *report_buf;
+    struct iperf_udp_header *report_hdr;
+
+    if (server_state->mcast_report != NULL)
+    {
+        /* The report for the previous test is still waiting; send it now. */
+        sys_untimeout(iperf_udp_server_mcast_report_timer, server_state);
+        iperf_udp_server_mcast_report_send(server_state);
+    }
+
+    report_buf = pbuf_alloc(PBUF_TRANSPORT,
+                            sizeof(struct iperf_udp_header) +
+                            sizeof(struct iperf_udp_server_report),
+                            PBUF_RAM);
+    if (report_buf == NULL)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Bad alloc\n"));
+        return;
+    }
+
+    /* We use the UDP header and flags from the pbuf we received. */
+    report_hdr = (struct iperf_udp_header *)report_buf->payload;
+    memset(report_hdr, 0, sizeof(*report_hdr));
+    pbuf_copy_partial(p, report_hdr, MM_MIN(sizeof(*report_hdr), p->tot_len), 0);
+    iperf_populate_udp_server_report(&server_state->base,
+                                     (struct iperf_udp_server_report *)(report_hdr + 1));
+
+    server_state->mcast_report = report_buf;
+    server_state->mcast_report_addr = *addr;
+    server_state->mcast_report_port = port;
+    sys_timeout(iperf_udp_mcast_report_delay_ms(), iperf_udp_server_mcast_report_timer,
+                server_state);
+}
+
+/** Close a UDP server and release its resources. The caller must hold the TCPIP core lock. */
+static void iperf_udp_server_close(struct iperf_server_state_udp *server_state)
+{
+    LWIP_ASSERT_CORE_LOCKED();
+
+    if (server_state->mcast_report != NULL)
+    {
+        sys_untimeout(iperf_udp_server_mcast_report_timer, server_state);
+        pbuf_free(server_state->mcast_report);
+        server_state->mcast_report = NULL;
+    }
+    udp_remove(server_state->pcb);
+    server_state->pcb = NULL;
+    iperf_list_remove(&server_state->base);
+    if (server_state->base.latency != NULL)
+    {
+        IPERF_FREE(struct iperf_latency_stats, server_state->base.latency);
+    }
+    IPERF_FREE(struct iperf_server_state_udp, server_state);
 }
 
 static void iperf_udp_server_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
@@ -163,16 +319,13 @@ static void iperf_udp_server_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p
 
     LWIP_ASSERT("NULL packet", p != NULL);
     udp_header_t *hdr = (udp_header_t *)p->payload;
-    struct iperf_settings *settings = (struct iperf_settings *)(hdr + 1);
-    struct timeval packet_time = {
-        .tv_sec = ntohl(hdr->tv_sec),
-        .tv_usec = ntohl(hdr->tv_usec),
-    };
+    struct iperf_settings settings;
+    uint32_t hdrs_len = iperf_udp_hdrs_len(server_state->args.version);
     int64_t packet_id = 0;
     bool final_packet = false;
     struct iperf_server_session_udp *session = &server_state->session;
 
-    if (p->len < sizeof(*hdr) + sizeof(*settings))
+    if (p->len < hdrs_len)
     {
         /* Technically the header could be split over multiple pbufs but it is so small that is
          * not going to happen in practice. */
@@ -180,6 +333,15 @@ static void iperf_udp_server_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p
         goto cleanup;
     }
 
+    if (server_state->specific_remote && !ip_addr_cmp_zoneless(addr, &server_state->remote_addr))
+    {
+        /* this listener belongs to a client session, and this is not the correct remote */
+        goto cleanup;
+    }
+
+    /* The settings follow the header, the length of which depends on the version. */
+    memcpy(&settings, (uint8_t *)p->payload + hdrs_len - sizeof(settings), sizeof(settings));
+
     if (server_state->args.version == IPERF_VERSION_2_0_9)
     {
         packet_id = (int64_t)((int32_t)ntohl(hdr->id_lo));
@@ -196,13 +358,21 @@ static void iperf_udp_server_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p
         packet_id = -packet_id;
     }
 
-    session = get_session(server_state, addr, port);
+    session = get_session(server_state, addr, port, &settings);
     if (session == NULL)
     {
         LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Another session already in progress\n"));
         goto cleanup;
     }
 
+    if (session->next_packet_id == 0 && server_state->base.report.rx_frames == 0 &&
+        (session->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_TEST)) &&
+        (session->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_NOW)))
+    {
+        /* client requested parallel transmission test */
+        iperf_udp_server_answer_test(server_state, session);
+    }
+
     /* next_packet_id < 0 indicates that we have already received the final frame from the client
      * so we should not update our session state. However, we can still send responses. */
     if (session->next_packet_id >= 0)
@@ -210,9 +380,22 @@ static void iperf_udp_server_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p
         server_state->base.last_rx_time_ms = mmosal_get_time_ms();
         server_state->base.report.bytes_transferred += p->tot_len;
         server_state->base.report.rx_frames++;
-        server_state->base.report.ipg_count++;
-        server_state->base.report.ipg_sum_ms += time_delta(&packet_time, &(session->ipg_start));
-        session->ipg_start = packet_time;
+        iperf_udp_server_update_timing(&server_state->base,
+                                       ((uint64_t)ntohl(hdr->tv_sec) * 1000000) +
+                                       ntohl(hdr->tv_usec),
+                                       &session->prev_tx_time_us);
+        if (server_state->base.verify_payload)
+        {
+            iperf_verify_pbuf(&server_state->base, p,
+                              iperf_udp_hdrs_len(server_state->args.version), 0);
+        }
+        if (p->tot_len > hdrs_len)
+        {
+            struct iperf_frame_header frame_hdr;
+            u16_t frame_hdr_len = pbuf_copy_partial(p, &frame_hdr, sizeof(frame_hdr), hdrs_len);
+            iperf_frame_rx_update(&server_state->base, &session->frame_rx, &frame_hdr,
+                                  frame_hdr_len);
+        }
 
         if (packet_id < session->next_packet_id)
         {
@@ -265,11 +448,26 @@ static void iperf_udp_server_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p
                 LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Bad alloc\n"));
             }
         }
+        else if (report_required &&
+                 (session->settings.flags & PP_HTONL(IPERF_FLAGS_MCAST_REPORT)))
+        {
+            /* The client of a multicast test asked each receiver to report back to it. Only the
+             * first final packet is answered since the client repeats it. */
+            iperf_udp_server_mcast_report_queue(server_state, p, addr, port);
+        }
 
         if (report_required)
         {
+            iperf_frame_rx_finish(&server_state->base, &session->frame_rx);
             iperf_finalize_report_and_invoke_callback(&server_state->base, duration_ms,
                                                       MMIPERF_UDP_DONE_SERVER);
+
+            if ((session->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_TEST)) &&
+                !(session->settings.flags & PP_HTONL(IPERF_FLAGS_ANSWER_NOW)))
+            {
+                /* client requested transmission after end of test */
+                iperf_udp_server_answer_test(server_state, session);
+            }
         }
     }
 
@@ -280,14 +478,21 @@ cleanup:
     }
 }
 
-mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args)
+/**
+ * Start a UDP server. The caller must hold the TCPIP core lock.
+ *
+ * @param args      Iperf server arguments.
+ * @param state     Receives the new server on success.
+ *
+ * @returns @c ERR_OK on success, @c ERR_USE if the port is already in use, else an appropriate
+ *          error code.
+ */
+static err_t iperf_start_udp_server_impl(const struct mmiperf_server_args *args,
+                                         struct iperf_server_state_udp **state)
 {
-    LOCK_TCPIP_CORE();
-
-    err_t err;
-    struct udp_pcb *pcb;
+    err_t err = ERR_MEM;
+    struct udp_pcb *pcb = NULL;
     struct iperf_server_state_udp *s;
-    mmiperf_handle_t result = NULL;
 
     LWIP_ASSERT_CORE_LOCKED();
 
@@ -303,10 +508,20 @@ mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args
     s->base.report_arg = args->report_arg;
     s->args.local_port = args->local_port;
     s->args.version = args->version;
+    s->base.verify_payload = args->verify_payload;
     /* Set next_packet_id to -1 to show that there is no session active. We will start a new
      * session with the first packet we receive from a client. */
     s->session.next_packet_id = -1;
     s->base.report.report_type = MMIPERF_INTERRIM_REPORT;
+    if (args->trip_times)
+    {
+        s->base.latency = (struct iperf_latency_stats *)IPERF_ALLOC(struct iperf_latency_stats);
+        if (s->base.latency == NULL)
+        {
+            goto exit;
+        }
+        memset(s->base.latency, 0, sizeof(*s->base.latency));
+    }
 
     s->args.local_addr = *(IP_ADDR_ANY);
     if (args->local_addr[0] != '\0')
@@ -316,13 +531,22 @@ mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args
         {
             LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS,
                         ("Unable to parse local_addr as IP address (%s)\n", args->local_addr));
+            err = ERR_ARG;
             goto exit;
         }
     }
 
+    if (!iperf_list_add(&s->base))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Too many iperf sessions\n"));
+        err = ERR_MEM;
+        goto exit;
+    }
+
     pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
     if (pcb == NULL)
     {
+        err = ERR_MEM;
         goto exit;
     }
 
@@ -348,45 +572,183 @@ mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args
     udp_recv(pcb, iperf_udp_server_recv, s);
 
     s->pcb = pcb;
+    pcb = NULL;
 
-    iperf_list_add(&s->base);
-    result = &(s->base);
+    *state = s;
     s = NULL;
 
 exit:
+    if (pcb != NULL)
+    {
+        udp_remove(pcb);
+    }
     if (s != NULL)
     {
+        iperf_list_remove(&s->base);
+        if (s->base.latency != NULL)
+        {
+            IPERF_FREE(struct iperf_latency_stats, s->base.latency);
+        }
         IPERF_FREE(struct iperf_server_state_udp, s);
     }
+    return err;
+}
+
+mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args)
+{
+    err_t err;
+    struct iperf_server_state_udp *state = NULL;
+
+    if (args->version == IPERF_VERSION_3)
+    {
+        /* The iperf3 server handles UDP tests too; see mmiperf_start_tcp_server(). */
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("iperf3 server must be started as a TCP server\n"));
+        return NULL;
+    }
+
+    LOCK_TCPIP_CORE();
+    err = iperf_start_udp_server_impl(args, &state);
     UNLOCK_TCPIP_CORE();
-    return result;
+    if (err == ERR_OK)
+    {
+        return state->base.handle;
+    }
+    return NULL;
 }
 
-static err_t iperf_udp_client_send_packet(struct iperf_client_state_udp *session,
-                                          uint32_t tx_amount, bool final)
+/**
+ * Get the pbuf chain to use to transmit a datagram. The chain is allocated on first use then
+ * reused for each subsequent datagram of the same length, so the transmit loop does not need to
+ * allocate in the common case. Stable payload data is referenced by @c PBUF_ROM pbufs so it is
+ * never copied; generated payload data is written into the header pbuf.
+ *
+ * @param session   The UDP client stream.
+ * @param hdrs_len  Length of the iperf headers.
+ * @param tx_amount Total length of the datagram.
+ *
+ * @returns the pbuf chain on success, else @c NULL.
+ */
+static struct pbuf *iperf_udp_client_get_tx_pbuf(struct iperf_client_state_udp *session,
+                                                 uint32_t hdrs_len, uint32_t tx_amount)
 {
-    udp_header_t *udp_hdr;
-    struct iperf_settings *settings;
-    uint32_t hdrs_len = sizeof(*udp_hdr) + sizeof(*settings);
+    struct pbuf *hdrs_pbuf = session->tx_pbuf;
+    uint32_t payload_len = 0;
+    uint32_t avail;
+    const uint8_t *payload;
 
-    if (session->args.version == IPERF_VERSION_2_0_9)
+    if (tx_amount > hdrs_len)
     {
-        hdrs_len = (hdrs_len - sizeof(uint32_t));
+        payload_len = tx_amount - hdrs_len;
+    }
+    payload = iperf_payload_get(&session->payload, session->tx_payload_offset, payload_len,
+                                &avail);
+
+    if (hdrs_pbuf != NULL)
+    {
+        /* We can only reuse the chain if nothing else (e.g., the ARP queue) still holds it. For
+         * stable payload data the payload must fit in the single payload pbuf of the chain. */
+        if (hdrs_pbuf->ref == 1 && session->tx_pbuf_len == tx_amount &&
+            (payload == NULL ||
+             (avail == payload_len && hdrs_pbuf->next != NULL && hdrs_pbuf->next->next == NULL)))
+        {
+            /* Undo the headers lower layers added in front of ours on the last transmit. */
+            pbuf_remove_header(hdrs_pbuf,
+                               (uint8_t *)session->tx_hdr - (uint8_t *)hdrs_pbuf->payload);
+            if (payload == NULL)
+            {
+                iperf_payload_copy(&session->payload, session->tx_payload_offset,
+                                   (uint8_t *)hdrs_pbuf->payload + hdrs_len, payload_len);
+            }
+            else
+            {
+                ((struct pbuf_rom *)hdrs_pbuf->next)->payload = payload;
+            }
+            return hdrs_pbuf;
+        }
+        pbuf_free(hdrs_pbuf);
+        session->tx_pbuf = NULL;
     }
 
-    struct pbuf *hdrs_pbuf = pbuf_alloc(PBUF_TRANSPORT, hdrs_len, PBUF_POOL);
+    if (payload == NULL)
+    {
+        /* Generated payload data has to be copied, so put it in the same pbuf as the headers. */
+        hdrs_pbuf = pbuf_alloc(PBUF_TRANSPORT, hdrs_len + payload_len, PBUF_RAM);
+    }
+    else
+    {
+        hdrs_pbuf = pbuf_alloc(PBUF_TRANSPORT, hdrs_len, PBUF_RAM);
+    }
     if (hdrs_pbuf == NULL)
     {
         LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf UDP tx failed to alloc hdrs\n"));
-        return ERR_MEM;
+        return NULL;
     }
 
     /* Ensure we got allocated the right length and not chained pbufs */
-    if (hdrs_pbuf->len != hdrs_len)
+    if (hdrs_pbuf->len != hdrs_pbuf->tot_len)
     {
         LWIP_PLATFORM_ASSERT("pbuf length mismatch");
     }
 
+    if (payload == NULL)
+    {
+        iperf_payload_copy(&session->payload, session->tx_payload_offset,
+                           (uint8_t *)hdrs_pbuf->payload + hdrs_len, payload_len);
+    }
+    else
+    {
+        struct pbuf *payload_pbuf = iperf_get_data_pbuf(&session->payload,
+                                                        session->tx_payload_offset,
+                                                        payload_len);
+        if (payload_pbuf == NULL)
+        {
+            LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("pbuf allocation failed\n"));
+            pbuf_free(hdrs_pbuf);
+            return NULL;
+        }
+
+        pbuf_cat(hdrs_pbuf, payload_pbuf);
+        payload_pbuf = NULL;
+    }
+
+    session->tx_pbuf = hdrs_pbuf;
+    session->tx_hdr = hdrs_pbuf->payload;
+    session->tx_pbuf_len = tx_amount;
+    return hdrs_pbuf;
+}
+
+/**
+ * Transmit a datagram of a UDP client stream. The caller must hold the TCPIP core lock.
+ *
+ * @param session   The UDP client stream.
+ * @param tx_amount Total length of the datagram.
+ * @param final     @c true if this is the final datagram of the test.
+ *
+ * @returns @c ERR_OK on success, else an appropriate error code.
+ */
+static err_t iperf_udp_client_send_packet(struct iperf_client_state_udp *session,
+                                          uint32_t tx_amount, bool final)
+{
+    udp_header_t *udp_hdr;
+    struct iperf_settings *settings;
+    uint32_t iperf_hdrs_len = iperf_udp_hdrs_len(session->args.version);
+    uint32_t hdrs_len = iperf_hdrs_len;
+    /* In isochronous frame mode each datagram apart from the final one carries a frame header */
+    bool frame_hdr = (session->frame.len > 0 && !final);
+
+    LWIP_ASSERT_CORE_LOCKED();
+
+    if (frame_hdr)
+    {
+        hdrs_len += sizeof(struct iperf_frame_header);
+    }
+
+    struct pbuf *hdrs_pbuf = iperf_udp_client_get_tx_pbuf(session, hdrs_len, tx_amount);
+    if (hdrs_pbuf == NULL)
+    {
+        return ERR_MEM;
+    }
+
     int64_t datagrams_cnt = session->base.report.tx_frames;
     if (final)
     {
@@ -403,76 +765,66 @@ static err_t iperf_udp_client_send_packet(struct iperf_client_state_udp *session
         udp_hdr->id_lo = htonl((uint32_t)((uint64_t)datagrams_cnt));
         udp_hdr->id_hi = htonl((uint32_t)(((uint64_t)datagrams_cnt) >> 32));
     }
-    uint32_t now = sys_now();
-    udp_hdr->tv_usec = htonl((now % 1000) * 1000);
-    udp_hdr->tv_sec = htonl(now / 1000);
-
-    settings = (struct iperf_settings *)(udp_hdr + 1);
-    memset(settings, 0, sizeof(*settings));
-
-    uint32_t payload_len = 0;
-    if (tx_amount > hdrs_len)
+    uint64_t now_us = iperf_get_time_us();
+    udp_hdr->tv_usec = htonl(now_us % 1000000);
+    udp_hdr->tv_sec = htonl(now_us / 1000000);
+
+    /* The settings follow the header, the length of which depends on the version. */
+    settings = (struct iperf_settings *)((uint8_t *)udp_hdr + iperf_hdrs_len - sizeof(*settings));
+    memcpy(settings, &session->settings, sizeof(*settings));
+    if (frame_hdr)
     {
-        payload_len = tx_amount - hdrs_len;
+        iperf_frame_tx_fill_header((uint8_t *)udp_hdr + iperf_hdrs_len, &session->frame,
+                                   session->args.packet_size - hdrs_len);
     }
 
-    struct pbuf *payload_pbuf = iperf_get_data_pbuf(0, payload_len);
-    if (payload_pbuf == NULL)
-    {
-        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("pbuf allocation failed\n"));
-        pbuf_free(hdrs_pbuf);
-        return ERR_MEM;
-    }
-
-    pbuf_cat(hdrs_pbuf, payload_pbuf);
-    payload_pbuf = NULL;
-
-    LOCK_TCPIP_CORE();
     err_t err = udp_sendto(session->pcb, hdrs_pbuf,
                            &(session->server_addr), session->args.server_port);
-    UNLOCK_TCPIP_CORE();
-    pbuf_free(hdrs_pbuf);
     if (err != ERR_OK)
     {
         LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf UDP tx failed to send (err=%d)\n", err));
         return err;
     }
 
+    if (!iperf_payload_is_default(&session->payload) && tx_amount > hdrs_len)
+    {
+        /* Application payload continues from one datagram to the next. */
+        session->tx_payload_offset += tx_amount - hdrs_len;
+    }
+
     return ERR_OK;
 }
 
-static void iperf_udp_client_task(void *arg)
+/** Initialise the transmit state of a UDP client stream at the start of the test. */
+static void iperf_udp_client_tx_init(struct iperf_client_state_udp *session)
 {
-    struct iperf_client_state_udp *session = (struct iperf_client_state_udp *)arg;
+    const char *result;
 
-    uint32_t end_time = UINT32_MAX;
-    uint64_t remaining_amount = UINT64_MAX;
+    session->end_time = UINT32_MAX;
+    session->remaining_amount = UINT64_MAX;
 
     /* A negative amount means it is a time (in hundredths of seconds), a postive amount is
      * number of bytes. */
     if (session->args.amount < 0)
     {
-        end_time = session->base.time_started_ms + (-(session->args.amount) * 10);
+        session->end_time = iperf_test_start_time_ms(&session->base) +
+                            (-(session->args.amount) * 10);
     }
     else
     {
-        remaining_amount = session->args.amount;
+        session->remaining_amount = session->args.amount;
     }
 
-    uint32_t tx_amount = 0;
-    bool final = false;
-    unsigned failure_cnt = 0;
-
-    /* if no input for bandwidth limit, set bw_limit flag to false */
-    bool bw_limit = true;
-    if (session->args.target_bw == 0)
+    if (session->args.mode == MMIPERF_CLIENT_MODE_REVERSE)
     {
-        bw_limit = false;
+        /* We only send enough to request the test; the amount is for the remote side. */
+        session->end_time = UINT32_MAX;
+        session->remaining_amount = 0;
     }
-    uint32_t block_end_time = sys_now() + BLOCK_DURATION_MS;
-    uint32_t block_remaining_tx_amount = session->block_tx_amount;
 
-    const char *result;
+    session->block_end_time = sys_now() + BLOCK_DURATION_MS;
+    session->block_remaining_tx_amount = session->block_tx_amount;
+    iperf_frame_tx_init(&session->frame, &session->args, 0);
 
     result = ipaddr_ntoa_r(&session->pcb->local_ip,
                            session->base.report.local_addr,
@@ -482,56 +834,182 @@ static void iperf_udp_client_task(void *arg)
     mmosal_safer_strcpy(session->base.report.remote_addr, session->args.server_addr,
                         sizeof(session->base.report.remote_addr));
     session->base.report.remote_port = session->args.server_port;
+}
+
+/** Check whether a UDP client stream has finished transmitting. */
+static bool iperf_udp_client_tx_done(struct iperf_client_state_udp *session)
+{
+    return session->final || session->failure_cnt >= IPERF_UDP_CLIENT_MAX_CONSEC_FAILURES;
+}
 
-    while (!final && failure_cnt < IPERF_UDP_CLIENT_MAX_CONSEC_FAILURES)
+/**
+ * Transmit the next datagram of a UDP client stream in isochronous frame mode, if a frame is in
+ * progress or due. Once the test is over the final datagram is sent without a frame header.
+ *
+ * @param session   The UDP client stream.
+ *
+ * @returns @c true if a transmit was attempted, else @c false.
+ */
+static bool iperf_udp_client_tx_next_frame(struct iperf_client_state_udp *session)
+{
+    uint32_t hdrs_len = iperf_udp_hdrs_len(session->args.version) +
+                        sizeof(struct iperf_frame_header);
+    bool test_over = (sys_now() > session->end_time || session->remaining_amount == 0);
+
+    if (!test_over)
     {
-        /* If this is the last packet then set the counter to negative to inform the other side. */
-        if (sys_now() > end_time || remaining_amount <= (uint64_t)session->args.packet_size ||
-            session->base.report.tx_frames >= UINT32_MAX - 10)
-        {
-            final = true;
-            session->awaiting_report = true;
-        }
-        tx_amount = min(remaining_amount, session->args.packet_size);
+        iperf_frame_tx_start(&session->frame, false);
+    }
 
-        /* when bw_limit is set to false, always send packets without check block parameter */
-        if (bw_limit && block_end_time < sys_now())
-        {
-            block_end_time = sys_now() + BLOCK_DURATION_MS;
-            block_remaining_tx_amount += session->block_tx_amount;
-        }
-        if (!bw_limit || block_remaining_tx_amount >= tx_amount || sys_now() > end_time)
-        {
-            err_t err = iperf_udp_client_send_packet(session, tx_amount, final);
+    if (session->frame.remaining > 0)
+    {
+        session->tx_amount = hdrs_len + min(session->args.packet_size - hdrs_len,
+                                            session->frame.remaining);
+    }
+    else if (test_over)
+    {
+        session->final = true;
+        session->awaiting_report = true;
+        session->tx_amount = iperf_udp_hdrs_len(session->args.version);
+    }
+    else
+    {
+        return false;
+    }
 
-            if (err == ERR_OK)
-            {
-                session->base.report.bytes_transferred += tx_amount;
-                session->base.report.tx_frames++;
-                remaining_amount -= tx_amount;
-                block_remaining_tx_amount -= tx_amount;
-                failure_cnt = 0;
-            }
-            else
-            {
-                failure_cnt++;
-                mmosal_task_sleep(IPERF_UDP_CLIENT_RETRY_WAIT_TIME_MS);
-            }
-        }
-        else
+    err_t err = iperf_udp_client_send_packet(session, session->tx_amount, session->final);
+    if (err == ERR_OK)
+    {
+        session->base.report.bytes_transferred += session->tx_amount;
+        session->base.report.tx_frames++;
+        if (!session->final)
         {
-            mmosal_task_sleep(1);
+            session->frame.remaining -= session->tx_amount - hdrs_len;
+            session->remaining_amount -= min(session->remaining_amount,
+                                             session->tx_amount - hdrs_len);
         }
+        session->failure_cnt = 0;
+    }
+    else
+    {
+        session->failure_cnt++;
+        session->retry_time = sys_now() + IPERF_UDP_CLIENT_RETRY_WAIT_TIME_MS;
+    }
+    return true;
+}
+
+/**
+ * Transmit the next datagram of a UDP client stream, if its bandwidth limit allows.
+ *
+ * @param session   The UDP client stream.
+ *
+ * @returns @c true if a transmit was attempted, else @c false.
+ */
+static bool iperf_udp_client_tx_next(struct iperf_client_state_udp *session)
+{
+    /* if no input for bandwidth limit, set bw_limit flag to false */
+    bool bw_limit = (session->args.target_bw != 0);
+
+    if (session->failure_cnt > 0 && !mmosal_time_has_passed(session->retry_time))
+    {
+        return false;
+    }
+
+    if (session->frame.len > 0)
+    {
+        return iperf_udp_client_tx_next_frame(session);
+    }
+
+    /* If this is the last packet then set the counter to negative to inform the other side. The
+     * first packet cannot be the last since its counter is zero. */
+    if (session->base.report.tx_frames > 0 &&
+        (sys_now() > session->end_time ||
+         session->remaining_amount <= (uint64_t)session->args.packet_size ||
+         session->base.report.tx_frames >= UINT32_MAX - 10))
+    {
+        session->final = true;
+        session->awaiting_report = true;
+    }
+    session->tx_amount = min(session->remaining_amount, session->args.packet_size);
+
+    /* when bw_limit is set to false, always send packets without check block parameter */
+    if (bw_limit && session->block_end_time < sys_now())
+    {
+        session->block_end_time = sys_now() + BLOCK_DURATION_MS;
+        session->block_remaining_tx_amount += session->block_tx_amount;
+    }
+    if (bw_limit && session->block_remaining_tx_amount < session->tx_amount &&
+        sys_now() <= session->end_time)
+    {
+        return false;
+    }
+
+    err_t err = iperf_udp_client_send_packet(session, session->tx_amount, session->final);
+    if (err == ERR_OK)
+    {
+        session->base.report.bytes_transferred += session->tx_amount;
+        session->base.report.tx_frames++;
+        session->remaining_amount -= session->tx_amount;
+        session->block_remaining_tx_amount -= session->tx_amount;
+        session->failure_cnt = 0;
+    }
+    else
+    {
+        session->failure_cnt++;
+        session->retry_time = sys_now() + IPERF_UDP_CLIENT_RETRY_WAIT_TIME_MS;
+    }
+    return true;
+}
+
+/**
+ * Collect the reports sent back by the receivers of a multicast test. The final packet is
+ * repeated a few times since it is not acknowledged, then reports are collected for
+ * @ref IPERF_UDP_MCAST_REPORT_WINDOW_MS.
+ */
+static void iperf_udp_client_collect_mcast_reports(struct iperf_client_state_udp *session)
+{
+    unsigned ii;
+
+    for (ii = 1; ii < IPERF_UDP_MCAST_FINAL_REPEATS; ii++)
+    {
+        mmosal_task_sleep(IPERF_UDP_MCAST_FINAL_INTERVAL_MS);
+        LOCK_TCPIP_CORE();
+        iperf_udp_client_send_packet(session, session->tx_amount, true);
+        UNLOCK_TCPIP_CORE();
+    }
+    mmosal_task_sleep(IPERF_UDP_MCAST_REPORT_WINDOW_MS);
+
+    /* Stop the receive callback touching the reports so they can be read without the lock. */
+    LOCK_TCPIP_CORE();
+    session->awaiting_report = false;
+    UNLOCK_TCPIP_CORE();
+
+    iperf_mcast_receivers_summarise(session->mcast_receivers, &session->base.report);
+}
+
+/** Collect the server report for a UDP client stream then clean up and report the result. */
+static void iperf_udp_client_finish(struct iperf_client_state_udp *session)
+{
+    uint32_t tx_end_ms = mmosal_get_time_ms();
+
+    if (session->mcast_receivers != NULL)
+    {
+        iperf_udp_client_collect_mcast_reports(session);
+    }
+    else
+    {
+        /* Wait for status report from other end.  Use a binary semaphore to block us until
+         * we receive report. */
+        mmosal_semb_wait(session->report_semb, IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS);
     }
-    /* Wait for status report from other end.  Use a binary semaphore to block us until
-     * we receive report. */
-    mmosal_semb_wait(session->report_semb, IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS);
     if (!ip_addr_ismulticast(&(session->server_addr)))
     {
         unsigned ii;
         for (ii = 0; ii < IPERF_UDP_CLIENT_REPORT_RETRIES && session->report == NULL; ii++)
         {
-            iperf_udp_client_send_packet(session, tx_amount, true);
+            LOCK_TCPIP_CORE();
+            iperf_udp_client_send_packet(session, session->tx_amount, true);
+            UNLOCK_TCPIP_CORE();
             mmosal_semb_wait(session->report_semb, IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS);
         }
     }
@@ -554,20 +1032,27 @@ static void iperf_udp_client_task(void *arg)
         pbuf_free(session->report);
         session->report = NULL;
     }
+    else if (ip_addr_ismulticast(&(session->server_addr)))
+    {
+        /* There is no server report for a multicast test, so report what we sent. */
+        final_duration_ms = tx_end_ms - session->base.time_started_ms;
+    }
     else
     {
         final_duration_ms = mmosal_get_time_ms() - session->base.time_started_ms;
-        if (!ip_addr_ismulticast(&(session->server_addr)))
-        {
-            /* If we receive no response from the server in unicast mode then set
-             * bytes_transferred to zero so it is obvious in the report. */
-            session->base.report.bytes_transferred = 0;
-        }
+        /* If we receive no response from the server in unicast mode then set
+         * bytes_transferred to zero so it is obvious in the report. */
+        session->base.report.bytes_transferred = 0;
     }
 
     /* Clean up state and free allocated memory. */
     LOCK_TCPIP_CORE();
     udp_remove(session->pcb);
+    if (session->tx_pbuf != NULL)
+    {
+        pbuf_free(session->tx_pbuf);
+        session->tx_pbuf = NULL;
+    }
     UNLOCK_TCPIP_CORE();
     mmosal_semb_delete(session->report_semb);
     session->report_semb = NULL;
@@ -575,9 +1060,166 @@ static void iperf_udp_client_task(void *arg)
     iperf_list_remove(&(session->base));
     iperf_finalize_report_and_invoke_callback(&session->base, final_duration_ms,
                                               MMIPERF_UDP_DONE_CLIENT);
+    if (session->mcast_receivers != NULL)
+    {
+        IPERF_FREE(struct iperf_mcast_receivers, session->mcast_receivers);
+    }
     IPERF_FREE(iperf_state_udp_t, session);
 }
 
+/**
+ * Wait for the receive direction of a bidirectional test to finish, then close the listener that
+ * was started for it. The remote side must start transmitting within
+ * @ref IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS of our transmit direction finishing, and if it stops
+ * transmitting for that long without sending its final datagram then the receive direction is
+ * reported as it stands.
+ *
+ * @param srv   The listener for the receive direction.
+ */
+static void iperf_udp_client_finish_reverse(struct iperf_server_state_udp *srv)
+{
+    uint32_t timeout_ms = mmosal_get_time_ms() + IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS;
+    uint32_t linger_end_ms = 0;
+    bool done = false;
+
+    while (!done)
+    {
+        mmosal_task_sleep(IPERF_UDP_CLIENT_REVERSE_POLL_MS);
+
+        LOCK_TCPIP_CORE();
+        if (srv->session.next_packet_id >= 0)
+        {
+            /* The receive direction is in progress. */
+            if (mmosal_time_has_passed(srv->base.last_rx_time_ms +
+                                       IPERF_UDP_CLIENT_REVERSE_TIMEOUT_MS))
+            {
+                LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf UDP reverse test timed out\n"));
+                srv->session.next_packet_id = -1;
+                iperf_finalize_report_and_invoke_callback(
+                    &srv->base, srv->base.last_rx_time_ms - srv->base.time_started_ms,
+                    MMIPERF_UDP_DONE_SERVER);
+                done = true;
+            }
+        }
+        else if (srv->base.report.rx_frames != 0)
+        {
+            /* The receive direction is done. Linger in case our report to the remote side was
+             * lost and it retransmits its final datagram. */
+            if (linger_end_ms == 0)
+            {
+                linger_end_ms = mmosal_get_time_ms() +
+                                IPERF_UDP_CLIENT_REPORT_RETRIES * IPERF_UDP_CLIENT_REPORT_TIMEOUT_MS;
+            }
+            done = mmosal_time_has_passed(linger_end_ms);
+        }
+        else if (mmosal_time_has_passed(timeout_ms))
+        {
+            LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING,
+                        ("Remote side did not start reverse direction of iperf test\n"));
+            done = true;
+        }
+
+        if (done)
+        {
+            iperf_udp_server_close(srv);
+        }
+        UNLOCK_TCPIP_CORE();
+    }
+}
+
+/**
+ * Task that runs a UDP client test. All streams of a parallel test are run from this one task,
+ * transmitting a datagram from each stream in turn. Datagrams are sent in bursts of up to
+ * @ref IPERF_UDP_CLIENT_TX_BURST per stream each time we take the TCPIP core lock.
+ */
+static void iperf_udp_client_task(void *arg)
+{
+    struct iperf_client_state_udp *first_stream = (struct iperf_client_state_udp *)arg;
+    struct iperf_client_state_udp *session;
+    struct iperf_client_state_udp *next;
+    struct iperf_server_state_udp *reverse_server;
+    bool active;
+
+    for (session = first_stream; session != NULL; session = session->next_stream)
+    {
+        iperf_udp_client_tx_init(session);
+    }
+
+    do
+    {
+        bool transmitted = false;
+        unsigned burst;
+
+        LOCK_TCPIP_CORE();
+        for (burst = 0; burst < IPERF_UDP_CLIENT_TX_BURST; burst++)
+        {
+            bool round_transmitted = false;
+            active = false;
+            for (session = first_stream; session != NULL; session = session->next_stream)
+            {
+                if (!iperf_udp_client_tx_done(session))
+                {
+                    active = true;
+                    round_transmitted |= iperf_udp_client_tx_next(session);
+                }
+            }
+            transmitted |= round_transmitted;
+            if (!round_transmitted)
+            {
+                break;
+            }
+        }
+        UNLOCK_TCPIP_CORE();
+
+        if (active && !transmitted)
+        {
+            mmosal_task_sleep(1);
+        }
+    } while (active);
+
+    /* Bidirectional tests only have one stream. */
+    reverse_server = first_stream->reverse_server;
+
+    for (session = first_stream; session != NULL; session = next)
+    {
+        next = session->next_stream;
+        iperf_udp_client_finish(session);
+    }
+
+    if (reverse_server != NULL)
+    {
+        iperf_udp_client_finish_reverse(reverse_server);
+    }
+}
+
+/** Handle a report unicast back by a receiver of a multicast test. */
+static void iperf_udp_client_mcast_recv(struct iperf_client_state_udp *session, struct pbuf *p,
+                                        const ip_addr_t *addr, uint16_t port)
+{
+    char addr_str[MMIPERF_IPADDR_MAXLEN];
+    struct iperf_udp_header *hdr = (struct iperf_udp_header *)p->payload;
+
+    if (port != session->args.server_port || !session->awaiting_report)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_ALL, ("UDP client rx unexpected\n"));
+        return;
+    }
+
+    if (p->len < sizeof(*hdr) + sizeof(struct iperf_udp_server_report))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("iperf UDP received report too short\n"));
+        return;
+    }
+
+    if (ipaddr_ntoa_r(addr, addr_str, sizeof(addr_str)) == NULL ||
+        !iperf_mcast_receivers_add(session->mcast_receivers, addr_str, hdr,
+                                   (struct iperf_udp_server_report *)(hdr + 1),
+                                   session->args.version, session->base.report.tx_frames))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("UDP client rx invalid multicast report\n"));
+    }
+}
+
 static void iperf_udp_client_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
                                   const ip_addr_t *addr, uint16_t port)
 {
@@ -585,6 +1227,12 @@ static void iperf_udp_client_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p
 
     struct iperf_client_state_udp *session = (struct iperf_client_state_udp *)arg;
 
+    if (session->mcast_receivers != NULL)
+    {
+        iperf_udp_client_mcast_recv(session, p, addr, port);
+        goto cleanup;
+    }
+
     if (!ip_addr_cmp_zoneless(addr, &(session->server_addr)))
     {
         LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("UDP client rx from invalid address\n"));
@@ -621,14 +1269,19 @@ cleanup:
         pbuf_free(p);
     }
 }
-
-mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args)
+/**
+ * Allocate and initialise a UDP client stream.
+ *
+ * @param args      Iperf client arguments.
+ * @param session   Receives the new stream on success.
+ *
+ * @returns @c ERR_OK on success else an appropriate error code.
+ */
+static err_t iperf_udp_client_create(const struct mmiperf_client_args *args,
+                                     struct iperf_client_state_udp **session)
 {
-    LOCK_TCPIP_CORE();
-
     struct udp_pcb *pcb;
     struct iperf_client_state_udp *s;
-    mmiperf_handle_t result = NULL;
     int ok;
     uint32_t pkt_size = 0;
     err_t err = ERR_VAL;
@@ -638,7 +1291,7 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
     s = (struct iperf_client_state_udp *)IPERF_ALLOC(struct iperf_client_state_udp);
     if (s == NULL)
     {
-        goto exit;
+        return ERR_MEM;
     }
 
     memset(s, 0, sizeof(*s));
@@ -689,6 +1342,14 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
         s->pcb = NULL;
         goto exit;
     }
+    if (iperf_frame_mode(&s->args) &&
+        s->args.packet_size <= iperf_udp_hdrs_len(s->args.version) +
+                               sizeof(struct iperf_frame_header))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("packet size too small for frame mode.\n"));
+        s->pcb = NULL;
+        goto exit;
+    }
 
     /* We use a counter across a range of local ports so we don't use the same port for subsequent
      * iterations. */
@@ -696,17 +1357,25 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
     (void)atomic_fetch_add(&session_counter, 1);
     s->local_port = IPERF_UDP_CLIENT_LOCAL_PORT_RANGE_BASE +
                     (session_counter & (IPERF_UDP_CLIENT_LOCAL_PORT_RANGE_SIZE - 1));
-    s->report_semb = mmosal_semb_create("iperf_udp");
 
     s->base.report.report_type = MMIPERF_INTERRIM_REPORT;
     s->base.time_started_ms = mmosal_get_time_ms();
+    iperf_resource_start(&s->base);
     s->base.report_fn = args->report_fn;
     s->base.report_arg = args->report_arg;
+    if (s->args.mode == MMIPERF_CLIENT_MODE_REVERSE)
+    {
+        /* Only the receive direction is reported. */
+        s->base.report_fn = NULL;
+    }
+    iperf_udp_client_settings_init(&s->settings, &s->args);
+    iperf_payload_source_init(&s->payload, &s->args);
 
     /* Create PCB to receive response from server */
     pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
     if (pcb == NULL)
     {
+        err = ERR_MEM;
         goto exit;
     }
 
@@ -725,26 +1394,220 @@ mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args
 
     if (err != ERR_OK)
     {
+        udp_remove(pcb);
         goto exit;
     }
 
+    s->report_semb = mmosal_semb_create("iperf_udp");
+    if (s->report_semb == NULL)
+    {
+        udp_remove(pcb);
+        err = ERR_MEM;
+        goto exit;
+    }
+
+    if (s->args.multicast_reports && ip_addr_ismulticast(&s->server_addr))
+    {
+        s->mcast_receivers =
+            (struct iperf_mcast_receivers *)IPERF_ALLOC(struct iperf_mcast_receivers);
+        if (s->mcast_receivers == NULL)
+        {
+            mmosal_semb_delete(s->report_semb);
+            udp_remove(pcb);
+            err = ERR_MEM;
+            goto exit;
+        }
+        memset(s->mcast_receivers, 0, sizeof(*s->mcast_receivers));
+    }
+
     udp_recv(pcb, iperf_udp_client_recv, s);
 
     s->pcb = pcb;
 
-    iperf_list_add(&s->base);
+    *session = s;
+    return ERR_OK;
 
-    s->task = mmosal_task_create(iperf_udp_client_task, s, MMOSAL_TASK_PRI_LOW,
-                                 MMIPERF_STACK_SIZE, "iperf_udp");
-    MMOSAL_ASSERT(s->task != NULL);
-    result = &(s->base);
-    s = NULL;
+exit:
+    IPERF_FREE(struct iperf_client_state_udp, s);
+    return err;
+}
+
+/** Release a UDP client stream that has not been started. */
+static void iperf_udp_client_destroy(struct iperf_client_state_udp *session)
+{
+    LWIP_ASSERT_CORE_LOCKED();
+
+    udp_remove(session->pcb);
+    mmosal_semb_delete(session->report_semb);
+    if (session->mcast_receivers != NULL)
+    {
+        IPERF_FREE(struct iperf_mcast_receivers, session->mcast_receivers);
+    }
+    IPERF_FREE(struct iperf_client_state_udp, session);
+}
+
+/**
+ * Start listening for the remote server to send the receive direction of a bidirectional test.
+ * The caller must hold the TCPIP core lock.
+ */
+static err_t iperf_udp_client_start_reverse_server(struct iperf_client_state_udp *session)
+{
+    err_t err;
+    struct iperf_server_state_udp *srv = NULL;
+    struct mmiperf_server_args server_args = MMIPERF_SERVER_ARGS_DEFAULT;
+
+    server_args.local_port = MMIPERF_DEFAULT_PORT;
+    server_args.report_fn = session->args.report_fn;
+    server_args.report_arg = session->args.report_arg;
+    server_args.version = session->args.version;
+
+    err = iperf_start_udp_server_impl(&server_args, &srv);
+    if (err == ERR_USE)
+    {
+        /* An iperf server is already listening on this port; it will receive the test. */
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_WARNING, ("Using existing UDP server for reverse test\n"));
+        return ERR_OK;
+    }
+    if (err != ERR_OK)
+    {
+        return err;
+    }
+
+    /* make this server accept sessions from the remote server only */
+    srv->specific_remote = 1;
+    srv->remote_addr = session->server_addr;
+    session->reverse_server = srv;
+    return ERR_OK;
+}
+
+/**
+ * Start a UDP client test. The caller must hold the TCPIP core lock.
+ *
+ * @param args  Iperf client arguments.
+ *
+ * @returns a handle to the client on success, or @c NULL on failure.
+ */
+static mmiperf_handle_t iperf_udp_client_start_impl(const struct mmiperf_client_args *args)
+{
+    struct iperf_client_state_udp *first_stream = NULL;
+    struct iperf_client_state_udp **next_stream = &first_stream;
+    struct iperf_client_state_udp *session;
+    struct iperf_stream_group *group = NULL;
+    struct mmosal_task *task;
+    mmiperf_handle_t result = NULL;
+    uint32_t num_streams = args->num_streams > 1 ? args->num_streams : 1;
+    uint32_t ii;
+
+    LWIP_ASSERT_CORE_LOCKED();
+
+    if (num_streams > MMIPERF_MAX_STREAMS ||
+        (num_streams > 1 && args->mode != MMIPERF_CLIENT_MODE_NORMAL) ||
+        ((iperf_frame_mode(args) || args->multicast_reports) &&
+         (num_streams > 1 || args->mode != MMIPERF_CLIENT_MODE_NORMAL)))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Unsupported UDP client configuration\n"));
+        return NULL;
+    }
+
+    if (num_streams > 1)
+    {
+        group = iperf_stream_group_alloc(0, args);
+        if (group == NULL)
+        {
+            goto exit;
+        }
+    }
+
+    for (ii = 0; ii < num_streams; ii++)
+    {
+        session = NULL;
+        if (iperf_udp_client_create(args, &session) != ERR_OK)
+        {
+            goto exit;
+        }
+        *next_stream = session;
+        next_stream = &session->next_stream;
+    }
+
+    if (args->mode != MMIPERF_CLIENT_MODE_NORMAL &&
+        iperf_udp_client_start_reverse_server(first_stream) != ERR_OK)
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Failed to start UDP server for reverse test\n"));
+        goto exit;
+    }
+
+    for (session = first_stream; session != NULL; session = session->next_stream)
+    {
+        if (group != NULL)
+        {
+            iperf_stream_group_add(group, &session->base);
+        }
+        if (!iperf_list_add(&session->base))
+        {
+            LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Too many iperf sessions\n"));
+            goto exit;
+        }
+    }
+    if (group != NULL && !iperf_list_add(&group->base))
+    {
+        LWIP_DEBUGF(LWIP_DBG_LEVEL_SERIOUS, ("Too many iperf sessions\n"));
+        goto exit;
+    }
+
+    task = mmosal_task_create(iperf_udp_client_task, first_stream, MMOSAL_TASK_PRI_LOW,
+                              MMIPERF_STACK_SIZE, "iperf_udp");
+    if (task == NULL)
+    {
+        goto exit;
+    }
+
+    for (session = first_stream; session != NULL; session = session->next_stream)
+    {
+        session->task = task;
+    }
+
+    if (group != NULL)
+    {
+        result = group->base.handle;
+    }
+    else
+    {
+        result = first_stream->base.handle;
+    }
+    first_stream = NULL;
+    group = NULL;
 
 exit:
-    if (s != NULL)
+    while (first_stream != NULL)
     {
-        IPERF_FREE(struct iperf_client_state_udp, s);
+        session = first_stream;
+        first_stream = session->next_stream;
+        if (session->reverse_server != NULL)
+        {
+            iperf_udp_server_close(session->reverse_server);
+        }
+        iperf_list_remove(&session->base);
+        iperf_udp_client_destroy(session);
+    }
+    if (group != NULL)
+    {
+        iperf_list_remove(&group->base);
+        IPERF_FREE(struct iperf_stream_group, group);
+    }
+    return result;
+}
+
+mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args)
+{
+    mmiperf_handle_t result;
+
+    if (args->version == IPERF_VERSION_3)
+    {
+        return iperf3_start_client(args, true);
     }
+
+    LOCK_TCPIP_CORE();
+    result = iperf_udp_client_start_impl(args);
     UNLOCK_TCPIP_CORE();
     return result;
 }
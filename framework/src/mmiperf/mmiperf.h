@@ -32,6 +32,8 @@ extern "C" {
 
 /** Default port for TCP and UDP iperf. */
 #define MMIPERF_DEFAULT_PORT                (5001)
+/** Default port for iperf3 (see @c IPERF_VERSION_3). */
+#define MMIPERF3_DEFAULT_PORT               (5201)
 /** Default packet size for @c IPv4 UDP iperf. */
 #define MMIPERF_DEFAULT_UDP_PACKET_SIZE_V4  (1460)
 /** Default packet size for @c IPv4 UDP iperf. */
@@ -41,10 +43,32 @@ extern "C" {
 #define MMIPERF_DEFAULT_AMOUNT              (-1000)
 /** Default bandwidth limit for iperf (in kbps) */
 #define MMIPERF_DEFAULT_BANDWIDTH           (0)
+/** Default maximum delay of a coalesced TCP receive window update (in milliseconds). */
+#define MMIPERF_DEFAULT_RX_WINDOW_UPDATE_MS (20)
 
 /** Maximum length of an IP address string including null-terminator. */
 #define MMIPERF_IPADDR_MAXLEN               (48)
 
+/** Maximum number of parallel streams for a single iperf client. */
+#define MMIPERF_MAX_STREAMS                 (8)
+
+/** Value of @ref mmiperf_report::stream_id for the aggregate (SUM) report of a parallel test. */
+#define MMIPERF_STREAM_ID_SUM               (0xff)
+
+/**
+ * Number of buckets in the frame latency histogram of a report (see
+ * @ref mmiperf_report::frame_latency_hist).
+ */
+#define MMIPERF_FRAME_LATENCY_BUCKETS       (12)
+
+/** Maximum number of CPU cores reported in @ref mmiperf_report::cpu_load_permille. */
+#define MMIPERF_MAX_CPU_CORES               (2)
+
+#ifndef MMIPERF_MAX_MCAST_RECEIVERS
+/** Maximum number of receivers whose reports are collected by a multicast UDP client. */
+#define MMIPERF_MAX_MCAST_RECEIVERS         (32)
+#endif
+
 #ifndef MMIPERF_STACK_SIZE
 /** Default stack to use for MMIPERF tasks. */
 #define MMIPERF_STACK_SIZE 512
@@ -91,11 +115,61 @@ enum iperf_version
     IPERF_VERSION_2_0_13,
     /** Iperf version 2.0.9 */
     IPERF_VERSION_2_0_9,
+    /**
+     * iperf3. This uses the iperf3 control protocol so that tests can be run against a stock
+     * iperf3 client or server. iperf3 tests run for a whole number of seconds and only the
+     * normal and reverse (iperf3 @c -R) client modes are supported. An iperf3 server accepts
+     * both TCP and UDP tests (including reverse tests) and is started with
+     * @ref mmiperf_start_tcp_server(). If the port is zero then @ref MMIPERF3_DEFAULT_PORT is
+     * used.
+     *
+     * The iperf3 server does not support bidirectional tests (iperf3 @c --bidir) or UDP tests
+     * with more than one stream (iperf3 @c -u @c -P with a count above one). The client is
+     * refused with an access denied or "too many streams" error respectively.
+     */
+    IPERF_VERSION_3,
 };
 
-/** Iperf client/server handle. */
+/** Enumeration of iperf client modes. */
+enum mmiperf_client_mode
+{
+    /** Unidirectional test: transmit only. */
+    MMIPERF_CLIENT_MODE_NORMAL,
+    /** Bidirectional test with both directions running simultaneously (iperf @c -d). */
+    MMIPERF_CLIENT_MODE_DUAL,
+    /** Bidirectional test with each direction run individually, the server transmitting after
+     *  the client has finished (iperf @c -r). */
+    MMIPERF_CLIENT_MODE_TRADEOFF,
+    /** Receive only: the server transmits to this device. For iperf2 this is a tradeoff test in
+     *  which the client sends no data of its own, so the remote iperf2 server must support
+     *  tradeoff tests, and it is only supported by the UDP client. For iperf3 this is a reverse
+     *  test (iperf3 @c -R) and is supported by both the TCP and UDP clients. */
+    MMIPERF_CLIENT_MODE_REVERSE,
+};
+
+/**
+ * Iperf client/server handle. This is an opaque value that identifies a session; it is not a
+ * pointer that can be dereferenced.
+ */
 typedef struct mmiperf_state *mmiperf_handle_t;
 
+/** Loss and jitter summary reported back by one receiver of a multicast UDP test. */
+struct mmiperf_mcast_receiver
+{
+    /** IP address of the receiver (as a string). */
+    char addr[MMIPERF_IPADDR_MAXLEN];
+    /** Number of datagrams received. */
+    uint32_t rx_frames;
+    /** Number of datagrams the receiver detected as lost from gaps in the sequence numbers. */
+    uint32_t error_count;
+    /** Number of datagrams received out of order. */
+    uint32_t out_of_sequence_frames;
+    /** Interarrival jitter measured by the receiver, in microseconds. */
+    uint32_t jitter_us;
+    /** Fraction of the datagrams sent that the receiver received, in thousandths. */
+    uint16_t delivery_permille;
+};
+
 /** Report data structure. */
 struct mmiperf_report
 {
@@ -126,12 +200,130 @@ struct mmiperf_report
     /** Number of inter-packet gaps (UDP only). */
     uint32_t ipg_count;
     /**
-     * Sum of inter-packet gaps (UDP only).
+     * Sum of inter-packet gaps in milliseconds (UDP only).
      *
      * @note That this is not strictly the inter-packet gap, but rather the gap between
      *       packet start times.
      */
     uint32_t ipg_sum_ms;
+    /** Sum of inter-packet gaps in microseconds (UDP only). See @ref ipg_sum_ms. */
+    uint64_t ipg_sum_us;
+    /** Index of the stream this report is for in a parallel test, or @ref MMIPERF_STREAM_ID_SUM
+     *  for the aggregate of all streams. Zero for single stream tests. */
+    uint8_t stream_id;
+    /**
+     * Number of datagrams included in the one-way latency statistics below. These are only
+     * collected by a UDP server with @ref mmiperf_server_args::trip_times set.
+     */
+    uint32_t latency_count;
+    /** Median one-way latency in microseconds. */
+    uint32_t latency_p50_us;
+    /** 90th percentile one-way latency in microseconds. */
+    uint32_t latency_p90_us;
+    /** 99th percentile one-way latency in microseconds. */
+    uint32_t latency_p99_us;
+    /** Maximum one-way latency in microseconds. */
+    uint32_t latency_max_us;
+    /**
+     * Number of received segments (TCP receive calls or UDP datagrams) whose payload was
+     * verified. Payload verification is enabled with @ref mmiperf_server_args::verify_payload.
+     */
+    uint32_t verify_segments;
+    /** Number of verified segments that contained at least one corrupted byte. */
+    uint32_t verify_corrupted_segments;
+    /** Total number of corrupted payload bytes. */
+    uint64_t verify_corrupted_bytes;
+    /**
+     * Time spent verifying payload data in microseconds. Compare with @ref duration_ms to gauge
+     * the overhead of verification.
+     */
+    uint64_t verify_time_us;
+    /**
+     * Number of frames delivered in isochronous frame mode (see
+     * @ref mmiperf_client_args::frame_period_ms). For TCP these are collected by the client and a
+     * frame is delivered once its last byte has been acknowledged. For UDP these are collected
+     * by the server and a frame is delivered once all of its datagrams have been received.
+     */
+    uint32_t frame_count;
+    /**
+     * Number of frames that missed their deadline. This includes frames that were never
+     * delivered (e.g., because a datagram was lost).
+     */
+    uint32_t frame_deadline_misses;
+    /** Mean frame delivery latency in microseconds. */
+    uint32_t frame_latency_mean_us;
+    /** Maximum frame delivery latency in microseconds. */
+    uint32_t frame_latency_max_us;
+    /**
+     * Histogram of frame delivery latency. Bucket 0 counts frames delivered in under 1 ms and
+     * bucket n counts frames delivered in 2^(n-1) ms up to 2^n ms. The last bucket also counts
+     * all longer latencies.
+     */
+    uint32_t frame_latency_hist[MMIPERF_FRAME_LATENCY_BUCKETS];
+    /**
+     * Number of CPU cores in @ref cpu_load_permille, or zero if CPU utilisation is not
+     * available (on ESP-IDF this requires @c CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS).
+     */
+    uint8_t cpu_num_cores;
+    /**
+     * Utilisation of each CPU core over the test in tenths of a percent, i.e., the proportion
+     * of time that the core was not idle. This is system wide so includes any other load.
+     */
+    uint16_t cpu_load_permille[MMIPERF_MAX_CPU_CORES];
+    /**
+     * CPU cost of the test: the sum of @ref cpu_load_permille over all cores divided by the
+     * throughput in Mbps. For example, 250 means that each Mbps of throughput kept a quarter of
+     * a core busy. Zero if CPU utilisation is not available or nothing was transferred.
+     */
+    uint32_t cpu_permille_per_mbps;
+    /** Total size of the heap in bytes. */
+    uint32_t heap_total_size;
+    /**
+     * Peak heap usage in bytes. The heap is sampled periodically while iperf sessions are
+     * running so short-lived peaks may be missed.
+     *
+     * @note The heap and packet memory peaks are system wide and are tracked from the start of
+     *       the most recently started iperf session, so concurrent tests share them.
+     */
+    uint32_t heap_peak_used;
+    /** Peak number of transmit packet memory buffers (mmpkts) allocated at once. */
+    uint16_t pktmem_tx_peak;
+    /** Number of transmit packet memory buffers available. */
+    uint16_t pktmem_tx_capacity;
+    /** Peak number of receive packet memory buffers (mmpkts) allocated at once. */
+    uint16_t pktmem_rx_peak;
+    /** Number of receive packet memory buffers available. */
+    uint16_t pktmem_rx_capacity;
+    /**
+     * Interarrival jitter of the received datagrams in microseconds, as defined by RFC 3550.
+     * Measured by UDP servers; for UDP clients this is taken from the server report.
+     */
+    uint32_t jitter_us;
+    /**
+     * Number of receivers that reported back in a multicast test (see
+     * @ref mmiperf_client_args::multicast_reports). The other @c mcast_ fields are only valid if
+     * this is non-zero.
+     */
+    uint16_t mcast_num_receivers;
+    /**
+     * Number of receivers that reported back but were left out because
+     * @ref MMIPERF_MAX_MCAST_RECEIVERS had already reported.
+     */
+    uint16_t mcast_receivers_dropped;
+    /** Lowest delivery ratio of any receiver, in thousandths. */
+    uint16_t mcast_delivery_min_permille;
+    /** Mean delivery ratio across all receivers, in thousandths. */
+    uint16_t mcast_delivery_mean_permille;
+    /** Highest jitter reported by any receiver, in microseconds. */
+    uint32_t mcast_jitter_max_us;
+    /** IP address of the receiver with the lowest delivery ratio (as a string). */
+    char mcast_worst_receiver_addr[MMIPERF_IPADDR_MAXLEN];
+    /**
+     * The individual receiver reports (@ref mcast_num_receivers entries). This is only set in the
+     * final report passed to the report callback and is only valid for the duration of the
+     * callback; it is @c NULL otherwise.
+     */
+    const struct mmiperf_mcast_receiver *mcast_receivers;
 };
 
 /**
@@ -144,6 +336,21 @@ struct mmiperf_report
 typedef void (*mmiperf_report_fn)(const struct mmiperf_report *report, void *arg,
                                   mmiperf_handle_t handle);
 
+/**
+ * Payload generator callback function prototype.
+ *
+ * The callback may be invoked more than once for the same offset (e.g., when the network stack
+ * has no room for the data), so the data it generates must depend only on the offset. For lwIP
+ * it is invoked from the TCP/IP thread and so must not block.
+ *
+ * @param offset    Offset of the first byte to generate within the payload data of the stream.
+ *                  The payload data starts at offset zero and does not include iperf headers.
+ * @param buf       Buffer to fill with payload data.
+ * @param len       Number of bytes to write to @p buf.
+ * @param arg       Opaque argument given when the iperf client was started.
+ */
+typedef void (*mmiperf_payload_fn)(uint64_t offset, uint8_t *buf, uint32_t len, void *arg);
+
 /**
  * Iperf client arguments data structure.
  *
@@ -176,6 +383,72 @@ struct mmiperf_client_args
     void *report_arg;
     /** Iperf version used to parse packet header. */
     enum iperf_version version;
+    /**
+     * Test mode. For the bidirectional modes the server connects back to this device on
+     * @ref MMIPERF_DEFAULT_PORT and the report callback is invoked once for each direction
+     * (@c MMIPERF_TCP_DONE_CLIENT or @c MMIPERF_UDP_DONE_CLIENT for the transmit direction and
+     * @c MMIPERF_TCP_DONE_SERVER or @c MMIPERF_UDP_DONE_SERVER for the receive direction). In
+     * the reverse mode only the receive direction is reported. For UDP tests the remote side
+     * transmits with the same packet size, bandwidth limit and amount as this client.
+     */
+    enum mmiperf_client_mode mode;
+    /**
+     * Number of parallel streams to run (iperf @c -P), up to @ref MMIPERF_MAX_STREAMS. All
+     * streams share a single test clock and are scheduled from a single task. The report
+     * callback is invoked for each stream and then once more with the aggregate of all streams
+     * (@ref mmiperf_report::stream_id is set to @ref MMIPERF_STREAM_ID_SUM). Bandwidth limits and
+     * byte amounts apply to each stream individually. Parallel streams may not be combined with
+     * the bidirectional modes.
+     */
+    uint32_t num_streams;
+    /**
+     * Buffer of payload data to send in place of the default data pattern (e.g., captured
+     * sensor or image data), or @c NULL to use the default pattern. Data is taken from the buffer
+     * in order, wrapping back to the start at the end of the buffer. Where the network stack
+     * allows, data is sent straight from the buffer without being copied, so the buffer must
+     * remain valid and unchanged until the test has completed. Note that a server verifying the
+     * payload (@ref mmiperf_server_args::verify_payload) will report this data as corrupt.
+     */
+    const uint8_t *payload_buf;
+    /** Length of @ref payload_buf in bytes. */
+    uint32_t payload_len;
+    /**
+     * Callback to generate the payload data in place of the default data pattern, or @c NULL.
+     * Ignored if @ref payload_buf is set. Generated data always has to be copied, so a stable
+     * @ref payload_buf should be preferred where the data allows.
+     */
+    mmiperf_payload_fn payload_fn;
+    /** Opaque argument to pass to the payload callback. May be @c NULL. */
+    void *payload_arg;
+    /**
+     * Length in bytes of each frame in isochronous frame mode. See @ref frame_period_ms.
+     */
+    uint32_t frame_len;
+    /**
+     * Frame period in milliseconds. If this and @ref frame_len are non-zero then instead of
+     * sending as fast as the bandwidth limit allows, the client sends a burst of
+     * @ref frame_len bytes every @ref frame_period_ms (e.g., a camera frame every 100 ms) and
+     * measures the delivery latency of each frame from its scheduled start time; see
+     * @ref mmiperf_report::frame_count. The bandwidth limit is ignored in this mode. Only
+     * supported for iperf2 tests in the normal mode with a single stream. For UDP each frame is
+     * split into datagrams of up to @ref packet_size bytes, each with a small frame header at
+     * the start of its payload, and the statistics are reported by an mmiperf UDP server.
+     */
+    uint32_t frame_period_ms;
+    /**
+     * Deadline in milliseconds by which each frame should be delivered, measured from its
+     * scheduled start time. If zero then the frame period is used.
+     */
+    uint32_t frame_deadline_ms;
+    /**
+     * When sending a UDP test to a multicast group, ask each receiver to unicast a summary of
+     * its loss and jitter back to this client once the test is over. Receivers spread their
+     * replies over a short period so as not to flood the client. The final report then includes
+     * per-receiver delivery ratios and the worst-case receiver (see
+     * @ref mmiperf_report::mcast_num_receivers). Only mmiperf UDP servers send these summaries.
+     * Only supported for iperf2 tests in the normal mode with a single stream.
+     */
+    bool multicast_reports;
 };
 
 /** Initializer for @ref mmiperf_client_args. */
@@ -183,7 +456,8 @@ struct mmiperf_client_args
     {                                                                                             \
         { 0 }, MMIPERF_DEFAULT_PORT, MMIPERF_DEFAULT_BANDWIDTH,                                   \
         0, MMIPERF_DEFAULT_AMOUNT, NULL,                                                          \
-        NULL, IPERF_VERSION_2_0_13,                                                               \
+        NULL, IPERF_VERSION_2_0_13, MMIPERF_CLIENT_MODE_NORMAL, 1,                                \
+        NULL, 0, NULL, NULL, 0, 0, 0, false,                                                      \
     }
 
 /**
@@ -208,12 +482,42 @@ struct mmiperf_server_args
     void *report_arg;
     /** Iperf version used to parse packet header. */
     enum iperf_version version;
+    /**
+     * Measure the one-way latency of each received datagram from its transmit timestamp (in the
+     * style of iperf @c --trip-times) and report its percentiles. Only supported by the UDP
+     * server. The results are only meaningful if the clocks of the client and server are
+     * synchronised (see @ref mmiperf_set_clock_offset_us()).
+     */
+    bool trip_times;
+    /**
+     * Verify the payload of received data against the data pattern sent by mmiperf clients and
+     * count corrupted bytes (see @ref mmiperf_report::verify_corrupted_bytes). This is intended
+     * to detect data corruption (for example, bit errors on the host interface) and does not
+     * abort the test. Only supported by the iperf2 TCP and UDP servers. Data sent by other iperf
+     * implementations may not use the same pattern, in which case it will be reported as
+     * corrupted.
+     */
+    bool verify_payload;
+    /**
+     * Coalesce TCP receive window updates: received data is only handed back to the TCP window
+     * once at least this many bytes have accumulated, or @c rx_window_update_ms after the first
+     * of them was received, whichever comes first. This reduces the number of window updates
+     * and ACKs sent on links with small segments. Zero updates the window for every segment
+     * received. The threshold is limited to half of the TCP window. Only supported by the lwIP
+     * iperf2 TCP server.
+     */
+    uint32_t rx_window_update_bytes;
+    /**
+     * Maximum time to hold back a window update when @c rx_window_update_bytes is non-zero,
+     * in milliseconds. If zero then @ref MMIPERF_DEFAULT_RX_WINDOW_UPDATE_MS will be used.
+     */
+    uint32_t rx_window_update_ms;
 };
 
 /** Initializer for @ref mmiperf_server_args. */
 #define MMIPERF_SERVER_ARGS_DEFAULT                                                             \
     {                                                                                           \
-        { 0 }, MMIPERF_DEFAULT_PORT, NULL, NULL, IPERF_VERSION_2_0_13,                          \
+        { 0 }, MMIPERF_DEFAULT_PORT, NULL, NULL, IPERF_VERSION_2_0_13, false, false, 0, 0,      \
     }
 
 /**
@@ -221,7 +525,8 @@ struct mmiperf_server_args
  *
  * @param args  Iperf client arguments.
  *
- * @returns a handle to the client on success, or @c NULL on failure.
+ * @returns a handle to the client on success, or @c NULL on failure. For a parallel test this
+ *          is a handle to the aggregate of all streams.
  */
 mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args);
 
@@ -239,24 +544,42 @@ mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args
  *
  * @param args  Iperf client arguments.
  *
- * @returns a handle to the client on success, or @c NULL on failure.
+ * @returns a handle to the client on success, or @c NULL on failure. For a parallel test this
+ *          is a handle to the aggregate of all streams.
  */
 mmiperf_handle_t mmiperf_start_tcp_client(const struct mmiperf_client_args *args);
 
 /**
  * Start a TCP iperf server.
  *
+ * If a client requests a bidirectional test the server will connect back to the client, either
+ * immediately (iperf @c -d) or once the client has finished transmitting (iperf @c -r). The
+ * transmit direction is reported separately with a report type of @c MMIPERF_TCP_DONE_CLIENT.
+ *
  * @param args  Iperf server arguments.
  *
  * @returns a handle to the server on success, or @c NULL on failure.
  */
 mmiperf_handle_t mmiperf_start_tcp_server(const struct mmiperf_server_args *args);
 
+/**
+ * Stop an iperf server and release its resources.
+ *
+ * Only iperf3 servers (@c IPERF_VERSION_3) can be stopped. The server stops asynchronously: a
+ * test in progress is terminated and the server's handle becomes stale shortly afterwards.
+ *
+ * @param handle    Handle of the server to stop.
+ *
+ * @returns @c true if the server is stopping, or @c false if the handle is invalid or the
+ *          server cannot be stopped.
+ */
+bool mmiperf_stop_server(mmiperf_handle_t handle);
+
 /**
  * Retrieve report for an in progress iperf session.
  *
- * This shall not be called after the report callback has been received for the given
- * session.
+ * This may be called from any task. Once the session has finished the handle becomes stale
+ * and this returns @c false, even if another session has been started since.
  *
  * @param handle    Handle to the iperf session to retrieve the report for.
  * @param report    Pointer to a report instance to receive the report.
@@ -265,6 +588,17 @@ mmiperf_handle_t mmiperf_start_tcp_server(const struct mmiperf_server_args *args
  */
 bool mmiperf_get_interim_report(mmiperf_handle_t handle, struct mmiperf_report *report);
 
+/**
+ * Set the offset between the system clock and the clock used for UDP packet timestamps.
+ *
+ * UDP packets are timestamped using @ref mmosal_get_time_us(), which counts from boot. To
+ * measure one-way latency against a remote iperf, which uses the wall clock, the application
+ * should set this to the wall clock time at boot (e.g., once SNTP has synchronised).
+ *
+ * @param offset_us     Offset to add to @ref mmosal_get_time_us() in microseconds.
+ */
+void mmiperf_set_clock_offset_us(int64_t offset_us);
+
 #ifdef __cplusplus
 }
 #endif
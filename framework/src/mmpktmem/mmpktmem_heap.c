@@ -13,6 +13,8 @@
 #include "mmpkt_list.h"
 #include "mmutils.h"
 
+#include "esp_heap_caps.h"
+
 /* MMPKTMEM_TX_POOL_N_BLOCKS and MMPKTMEM_RX_POOL_N_BLOCKS provide an upper bound on the number
  * of packets we will allocate in the transmit and receive directions respectively. */
 
@@ -36,6 +38,18 @@
 #define MMPKT_LOG(...) printf(__VA_ARGS__)
 #endif
 
+#ifndef MMPKTMEM_DMA_ALIGNMENT
+/**
+ * Alignment in bytes of packet buffers. This should be at least the alignment required by the SPI
+ * DMA engine (4 bytes), or the cache line size if packet memory may be placed in external RAM.
+ */
+#define MMPKTMEM_DMA_ALIGNMENT (4)
+#endif
+
+MM_STATIC_ASSERT((MMPKTMEM_DMA_ALIGNMENT & (MMPKTMEM_DMA_ALIGNMENT - 1)) == 0 &&
+                 MMPKTMEM_DMA_ALIGNMENT >= 4 && MMPKTMEM_DMA_ALIGNMENT <= TX_COMMAND_POOL_BLOCK_SIZE,
+                 "MMPKTMEM_DMA_ALIGNMENT must be a power of 2 between 4 and the command block size");
+
 struct pktmem_data
 {
     /** Count of allocated tx packets (excluding command pool -- see below). */
@@ -44,11 +58,18 @@ struct pktmem_data
     volatile atomic_uint_fast8_t tx_data_pool_tx_paused;
     /** Count of allocated rx packets. */
     volatile atomic_int_least32_t rx_pool_allocated;
+    /** Peak value of @c tx_data_pool_allocated since the last reset. */
+    volatile atomic_int_least32_t tx_data_pool_peak;
+    /** Peak value of @c rx_pool_allocated since the last reset. */
+    volatile atomic_int_least32_t rx_pool_peak;
+    /** Total number of rx packets allocated. */
+    volatile atomic_uint_least32_t rx_pool_total;
 
     /** Command pool free (unallocated) packet list. */
     struct mmpkt_list tx_command_pool_free_list;
     /** Statically allocated memory for the command pool. */
-    uint8_t tx_command_pool[TX_COMMAND_POOL_BLOCK_SIZE * TX_COMMAND_POOL_N_BLOCKS];
+    uint8_t tx_command_pool[TX_COMMAND_POOL_BLOCK_SIZE * TX_COMMAND_POOL_N_BLOCKS]
+        __attribute__((aligned(MMPKTMEM_DMA_ALIGNMENT)));
 
     /** Flow control callback function pointer. */
     mmhal_wlan_pktmem_tx_flow_control_cb_t tx_flow_control_cb;
@@ -103,6 +124,136 @@ void mmhal_wlan_pktmem_deinit(void)
     }
 }
 
+/** Raise the given peak allocation count to @p value if it is higher. */
+static void update_peak(volatile atomic_int_least32_t *peak, int_least32_t value)
+{
+    int_least32_t old_peak = atomic_load(peak);
+    while (value > old_peak && !atomic_compare_exchange_weak(peak, &old_peak, value))
+    {
+    }
+}
+
+void mmhal_wlan_pktmem_get_stats(struct mmhal_wlan_pktmem_stats *stats, bool reset_peak)
+{
+    stats->tx_allocated = pktmem.tx_data_pool_allocated;
+    stats->tx_capacity = MMPKTMEM_TX_POOL_N_BLOCKS;
+    stats->rx_allocated = pktmem.rx_pool_allocated;
+    stats->rx_capacity = MMPKTMEM_RX_POOL_N_BLOCKS;
+    stats->rx_total = pktmem.rx_pool_total;
+    if (reset_peak)
+    {
+        stats->tx_peak = atomic_exchange(&pktmem.tx_data_pool_peak,
+                                         pktmem.tx_data_pool_allocated);
+        stats->rx_peak = atomic_exchange(&pktmem.rx_pool_peak, pktmem.rx_pool_allocated);
+    }
+    else
+    {
+        stats->tx_peak = pktmem.tx_data_pool_peak;
+        stats->rx_peak = pktmem.rx_pool_peak;
+    }
+}
+
+/*
+ * --------------------------------------------------------------------------------------
+ *     Aligned packet layout
+ * --------------------------------------------------------------------------------------
+ */
+
+/*
+ * Packets are laid out so that the buffer handed to the SPI driver is DMA-capable and aligned
+ * to MMPKTMEM_DMA_ALIGNMENT, allowing the driver to transfer it in place rather than copying it
+ * to a bounce buffer. The headroom starts at the aligned start of the buffer, so the frame is
+ * aligned once all of the requested headroom has been prepended. For receive packets there is no
+ * headroom, so the data itself starts at the aligned start of the buffer.
+ *
+ *      +--------+------------------+--------------------+---------------+----------+
+ *      | mmpkt  | space_at_start   | space_at_end       | (round up)    | metadata |
+ *      +--------+------------------+--------------------+---------------+----------+
+ *      ^        ^                  ^
+ *    block     buf (aligned)   start_offset
+ */
+
+/** Size of the mmpkt header, rounded up so that the buffer following it is aligned. */
+#define PKTMEM_HEADER_SIZE MM_FAST_ROUND_UP(sizeof(struct mmpkt), MMPKTMEM_DMA_ALIGNMENT)
+
+/** Size of the data buffer for the given reservations. */
+static inline uint32_t pktmem_buf_len(uint32_t space_at_start, uint32_t space_at_end)
+{
+    return MM_FAST_ROUND_UP(space_at_start + space_at_end, MMPKTMEM_DMA_ALIGNMENT);
+}
+
+/** Total size of a block holding a packet with the given reservations. */
+static inline uint32_t pktmem_block_len(uint32_t space_at_start, uint32_t space_at_end,
+                                        uint32_t metadata_length)
+{
+    return PKTMEM_HEADER_SIZE + pktmem_buf_len(space_at_start, space_at_end) +
+           MM_FAST_ROUND_UP(metadata_length, 4);
+}
+
+/**
+ * Initialize an mmpkt in the given block using the aligned layout.
+ *
+ * @param block             Block to initialize. Must be aligned to @c MMPKTMEM_DMA_ALIGNMENT.
+ * @param block_len         Length of @p block.
+ * @param space_at_start    Amount of space to reserve at start of buffer.
+ * @param space_at_end      Amount of space to reserve at end of buffer.
+ * @param metadata_length   Size of metadata (0 for no metadata).
+ * @param ops               Operations data structure.
+ *
+ * @returns a pointer to the initialized @c mmpkt (will be the same address as @p block) or
+ *          @c NULL if @p block is too short.
+ */
+static struct mmpkt *pktmem_init_aligned(uint8_t *block, uint32_t block_len,
+                                         uint32_t space_at_start, uint32_t space_at_end,
+                                         uint32_t metadata_length, const struct mmpkt_ops *ops)
+{
+    struct mmpkt *mmpkt = (struct mmpkt *)block;
+    uint32_t buf_len = pktmem_buf_len(space_at_start, space_at_end);
+    uint8_t *buf = block + PKTMEM_HEADER_SIZE;
+
+    metadata_length = MM_FAST_ROUND_UP(metadata_length, 4);
+    if (PKTMEM_HEADER_SIZE + buf_len + metadata_length > block_len)
+    {
+        return NULL;
+    }
+
+    mmpkt_init(mmpkt, buf, buf_len, space_at_start, ops);
+
+    /* The frame starts here once all of the requested headroom has been prepended. */
+    MMOSAL_ASSERT(((uintptr_t)(mmpkt->buf + mmpkt->start_offset - space_at_start) &
+                   (MMPKTMEM_DMA_ALIGNMENT - 1)) == 0);
+
+    if (metadata_length != 0)
+    {
+        mmpkt->metadata.opaque = buf + buf_len;
+        memset(mmpkt->metadata.opaque, 0, metadata_length);
+    }
+
+    return mmpkt;
+}
+
+/** Allocate a packet from DMA-capable heap memory using the aligned layout. */
+static struct mmpkt *pktmem_alloc_aligned(uint32_t space_at_start, uint32_t space_at_end,
+                                          uint32_t metadata_length, const struct mmpkt_ops *ops)
+{
+    uint32_t block_len = pktmem_block_len(space_at_start, space_at_end, metadata_length);
+    uint8_t *block = (uint8_t *)heap_caps_aligned_alloc(MMPKTMEM_DMA_ALIGNMENT, block_len,
+                                                        MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    return pktmem_init_aligned(block, block_len, space_at_start, space_at_end,
+                               metadata_length, ops);
+}
+
+/** Free a packet allocated with @ref pktmem_alloc_aligned(). */
+static void pktmem_free_aligned(void *mmpkt)
+{
+    heap_caps_free(mmpkt);
+}
+
 /*
  * --------------------------------------------------------------------------------------
  *     Command pool
@@ -137,8 +288,8 @@ static struct mmpkt *alloc_pkt_from_list(struct mmpkt_list *list, uint32_t pktbu
         return NULL;
     }
 
-    mmpkt = mmpkt_init_buf((uint8_t *)mmpkt_buf, pktbufsize, space_at_start, space_at_end,
-                           metadata_length, &tx_command_pool_ops);
+    mmpkt = pktmem_init_aligned((uint8_t *)mmpkt_buf, pktbufsize, space_at_start, space_at_end,
+                                metadata_length, &tx_command_pool_ops);
     if (mmpkt == NULL)
     {
         /* Command was too big for the reserved buffer. Return the reserved buffer. */
@@ -166,7 +317,7 @@ static void tx_data_pool_pkt_free(void *mmpkt)
 {
     atomic_int_least32_t old_value = atomic_fetch_sub(&pktmem.tx_data_pool_allocated, 1);
     MMOSAL_ASSERT(old_value > 0);
-    mmosal_free(mmpkt);
+    pktmem_free_aligned(mmpkt);
 
     if (pktmem.tx_data_pool_allocated < TX_DATA_POOL_UNPAUSE_THRESHOLD)
     {
@@ -209,14 +360,15 @@ struct mmpkt *mmhal_wlan_alloc_mmpkt_for_tx(uint8_t pkt_class,
         return NULL;
     }
 
-    mmpkt = mmpkt_alloc_on_heap(space_at_start, space_at_end, metadata_length);
+    mmpkt = pktmem_alloc_aligned(space_at_start, space_at_end, metadata_length,
+                                 &tx_data_pool_pkt_ops);
     if (mmpkt == NULL)
     {
         atomic_fetch_sub(&pktmem.tx_data_pool_allocated, 1);
         return NULL;
     }
 
-    mmpkt->ops = &tx_data_pool_pkt_ops;
+    update_peak(&pktmem.tx_data_pool_peak, old_value + 1);
 
     if (pktmem.tx_data_pool_allocated > TX_DATA_POOL_PAUSE_THRESHOLD)
     {
@@ -235,7 +387,7 @@ static void rx_pkt_free(void *mmpkt)
     if (mmpkt != NULL)
     {
         atomic_fetch_sub(&pktmem.rx_pool_allocated, 1);
-        mmosal_free(mmpkt);
+        pktmem_free_aligned(mmpkt);
     }
 }
 
@@ -258,15 +410,14 @@ struct mmpkt *mmhal_wlan_alloc_mmpkt_for_rx(uint32_t capacity, uint32_t metadata
     }
 
     /* For now we do not put an explicit limit on the of packets buffers on the RX path. */
-    mmpkt = mmpkt_alloc_on_heap(0, capacity, metadata_length);
+    mmpkt = pktmem_alloc_aligned(0, capacity, metadata_length, &mmpkt_rx_ops);
     if (mmpkt == NULL)
     {
         atomic_fetch_sub(&pktmem.rx_pool_allocated, 1);
         return NULL;
     }
 
-    /* Override packet ops to use a custom free function that also decrements the
-     * allocation count. */
-    mmpkt->ops = &mmpkt_rx_ops;
+    update_peak(&pktmem.rx_pool_peak, old_value + 1);
+    atomic_fetch_add(&pktmem.rx_pool_total, 1);
     return mmpkt;
 }
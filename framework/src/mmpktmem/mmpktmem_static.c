@@ -56,6 +56,13 @@ struct pktmem_data
     /** Statically allocated memory for the TX data pool. */
     uint8_t rx_pool[MMPKTMEM_RX_POOL_BLOCK_SIZE * MMPKTMEM_RX_POOL_N_BLOCKS];
 
+    /** Peak number of TX data pool blocks allocated since the last reset. */
+    uint32_t tx_data_pool_peak;
+    /** Peak number of RX pool blocks allocated since the last reset. */
+    uint32_t rx_pool_peak;
+    /** Total number of RX pool blocks allocated. */
+    uint32_t rx_pool_total;
+
     /** Flow control callback function pointer. */
     mmhal_wlan_pktmem_tx_flow_control_cb_t tx_flow_control_cb;
 };
@@ -182,7 +189,40 @@ static const struct mmpkt_ops tx_data_pool_ops = {
     .free_mmpkt = tx_data_free,
 };
 
-static struct mmpkt *alloc_pkt_from_list(struct mmpkt_list *list, uint32_t pktbufsize,
+void mmhal_wlan_pktmem_get_stats(struct mmhal_wlan_pktmem_stats *stats, bool reset_peak)
+{
+    MMOSAL_TASK_ENTER_CRITICAL();
+    stats->tx_allocated = MMPKTMEM_TX_POOL_N_BLOCKS - pktmem.tx_data_pool_free_list.len;
+    stats->tx_peak = pktmem.tx_data_pool_peak;
+    stats->rx_allocated = MMPKTMEM_RX_POOL_N_BLOCKS - pktmem.rx_pool_free_list.len;
+    stats->rx_peak = pktmem.rx_pool_peak;
+    if (reset_peak)
+    {
+        pktmem.tx_data_pool_peak = stats->tx_allocated;
+        pktmem.rx_pool_peak = stats->rx_allocated;
+    }
+    MMOSAL_TASK_EXIT_CRITICAL();
+    stats->tx_capacity = MMPKTMEM_TX_POOL_N_BLOCKS;
+    stats->rx_capacity = MMPKTMEM_RX_POOL_N_BLOCKS;
+    stats->rx_total = pktmem.rx_pool_total;
+}
+
+/**
+ * Allocate a packet from the given pool.
+ *
+ * @param list          Free list of the pool.
+ * @param n_blocks      Number of blocks in the pool.
+ * @param peak          Peak allocation count of the pool to update, or @c NULL.
+ * @param pktbufsize    Size of the blocks in the pool.
+ * @param ops           Packet operations to use for the allocated packet.
+ * @param space_at_start    Amount of space to allocate at start of mmpkt (for prepend).
+ * @param space_at_end      Amount of space to allocate at end of mmpkt (for append).
+ * @param metadata_length   Amount of space to allocate for metadata.
+ *
+ * @returns the allocated packet, or @c NULL on failure.
+ */
+static struct mmpkt *alloc_pkt_from_list(struct mmpkt_list *list, uint32_t n_blocks,
+                                         uint32_t *peak, uint32_t pktbufsize,
                                          const struct mmpkt_ops *ops,
                                          uint32_t space_at_start, uint32_t space_at_end,
                                          uint32_t metadata_length)
@@ -192,6 +232,10 @@ static struct mmpkt *alloc_pkt_from_list(struct mmpkt_list *list, uint32_t pktbu
 
     MMOSAL_TASK_ENTER_CRITICAL();
     mmpkt_buf = mmpkt_list_dequeue(list);
+    if (peak != NULL && n_blocks - list->len > *peak)
+    {
+        *peak = n_blocks - list->len;
+    }
     MMOSAL_TASK_EXIT_CRITICAL();
 
     if (mmpkt_buf == NULL)
@@ -213,15 +257,17 @@ static struct mmpkt *tx_command_pool_alloc(uint32_t space_at_start, uint32_t spa
                                            uint32_t metadata_length)
 {
     return alloc_pkt_from_list(
-        &pktmem.tx_command_pool_free_list, MMPKTMEM_TX_COMMAND_POOL_BLOCK_SIZE,
-        &tx_command_pool_ops, space_at_start, space_at_end, metadata_length);
+        &pktmem.tx_command_pool_free_list, MMPKTMEM_TX_COMMAND_POOL_N_BLOCKS, NULL,
+        MMPKTMEM_TX_COMMAND_POOL_BLOCK_SIZE, &tx_command_pool_ops,
+        space_at_start, space_at_end, metadata_length);
 }
 
 static struct mmpkt *tx_data_pool_alloc(uint32_t space_at_start, uint32_t space_at_end,
                                         uint32_t metadata_length)
 {
     return alloc_pkt_from_list(
-        &pktmem.tx_data_pool_free_list, MMPKTMEM_TX_POOL_BLOCK_SIZE, &tx_data_pool_ops,
+        &pktmem.tx_data_pool_free_list, MMPKTMEM_TX_POOL_N_BLOCKS, &pktmem.tx_data_pool_peak,
+        MMPKTMEM_TX_POOL_BLOCK_SIZE, &tx_data_pool_ops,
         space_at_start, space_at_end, metadata_length);
 }
 
@@ -286,7 +332,16 @@ static const struct mmpkt_ops rx_pool_ops = {
 
 struct mmpkt *mmhal_wlan_alloc_mmpkt_for_rx(uint32_t capacity, uint32_t metadata_length)
 {
-    return alloc_pkt_from_list(
-        &pktmem.rx_pool_free_list, MMPKTMEM_RX_POOL_BLOCK_SIZE, &rx_pool_ops,
+    struct mmpkt *mmpkt = alloc_pkt_from_list(
+        &pktmem.rx_pool_free_list, MMPKTMEM_RX_POOL_N_BLOCKS, &pktmem.rx_pool_peak,
+        MMPKTMEM_RX_POOL_BLOCK_SIZE, &rx_pool_ops,
         0, capacity, metadata_length);
+
+    if (mmpkt != NULL)
+    {
+        /* Receive packets are only allocated by the driver's receive path, so this does not
+         * need to be protected. */
+        pktmem.rx_pool_total++;
+    }
+    return mmpkt;
 }
@@ -0,0 +1,344 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "mmbin.h"
+#include "mmosal.h"
+#include "mmutils.h"
+
+/** Number of entries initially allocated for an index. Enough for the BCFs without growing. */
+#define MMBIN_INITIAL_CAPACITY (16)
+
+/** Maximum length of the header of any field that the indexer needs to decode. */
+#define MMBIN_MAX_HDR_LEN (sizeof(struct mbin_deflated_segment_hdr))
+
+/** Decode a little endian 16-bit value. */
+static inline uint16_t mmbin_get_le16(const uint8_t *buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+/** Decode a little endian 32-bit value. */
+static inline uint32_t mmbin_get_le32(const uint8_t *buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+void mmbin_robuf_release(struct mmhal_robuf *robuf)
+{
+    if (robuf->free_cb != NULL)
+    {
+        robuf->free_cb(robuf->free_arg);
+    }
+    memset(robuf, 0, sizeof(*robuf));
+}
+
+/** Check that a robuf returned by a read function meets the requirements of the HAL API. */
+static enum mmbin_status mmbin_check_robuf(const struct mmhal_robuf *robuf, uint32_t requested_len)
+{
+    if (robuf->buf == NULL || robuf->len == 0)
+    {
+        return MMBIN_ERR_READ_FAILED;
+    }
+
+    if (robuf->len > requested_len)
+    {
+        return MMBIN_ERR_READ_TOO_LONG;
+    }
+
+    if (robuf->len < MM_MIN(requested_len, MMHAL_WLAN_FW_BCF_MIN_READ_LENGTH))
+    {
+        return MMBIN_ERR_READ_TOO_SHORT;
+    }
+
+    return MMBIN_OK;
+}
+
+/** Copy @p len octets of the image starting at @p offset into @p dst. */
+static enum mmbin_status mmbin_read(mmbin_read_fn_t read_fn, uint32_t offset, void *dst,
+                                    uint32_t len)
+{
+    uint8_t *dst_buf = (uint8_t *)dst;
+
+    while (len > 0)
+    {
+        struct mmhal_robuf robuf = { 0 };
+        enum mmbin_status status;
+
+        read_fn(offset, len, &robuf);
+        status = mmbin_check_robuf(&robuf, len);
+        if (status == MMBIN_OK)
+        {
+            memcpy(dst_buf, robuf.buf, robuf.len);
+            dst_buf += robuf.len;
+            offset += robuf.len;
+            len -= robuf.len;
+        }
+        mmbin_robuf_release(&robuf);
+
+        if (status != MMBIN_OK)
+        {
+            return status;
+        }
+    }
+
+    return MMBIN_OK;
+}
+
+/** Append a zeroed entry to the index, growing the table if required. */
+static struct mmbin_entry *mmbin_index_append(struct mmbin_index *index, uint16_t *capacity)
+{
+    struct mmbin_entry *entry;
+
+    if (index->num_entries == *capacity)
+    {
+        uint16_t new_capacity = (*capacity == 0) ? MMBIN_INITIAL_CAPACITY : (*capacity * 2);
+        struct mmbin_entry *entries;
+
+        if (new_capacity <= *capacity)
+        {
+            return NULL;
+        }
+
+        entries = (struct mmbin_entry *)mmosal_realloc(index->entries,
+                                                      new_capacity * sizeof(*entries));
+        if (entries == NULL)
+        {
+            return NULL;
+        }
+        index->entries = entries;
+        *capacity = new_capacity;
+    }
+
+    entry = &index->entries[index->num_entries++];
+    memset(entry, 0, sizeof(*entry));
+    return entry;
+}
+
+/**
+ * Decode the header of the given field into its index entry.
+ *
+ * @param index             The index being built.
+ * @param entry             Entry for the field, with @c type, @c len and @c offset set.
+ * @param expected_magic    Expected magic number, or 0 to accept any.
+ *
+ * @returns @ref MMBIN_OK on success, otherwise an error code.
+ */
+static enum mmbin_status mmbin_decode_field(struct mmbin_index *index, struct mmbin_entry *entry,
+                                            uint32_t expected_magic)
+{
+    uint8_t hdr[MMBIN_MAX_HDR_LEN];
+    uint32_t hdr_len = mmbin_entry_hdr_len(entry);
+    enum mmbin_status status;
+
+    if (entry->type == FIELD_TYPE_MAGIC)
+    {
+        hdr_len = sizeof(uint32_t);
+    }
+
+    if (entry->len < hdr_len)
+    {
+        return MMBIN_ERR_MALFORMED;
+    }
+
+    if (hdr_len == 0)
+    {
+        return MMBIN_OK;
+    }
+
+    status = mmbin_read(index->read_fn, entry->offset, hdr, hdr_len);
+    if (status == MMBIN_ERR_READ_FAILED)
+    {
+        /* Ran off the end of the image inside the field, as for a TLV header. */
+        status = MMBIN_ERR_NO_EOF;
+    }
+    if (status != MMBIN_OK)
+    {
+        return status;
+    }
+
+    if (entry->type == FIELD_TYPE_MAGIC)
+    {
+        index->magic = mmbin_get_le32(hdr);
+        if (expected_magic != 0 && index->magic != expected_magic)
+        {
+            return MMBIN_ERR_BAD_MAGIC;
+        }
+    }
+    else if (mmbin_entry_is_segment(entry))
+    {
+        entry->base_address = mmbin_get_le32(hdr + offsetof(struct mbin_segment_hdr,
+                                                            base_address));
+        if (mmbin_entry_is_deflated(entry))
+        {
+            entry->chunk_size = mmbin_get_le16(hdr + offsetof(struct mbin_deflated_segment_hdr,
+                                                              chunk_size));
+            index->loaded_len += entry->chunk_size;
+        }
+        else
+        {
+            index->loaded_len += mmbin_entry_data_len(entry);
+        }
+        index->num_segments++;
+    }
+    else if (entry->type == FIELD_TYPE_BCF_REGDOM)
+    {
+        memcpy(entry->country_code, hdr + offsetof(struct mbin_regdom_hdr, country_code),
+               sizeof(entry->country_code));
+        index->num_regdoms++;
+    }
+
+    return MMBIN_OK;
+}
+
+enum mmbin_status mmbin_index_build(struct mmbin_index *index, mmbin_read_fn_t read_fn,
+                                    uint32_t expected_magic)
+{
+    enum mmbin_status status;
+    uint16_t capacity = 0;
+    uint32_t offset = 0;
+    uint32_t magic;
+
+    memset(index, 0, sizeof(*index));
+    index->read_fn = read_fn;
+
+    while (true)
+    {
+        struct mbin_tlv_hdr tlv_hdr;
+        struct mmbin_entry *entry;
+
+        status = mmbin_read(read_fn, offset, &tlv_hdr, sizeof(tlv_hdr));
+        if (status == MMBIN_ERR_READ_FAILED && offset != 0)
+        {
+            /* Ran off the end of the image. */
+            status = MMBIN_ERR_NO_EOF;
+        }
+        if (status != MMBIN_OK)
+        {
+            break;
+        }
+
+        if (index->num_entries == 0 && tlv_hdr.type != FIELD_TYPE_MAGIC)
+        {
+            status = MMBIN_ERR_NO_MAGIC;
+            break;
+        }
+
+        entry = mmbin_index_append(index, &capacity);
+        if (entry == NULL)
+        {
+            status = MMBIN_ERR_NO_MEM;
+            break;
+        }
+        entry->type = tlv_hdr.type;
+        entry->len = tlv_hdr.len;
+        entry->offset = offset + sizeof(tlv_hdr);
+
+        status = mmbin_decode_field(index, entry, expected_magic);
+        if (status != MMBIN_OK)
+        {
+            break;
+        }
+
+        offset = entry->offset + entry->len;
+
+        if (entry->type == FIELD_TYPE_EOF || entry->type == FIELD_TYPE_EOF_WITH_SIGNATURE)
+        {
+            index->image_len = offset;
+            return MMBIN_OK;
+        }
+    }
+
+    /* Keep the magic number so that the caller can report what was found. */
+    magic = index->magic;
+    mmbin_index_free(index);
+    index->magic = magic;
+    return status;
+}
+
+void mmbin_index_free(struct mmbin_index *index)
+{
+    mmosal_free(index->entries);
+    memset(index, 0, sizeof(*index));
+}
+
+const struct mmbin_entry *mmbin_index_find_regdom(const struct mmbin_index *index,
+                                                  const char *country_code)
+{
+    struct mmbin_iter iter;
+    const struct mmbin_entry *entry;
+
+    mmbin_iter_init(&iter, index, FIELD_TYPE_BCF_REGDOM);
+    while ((entry = mmbin_iter_next(&iter)) != NULL)
+    {
+        if (entry->country_code[0] == country_code[0] &&
+            entry->country_code[1] == country_code[1])
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+void mmbin_iter_init(struct mmbin_iter *iter, const struct mmbin_index *index, uint16_t filter)
+{
+    iter->index = index;
+    iter->filter = filter;
+    iter->next = 0;
+}
+
+const struct mmbin_entry *mmbin_iter_next(struct mmbin_iter *iter)
+{
+    while (iter->next < iter->index->num_entries)
+    {
+        const struct mmbin_entry *entry = &iter->index->entries[iter->next++];
+
+        if (iter->filter == MMBIN_ITER_ALL || iter->filter == entry->type ||
+            (iter->filter == MMBIN_ITER_SEGMENTS && mmbin_entry_is_segment(entry)))
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+enum mmbin_status mmbin_entry_get(const struct mmbin_index *index,
+                                  const struct mmbin_entry *entry, uint32_t offset, uint32_t len,
+                                  struct mmhal_robuf *robuf)
+{
+    uint32_t data_len = mmbin_entry_data_len(entry);
+    enum mmbin_status status;
+
+    if (offset >= data_len || len == 0)
+    {
+        return MMBIN_ERR_INVALID_ARG;
+    }
+
+    len = MM_MIN(len, data_len - offset);
+    index->read_fn(mmbin_entry_data_offset(entry) + offset, len, robuf);
+    status = mmbin_check_robuf(robuf, len);
+    if (status != MMBIN_OK)
+    {
+        mmbin_robuf_release(robuf);
+    }
+
+    return status;
+}
+
+enum mmbin_status mmbin_entry_read(const struct mmbin_index *index,
+                                   const struct mmbin_entry *entry, uint32_t offset, void *dst,
+                                   uint32_t len)
+{
+    if (offset > mmbin_entry_data_len(entry) || len > mmbin_entry_data_len(entry) - offset)
+    {
+        return MMBIN_ERR_INVALID_ARG;
+    }
+
+    return mmbin_read(index->read_fn, mmbin_entry_data_offset(entry) + offset, dst, len);
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+ /**
+  * @defgroup MMBIN Morse Micro Binary Image Index (mmbin) API
+  *
+  * This API indexes firmware and BCF images in @c mbin format (see @ref MBIN) so that their
+  * segments and regulatory domain entries can be accessed directly.
+  *
+  * The image is read through a function with the same signature as
+  * @ref mmhal_wlan_read_fw_file() and @ref mmhal_wlan_read_bcf_file(). Building the index walks
+  * the TLV chain once, reading only the TLV and segment headers, and records the location of
+  * each field in a compact table. Loaders and validators can then iterate over the table, or
+  * seek straight to a given field, without parsing the image again.
+  *
+  * @code{.c}
+  * struct mmbin_index index;
+  * struct mmbin_iter iter;
+  * const struct mmbin_entry *entry;
+  *
+  * if (mmbin_index_build(&index, mmhal_wlan_read_fw_file, MBIN_FW_MAGIC_NUMBER) != MMBIN_OK)
+  *     return;
+  *
+  * mmbin_iter_init(&iter, &index, MMBIN_ITER_SEGMENTS);
+  * while ((entry = mmbin_iter_next(&iter)) != NULL)
+  * {
+  *     // Load mmbin_entry_data_len(entry) bytes from mmbin_entry_data_offset(entry) to
+  *     // entry->base_address.
+  * }
+  *
+  * mmbin_index_free(&index);
+  * @endcode
+  *
+  * @{
+  */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbin.h"
+#include "mmhal_wlan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Function used to read an image. See @ref mmhal_wlan_read_fw_file(). */
+typedef void (*mmbin_read_fn_t)(uint32_t offset, uint32_t requested_len,
+                                struct mmhal_robuf *robuf);
+
+/** Status codes returned by the mmbin API. */
+enum mmbin_status
+{
+    /** Success. */
+    MMBIN_OK,
+    /** The read function returned no data (or a @c NULL buffer) before the end of the image. */
+    MMBIN_ERR_READ_FAILED,
+    /**
+     * The read function returned less than @ref MMHAL_WLAN_FW_BCF_MIN_READ_LENGTH octets when at
+     * least that many were requested.
+     */
+    MMBIN_ERR_READ_TOO_SHORT,
+    /** The read function returned more data than was requested. */
+    MMBIN_ERR_READ_TOO_LONG,
+    /** The image did not start with a magic number field. */
+    MMBIN_ERR_NO_MAGIC,
+    /** The magic number did not match the expected value. */
+    MMBIN_ERR_BAD_MAGIC,
+    /** A field was too short to contain its header. */
+    MMBIN_ERR_MALFORMED,
+    /** The image ended without an EOF field. */
+    MMBIN_ERR_NO_EOF,
+    /** Memory allocation failed. */
+    MMBIN_ERR_NO_MEM,
+    /** An argument was out of range (e.g., an offset beyond the end of an entry). */
+    MMBIN_ERR_INVALID_ARG,
+};
+
+/** An entry in an mbin index, describing a single TLV field of the image. */
+struct mmbin_entry
+{
+    /** Field type (see @ref mbin_tlv_types). */
+    uint16_t type;
+    /** Length of the field payload in octets, including any segment header. */
+    uint16_t len;
+    /** Offset of the field payload (i.e., after the TLV header) from the start of the image. */
+    uint32_t offset;
+    /** Destination base address for segment fields, otherwise 0. */
+    uint32_t base_address;
+    /** Size of the inflated data for deflated segment fields, otherwise 0. */
+    uint16_t chunk_size;
+    /** Country code for @c FIELD_TYPE_BCF_REGDOM fields, otherwise zero. */
+    char country_code[2];
+};
+
+/** Index of an mbin image. */
+struct mmbin_index
+{
+    /** Function used to read the image. */
+    mmbin_read_fn_t read_fn;
+    /** Table of fields in the order in which they appear in the image, ending with the EOF. */
+    struct mmbin_entry *entries;
+    /** Number of entries in @c entries. */
+    uint16_t num_entries;
+    /** Number of segment entries (deflated or otherwise). */
+    uint16_t num_segments;
+    /** Number of @c FIELD_TYPE_BCF_REGDOM entries. */
+    uint16_t num_regdoms;
+    /** Magic number of the image. */
+    uint32_t magic;
+    /** Length of the image up to and including the EOF field. */
+    uint32_t image_len;
+    /** Total size of the segment data once loaded (i.e., after inflation). */
+    uint32_t loaded_len;
+};
+
+/** Iterator filter that matches all entries. See @ref mmbin_iter_init(). */
+#define MMBIN_ITER_ALL (0x0000)
+/** Iterator filter that matches all segment entries, deflated or otherwise. */
+#define MMBIN_ITER_SEGMENTS (0xffff)
+
+/** Iterator over the entries of an mbin index. See @ref mmbin_iter_init(). */
+struct mmbin_iter
+{
+    /** The index being iterated over. */
+    const struct mmbin_index *index;
+    /** Filter passed to @ref mmbin_iter_init(). */
+    uint16_t filter;
+    /** Index of the next entry to examine. */
+    uint16_t next;
+};
+
+/**
+ * Build an index of the given image.
+ *
+ * Only the headers of each field are read, so this costs one or two reads per field regardless
+ * of the size of the image. The index must be released with @ref mmbin_index_free().
+ *
+ * @param index             Index to initialize.
+ * @param read_fn           Function used to read the image.
+ * @param expected_magic    Expected magic number (e.g., @ref MBIN_FW_MAGIC_NUMBER), or 0 to
+ *                          accept any.
+ *
+ * @returns @ref MMBIN_OK on success, otherwise an error code. On error @p index is left empty,
+ *          except that @c magic holds the magic number read from the image (or 0 if none was
+ *          read), and need not be freed.
+ */
+enum mmbin_status mmbin_index_build(struct mmbin_index *index, mmbin_read_fn_t read_fn,
+                                    uint32_t expected_magic);
+
+/**
+ * Release the memory used by an index.
+ *
+ * @param index     The index to free.
+ */
+void mmbin_index_free(struct mmbin_index *index);
+
+/**
+ * Find the regulatory domain entry for the given country.
+ *
+ * @param index         The index of a BCF image.
+ * @param country_code  Two character country code.
+ *
+ * @returns the entry, or @c NULL if there is none for @p country_code.
+ */
+const struct mmbin_entry *mmbin_index_find_regdom(const struct mmbin_index *index,
+                                                  const char *country_code);
+
+/**
+ * Initialize an iterator over the entries of an index.
+ *
+ * @param iter      Iterator to initialize.
+ * @param index     The index to iterate over.
+ * @param filter    Field type to return (see @ref mbin_tlv_types), @ref MMBIN_ITER_SEGMENTS or
+ *                  @ref MMBIN_ITER_ALL.
+ */
+void mmbin_iter_init(struct mmbin_iter *iter, const struct mmbin_index *index, uint16_t filter);
+
+/**
+ * Get the next entry that matches the iterator's filter.
+ *
+ * @param iter      The iterator.
+ *
+ * @returns the entry, or @c NULL when there are no more.
+ */
+const struct mmbin_entry *mmbin_iter_next(struct mmbin_iter *iter);
+
+/**
+ * Tests whether an entry is a segment (deflated or otherwise).
+ *
+ * @param entry     The entry to test.
+ *
+ * @returns @c true if @p entry is a segment, else @c false.
+ */
+static inline bool mmbin_entry_is_segment(const struct mmbin_entry *entry)
+{
+    return entry->type == FIELD_TYPE_FW_SEGMENT ||
+           entry->type == FIELD_TYPE_FW_SEGMENT_DEFLATED ||
+           entry->type == FIELD_TYPE_SW_SEGMENT ||
+           entry->type == FIELD_TYPE_SW_SEGMENT_DEFLATED;
+}
+
+/**
+ * Tests whether an entry is a deflated segment.
+ *
+ * @param entry     The entry to test.
+ *
+ * @returns @c true if @p entry is a deflated segment, else @c false.
+ */
+static inline bool mmbin_entry_is_deflated(const struct mmbin_entry *entry)
+{
+    return entry->type == FIELD_TYPE_FW_SEGMENT_DEFLATED ||
+           entry->type == FIELD_TYPE_SW_SEGMENT_DEFLATED;
+}
+
+/**
+ * Get the length of the header that precedes the data of an entry.
+ *
+ * For deflated segments the data is the zlib stream, which begins with the zlib header in
+ * @ref mbin_deflated_segment_hdr, so that header is not included.
+ *
+ * @param entry     The entry.
+ *
+ * @returns the header length in octets.
+ */
+static inline uint32_t mmbin_entry_hdr_len(const struct mmbin_entry *entry)
+{
+    if (mmbin_entry_is_deflated(entry))
+    {
+        return offsetof(struct mbin_deflated_segment_hdr, zlib_header);
+    }
+    if (mmbin_entry_is_segment(entry))
+    {
+        return sizeof(struct mbin_segment_hdr);
+    }
+    if (entry->type == FIELD_TYPE_BCF_REGDOM)
+    {
+        return sizeof(struct mbin_regdom_hdr);
+    }
+    return 0;
+}
+
+/**
+ * Get the offset of the data of an entry from the start of the image.
+ *
+ * @param entry     The entry.
+ *
+ * @returns the offset in octets.
+ */
+static inline uint32_t mmbin_entry_data_offset(const struct mmbin_entry *entry)
+{
+    return entry->offset + mmbin_entry_hdr_len(entry);
+}
+
+/**
+ * Get the length of the data of an entry (i.e., excluding any segment header).
+ *
+ * @param entry     The entry.
+ *
+ * @returns the length in octets.
+ */
+static inline uint32_t mmbin_entry_data_len(const struct mmbin_entry *entry)
+{
+    return entry->len - mmbin_entry_hdr_len(entry);
+}
+
+/**
+ * Read part of the data of an entry without copying it.
+ *
+ * This seeks directly to the data using the read function the index was built with, so the
+ * same conditions apply: fewer than @p len octets may be returned and @p robuf must be released
+ * by the caller.
+ *
+ * @param index     The index.
+ * @param entry     The entry to read.
+ * @param offset    Offset within the entry's data (see @ref mmbin_entry_data_offset()).
+ * @param len       Maximum number of octets to return.
+ * @param robuf     Read-only buffer to fill out. Must be zeroed by the caller.
+ *
+ * @returns @ref MMBIN_OK on success, otherwise an error code.
+ */
+enum mmbin_status mmbin_entry_get(const struct mmbin_index *index,
+                                  const struct mmbin_entry *entry, uint32_t offset, uint32_t len,
+                                  struct mmhal_robuf *robuf);
+
+/**
+ * Copy part of the data of an entry into a buffer.
+ *
+ * @param index     The index.
+ * @param entry     The entry to read.
+ * @param offset    Offset within the entry's data (see @ref mmbin_entry_data_offset()).
+ * @param dst       Buffer to copy into.
+ * @param len       Number of octets to copy.
+ *
+ * @returns @ref MMBIN_OK on success, otherwise an error code.
+ */
+enum mmbin_status mmbin_entry_read(const struct mmbin_index *index,
+                                   const struct mmbin_entry *entry, uint32_t offset, void *dst,
+                                   uint32_t len);
+
+/**
+ * Release a read-only buffer returned by @ref mmbin_entry_get() (or directly by a read function),
+ * invoking its @c free_cb if set, and zero it ready for reuse.
+ *
+ * @param robuf     The buffer to release.
+ */
+void mmbin_robuf_release(struct mmhal_robuf *robuf);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
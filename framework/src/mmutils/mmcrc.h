@@ -33,6 +33,34 @@ extern "C" {
  */
 uint16_t mmcrc_16_xmodem(uint16_t crc, const void *data, size_t data_len);
 
+/**
+ * @brief Copy a data buffer and compute its CRC-16 using the XMODEM model in a single pass.
+ *
+ * This is equivalent to @c memcpy() followed by @ref mmcrc_16_xmodem(), but only reads the
+ * source data once.
+ *
+ * @param crc       Seed for CRC calc, as for @ref mmcrc_16_xmodem().
+ * @param dst       Pointer to the destination buffer. Must not overlap @p src.
+ * @param src       Pointer to the start of the data to copy and calculate the crc over.
+ * @param data_len  Length of the data array in bytes.
+ *
+ * @return Returns the CRC value.
+ */
+uint16_t mmcrc_16_xmodem_copy(uint16_t crc, void *dst, const void *src, size_t data_len);
+
+/**
+ * @brief Compute the CRC-7 for the data buffer, as used by SD/SDIO commands.
+ *
+ * @param crc       Seed for CRC calc, zero in most cases. If chaining calls then this is the
+ *                  output from the previous invocation.
+ * @param data      Pointer to the start of the data to calculate the crc over.
+ * @param data_len  Length of the data array in bytes.
+ *
+ * @return Returns the 7-bit CRC value (in the least significant bits). Note that in an SD/SDIO
+ *         command this is shifted left by one and followed by the end bit.
+ */
+uint8_t mmcrc_7(uint8_t crc, const void *data, size_t data_len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,347 @@
+#!/usr/bin/env python3
+#
+# Copyright 2024 Morse Micro
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""
+Run a matrix of mmiperf tests on the host over a simulated link and collect the results.
+
+The tests use the host build of mmiperf (``mmiperf_host``, see CMakeLists.txt in this directory),
+which runs the iperf3 mode of mmiperf through the same mmiperf_start_*() calls and lwIP socket
+layer as the target. A client and a server are run on the loopback interface with a link shim
+between them that applies netem-style impairments in each direction:
+
+* ``--rate-kbps``: link rate. Data is serialised at this rate behind a queue of ``--queue-bytes``,
+  which are shared by all flows in the same direction. UDP datagrams that arrive to a full queue
+  are dropped; TCP is back-pressured instead.
+* ``--delay-ms`` and ``--jitter-ms``: one-way delay, plus a uniformly distributed random amount
+  of up to the jitter. Order is preserved.
+* ``--loss-pct``: random loss of UDP datagrams. TCP is relayed as a byte stream, so it sees the
+  rate and delay but not loss; use ``tc qdisc ... netem loss`` on the loopback interface for
+  packet-level TCP loss.
+
+Each case's console output is saved as ``<out>/<case>.log`` and the results are collected with
+``../iperf_regress.py`` into ``<out>/results.json`` and ``<out>/results.csv``. If a baseline is
+given the results are compared against it and the exit status is that of the comparison::
+
+    cmake -S framework/tools/host -B build_host && cmake --build build_host
+    framework/tools/host/iperf_link_matrix.py --build-dir build_host --out results \\
+        --rate-kbps 8000 --delay-ms 10 --jitter-ms 2 --loss-pct 0.5 --baseline baseline.json
+
+Cases may be replaced with ``--case NAME="mmiperf_host client options"``, for example
+``--case udp_up_2m="-u -b 2M -t 5"``.
+"""
+
+import argparse
+import os
+import random
+import select
+import socket
+import subprocess
+import sys
+import threading
+import time
+from collections import deque
+from types import SimpleNamespace
+from typing import Deque, Dict, List, Optional, Tuple
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import iperf_regress  # noqa: E402
+
+# Default test cases: name and mmiperf_host client options. "{t}" is replaced by the duration.
+DEFAULT_CASES = [
+    ("tcp_up", "-t {t}"),
+    ("tcp_down", "-t {t} -R"),
+    ("tcp_up_p2", "-t {t} -P 2"),
+    ("tcp_up_4m", "-n 4M"),
+    ("udp_up", "-u -b {b} -t {t}"),
+    ("udp_down", "-u -b {b} -t {t} -R"),
+    ("udp_up_512", "-u -b {b} -l 512 -t {t}"),
+]
+
+# Size of the reads from a relayed TCP connection.
+TCP_CHUNK_LEN = 4096
+
+# Receive buffer size of the relayed TCP connections. Loopback buffers are otherwise several
+# megabytes, which a TCP sender fills long before the data has crossed the simulated link, so it
+# would report far more than the link rate. This is set before the connections are established
+# so that the advertised window is limited too.
+TCP_RCVBUF_LEN = 32 * 1024
+
+
+class Shaper:
+    """The rate limit and queue of one direction of the link, shared by all flows."""
+
+    def __init__(self, args):
+        self.rate_bps = args.rate_kbps * 1000
+        self.queue_bytes = args.queue_bytes
+        self.tx_free_time = 0.0
+        self.lock = threading.Lock()
+
+    def reserve(self, length: int, now: float) -> Optional[float]:
+        """Queue data for transmission, returning the time it has been sent or None if the queue
+        is full."""
+        with self.lock:
+            if not self.rate_bps:
+                return now
+            backlog = max(0.0, self.tx_free_time - now) * self.rate_bps / 8
+            if backlog > self.queue_bytes:
+                return None
+            self.tx_free_time = max(now, self.tx_free_time) + length * 8 / self.rate_bps
+            return self.tx_free_time
+
+
+class Link:
+    """One flow in one direction of the simulated link: the shared shaper followed by a delay
+    line for the flow."""
+
+    def __init__(self, args, shaper: Shaper, send_fn, stream: bool):
+        self.shaper = shaper
+        self.delay_s = args.delay_ms / 1000
+        self.jitter_s = args.jitter_ms / 1000
+        self.loss = args.loss_pct / 100
+        self.send_fn = send_fn
+        self.stream = stream
+        self.last_delivery = 0.0
+        self.pending: Deque[Tuple[float, bytes]] = deque()
+        self.cond = threading.Condition()
+        self.closed = False
+        self.dropped = 0
+        threading.Thread(target=self._deliver, daemon=True).start()
+
+    def submit(self, data: bytes):
+        """Queue data for delivery. For a stream this blocks while the queue is full."""
+        if not self.stream and random.random() < self.loss:
+            self.dropped += 1
+            return
+
+        tx_done = self.shaper.reserve(len(data), time.monotonic())
+        while tx_done is None and self.stream:
+            time.sleep(0.001)
+            tx_done = self.shaper.reserve(len(data), time.monotonic())
+        if tx_done is None:
+            self.dropped += 1
+            return
+
+        delivery = max(tx_done + self.delay_s + random.uniform(0, self.jitter_s),
+                       self.last_delivery)
+        self.last_delivery = delivery
+        with self.cond:
+            self.pending.append((delivery, data))
+            self.cond.notify()
+
+    def close(self):
+        """Deliver what is queued, then stop."""
+        with self.cond:
+            self.closed = True
+            self.cond.notify()
+
+    def _deliver(self):
+        while True:
+            with self.cond:
+                while not self.pending and not self.closed:
+                    self.cond.wait()
+                if not self.pending:
+                    break
+                delivery, data = self.pending[0]
+            wait = delivery - time.monotonic()
+            if wait > 0:
+                time.sleep(wait)
+            with self.cond:
+                self.pending.popleft()
+            try:
+                self.send_fn(data)
+            except OSError:
+                break
+        if self.stream:
+            self.send_fn(b"")
+
+
+class LinkShim:
+    """Relays TCP connections and UDP flows from a local port to a server through a Link."""
+
+    def __init__(self, args, listen_port: int, server_port: int):
+        self.args = args
+        self.server = ("127.0.0.1", server_port)
+        self.uplink = Shaper(args)
+        self.downlink = Shaper(args)
+        self.tcp = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.tcp.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.tcp.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, TCP_RCVBUF_LEN)
+        self.tcp.bind(("127.0.0.1", listen_port))
+        self.tcp.listen(16)
+        self.udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.udp.bind(("127.0.0.1", listen_port))
+        # Upstream socket and link in each direction of each UDP flow, by client address.
+        self.udp_flows: Dict[Tuple[str, int], Tuple[socket.socket, Link, Link]] = {}
+        self.udp_lock = threading.Lock()
+        threading.Thread(target=self._accept, daemon=True).start()
+        threading.Thread(target=self._relay_udp, daemon=True).start()
+
+    @property
+    def udp_dropped(self) -> int:
+        with self.udp_lock:
+            flows = list(self.udp_flows.values())
+        return sum(forward.dropped + back.dropped for _, forward, back in flows)
+
+    def _accept(self):
+        while True:
+            client, _ = self.tcp.accept()
+            upstream = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            upstream.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, TCP_RCVBUF_LEN)
+            upstream.connect(self.server)
+            for sock in (client, upstream):
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            self._pump_tcp(client, upstream, self.uplink)
+            self._pump_tcp(upstream, client, self.downlink)
+
+    def _pump_tcp(self, src: socket.socket, dst: socket.socket, shaper: Shaper):
+        def send(data: bytes):
+            if data:
+                dst.sendall(data)
+            else:
+                try:
+                    dst.shutdown(socket.SHUT_WR)
+                except OSError:
+                    pass
+
+        def pump():
+            link = Link(self.args, shaper, send, stream=True)
+            while True:
+                try:
+                    data = src.recv(TCP_CHUNK_LEN)
+                except OSError:
+                    data = b""
+                if not data:
+                    break
+                link.submit(data)
+            link.close()
+
+        threading.Thread(target=pump, daemon=True).start()
+
+    def _relay_udp(self):
+        upstreams: Dict[socket.socket, Link] = {}
+        while True:
+            readable, _, _ = select.select([self.udp] + list(upstreams), [], [])
+            for sock in readable:
+                if sock is not self.udp:
+                    upstreams[sock].submit(sock.recv(65536))
+                    continue
+
+                data, client = self.udp.recvfrom(65536)
+                flow = self.udp_flows.get(client)
+                if flow is None:
+                    upstream = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+                    upstream.connect(self.server)
+                    back = Link(self.args, self.downlink,
+                                lambda d, c=client: self.udp.sendto(d, c), stream=False)
+                    forward = Link(self.args, self.uplink, upstream.send, stream=False)
+                    flow = (upstream, forward, back)
+                    with self.udp_lock:
+                        self.udp_flows[client] = flow
+                    upstreams[upstream] = back
+                flow[1].submit(data)
+
+
+def free_port() -> int:
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
+        sock.bind(("127.0.0.1", 0))
+        return sock.getsockname()[1]
+
+
+def parse_cases(args) -> List[Tuple[str, str]]:
+    if not args.case:
+        return [(name, options.format(t=args.duration, b=args.udp_bandwidth))
+                for name, options in DEFAULT_CASES]
+    cases = []
+    for case in args.case:
+        name, sep, options = case.partition("=")
+        if not sep:
+            sys.exit(f"Expected NAME=OPTIONS, got '{case}'")
+        cases.append((name, options))
+    return cases
+
+
+def run(args) -> int:
+    binary = os.path.join(args.build_dir, "mmiperf_host")
+    if not os.access(binary, os.X_OK):
+        sys.exit(f"{binary} not found; build framework/tools/host first")
+    os.makedirs(args.out, exist_ok=True)
+
+    server_port = free_port()
+    shim_port = free_port()
+    with open(os.path.join(args.out, "server.log"), "w") as server_log:
+        server = subprocess.Popen([binary, "-s", "-p", str(server_port)], stdout=server_log,
+                                  stderr=subprocess.STDOUT)
+    shim = LinkShim(args, shim_port, server_port)
+    time.sleep(0.5)
+
+    logs = []
+    failed = []
+    try:
+        for name, options in parse_cases(args):
+            log_path = os.path.join(args.out, f"{name}.log")
+            dropped = shim.udp_dropped
+            with open(log_path, "w") as log:
+                log.write(f"# mmiperf_host -c 127.0.0.1 {options} over rate {args.rate_kbps} "
+                          f"kbps, delay {args.delay_ms} ms, jitter {args.jitter_ms} ms, "
+                          f"loss {args.loss_pct}%\n")
+                log.flush()
+                result = subprocess.run([binary, "-c", "127.0.0.1", "-p", str(shim_port)] +
+                                        options.split(), stdout=log, stderr=subprocess.STDOUT,
+                                        timeout=args.duration * 4 + 60)
+            print(f"{name:16} {options:32} exit {result.returncode}, "
+                  f"{shim.udp_dropped - dropped} datagrams dropped by the link")
+            if result.returncode == 0:
+                logs.append(f"{name}={log_path}")
+            else:
+                failed.append(name)
+    finally:
+        server.terminate()
+        server.wait()
+
+    if logs:
+        iperf_regress.collect(SimpleNamespace(cases=logs,
+                                              json=os.path.join(args.out, "results.json"),
+                                              csv=os.path.join(args.out, "results.csv")))
+    if failed:
+        print(f"Failed cases: {', '.join(failed)}")
+
+    status = 1 if failed else 0
+    if args.baseline:
+        status |= iperf_regress.compare(SimpleNamespace(
+            results=os.path.join(args.out, "results.json"), baseline=args.baseline,
+            tolerance=args.tolerance, verbose=args.verbose))
+    return status
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--build-dir", required=True,
+                        help="Build directory of framework/tools/host")
+    parser.add_argument("--out", required=True, help="Directory for the logs and results")
+    parser.add_argument("--rate-kbps", type=int, default=0,
+                        help="Link rate in kbps in each direction (default: unlimited)")
+    parser.add_argument("--queue-bytes", type=int, default=64 * 1024,
+                        help="Queue length of the link in bytes (default: %(default)s)")
+    parser.add_argument("--delay-ms", type=float, default=0, help="One-way delay")
+    parser.add_argument("--jitter-ms", type=float, default=0, help="Random extra delay")
+    parser.add_argument("--loss-pct", type=float, default=0, help="UDP datagram loss")
+    parser.add_argument("--duration", type=int, default=5,
+                        help="Duration of the default cases in seconds (default: %(default)s)")
+    parser.add_argument("--udp-bandwidth", default="5M",
+                        help="Bandwidth of the default UDP cases (default: %(default)s)")
+    parser.add_argument("--case", action="append", default=[], metavar="NAME=OPTIONS",
+                        help="Run this case instead of the defaults (may be repeated)")
+    parser.add_argument("--baseline", help="Compare the results against this baseline")
+    parser.add_argument("--tolerance", action="append", default=[], metavar="METRIC=FRACTION",
+                        help="Override the relative tolerance of a metric")
+    parser.add_argument("--verbose", action="store_true",
+                        help="Print every metric compared, not only regressions")
+    return run(parser.parse_args())
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host benchmark for the firmware and BCF image handling.
+ *
+ * The images are read through the host backend in mm_shims/host/mmhal_wlan_binaries_host.c, so
+ * this measures the mmbin code (index build and entry reads) along with the number of read
+ * calls it makes, which is what dominates on a target where each read maps flash. Usage:
+ *
+ *     MMHAL_FW_FILE=mm6108.mbin MMHAL_BCF_FILE=bcf_mf08551.mbin ./loader_benchmark [iterations]
+ *
+ * Either variable may be left unset to skip that image.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mmbin.h"
+#include "mmosal.h"
+
+/** Number of iterations used when none is given on the command line. */
+#define DEFAULT_ITERATIONS 1000
+
+/** Number of calls made to the read functions. */
+static uint32_t read_count;
+
+/** Read function wrapper that counts the calls made to @ref mmhal_wlan_read_fw_file(). */
+static void counted_read_fw_file(uint32_t offset, uint32_t requested_len,
+                                 struct mmhal_robuf *robuf)
+{
+    read_count++;
+    mmhal_wlan_read_fw_file(offset, requested_len, robuf);
+}
+
+/** Read function wrapper that counts the calls made to @ref mmhal_wlan_read_bcf_file(). */
+static void counted_read_bcf_file(uint32_t offset, uint32_t requested_len,
+                                  struct mmhal_robuf *robuf)
+{
+    read_count++;
+    mmhal_wlan_read_bcf_file(offset, requested_len, robuf);
+}
+
+/**
+ * Read the data of every entry of an index, as the porting assistant and the firmware loader do.
+ *
+ * @param index     The index.
+ * @param checksum  Updated with the sum of the octets read, so that the reads are not optimized
+ *                  away.
+ *
+ * @returns @ref MMBIN_OK on success, otherwise an error code.
+ */
+static enum mmbin_status read_all_entries(const struct mmbin_index *index, uint32_t *checksum)
+{
+    struct mmbin_iter iter;
+    const struct mmbin_entry *entry;
+    enum mmbin_status status = MMBIN_OK;
+
+    mmbin_iter_init(&iter, index, MMBIN_ITER_ALL);
+    while (status == MMBIN_OK && (entry = mmbin_iter_next(&iter)) != NULL)
+    {
+        uint32_t data_len = mmbin_entry_data_len(entry);
+        uint32_t offset = 0;
+
+        while (status == MMBIN_OK && offset < data_len)
+        {
+            struct mmhal_robuf robuf = { 0 };
+            uint32_t ii;
+
+            status = mmbin_entry_get(index, entry, offset, data_len - offset, &robuf);
+            for (ii = 0; status == MMBIN_OK && ii < robuf.len; ii++)
+            {
+                *checksum += robuf.buf[ii];
+            }
+            offset += robuf.len;
+            mmbin_robuf_release(&robuf);
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Benchmark one image.
+ *
+ * @param name          Name of the image, for the report.
+ * @param env_var       Environment variable giving the path of the image.
+ * @param read_fn       Function used to read the image.
+ * @param magic         Expected magic number.
+ * @param iterations    Number of times to repeat each measurement.
+ *
+ * @returns @c true on success (or if the image was skipped), else @c false.
+ */
+static bool benchmark_image(const char *name, const char *env_var, mmbin_read_fn_t read_fn,
+                            uint32_t magic, unsigned iterations)
+{
+    struct mmbin_index index;
+    enum mmbin_status status;
+    uint32_t checksum = 0;
+    uint32_t index_reads;
+    uint32_t entry_reads;
+    uint64_t index_us;
+    uint64_t read_us;
+    uint64_t start_us;
+    unsigned ii;
+
+    if (getenv(env_var) == NULL)
+    {
+        printf("%s: skipped (%s not set)\n", name, env_var);
+        return true;
+    }
+
+    /* The first build maps the file, so keep it out of the measurement. */
+    status = mmbin_index_build(&index, read_fn, magic);
+    if (status != MMBIN_OK)
+    {
+        printf("%s: index build failed (status %d, magic 0x%08" PRIx32 ")\n",
+               name, status, index.magic);
+        return false;
+    }
+    mmbin_index_free(&index);
+
+    read_count = 0;
+    start_us = mmosal_get_time_us();
+    for (ii = 0; ii < iterations; ii++)
+    {
+        status = mmbin_index_build(&index, read_fn, magic);
+        if (status != MMBIN_OK)
+        {
+            printf("%s: index build failed (status %d)\n", name, status);
+            return false;
+        }
+        mmbin_index_free(&index);
+    }
+    index_us = mmosal_get_time_us() - start_us;
+    index_reads = read_count / iterations;
+
+    status = mmbin_index_build(&index, read_fn, magic);
+    if (status != MMBIN_OK)
+    {
+        printf("%s: index build failed (status %d)\n", name, status);
+        return false;
+    }
+
+    read_count = 0;
+    start_us = mmosal_get_time_us();
+    for (ii = 0; ii < iterations && status == MMBIN_OK; ii++)
+    {
+        status = read_all_entries(&index, &checksum);
+    }
+    read_us = mmosal_get_time_us() - start_us;
+    entry_reads = read_count / iterations;
+
+    if (status != MMBIN_OK)
+    {
+        printf("%s: entry read failed (status %d)\n", name, status);
+        mmbin_index_free(&index);
+        return false;
+    }
+
+    printf("%s: %" PRIu32 " octets, %u entries (%u segments), loaded size %" PRIu32 "\n",
+           name, index.image_len, index.num_entries, index.num_segments, index.loaded_len);
+    printf("  index build: %.2f us, %" PRIu32 " reads\n",
+           (double)index_us / iterations, index_reads);
+    printf("  read all:    %.2f us, %" PRIu32 " reads, %.1f MB/s (checksum 0x%08" PRIx32 ")\n",
+           (double)read_us / iterations, entry_reads,
+           read_us ? ((double)index.image_len * iterations) / read_us : 0.0, checksum);
+
+    mmbin_index_free(&index);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = DEFAULT_ITERATIONS;
+    bool ok;
+
+    if (argc > 1)
+    {
+        iterations = strtoul(argv[1], NULL, 0);
+        if (iterations == 0)
+        {
+            printf("Usage: %s [iterations]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    ok = benchmark_image("firmware", "MMHAL_FW_FILE", counted_read_fw_file,
+                         MBIN_FW_MAGIC_NUMBER, iterations);
+    ok &= benchmark_image("bcf", "MMHAL_BCF_FILE", counted_read_bcf_file,
+                          MBIN_BCF_MAGIC_NUMBER, iterations);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
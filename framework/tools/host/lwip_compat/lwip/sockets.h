@@ -0,0 +1,118 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host (Linux) stand-in for the parts of the lwIP sockets API used by
+ * src/mmiperf/lwip/mmiperf3_lwip.c, so that it can be built by framework/tools/host unmodified.
+ * The lwip_*() calls map directly onto the POSIX sockets API, which lwIP's is modelled on.
+ *
+ * lwIP's socket addresses start with a length field (@c sin_len and @c sin6_len), which Linux's
+ * do not have. The address structures are therefore redefined here with the Linux layout
+ * followed by the length field, which the kernel ignores since only the leading part of the
+ * address is read.
+ *
+ * TCP sockets are given the send buffer and receive window that lwIP is configured with in the
+ * examples, rather than the Linux defaults of several megabytes. Otherwise a TCP sender fills its
+ * buffer far faster than a slow (e.g., simulated) link drains it and reports the rate at which
+ * it filled the buffer.
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef LWIP_IPV4
+#define LWIP_IPV4 1
+#endif
+#ifndef LWIP_IPV6
+#define LWIP_IPV6 1
+#endif
+
+/** Debug output is always enabled on the host. */
+#define LWIP_DEBUG
+/** Debug level used for warnings. */
+#define LWIP_DBG_LEVEL_WARNING 0x01
+/** Debug level used for serious errors. */
+#define LWIP_DBG_LEVEL_SERIOUS 0x02
+/** Print a debug message, which is given as a parenthesized printf() argument list. */
+#define LWIP_DEBUGF(debug, message) do { (void)(debug); printf message; } while (0)
+
+/** TCP send buffer size (@c CONFIG_LWIP_TCP_SND_BUF_DEFAULT in the examples). */
+#ifndef LWIP_COMPAT_TCP_SND_BUF
+#define LWIP_COMPAT_TCP_SND_BUF 8760
+#endif
+/** TCP receive window (@c CONFIG_LWIP_TCP_WND_DEFAULT in the examples). */
+#ifndef LWIP_COMPAT_TCP_WND
+#define LWIP_COMPAT_TCP_WND 14600
+#endif
+
+/** IPv4 socket address with the lwIP length field. */
+struct lwip_compat_sockaddr_in
+{
+    sa_family_t sin_family;
+    in_port_t sin_port;
+    struct in_addr sin_addr;
+    uint8_t sin_zero[8];
+    uint8_t sin_len;
+};
+
+/** IPv6 socket address with the lwIP length field. */
+struct lwip_compat_sockaddr_in6
+{
+    sa_family_t sin6_family;
+    in_port_t sin6_port;
+    uint32_t sin6_flowinfo;
+    struct in6_addr sin6_addr;
+    uint32_t sin6_scope_id;
+    uint8_t sin6_len;
+};
+
+#define sockaddr_in     lwip_compat_sockaddr_in
+#define sockaddr_in6    lwip_compat_sockaddr_in6
+
+#define lwip_htons(x)   htons(x)
+#define lwip_ntohs(x)   ntohs(x)
+
+#define lwip_inet_pton  inet_pton
+#define lwip_inet_ntop  inet_ntop
+
+/** Create a socket, limiting the buffers of TCP sockets to the lwIP configuration. */
+static inline int lwip_socket(int domain, int type, int protocol)
+{
+    int fd = socket(domain, type, protocol);
+
+    if (fd >= 0 && type == SOCK_STREAM)
+    {
+        int snd_buf = LWIP_COMPAT_TCP_SND_BUF;
+        int wnd = LWIP_COMPAT_TCP_WND;
+
+        /* Sockets accepted from a listening socket inherit these. */
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &snd_buf, sizeof(snd_buf));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &wnd, sizeof(wnd));
+    }
+    return fd;
+}
+
+#define lwip_bind       bind
+#define lwip_connect    connect
+#define lwip_listen     listen
+#define lwip_accept     accept
+#define lwip_send       send
+#define lwip_sendto     sendto
+#define lwip_recv       recv
+#define lwip_recvfrom   recvfrom
+#define lwip_setsockopt setsockopt
+#define lwip_getsockname getsockname
+#define lwip_getpeername getpeername
+#define lwip_close      close
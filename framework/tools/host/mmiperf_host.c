@@ -0,0 +1,413 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host (Linux) build of mmiperf in iperf3 mode, for testing against a stock iperf3 and for
+ * running regression tests without a target.
+ *
+ * Tests are started through the public mmiperf_start_*() functions and run by the same iperf3
+ * engine (src/mmiperf/common/mmiperf3.c) and lwIP socket layer (src/mmiperf/lwip/mmiperf3_lwip.c)
+ * as on the target. Reports are printed in the same format as the iperf example application, so
+ * the output can be fed to framework/tools/iperf_regress.py. The options follow iperf3:
+ *
+ *     ./mmiperf_host -s [-p port]
+ *     ./mmiperf_host -c addr [-p port] [-u] [-P streams] [-R] [-n bytes | -t seconds]
+ *                    [-b bandwidth] [-l length]
+ *
+ * A server runs until it is interrupted. A client exits once its test has finished, with a
+ * non-zero exit status if the test failed.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmiperf.h"
+#include "mmosal.h"
+
+/**
+ * Time to wait for the server to stop after @ref mmiperf_stop_server(). The server stops within
+ * its accept timeout of one second.
+ */
+#define SERVER_STOP_WAIT_MS     (1500)
+
+/** Array of power of 10 unit specifiers. */
+static const char units[] = {' ', 'K', 'M', 'G', 'T'};
+
+/** Protects the fields below. */
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Signalled when the final report of the client test has been printed. */
+static pthread_cond_t client_done_cond = PTHREAD_COND_INITIALIZER;
+/** Set once the final report of the client test has been printed. */
+static bool client_done;
+/** @c true if the client test completed successfully. */
+static bool client_ok;
+
+/** Set by the signal handler to stop the server. */
+static volatile sig_atomic_t server_stop;
+
+/**
+ * Format a given number of bytes into an appropriate SI base, as the iperf example does.
+ *
+ * @param[in]   bytes       Original number of bytes
+ * @param[out]  unit_index  Index into the @ref units array.
+ *
+ * @return Number of bytes formatted to the appropriate unit given by the unit index.
+ */
+static unsigned long format_bytes(uint64_t bytes, uint8_t *unit_index)
+{
+    *unit_index = 0;
+
+    while (bytes >= 1000 && *unit_index < 4)
+    {
+        bytes /= 1000;
+        (*unit_index)++;
+    }
+
+    return (unsigned long)bytes;
+}
+
+/**
+ * Parse a number with an optional K, M or G suffix (powers of 1000).
+ *
+ * @param str       The string to parse.
+ * @param value     Receives the value.
+ *
+ * @returns @c true on success, else @c false.
+ */
+static bool parse_scaled(const char *str, uint64_t *value)
+{
+    char *end;
+    double result = strtod(str, &end);
+
+    if (end == str || result < 0)
+    {
+        return false;
+    }
+
+    switch (*end)
+    {
+    case 'k':
+    case 'K':
+        result *= 1e3;
+        end++;
+        break;
+
+    case 'm':
+    case 'M':
+        result *= 1e6;
+        end++;
+        break;
+
+    case 'g':
+    case 'G':
+        result *= 1e9;
+        end++;
+        break;
+
+    default:
+        break;
+    }
+
+    if (*end != '\0')
+    {
+        return false;
+    }
+
+    *value = (uint64_t)result;
+    return true;
+}
+
+/** Check whether a report type indicates that the test completed successfully. */
+static bool report_type_is_done(enum mmiperf_report_type report_type)
+{
+    return report_type == MMIPERF_TCP_DONE_CLIENT || report_type == MMIPERF_TCP_DONE_SERVER ||
+           report_type == MMIPERF_UDP_DONE_CLIENT || report_type == MMIPERF_UDP_DONE_SERVER;
+}
+
+/**
+ * Print a report in the format used by the iperf example application.
+ *
+ * @param report    The iperf report.
+ */
+static void print_report(const struct mmiperf_report *report)
+{
+    uint8_t unit_index = 0;
+    unsigned long bytes = format_bytes(report->bytes_transferred, &unit_index);
+
+    if (report->stream_id == MMIPERF_STREAM_ID_SUM)
+    {
+        printf("\nIperf Report [SUM]\n");
+    }
+    else
+    {
+        printf("\nIperf Report\n");
+    }
+    printf("  Remote Address: %s:%d\n", report->remote_addr, report->remote_port);
+    printf("  Local Address:  %s:%d\n", report->local_addr, report->local_port);
+    printf("  Transferred: %lu %cBytes, duration: %lu ms, bandwidth: %lu kbps\n",
+           bytes, units[unit_index], (unsigned long)report->duration_ms,
+           (unsigned long)report->bandwidth_kbitpsec);
+    if (report->tx_frames != 0 && report->duration_ms != 0)
+    {
+        printf("  Frames transmitted: %lu, rate: %lu pps\n", (unsigned long)report->tx_frames,
+               (unsigned long)(((uint64_t)report->tx_frames * 1000) / report->duration_ms));
+    }
+    if (report->rx_frames != 0 || report->error_count != 0)
+    {
+        printf("  Frames received: %lu, lost: %lu, out of sequence: %lu\n",
+               (unsigned long)report->rx_frames, (unsigned long)report->error_count,
+               (unsigned long)report->out_of_sequence_frames);
+    }
+    if (report->jitter_us != 0)
+    {
+        printf("  Jitter: %lu us\n", (unsigned long)report->jitter_us);
+    }
+    if (!report_type_is_done(report->report_type))
+    {
+        printf("  Test aborted (report type %d)\n", report->report_type);
+    }
+    printf("\n");
+}
+
+/**
+ * Handle a report from the client.
+ *
+ * @param report    The iperf report.
+ * @param arg       The number of streams in the test.
+ * @param handle    The iperf instance handle returned when iperf was started.
+ */
+static void client_report_handler(const struct mmiperf_report *report, void *arg,
+                                  mmiperf_handle_t handle)
+{
+    uint32_t num_streams = *(const uint32_t *)arg;
+
+    (void)handle;
+
+    print_report(report);
+
+    /* The aggregate of a parallel test is reported after the individual streams. */
+    if (num_streams <= 1 || report->stream_id == MMIPERF_STREAM_ID_SUM)
+    {
+        pthread_mutex_lock(&client_lock);
+        client_ok = report_type_is_done(report->report_type);
+        client_done = true;
+        pthread_cond_signal(&client_done_cond);
+        pthread_mutex_unlock(&client_lock);
+    }
+}
+
+/**
+ * Handle a report from the server.
+ *
+ * @param report    The iperf report.
+ * @param arg       Opaque argument specified when iperf was started.
+ * @param handle    The iperf instance handle returned when iperf was started.
+ */
+static void server_report_handler(const struct mmiperf_report *report, void *arg,
+                                  mmiperf_handle_t handle)
+{
+    (void)arg;
+    (void)handle;
+
+    print_report(report);
+}
+
+/** Signal handler used to stop the server. */
+static void handle_stop_signal(int signum)
+{
+    (void)signum;
+    server_stop = 1;
+}
+
+/** Print the usage message. */
+static void usage(const char *prog)
+{
+    printf("Usage: %s -s [-p port]\n"
+           "       %s -c addr [-p port] [-u] [-P streams] [-R] [-n bytes | -t seconds]\n"
+           "       %*s [-b bandwidth] [-l length]\n"
+           "\n"
+           "  -s            run a server (until interrupted)\n"
+           "  -c addr       run a client connecting to the given server\n"
+           "  -p port       server port (default %u)\n"
+           "  -u            UDP test (default TCP)\n"
+           "  -P streams    number of parallel streams (up to %u)\n"
+           "  -R            reverse test: the server sends\n"
+           "  -n bytes      number of bytes to transfer (K, M and G suffixes accepted)\n"
+           "  -t seconds    duration of the test (default %d)\n"
+           "  -b bandwidth  bandwidth limit in bits per second (K, M and G suffixes accepted)\n"
+           "  -l length     UDP datagram length\n",
+           prog, prog, (int)strlen(prog), "", MMIPERF3_DEFAULT_PORT, MMIPERF_MAX_STREAMS,
+           -MMIPERF_DEFAULT_AMOUNT / 100);
+}
+
+/**
+ * Run the server until it is interrupted.
+ *
+ * @param args  Iperf server arguments.
+ *
+ * @returns the exit status.
+ */
+static int run_server(struct mmiperf_server_args *args)
+{
+    struct sigaction sa;
+    mmiperf_handle_t handle;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    args->report_fn = server_report_handler;
+    handle = mmiperf_start_tcp_server(args);
+    if (handle == NULL)
+    {
+        printf("Failed to start the server\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Server listening on port %u\n", args->local_port);
+    while (!server_stop)
+    {
+        pause();
+    }
+
+    /* Give the server task time to terminate any test in progress and close its sockets. */
+    mmiperf_stop_server(handle);
+    mmosal_task_sleep(SERVER_STOP_WAIT_MS);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Run a client test and wait for it to finish.
+ *
+ * @param args  Iperf client arguments.
+ * @param udp   @c true for a UDP test, @c false for a TCP test.
+ *
+ * @returns the exit status.
+ */
+static int run_client(struct mmiperf_client_args *args, bool udp)
+{
+    mmiperf_handle_t handle;
+
+    args->report_fn = client_report_handler;
+    args->report_arg = &args->num_streams;
+    handle = udp ? mmiperf_start_udp_client(args) : mmiperf_start_tcp_client(args);
+    if (handle == NULL)
+    {
+        printf("Failed to start the client\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_mutex_lock(&client_lock);
+    while (!client_done)
+    {
+        pthread_cond_wait(&client_done_cond, &client_lock);
+    }
+    pthread_mutex_unlock(&client_lock);
+
+    return client_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+    struct mmiperf_client_args client_args = MMIPERF_CLIENT_ARGS_DEFAULT;
+    struct mmiperf_server_args server_args = MMIPERF_SERVER_ARGS_DEFAULT;
+    const char *server_addr = NULL;
+    bool server = false;
+    bool udp = false;
+    uint16_t port = MMIPERF3_DEFAULT_PORT;
+    uint64_t value;
+    int opt;
+
+    /* A closed connection is reported by send() rather than by killing the process. */
+    signal(SIGPIPE, SIG_IGN);
+    /* Keep the output in order with the log messages when it is redirected to a file. */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    client_args.version = IPERF_VERSION_3;
+    server_args.version = IPERF_VERSION_3;
+
+    while ((opt = getopt(argc, argv, "sc:p:uP:Rn:t:b:l:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            server = true;
+            break;
+
+        case 'c':
+            server_addr = optarg;
+            break;
+
+        case 'p':
+            port = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'u':
+            udp = true;
+            break;
+
+        case 'P':
+            client_args.num_streams = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'R':
+            client_args.mode = MMIPERF_CLIENT_MODE_REVERSE;
+            break;
+
+        case 'n':
+            if (!parse_scaled(optarg, &value) || value == 0 || value > INT32_MAX)
+            {
+                printf("Invalid amount %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            client_args.amount = (int32_t)value;
+            break;
+
+        case 't':
+            client_args.amount = -(int32_t)(strtoul(optarg, NULL, 0) * 100);
+            break;
+
+        case 'b':
+            if (!parse_scaled(optarg, &value))
+            {
+                printf("Invalid bandwidth %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            client_args.target_bw = (uint32_t)(value / 1000);
+            break;
+
+        case 'l':
+            client_args.packet_size = strtoul(optarg, NULL, 0);
+            break;
+
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (server == (server_addr != NULL) || optind != argc)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (server)
+    {
+        server_args.local_port = port;
+        return run_server(&server_args);
+    }
+
+    snprintf(client_args.server_addr, sizeof(client_args.server_addr), "%s", server_addr);
+    client_args.server_port = port;
+    return run_client(&client_args, udp);
+}
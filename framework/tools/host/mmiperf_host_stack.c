@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host (Linux) implementation of the mmiperf start functions.
+ *
+ * This takes the place of src/mmiperf/lwip/mmiperf_tcp.c and mmiperf_udp.c in the host build.
+ * Only iperf3 (@c IPERF_VERSION_3) is supported: it runs over the lwIP sockets API in
+ * src/mmiperf/lwip/mmiperf3_lwip.c, which lwip_compat/lwip/sockets.h maps onto the host's
+ * sockets. The iperf2 implementations use the lwIP raw API and so need the lwIP core.
+ */
+
+#include "mmiperf3_private.h"
+
+mmiperf_handle_t mmiperf_start_udp_client(const struct mmiperf_client_args *args)
+{
+    if (args->version != IPERF_VERSION_3)
+    {
+        iperf3_log("Only iperf3 is supported on the host\n");
+        return NULL;
+    }
+
+    return iperf3_start_client(args, true);
+}
+
+mmiperf_handle_t mmiperf_start_udp_server(const struct mmiperf_server_args *args)
+{
+    (void)args;
+
+    /* The iperf3 server handles UDP tests too; see mmiperf_start_tcp_server(). */
+    iperf3_log("iperf3 server must be started as a TCP server\n");
+    return NULL;
+}
+
+mmiperf_handle_t mmiperf_start_tcp_client(const struct mmiperf_client_args *args)
+{
+    if (args->version != IPERF_VERSION_3)
+    {
+        iperf3_log("Only iperf3 is supported on the host\n");
+        return NULL;
+    }
+
+    return iperf3_start_client(args, false);
+}
+
+mmiperf_handle_t mmiperf_start_tcp_server(const struct mmiperf_server_args *args)
+{
+    if (args->version != IPERF_VERSION_3)
+    {
+        iperf3_log("Only iperf3 is supported on the host\n");
+        return NULL;
+    }
+
+    return iperf3_start_server(args);
+}
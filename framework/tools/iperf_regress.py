@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+#
+# Copyright 2024 Morse Micro
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""
+Collect mmiperf results as JSON/CSV and check them against a stored baseline.
+
+Each test case is one run of the iperf example (or any application that prints mmiperf reports
+in the same format) captured from the console. ``collect`` parses the ``Iperf Report`` blocks in
+each log, using the ``[SUM]`` report when there are parallel streams, and writes one record per
+case::
+
+    ./iperf_regress.py collect tcp_client_1460=tcp_client.log udp_server_512=udp_server.log \\
+        --json results.json --csv results.csv
+
+``compare`` checks the results against a baseline produced the same way. Each metric has a
+direction (higher or lower is better) and a relative tolerance; a case regresses if any metric is
+worse than the baseline by more than its tolerance. Tolerances may be overridden on the command
+line or stored in the baseline under ``"tolerances"``::
+
+    ./iperf_regress.py compare results.json baseline.json --tolerance bandwidth_kbps=0.05
+
+The exit status is 1 if any case regressed or is missing from the results, so the comparison can
+gate a CI job.
+
+host/iperf_link_matrix.py runs a matrix of cases with the host build of mmiperf over a simulated
+link and collects them with this script.
+"""
+
+import argparse
+import csv
+import json
+import re
+import sys
+from typing import Dict, List, Optional, Tuple
+
+UNITS = {" ": 1, "K": 1000, "M": 1000 ** 2, "G": 1000 ** 3, "T": 1000 ** 4}
+
+# Metric name: (True if higher is better, default relative tolerance)
+METRICS = {
+    "bandwidth_kbps": (True, 0.05),
+    "tx_pps": (True, 0.05),
+    "latency_p50_us": (False, 0.20),
+    "latency_p99_us": (False, 0.30),
+    "jitter_us": (False, 0.50),
+    "cpu_load_max_pct": (False, 0.15),
+    "cpu_pct_per_mbps": (False, 0.15),
+    "heap_peak_used": (False, 0.10),
+    "pktmem_tx_peak": (False, 0.25),
+    "pktmem_rx_peak": (False, 0.25),
+    "verify_corrupted_segments": (False, 0.0),
+    "mcast_delivery_min_pct": (True, 0.02),
+}
+
+PATTERNS = [
+    (re.compile(r"Transferred: (\d+) ([ KMGT])Bytes, duration: (\d+) ms, bandwidth: (\d+) kbps"),
+     lambda m: {"bytes": int(m[1]) * UNITS[m[2]], "duration_ms": int(m[3]),
+                "bandwidth_kbps": int(m[4])}),
+    (re.compile(r"Frames transmitted: (\d+), rate: (\d+) pps"),
+     lambda m: {"tx_frames": int(m[1]), "tx_pps": int(m[2])}),
+    (re.compile(r"One-way latency \(us\): p50 (\d+), p90 (\d+), p99 (\d+), max (\d+)"),
+     lambda m: {"latency_p50_us": int(m[1]), "latency_p90_us": int(m[2]),
+                "latency_p99_us": int(m[3]), "latency_max_us": int(m[4])}),
+    (re.compile(r"Payload verification: (\d+)/(\d+) segments corrupted"),
+     lambda m: {"verify_corrupted_segments": int(m[1]), "verify_segments": int(m[2])}),
+    (re.compile(r"CPU load \(%\):(.*), ([\d.]+)% of a core per Mbps"),
+     lambda m: {"cpu_load_max_pct": max(float(load) for load in
+                                        re.findall(r"core\d+ ([\d.]+)", m[1])),
+                "cpu_pct_per_mbps": float(m[2])}),
+    (re.compile(r"Jitter: (\d+) us"),
+     lambda m: {"jitter_us": int(m[1])}),
+    (re.compile(r"Multicast receivers: (\d+) .*delivery min ([\d.]+)%"),
+     lambda m: {"mcast_receivers": int(m[1]), "mcast_delivery_min_pct": float(m[2])}),
+    (re.compile(r"Peak heap used: (\d+)/(\d+) bytes, peak pktmem: tx (\d+)/(\d+), rx (\d+)/(\d+)"),
+     lambda m: {"heap_peak_used": int(m[1]), "heap_total": int(m[2]),
+                "pktmem_tx_peak": int(m[3]), "pktmem_rx_peak": int(m[5])}),
+]
+
+
+def parse_reports(lines) -> List[Tuple[bool, Dict]]:
+    """Parse the reports in a console log, returning (is_sum, fields) for each."""
+    reports = []
+    current: Optional[Dict] = None
+    is_sum = False
+
+    for line in lines:
+        line = line.rstrip()
+        if line.endswith("Iperf Report") or line.endswith("Iperf Report [SUM]"):
+            current = {}
+            is_sum = line.endswith("[SUM]")
+            reports.append((is_sum, current))
+            continue
+        if current is None:
+            continue
+        if not line.strip():
+            current = None
+            continue
+        for pattern, convert in PATTERNS:
+            match = pattern.search(line)
+            if match:
+                current.update(convert(match))
+                break
+
+    return [(is_sum, fields) for is_sum, fields in reports if "bandwidth_kbps" in fields]
+
+
+def select_report(reports: List[Tuple[bool, Dict]]) -> Optional[Dict]:
+    """Select the report that represents a run: the last [SUM] report if any, else the last."""
+    sums = [fields for is_sum, fields in reports if is_sum]
+    if sums:
+        return sums[-1]
+    return reports[-1][1] if reports else None
+
+
+def collect(args):
+    results = {}
+    for case in args.cases:
+        name, sep, path = case.partition("=")
+        if not sep:
+            sys.exit(f"Expected CASE=LOG, got '{case}'")
+        with open(path) as log:
+            report = select_report(parse_reports(log))
+        if report is None:
+            sys.exit(f"No iperf report found in {path}")
+        results[name] = report
+
+    output = {"results": results}
+    if args.json:
+        with open(args.json, "w") as json_file:
+            json.dump(output, json_file, indent=2, sort_keys=True)
+            json_file.write("\n")
+    else:
+        json.dump(output, sys.stdout, indent=2, sort_keys=True)
+        print()
+
+    if args.csv:
+        fields = sorted({key for report in results.values() for key in report})
+        with open(args.csv, "w", newline="") as csv_file:
+            writer = csv.writer(csv_file)
+            writer.writerow(["case"] + fields)
+            for name, report in sorted(results.items()):
+                writer.writerow([name] + [report.get(key, "") for key in fields])
+
+
+def parse_tolerances(values: List[str]) -> Dict[str, float]:
+    tolerances = {}
+    for value in values:
+        metric, sep, tolerance = value.partition("=")
+        if not sep or metric not in METRICS:
+            sys.exit(f"Invalid tolerance '{value}', expected METRIC=FRACTION with METRIC one of "
+                     f"{', '.join(METRICS)}")
+        tolerances[metric] = float(tolerance)
+    return tolerances
+
+
+def compare(args):
+    with open(args.results) as results_file:
+        results = json.load(results_file)["results"]
+    with open(args.baseline) as baseline_file:
+        baseline_doc = json.load(baseline_file)
+    baseline = baseline_doc["results"]
+
+    tolerances = {metric: tolerance for metric, (_, tolerance) in METRICS.items()}
+    tolerances.update(baseline_doc.get("tolerances", {}))
+    tolerances.update(parse_tolerances(args.tolerance))
+
+    failed = False
+    print(f"{'case':24} {'metric':26} {'baseline':>12} {'result':>12} {'change':>8}  status")
+    for name, expected in sorted(baseline.items()):
+        actual = results.get(name)
+        if actual is None:
+            print(f"{name:24} {'':26} {'':>12} {'':>12} {'':>8}  MISSING")
+            failed = True
+            continue
+
+        for metric, (higher_is_better, _) in METRICS.items():
+            if metric not in expected or metric not in actual:
+                continue
+            base = expected[metric]
+            value = actual[metric]
+            change = (value - base) / base if base else (0.0 if value == base else float("inf"))
+            worse = -change if higher_is_better else change
+            regressed = worse > tolerances[metric]
+            failed |= regressed
+            if regressed or args.verbose:
+                print(f"{name:24} {metric:26} {base:>12} {value:>12} {change * 100:7.1f}%  "
+                      f"{'REGRESSED' if regressed else 'ok'}")
+
+    print("FAIL" if failed else "PASS")
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    collect_parser = subparsers.add_parser("collect", help="Parse console logs into results")
+    collect_parser.add_argument("cases", nargs="+", metavar="CASE=LOG",
+                                help="Name of a test case and the console log of its run")
+    collect_parser.add_argument("--json", help="Write the results to a JSON file "
+                                               "(default: stdout)")
+    collect_parser.add_argument("--csv", help="Also write the results to a CSV file")
+
+    compare_parser = subparsers.add_parser("compare", help="Compare results against a baseline")
+    compare_parser.add_argument("results", help="Results JSON produced by collect")
+    compare_parser.add_argument("baseline", help="Baseline JSON produced by collect")
+    compare_parser.add_argument("--tolerance", action="append", default=[],
+                                metavar="METRIC=FRACTION",
+                                help="Override the relative tolerance of a metric")
+    compare_parser.add_argument("--verbose", action="store_true",
+                                help="Print every metric compared, not only regressions")
+
+    args = parser.parse_args()
+    if args.command == "collect":
+        collect(args)
+        return 0
+    return compare(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
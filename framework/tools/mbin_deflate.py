@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+#
+# Copyright 2024 Morse Micro
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""
+Convert the segments of an mbin image to or from deflated segments.
+
+Each ``FIELD_TYPE_FW_SEGMENT`` or ``FIELD_TYPE_SW_SEGMENT`` field is split into chunks of at
+most ``--chunk-size`` octets, and each chunk is written as a ``FIELD_TYPE_XX_SEGMENT_DEFLATED``
+field containing the chunk's base address, its inflated size and a zlib stream. All other fields
+are copied unchanged. With ``--inflate`` the conversion is reversed.
+
+This is used to produce compressed and uncompressed versions of the same firmware so that the
+time taken to download each can be compared (see the "Firmware download pipeline" step of the
+porting assistant).
+
+Example::
+
+    ./mbin_deflate.py mm6108.mbin mm6108-deflated.mbin
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+FIELD_TYPE_FW_SEGMENT = 0x8001
+FIELD_TYPE_FW_SEGMENT_DEFLATED = 0x8002
+FIELD_TYPE_SW_SEGMENT = 0x8201
+FIELD_TYPE_SW_SEGMENT_DEFLATED = 0x8202
+FIELD_TYPE_EOF = 0x8F00
+FIELD_TYPE_EOF_WITH_SIGNATURE = 0x8F01
+
+DEFLATED_TYPES = {
+    FIELD_TYPE_FW_SEGMENT: FIELD_TYPE_FW_SEGMENT_DEFLATED,
+    FIELD_TYPE_SW_SEGMENT: FIELD_TYPE_SW_SEGMENT_DEFLATED,
+}
+INFLATED_TYPES = {value: key for key, value in DEFLATED_TYPES.items()}
+
+TLV_HDR = struct.Struct("<HH")
+SEGMENT_HDR = struct.Struct("<I")
+DEFLATED_SEGMENT_HDR = struct.Struct("<IH")
+
+# Largest payload that fits in a TLV field.
+MAX_FIELD_LEN = 0xFFFF
+
+
+def parse(image: bytes):
+    """Split an image into a list of (type, payload) tuples, ending with the EOF field."""
+    fields = []
+    offset = 0
+    while offset + TLV_HDR.size <= len(image):
+        field_type, length = TLV_HDR.unpack_from(image, offset)
+        offset += TLV_HDR.size
+        if offset + length > len(image):
+            raise ValueError(f"Field 0x{field_type:04x} at offset {offset} overruns the image")
+        fields.append((field_type, image[offset:offset + length]))
+        offset += length
+        if field_type in (FIELD_TYPE_EOF, FIELD_TYPE_EOF_WITH_SIGNATURE):
+            return fields
+    raise ValueError("Image ended without an EOF field")
+
+
+def tlv(field_type: int, payload: bytes) -> bytes:
+    if len(payload) > MAX_FIELD_LEN:
+        raise ValueError(f"Field 0x{field_type:04x} payload of {len(payload)} octets is too long")
+    return TLV_HDR.pack(field_type, len(payload)) + payload
+
+
+def deflate(fields, chunk_size: int, level: int) -> bytes:
+    out = bytearray()
+    for field_type, payload in fields:
+        if field_type not in DEFLATED_TYPES:
+            out += tlv(field_type, payload)
+            continue
+        (base_address,) = SEGMENT_HDR.unpack_from(payload)
+        data = payload[SEGMENT_HDR.size:]
+        for offset in range(0, len(data), chunk_size):
+            chunk = data[offset:offset + chunk_size]
+            out += tlv(DEFLATED_TYPES[field_type],
+                       DEFLATED_SEGMENT_HDR.pack(base_address + offset, len(chunk)) +
+                       zlib.compress(chunk, level))
+    return bytes(out)
+
+
+def inflate(fields) -> bytes:
+    out = bytearray()
+    for field_type, payload in fields:
+        if field_type not in INFLATED_TYPES:
+            out += tlv(field_type, payload)
+            continue
+        base_address, chunk_size = DEFLATED_SEGMENT_HDR.unpack_from(payload)
+        chunk = zlib.decompress(payload[DEFLATED_SEGMENT_HDR.size:])
+        if len(chunk) != chunk_size:
+            raise ValueError(f"Chunk at 0x{base_address:08x} inflated to {len(chunk)} octets, "
+                             f"expected {chunk_size}")
+        out += tlv(INFLATED_TYPES[field_type], SEGMENT_HDR.pack(base_address) + chunk)
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", type=argparse.FileType("rb"), help="Input mbin image")
+    parser.add_argument("output", type=argparse.FileType("wb"), help="Output mbin image")
+    parser.add_argument("--chunk-size", type=int, default=4096,
+                        help="Maximum inflated size of each deflated segment (default: 4096). "
+                             "The loader needs two buffers of this size.")
+    parser.add_argument("--level", type=int, default=9, choices=range(0, 10), metavar="0-9",
+                        help="zlib compression level (default: 9)")
+    parser.add_argument("--inflate", action="store_true",
+                        help="Convert deflated segments back to uncompressed segments")
+    args = parser.parse_args()
+
+    if not 4 <= args.chunk_size <= 0xFFFF or args.chunk_size % 4:
+        sys.exit("--chunk-size must be a multiple of 4 between 4 and 65532")
+
+    image = args.input.read()
+    try:
+        fields = parse(image)
+        if any(field_type == FIELD_TYPE_EOF_WITH_SIGNATURE for field_type, _ in fields):
+            print("Warning: the image is signed and the signature will not match the output",
+                  file=sys.stderr)
+        output = inflate(fields) if args.inflate else deflate(fields, args.chunk_size, args.level)
+    except ValueError as error:
+        sys.exit(str(error))
+
+    args.output.write(output)
+    print(f"{len(image)} -> {len(output)} octets ({100.0 * len(output) / len(image):.1f}%)",
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+#
+# Copyright 2024 Morse Micro
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+"""
+Decode a WLAN SPI trace captured from the console.
+
+The trace is produced by ``mmhal_wlan_spi_trace_dump()`` when the firmware is built with
+``CONFIG_MM_SPI_TRACE`` enabled. Each dump is a block of lines of the form::
+
+    SPITRACE begin clock_khz=<khz> entries=<n> wrapped=<0|1>
+    SPITRACE <start_us> <duration_us> <mode> <dir> <len> <first_tx> <first_rx>
+    ...
+    SPITRACE end
+
+where mode is ``P`` (polling), ``I`` (interrupt) or ``C`` (chip select window)
+and dir is ``T`` (transmit), ``R`` (receive), ``X`` (both) or ``-``.
+
+The decoder reports where bus time goes (payload, command, token polling, chip select held while
+the CPU works, and chip select deasserted while waiting on the busy/IRQ lines) and can print a
+per chip select window timeline or export the entries as CSV.
+
+Example::
+
+    ./spi_trace.py console.log --timeline --limit 50
+"""
+
+import argparse
+import csv
+import re
+import sys
+from dataclasses import dataclass, field
+from typing import List, Optional
+
+TRACE_RE = re.compile(r"SPITRACE (.*)$")
+BEGIN_RE = re.compile(r"begin clock_khz=(\d+) entries=(\d+) wrapped=(\d+)")
+
+# Transactions of at least this many octets are treated as data payload.
+PAYLOAD_MIN_LEN = 8
+# Transactions of at most this many octets clocking out 0xff are token or response polls.
+POLL_MAX_LEN = 4
+
+CATEGORIES = ["payload", "command", "token poll (busy)", "token/response"]
+
+
+@dataclass
+class Entry:
+    start_us: int
+    duration_us: int
+    mode: str
+    direction: str
+    length: int
+    first_tx: int
+    first_rx: int
+
+    @property
+    def end_us(self) -> int:
+        return self.start_us + self.duration_us
+
+    @property
+    def category(self) -> str:
+        if self.length >= PAYLOAD_MIN_LEN:
+            return "payload"
+        if self.length <= POLL_MAX_LEN and self.first_tx == 0xFF:
+            return "token poll (busy)" if self.first_rx == 0xFF else "token/response"
+        return "command"
+
+
+@dataclass
+class Dump:
+    clock_khz: int
+    wrapped: bool
+    entries: List[Entry] = field(default_factory=list)
+
+
+def parse(lines) -> List[Dump]:
+    """Parse all of the trace dumps in the given console output."""
+    dumps = []
+    current: Optional[Dump] = None
+    raw = []
+
+    for line in lines:
+        match = TRACE_RE.search(line.rstrip())
+        if match is None:
+            continue
+        body = match.group(1)
+
+        begin = BEGIN_RE.match(body)
+        if begin:
+            current = Dump(int(begin.group(1)), begin.group(3) != "0")
+            raw = []
+            continue
+
+        if current is None:
+            continue
+
+        if body.startswith("end"):
+            current.entries = unwrap(raw)
+            dumps.append(current)
+            current = None
+            continue
+
+        fields = body.split()
+        if len(fields) != 7:
+            continue
+        raw.append(Entry(int(fields[0]), int(fields[1]), fields[2], fields[3], int(fields[4]),
+                         int(fields[5], 16), int(fields[6], 16)))
+
+    return dumps
+
+
+def unwrap(entries: List[Entry]) -> List[Entry]:
+    """
+    Convert the 32-bit timestamps to microseconds since the earliest entry and sort by start time.
+
+    Entries are recorded when they complete, so a chip select window appears after the
+    transactions within it. The trace must span less than 2^31 microseconds.
+    """
+    if not entries:
+        return []
+
+    base = entries[0].start_us
+    for entry in entries:
+        delta = (entry.start_us - base) & 0xFFFFFFFF
+        if delta >= 0x80000000:
+            delta -= 0x100000000
+        entry.start_us = delta
+
+    earliest = min(entry.start_us for entry in entries)
+    for entry in entries:
+        entry.start_us -= earliest
+
+    return sorted(entries, key=lambda entry: (entry.start_us, entry.mode != "C"))
+
+
+def wire_time_us(octets: int, clock_khz: int) -> float:
+    return (octets * 8 * 1000.0) / clock_khz if clock_khz else 0.0
+
+
+def busy_time(intervals) -> int:
+    """Total time covered by the given (start, end) intervals, counting overlaps once."""
+    total = 0
+    covered_to = None
+    for start, end in sorted(intervals):
+        if covered_to is not None and start < covered_to:
+            start = covered_to
+        if end > start:
+            total += end - start
+            covered_to = end
+    return total
+
+
+def report(dump: Dump, out):
+    transactions = [entry for entry in dump.entries if entry.mode != "C"]
+    windows = [entry for entry in dump.entries if entry.mode == "C"]
+
+    if not dump.entries:
+        print("Trace is empty", file=out)
+        return
+
+    span_us = max(entry.end_us for entry in dump.entries)
+    transaction_us = busy_time((entry.start_us, entry.end_us) for entry in transactions)
+    cs_us = busy_time((entry.start_us, entry.end_us) for entry in windows)
+    octets = sum(entry.length for entry in transactions)
+    # Timestamps have microsecond resolution, so clamp rather than report negative overhead.
+    wire_us = min(wire_time_us(octets, dump.clock_khz), transaction_us)
+
+    def pct(value):
+        return (100.0 * value / span_us) if span_us else 0.0
+
+    print(f"SPI clock:          {dump.clock_khz} kHz", file=out)
+    print(f"Entries:            {len(dump.entries)}"
+          f"{' (ring wrapped, oldest entries lost)' if dump.wrapped else ''}", file=out)
+    print(f"Trace span:         {span_us} us", file=out)
+    print(f"Transactions:       {len(transactions)} ({octets} octets)", file=out)
+    print(f"CS windows:         {len(windows)}", file=out)
+    print(file=out)
+
+    print(f"{'Time breakdown':32} {'us':>10} {'%':>7}", file=out)
+    print(f"{'Clocking data on the wire':32} {wire_us:10.0f} {pct(wire_us):7.1f}", file=out)
+    print(f"{'Transaction setup/driver':32} {transaction_us - wire_us:10.0f} "
+          f"{pct(transaction_us - wire_us):7.1f}", file=out)
+    if windows:
+        print(f"{'CS held, no transaction (CPU)':32} {cs_us - transaction_us:10.0f} "
+              f"{pct(cs_us - transaction_us):7.1f}", file=out)
+        print(f"{'CS deasserted (busy/IRQ/idle)':32} {span_us - cs_us:10.0f} "
+              f"{pct(span_us - cs_us):7.1f}", file=out)
+    else:
+        print(f"{'Between transactions':32} {span_us - transaction_us:10.0f} "
+              f"{pct(span_us - transaction_us):7.1f}", file=out)
+    print(file=out)
+
+    print(f"{'Transaction type':20} {'count':>8} {'octets':>10} {'us':>10} {'% span':>7} "
+          f"{'mean us':>8}", file=out)
+    for category in CATEGORIES:
+        selected = [entry for entry in transactions if entry.category == category]
+        duration = busy_time((entry.start_us, entry.end_us) for entry in selected)
+        mean = duration / len(selected) if selected else 0.0
+        print(f"{category:20} {len(selected):8} {sum(e.length for e in selected):10} "
+              f"{duration:10} {pct(duration):7.1f} {mean:8.1f}", file=out)
+    print(file=out)
+
+    print(f"{'Method':20} {'count':>8} {'octets':>10} {'us':>10}", file=out)
+    for mode, name in (("P", "polling"), ("I", "interrupt")):
+        selected = [entry for entry in transactions if entry.mode == mode]
+        print(f"{name:20} {len(selected):8} {sum(e.length for e in selected):10} "
+              f"{sum(e.duration_us for e in selected):10}", file=out)
+
+
+def describe(entries: List[Entry]) -> str:
+    """Summarise a sequence of transactions, collapsing runs of token polls."""
+    parts = []
+    run = 0
+    for entry in entries:
+        if entry.category == "token poll (busy)":
+            run += 1
+            continue
+        if run:
+            parts.append(f"poll*{run}")
+            run = 0
+        if entry.category == "token/response":
+            parts.append(f"{entry.mode}{entry.direction}{entry.length}<{entry.first_rx:02x}")
+        else:
+            parts.append(f"{entry.mode}{entry.direction}{entry.length}>{entry.first_tx:02x}")
+    if run:
+        parts.append(f"poll*{run}")
+    return " ".join(parts)
+
+
+def timeline(dump: Dump, out, limit: Optional[int]):
+    """Print one line per chip select window along with the transactions within it."""
+    transactions = [entry for entry in dump.entries if entry.mode != "C"]
+    windows = [entry for entry in dump.entries if entry.mode == "C"]
+    index = 0
+    previous_end = None
+
+    print(f"{'start us':>10} {'gap us':>7} {'CS us':>7} {'xfer us':>7}  transactions", file=out)
+    for count, window in enumerate(windows):
+        if limit is not None and count >= limit:
+            break
+
+        while index < len(transactions) and transactions[index].start_us < window.start_us:
+            index += 1
+        inside = []
+        while index < len(transactions) and transactions[index].start_us <= window.end_us:
+            inside.append(transactions[index])
+            index += 1
+
+        gap = "" if previous_end is None else str(window.start_us - previous_end)
+        xfer_us = busy_time((entry.start_us, entry.end_us) for entry in inside)
+        print(f"{window.start_us:10} {gap:>7} {window.duration_us:7} {xfer_us:7}  "
+              f"{describe(inside)}", file=out)
+        previous_end = window.end_us
+
+
+def write_csv(dump: Dump, path: str):
+    with open(path, "w", newline="") as csv_file:
+        writer = csv.writer(csv_file)
+        writer.writerow(["start_us", "duration_us", "mode", "dir", "len", "first_tx", "first_rx",
+                         "category"])
+        for entry in dump.entries:
+            writer.writerow([entry.start_us, entry.duration_us, entry.mode, entry.direction,
+                             entry.length, f"{entry.first_tx:02x}", f"{entry.first_rx:02x}",
+                             "cs window" if entry.mode == "C" else entry.category])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"), default=sys.stdin,
+                        help="Console log containing the trace dump (default: stdin)")
+    parser.add_argument("--dump", type=int, default=-1,
+                        help="Index of the dump to decode if the log has several (default: last)")
+    parser.add_argument("--timeline", action="store_true",
+                        help="Print a timeline of chip select windows")
+    parser.add_argument("--limit", type=int, help="Maximum number of timeline lines to print")
+    parser.add_argument("--csv", metavar="FILE", help="Write the decoded entries to a CSV file")
+    args = parser.parse_args()
+
+    dumps = parse(args.log)
+    if not dumps:
+        sys.exit("No SPI trace found (expected SPITRACE begin/end lines)")
+
+    try:
+        dump = dumps[args.dump]
+    except IndexError:
+        sys.exit(f"Dump index {args.dump} out of range, log contains {len(dumps)} dump(s)")
+
+    report(dump, sys.stdout)
+    if args.timeline:
+        print()
+        timeline(dump, sys.stdout, args.limit)
+    if args.csv:
+        write_csv(dump, args.csv)
+
+
+if __name__ == "__main__":
+    main()